@@ -0,0 +1,142 @@
+"""
+Decoder for the firmware's binary streaming frames (FORMAT:BINARY).
+Keep in sync with include/binary_protocol.h
+"""
+import struct
+
+FRAME_MAGIC = 0xA5
+PROTOCOL_VERSION = 1
+
+# Mode bit of the frames a DUMP streams from the flash log; the sequence of
+# those is the low 16 bits of the page number
+MODE_FLASH_LOG = 0x80
+
+# Streams that are no mode of their own (RATE:ACCEL:<hz>)
+MODE_ACCEL = 0x10
+
+FLAG_COLLECTING = 1 << 0
+FLAG_AVERAGE = 1 << 1
+
+# magic, version, mode, record_size, sample_count, sequence, timestamp
+HEADER = struct.Struct('<BBBBBHI')
+
+# OperatingMode values
+MODE_IDLE = 0
+MODE_HR_SPO2 = 1
+MODE_TEMPERATURE = 2
+MODE_FORCE_TEST = 3
+MODE_DISTANCE_TEST = 4
+MODE_QUALITY = 5
+MODE_RAW_DATA = 6
+
+MODE_NAMES = {
+    MODE_IDLE: "IDLE",
+    MODE_HR_SPO2: "HR_SPO2",
+    MODE_TEMPERATURE: "TEMPERATURE",
+    MODE_FORCE_TEST: "FORCE_TEST",
+    MODE_DISTANCE_TEST: "DISTANCE_TEST",
+    MODE_QUALITY: "QUALITY",
+    MODE_RAW_DATA: "RAW_DATA",
+    MODE_ACCEL: "ACCEL",
+}
+
+RECORDS = {
+    MODE_IDLE: struct.Struct('<I'),
+    MODE_HR_SPO2: struct.Struct('<HHhhh'),
+    MODE_TEMPERATURE: struct.Struct('<h'),
+    MODE_FORCE_TEST: struct.Struct('<HHHB'),
+    MODE_DISTANCE_TEST: struct.Struct('<IIHHB'),
+    MODE_QUALITY: struct.Struct('<HHhhhBH'),
+    MODE_RAW_DATA: struct.Struct('<HHHhhh'),
+    MODE_ACCEL: struct.Struct('<hhh'),
+}
+
+# Flash log records start with a dtMs like the raw ones
+LOG_RECORDS = {
+    MODE_HR_SPO2: struct.Struct('<HHHhhh'),
+    MODE_QUALITY: struct.Struct('<HHHhhh'),
+    MODE_RAW_DATA: RECORDS[MODE_RAW_DATA],
+}
+
+
+def is_binary_frame(data):
+    """True if a notification payload is a binary frame rather than JSON"""
+    return len(data) >= HEADER.size and data[0] == FRAME_MAGIC
+
+
+def _vitals(hr, spo2, ax, ay, az):
+    return {"hr": hr / 10.0, "spo2": spo2 / 10.0,
+            "ax": ax / 1000.0, "ay": ay / 1000.0, "az": az / 1000.0}
+
+
+def _record_to_dict(mode, fields, timestamp):
+    """Map a record to the same keys the JSON format uses"""
+    if mode == MODE_HR_SPO2:
+        obj = _vitals(*fields)
+    elif mode == MODE_TEMPERATURE:
+        obj = {"temperature": fields[0] / 100.0}
+    elif mode == MODE_FORCE_TEST:
+        ir, red, fsr, flags = fields
+        obj = {"ir": ir, "red": red, "fsr": fsr, "collecting": bool(flags & FLAG_COLLECTING)}
+    elif mode == MODE_DISTANCE_TEST:
+        ir, red, distance, samples, flags = fields
+        obj = {"distance_mm": distance, "collecting": bool(flags & FLAG_COLLECTING)}
+        if flags & FLAG_AVERAGE:
+            obj.update({"type": "average", "avg_ir": ir / 100.0, "avg_red": red / 100.0, "samples": samples})
+        else:
+            obj.update({"ir": ir // 100, "red": red // 100})
+    elif mode == MODE_QUALITY:
+        hr, spo2, ax, ay, az, quality, percent = fields
+        obj = _vitals(hr, spo2, ax, ay, az)
+        obj.update({"quality": quality, "quality_percent": percent / 10.0,
+                    "accel_mag": (obj["ax"] ** 2 + obj["ay"] ** 2 + obj["az"] ** 2) ** 0.5})
+    elif mode == MODE_RAW_DATA:
+        dt, ir, red, ax, ay, az = fields
+        obj = {"ir": ir, "red": red, "ax": ax / 1000.0, "ay": ay / 1000.0, "az": az / 1000.0}
+        timestamp += dt
+    elif mode == MODE_ACCEL:
+        obj = {"ax": fields[0] / 1000.0, "ay": fields[1] / 1000.0, "az": fields[2] / 1000.0}
+    else:
+        obj = {"status": "idle", "free_heap": fields[0]}
+
+    obj["timestamp"] = timestamp
+    return obj
+
+
+def decode_frame(data):
+    """
+    Decode one binary frame.
+    Returns (header, records): header is a dict, records a list of dicts keyed
+    like the JSON notifications (one per sample in the frame).
+    Raises ValueError on malformed frames.
+    """
+    if not is_binary_frame(data):
+        raise ValueError("Not a binary frame")
+
+    magic, version, mode, record_size, count, sequence, timestamp = HEADER.unpack_from(data, 0)
+    if version != PROTOCOL_VERSION:
+        raise ValueError(f"Unsupported protocol version {version}")
+    if len(data) < HEADER.size + count * record_size:
+        raise ValueError(f"Truncated frame: {len(data)} bytes for {count} records of {record_size}")
+
+    flash_log = bool(mode & MODE_FLASH_LOG)
+    mode &= ~MODE_FLASH_LOG
+    header = {"mode": MODE_NAMES.get(mode, str(mode)), "sequence": sequence,
+              "timestamp": timestamp, "sample_count": count, "flash_log": flash_log}
+
+    record = (LOG_RECORDS if flash_log else RECORDS).get(mode)
+    if record is None or record.size != record_size:
+        # Unknown layout: the header is still valid, skip the payload
+        return header, []
+
+    records = []
+    for i in range(count):
+        fields = record.unpack_from(data, HEADER.size + i * record_size)
+        if flash_log and mode != MODE_RAW_DATA:
+            # Logged vitals: dtMs, then the live record
+            obj = _vitals(*fields[1:])
+            obj["timestamp"] = timestamp + fields[0]
+        else:
+            obj = _record_to_dict(mode, fields, timestamp)
+        records.append(obj)
+    return header, records
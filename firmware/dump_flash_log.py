@@ -0,0 +1,161 @@
+"""
+Download the device's flash log (LOG:START recordings) over BLE.
+
+Sends DUMP and writes what comes back to CSVs next to the live capture ones:
+raw samples to raw_data_<time>_flashlog.csv (the layout of record_ml_model.py
+raw mode, so train_ml_model.py can replay it), vitals to vitals_<time>_flashlog.csv.
+The device timestamps are its uptime: a new Session starts wherever they go
+back, i.e. the device rebooted between two recordings.
+
+    python dump_flash_log.py [--erase]
+"""
+import argparse
+import asyncio
+import csv
+import datetime
+import json
+import time
+from bleak import BleakScanner, BleakClient
+from binary_protocol import is_binary_frame, decode_frame
+
+DEVICE_NAME = "ESP32_Unified_Sensor"
+
+SERVICE_UUID = "12345678-1234-5678-1234-56789abcdef0"
+DATA_CHAR_UUID = "abcdefab-1234-5678-1234-56789abcdef1"
+CONTROL_CHAR_UUID = "abcdefab-1234-5678-1234-56789abcdef2"
+STATUS_CHAR_UUID = "abcdefab-1234-5678-1234-56789abcdef3"
+
+
+class DumpWriter:
+    def __init__(self):
+        stamp = datetime.datetime.now().strftime('%Y%m%d_%H%M%S')
+        self.raw_filename = f"raw_data_{stamp}_flashlog.csv"
+        self.vitals_filename = f"vitals_{stamp}_flashlog.csv"
+        self.raw_writer = None
+        self.vitals_writer = None
+        self.files = []
+        self.session = {"raw": 0, "vitals": 0}
+        self.last_timestamp = {"raw": None, "vitals": None}
+        self.pages = set()
+        self.samples = 0
+        self.done = asyncio.Event()
+        self.summary = None
+
+    def _writer(self, kind):
+        if kind == "raw" and self.raw_writer is None:
+            f = open(self.raw_filename, mode='w', newline='')
+            self.files.append(f)
+            self.raw_writer = csv.writer(f)
+            self.raw_writer.writerow(["Timestamp", "IR", "Red", "Ax", "Ay", "Az", "Label", "Device_Timestamp", "Session"])
+        elif kind == "vitals" and self.vitals_writer is None:
+            f = open(self.vitals_filename, mode='w', newline='')
+            self.files.append(f)
+            self.vitals_writer = csv.writer(f)
+            self.vitals_writer.writerow(["Device_Timestamp", "Mode", "HeartRate", "SpO2", "Ax", "Ay", "Az", "Session"])
+        return self.raw_writer if kind == "raw" else self.vitals_writer
+
+    def _session(self, kind, timestamp):
+        last = self.last_timestamp[kind]
+        if last is not None and timestamp < last:
+            self.session[kind] += 1
+        self.last_timestamp[kind] = timestamp
+        return self.session[kind]
+
+    def on_data(self, data):
+        if not is_binary_frame(data):
+            return
+        try:
+            header, records = decode_frame(data)
+        except ValueError as e:
+            print(f"❌ Frame error: {e}")
+            return
+        if not header["flash_log"]:
+            return
+
+        self.pages.add((header["sequence"], header["timestamp"]))
+        kind = "raw" if header["mode"] == "RAW_DATA" else "vitals"
+        writer = self._writer(kind)
+        for record in records:
+            session = self._session(kind, record["timestamp"])
+            if kind == "raw":
+                # No host time for logged samples: the device clock goes in both columns
+                writer.writerow([record["timestamp"], record["ir"], record["red"],
+                                 record["ax"], record["ay"], record["az"], "unlabeled",
+                                 record["timestamp"], session])
+            else:
+                writer.writerow([record["timestamp"], header["mode"], record["hr"], record["spo2"],
+                                 record["ax"], record["ay"], record["az"], session])
+        self.samples += len(records)
+
+    def on_status(self, data):
+        try:
+            obj = json.loads(data.decode())
+        except Exception:
+            return
+        if obj.get("dump") in ("done", "failed"):
+            self.summary = obj
+            self.done.set()
+        elif obj.get("cmd") == "DUMP" and obj.get("result") != "ok":
+            print("❌ DUMP refused: no flash log, erasing, already dumping or data notifications off")
+            self.summary = {"dump": "refused", "pages": 0, "skipped": 0}
+            self.done.set()
+        elif "log" in obj:
+            print(f"📟 Device: log={obj['log']} pages={obj.get('log_pages')}")
+
+    def close(self):
+        for f in self.files:
+            f.close()
+
+
+async def dump(erase):
+    print(f"🔍 Scanning for {DEVICE_NAME}...")
+    devices = await BleakScanner.discover(timeout=15.0)
+    target = next((d for d in devices if d.name and DEVICE_NAME in d.name), None)
+    if not target:
+        print(f"❌ Device '{DEVICE_NAME}' not found.")
+        return
+
+    print(f"✅ Found device: {target.name} @ {target.address}")
+    writer = DumpWriter()
+    try:
+        async with BleakClient(target.address, timeout=10.0) as client:
+            print(f"🔗 Connected (MTU {client.mtu_size})")
+            await client.start_notify(DATA_CHAR_UUID, lambda _, data: writer.on_data(data))
+            await client.start_notify(STATUS_CHAR_UUID, lambda _, data: writer.on_status(data))
+
+            start = time.time()
+            await client.write_gatt_char(CONTROL_CHAR_UUID, b"DUMP")
+            print("📤 Sent command: DUMP")
+            while not writer.done.is_set():
+                try:
+                    await asyncio.wait_for(writer.done.wait(), timeout=5.0)
+                except asyncio.TimeoutError:
+                    print(f"   {len(writer.pages)} pages, {writer.samples} records...")
+            elapsed = time.time() - start
+
+            if writer.summary["dump"] != "done":
+                print(f"❌ Dump {writer.summary['dump']} after {writer.summary['pages']} pages: "
+                      f"the log is kept, run it again")
+                erase = False
+            else:
+                print(f"✅ Dump done: {writer.summary['pages']} pages ({writer.summary['skipped']} skipped), "
+                      f"{writer.samples} records in {elapsed:.1f}s")
+            if erase:
+                await client.write_gatt_char(CONTROL_CHAR_UUID, b"LOG:ERASE")
+                print("📤 Sent command: LOG:ERASE")
+
+            await client.stop_notify(DATA_CHAR_UUID)
+            await client.stop_notify(STATUS_CHAR_UUID)
+    except Exception as e:
+        print(f"❌ BLE Error: {e}")
+    finally:
+        writer.close()
+        for f in writer.files:
+            print(f"💾 {f.name}")
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Download the flash log of the ESP32 Unified Sensor")
+    parser.add_argument('--erase', action='store_true', help="wipe the log once it is downloaded")
+    args = parser.parse_args()
+    asyncio.run(dump(args.erase))
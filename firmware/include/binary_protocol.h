@@ -0,0 +1,115 @@
+#ifndef BINARY_PROTOCOL_H
+#define BINARY_PROTOCOL_H
+
+#include <stdint.h>
+
+// Binary streaming protocol for the data characteristic (FORMAT:BINARY)
+// Keep in sync with binary_protocol.py
+//
+// Every notification is one frame: a BinaryFrameHeader followed by sampleCount
+// records of recordSize bytes. The record layout depends on the mode byte.
+// Multi-byte fields are little-endian, fixed-point scaling is noted per field.
+
+#define BINARY_FRAME_MAGIC          0xA5    // Never '{', so JSON and binary frames can't be confused
+#define BINARY_PROTOCOL_VERSION     1
+
+// Frames of a DUMP carry flash log pages, with this bit set on the mode byte.
+// Their records are the logged ones (RawRecord, LoggedVitalsRecord), dtMs is
+// relative to the frame timestamp, and the sequence holds the low 16 bits of
+// the page number: a page split over two frames sends it twice.
+#define BINARY_MODE_FLASH_LOG       0x80
+
+// Streams that are no mode of their own use mode bytes above the OperatingMode values
+#define BINARY_MODE_ACCEL           0x10
+
+// Record flags
+#define BINARY_FLAG_COLLECTING      (1 << 0)
+#define BINARY_FLAG_AVERAGE         (1 << 1)
+
+struct __attribute__((packed)) BinaryFrameHeader {
+    uint8_t magic;              // BINARY_FRAME_MAGIC
+    uint8_t version;            // BINARY_PROTOCOL_VERSION
+    uint8_t mode;               // OperatingMode
+    uint8_t recordSize;         // in bytes, lets decoders skip unknown modes
+    uint8_t sampleCount;        // records following the header
+    uint16_t sequence;          // frame counter, reset on connection, wraps
+    uint32_t timestamp;         // in ms, device uptime of the first record
+};
+
+// MODE_HR_SPO2
+struct __attribute__((packed)) VitalsRecord {
+    uint16_t heartRateX10;      // bpm * 10
+    uint16_t spO2X10;           // % * 10
+    int16_t axMg;               // mg
+    int16_t ayMg;
+    int16_t azMg;
+};
+
+// MODE_TEMPERATURE
+struct __attribute__((packed)) TemperatureRecord {
+    int16_t temperatureCentiC;  // degC * 100
+};
+
+// MODE_FORCE_TEST (the label is the one last sent with LABEL:)
+struct __attribute__((packed)) ForceRecord {
+    uint16_t ir;
+    uint16_t red;
+    uint16_t fsr;
+    uint8_t flags;              // BINARY_FLAG_COLLECTING
+};
+
+// MODE_DISTANCE_TEST (the LED is the one last sent with START:)
+struct __attribute__((packed)) DistanceRecord {
+    uint32_t irX100;            // counts * 100, averaged when BINARY_FLAG_AVERAGE is set
+    uint32_t redX100;
+    uint16_t distanceMm;
+    uint16_t samples;           // samples in the average, saturating at 65535
+    uint8_t flags;              // BINARY_FLAG_COLLECTING | BINARY_FLAG_AVERAGE
+};
+
+// MODE_QUALITY
+struct __attribute__((packed)) QualityRecord {
+    VitalsRecord vitals;
+    uint8_t quality;            // 1 good, 0 poor
+    uint16_t qualityPercentX10; // % * 10
+};
+
+// MODE_RAW_DATA, one record per FIFO sample
+struct __attribute__((packed)) RawRecord {
+    uint16_t dtMs;              // in ms, sample time relative to the frame timestamp
+    uint16_t ir;
+    uint16_t red;
+    int16_t axMg;
+    int16_t ayMg;
+    int16_t azMg;
+};
+
+// BINARY_MODE_ACCEL, the ACCEL stream
+struct __attribute__((packed)) AccelRecord {
+    int16_t axMg;               // mg
+    int16_t ayMg;
+    int16_t azMg;
+};
+
+// MODE_HR_SPO2 and MODE_QUALITY in the flash log, one per report
+struct __attribute__((packed)) LoggedVitalsRecord {
+    uint16_t dtMs;              // in ms, relative to the frame timestamp
+    VitalsRecord vitals;
+};
+
+// MODE_IDLE
+struct __attribute__((packed)) StatusRecord {
+    uint32_t freeHeap;
+};
+
+inline uint16_t toFixedX10(float value)
+{
+    return value <= 0 ? 0 : (uint16_t)(value * 10 + 0.5f);
+}
+
+inline int16_t toMilliG(float g)
+{
+    return (int16_t)(g * 1000 + (g < 0 ? -0.5f : 0.5f));
+}
+
+#endif
@@ -0,0 +1,305 @@
+"""
+Host side ingest of the data characteristic, shared by the dashboards and the
+record_*.py scripts.
+
+Every notification, JSON or binary frame, is decoded into columns: a binary
+frame with one np.frombuffer() over all of its records rather than record by
+record. The columns go into a preallocated ring per stream, which the plots
+read, and come back as a Batch for the caller to write out. Frames lost on the
+way are counted from the header sequence. Keep in sync with
+include/binary_protocol.h
+
+    ingest = StreamIngest()
+    batch = ingest.feed(data)                           # in the notify callback
+    if batch and batch.stream == "RAW_DATA":
+        writer.writerows(batch.rows("timestamp", "ir", "red"))
+    ir = ingest.ring("RAW_DATA").latest(500)["ir"]      # in the plot update
+"""
+import json
+import threading
+import numpy as np
+from binary_protocol import (HEADER, PROTOCOL_VERSION, MODE_FLASH_LOG, MODE_NAMES, RECORDS, LOG_RECORDS,
+                             FLAG_COLLECTING, FLAG_AVERAGE, is_binary_frame,
+                             MODE_IDLE, MODE_HR_SPO2, MODE_TEMPERATURE, MODE_FORCE_TEST,
+                             MODE_DISTANCE_TEST, MODE_QUALITY, MODE_RAW_DATA, MODE_ACCEL)
+
+DEFAULT_CAPACITY = 4096
+
+# The records as numpy dtypes, packed like the structs of binary_protocol.py.
+# "dt" is the record time relative to the frame timestamp.
+_VITALS = [('hr', '<u2'), ('spo2', '<u2'), ('ax', '<i2'), ('ay', '<i2'), ('az', '<i2')]
+RECORD_DTYPES = {
+    MODE_IDLE: np.dtype([('free_heap', '<u4')]),
+    MODE_HR_SPO2: np.dtype(_VITALS),
+    MODE_TEMPERATURE: np.dtype([('temperature', '<i2')]),
+    MODE_FORCE_TEST: np.dtype([('ir', '<u2'), ('red', '<u2'), ('fsr', '<u2'), ('flags', 'u1')]),
+    MODE_DISTANCE_TEST: np.dtype([('ir', '<u4'), ('red', '<u4'), ('distance_mm', '<u2'),
+                                  ('samples', '<u2'), ('flags', 'u1')]),
+    MODE_QUALITY: np.dtype(_VITALS + [('quality', 'u1'), ('quality_percent', '<u2')]),
+    MODE_RAW_DATA: np.dtype([('dt', '<u2'), ('ir', '<u2'), ('red', '<u2'),
+                             ('ax', '<i2'), ('ay', '<i2'), ('az', '<i2')]),
+    MODE_ACCEL: np.dtype([('ax', '<i2'), ('ay', '<i2'), ('az', '<i2')]),
+}
+LOG_RECORD_DTYPES = {
+    MODE_HR_SPO2: np.dtype([('dt', '<u2')] + _VITALS),
+    MODE_QUALITY: np.dtype([('dt', '<u2')] + _VITALS),
+    MODE_RAW_DATA: RECORD_DTYPES[MODE_RAW_DATA],
+}
+for _mode, _dtype in RECORD_DTYPES.items():
+    assert _dtype.itemsize == RECORDS[_mode].size, MODE_NAMES[_mode]
+for _mode, _dtype in LOG_RECORD_DTYPES.items():
+    assert _dtype.itemsize == LOG_RECORDS[_mode].size, MODE_NAMES[_mode]
+
+# Fixed point fields: the divisor the firmware scaled them by
+SCALES = {'hr': 10.0, 'spo2': 10.0, 'ax': 1000.0, 'ay': 1000.0, 'az': 1000.0,
+          'temperature': 100.0, 'quality_percent': 10.0}
+
+_F, _I = np.float64, np.int64
+_ACCEL_COLUMNS = [('ax', _F), ('ay', _F), ('az', _F)]
+
+# The columns of every stream, named like the JSON keys. A column a record
+# does not carry is NaN if float, 0 otherwise (the hr of a binary raw sample):
+# every Batch of a stream has them all.
+COLUMNS = {
+    "IDLE": [('timestamp', _I), ('free_heap', _I)],
+    # confidence only comes in JSON records
+    "HR_SPO2": [('timestamp', _I), ('hr', _F), ('spo2', _F), ('confidence', _F)] + _ACCEL_COLUMNS,
+    "TEMPERATURE": [('timestamp', _I), ('temperature', _F)],
+    "FORCE_TEST": [('timestamp', _I), ('ir', _I), ('red', _I), ('fsr', _I), ('collecting', _I)],
+    # Averages are in ir/red too, with average set
+    "DISTANCE_TEST": [('timestamp', _I), ('ir', _F), ('red', _F), ('distance_mm', _I),
+                      ('samples', _I), ('average', _I), ('collecting', _I)],
+    "QUALITY": [('timestamp', _I), ('hr', _F), ('spo2', _F)] + _ACCEL_COLUMNS +
+               [('quality', _I), ('quality_percent', _F), ('accel_mag', _F)],
+    "RAW_DATA": [('timestamp', _I), ('ir', _I), ('red', _I)] + _ACCEL_COLUMNS + [('hr', _F), ('spo2', _F)],
+    "ACCEL": [('timestamp', _I)] + _ACCEL_COLUMNS,
+}
+
+# Records per second of every stream at the firmware defaults; RATE:<stream>:<hz> changes them
+DEFAULT_RATES_HZ = {"IDLE": 2.0, "HR_SPO2": 2.0, "TEMPERATURE": 2.0, "FORCE_TEST": 2.0, "DISTANCE_TEST": 2.0,
+                    "QUALITY": 2.0, "RAW_DATA": 100.0, "ACCEL": 10.0}
+
+
+def _fill(dtype):
+    return np.nan if np.issubdtype(dtype, np.floating) else 0
+
+
+class Ring:
+    """The latest `capacity` records of one stream, as preallocated columns"""
+
+    def __init__(self, columns, capacity=DEFAULT_CAPACITY):
+        self.capacity = capacity
+        self.columns = [name for name, _ in columns]
+        self.data = {name: np.zeros(capacity, dtype) for name, dtype in columns}
+        self.head = 0     # next slot written
+        self.count = 0    # slots in use
+        self.total = 0    # records ever written
+        self.lock = threading.Lock()
+
+    def __len__(self):
+        return self.count
+
+    def extend(self, columns, n):
+        """Append n records given as {column: array}; missing columns are filled"""
+        if n <= 0:
+            return
+        skip = max(0, n - self.capacity)
+        with self.lock:
+            self.total += n
+            n -= skip
+            first = min(n, self.capacity - self.head)
+            for name, array in self.data.items():
+                values = columns.get(name)
+                if values is None:
+                    array[self.head:self.head + first] = _fill(array.dtype)
+                    array[:n - first] = _fill(array.dtype)
+                else:
+                    array[self.head:self.head + first] = values[skip:skip + first]
+                    array[:n - first] = values[skip + first:]
+            self.head = (self.head + n) % self.capacity
+            self.count = min(self.count + n, self.capacity)
+
+    def latest(self, n=None):
+        """Copies of the last n records (all by default), the oldest first"""
+        with self.lock:
+            n = self.count if n is None else min(n, self.count)
+            start = self.head - n
+            if start >= 0:
+                return {name: array[start:self.head].copy() for name, array in self.data.items()}
+            return {name: np.concatenate((array[start:], array[:self.head]))
+                    for name, array in self.data.items()}
+
+    def last(self, name, default=0):
+        """The newest value of a column"""
+        with self.lock:
+            return self.data[name][self.head - 1].item() if self.count else default
+
+    def clear(self):
+        with self.lock:
+            self.head = self.count = 0
+
+
+class Batch:
+    """The records of one notification, as columns"""
+    __slots__ = ("stream", "columns", "sequence", "flash_log", "gap", "text")
+
+    def __init__(self, stream, columns, sequence=None, flash_log=False, gap=0, text=None):
+        self.stream = stream
+        self.columns = columns
+        self.sequence = sequence
+        self.flash_log = flash_log
+        self.gap = gap            # frames lost just before this one
+        self.text = text or {}    # string fields of a JSON record (label, led, ...)
+
+    def __len__(self):
+        return len(self.columns["timestamp"])
+
+    def __getitem__(self, name):
+        return self.columns[name]
+
+    def rows(self, *names):
+        """Records as tuples of plain Python values, for csv.writer.writerows()"""
+        return zip(*(self.columns[name].tolist() for name in names))
+
+    def records(self):
+        """Records as dicts keyed like the JSON notifications, without the fields they lack"""
+        names = list(self.columns)
+        return [{**{name: value for name, value in zip(names, row) if value == value}, **self.text}
+                for row in self.rows(*names)]
+
+
+class StreamIngest:
+    """
+    Decodes the data characteristic. feed() is safe to call from the BLE thread
+    while another one reads the rings.
+    """
+
+    def __init__(self, capacity=DEFAULT_CAPACITY, capacities=None):
+        self.capacity = capacity
+        self.capacities = capacities or {}
+        self.rings = {}
+        self.frames = 0
+        self.lost_frames = 0
+        self.last_sequence = None
+
+    def ring(self, stream):
+        """The ring of a stream, created empty if nothing came for it yet"""
+        ring = self.rings.get(stream)
+        if ring is None:
+            ring = self.rings.setdefault(stream, Ring(COLUMNS[stream], self.capacities.get(stream, self.capacity)))
+        return ring
+
+    def reset(self):
+        """Forget the sequence, e.g. on reconnect, where the device restarts it"""
+        self.last_sequence = None
+
+    def clear(self):
+        for ring in self.rings.values():
+            ring.clear()
+
+    def feed(self, data):
+        """
+        Decode one notification into its ring.
+        Returns a Batch, or None for payloads that carry no records.
+        Raises ValueError on malformed frames and JSON.
+        """
+        if is_binary_frame(data):
+            batch = self._decode_frame(data)
+        else:
+            batch = self._decode_json(data)
+        if batch is not None and not batch.flash_log and len(batch):
+            self.ring(batch.stream).extend(batch.columns, len(batch))
+        return batch
+
+    def _decode_frame(self, data):
+        magic, version, mode, record_size, count, sequence, timestamp = HEADER.unpack_from(data, 0)
+        if version != PROTOCOL_VERSION:
+            raise ValueError(f"Unsupported protocol version {version}")
+        if len(data) < HEADER.size + count * record_size:
+            raise ValueError(f"Truncated frame: {len(data)} bytes for {count} records of {record_size}")
+
+        flash_log = bool(mode & MODE_FLASH_LOG)
+        mode &= ~MODE_FLASH_LOG
+        gap = 0
+        if not flash_log:
+            # Dump frames count pages, not live frames
+            if self.last_sequence is not None:
+                gap = (sequence - self.last_sequence - 1) & 0xFFFF
+                self.lost_frames += gap
+            self.last_sequence = sequence
+            self.frames += 1
+
+        dtype = (LOG_RECORD_DTYPES if flash_log else RECORD_DTYPES).get(mode)
+        if dtype is None or dtype.itemsize != record_size:
+            # Unknown layout: skip the payload
+            return None
+
+        records = np.frombuffer(data, dtype=dtype, count=count, offset=HEADER.size)
+        timestamps = np.full(count, timestamp, dtype=np.int64)
+        if 'dt' in dtype.names:
+            timestamps += records['dt']
+        columns = {'timestamp': timestamps}
+        for name in dtype.names:
+            if name in ('dt', 'flags'):
+                continue
+            scale = SCALES.get(name)
+            columns[name] = records[name] / scale if scale else records[name].astype(np.int64)
+
+        if mode == MODE_DISTANCE_TEST:
+            # Averages are sent X100, the single readings too
+            columns['ir'] = records['ir'] / 100.0
+            columns['red'] = records['red'] / 100.0
+            columns['average'] = (records['flags'] & FLAG_AVERAGE != 0).astype(np.int64)
+        if mode in (MODE_FORCE_TEST, MODE_DISTANCE_TEST):
+            columns['collecting'] = (records['flags'] & FLAG_COLLECTING != 0).astype(np.int64)
+        if mode == MODE_QUALITY:
+            columns['accel_mag'] = np.sqrt(columns['ax'] ** 2 + columns['ay'] ** 2 + columns['az'] ** 2)
+
+        stream = MODE_NAMES[mode]
+        for name, column_dtype in COLUMNS[stream]:
+            if name not in columns:
+                columns[name] = np.full(count, _fill(column_dtype), dtype=column_dtype)
+        return Batch(stream, columns, sequence, flash_log, gap)
+
+    def _decode_json(self, data):
+        obj = json.loads(bytes(data).decode())
+        stream = _json_stream(obj)
+        if stream is None:
+            return None
+
+        values = dict(obj)
+        values.setdefault('timestamp', obj.get('uptime', 0))
+        if stream == "DISTANCE_TEST":
+            values['average'] = obj.get('type') == "average"
+            if values['average']:
+                values['ir'], values['red'] = obj.get('avg_ir'), obj.get('avg_red')
+        if stream == "QUALITY" and 'accel_mag' not in obj:
+            values['accel_mag'] = (obj.get('ax', 0) ** 2 + obj.get('ay', 0) ** 2 + obj.get('az', 0) ** 2) ** 0.5
+
+        columns = {}
+        for name, dtype in COLUMNS[stream]:
+            value = values.get(name)
+            columns[name] = np.array([_fill(dtype) if value is None else value], dtype=dtype)
+        text = {key: value for key, value in obj.items() if isinstance(value, str)}
+        return Batch(stream, columns, text=text)
+
+
+def _json_stream(obj):
+    """The stream a JSON record belongs to, from its keys"""
+    if 'quality' in obj:
+        return "QUALITY"
+    if 'distance_mm' in obj:
+        return "DISTANCE_TEST"
+    if 'fsr' in obj:
+        return "FORCE_TEST"
+    if 'temperature' in obj:
+        return "TEMPERATURE"
+    if 'ir' in obj:
+        return "RAW_DATA"
+    if 'hr' in obj:
+        return "HR_SPO2"
+    if 'ax' in obj:
+        return "ACCEL"
+    if obj.get('status') == "idle":
+        return "IDLE"
+    return None
@@ -31,6 +31,12 @@
 #include <Arduino.h>
 #include "ADXL335.h"
 
+#if defined(ARDUINO_ARCH_ESP32)
+#include <driver/i2s.h>
+#include <driver/adc.h>
+#define ADXL335_I2S_PORT I2S_NUM_0
+#endif
+
 void ADXL335::pinsInit() {
     pinMode(X_AXIS_PIN, INPUT);
     pinMode(Y_AXIS_PIN, INPUT);
@@ -40,45 +46,237 @@ void ADXL335::begin() {
     pinsInit();
     scale = (float)SENSITIVITY * ADC_AMPLITUDE / ADC_REF;
 }
+float ADXL335::toAcceleration(float raw, float zero) {
+    return (raw * ADC_REF / ADC_AMPLITUDE - zero) / SENSITIVITY;
+}
 void ADXL335::getXYZ(int* x, int* y, int* z) {
     *x = analogRead(X_AXIS_PIN);
     *y = analogRead(Y_AXIS_PIN);
     *z = analogRead(Z_AXIS_PIN);
 }
 void ADXL335::getAcceleration(float* ax, float* ay, float* az) {
+    if (continuous) {
+        drainDma();
+        *ax = latest.x;
+        *ay = latest.y;
+        *az = latest.z;
+        return;
+    }
+
     int x, y, z;
-    float xvoltage, yvoltage, zvoltage;
     getXYZ(&x, &y, &z);
-    
-    xvoltage = (float)x * ADC_REF / ADC_AMPLITUDE;
-    yvoltage = (float)y * ADC_REF / ADC_AMPLITUDE;
-    zvoltage = (float)z * ADC_REF / ADC_AMPLITUDE;
-    
-    *ax = (xvoltage - ZERO_X) / SENSITIVITY;
-    *ay = (yvoltage - ZERO_Y) / SENSITIVITY;
-    *az = (zvoltage - ZERO_Z) / SENSITIVITY;
+    *ax = toAcceleration(x, ZERO_X);
+    *ay = toAcceleration(y, ZERO_Y);
+    *az = toAcceleration(z, ZERO_Z);
 }
 float ADXL335::getAccelerationX() {
-    int x, y, z;
-    float xvoltage, ax;
-    getXYZ(&x, &y, &z);
-    xvoltage = (float)x * ADC_REF / ADC_AMPLITUDE;
-    ax = (xvoltage - ZERO_X) / SENSITIVITY;
-    return ax;
+    if (continuous) {
+        drainDma();
+        return latest.x;
+    }
+    return toAcceleration(analogRead(X_AXIS_PIN), ZERO_X);
 }
 float ADXL335::getAccelerationY() {
-    int x, y, z;
-    float yvoltage, ay;
-    getXYZ(&x, &y, &z);
-    yvoltage = (float)y * ADC_REF / ADC_AMPLITUDE;
-    ay = (yvoltage - ZERO_Y) / SENSITIVITY;
-    return ay;
+    if (continuous) {
+        drainDma();
+        return latest.y;
+    }
+    return toAcceleration(analogRead(Y_AXIS_PIN), ZERO_Y);
 }
 float ADXL335::getAccelerationZ() {
-    int x, y, z;
-    float zvoltage, az;
-    getXYZ(&x, &y, &z);
-    zvoltage = (float)z * ADC_REF / ADC_AMPLITUDE;
-    az = (zvoltage - ZERO_Z) / SENSITIVITY;
-    return az;
+    if (continuous) {
+        drainDma();
+        return latest.z;
+    }
+    return toAcceleration(analogRead(Z_AXIS_PIN), ZERO_Z);
+}
+
+bool ADXL335::beginContinuous(uint32_t outputRateHz, uint16_t oversamplingRatio) {
+#if defined(ARDUINO_ARCH_ESP32)
+    if (continuous) {
+        endContinuous();
+    }
+
+    // All three axes must be on ADC1: ADC2 is unavailable while the radio runs
+    channels[0] = digitalPinToAnalogChannel(X_AXIS_PIN);
+    channels[1] = digitalPinToAnalogChannel(Y_AXIS_PIN);
+    channels[2] = digitalPinToAnalogChannel(Z_AXIS_PIN);
+    for (uint8_t axis = 0; axis < 3; axis++) {
+        if (channels[axis] >= ADC1_CHANNEL_MAX) {
+            return false;
+        }
+    }
+
+    oversampling = oversamplingRatio;
+    conversionRate = outputRateHz * oversamplingRatio * 3;
+    outputPeriodUs = 1000000UL / outputRateHz;
+
+    i2s_config_t config = {};
+    config.mode = (i2s_mode_t)(I2S_MODE_MASTER | I2S_MODE_RX | I2S_MODE_ADC_BUILT_IN);
+    config.sample_rate = conversionRate;
+    config.bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT;
+    config.channel_format = I2S_CHANNEL_FMT_ONLY_LEFT;
+    config.communication_format = I2S_COMM_FORMAT_STAND_I2S;
+    config.dma_buf_count = ADXL335_DMA_BUFFER_COUNT;
+    config.dma_buf_len = ADXL335_DMA_BUFFER_LEN;
+    config.use_apll = false;
+    if (i2s_driver_install(ADXL335_I2S_PORT, &config, 0, NULL) != ESP_OK) {
+        return false;
+    }
+
+    adc1_config_width(ADC_WIDTH_BIT_12);
+    for (uint8_t axis = 0; axis < 3; axis++) {
+        adc1_config_channel_atten((adc1_channel_t)channels[axis], ADC_ATTEN_DB_11);
+    }
+    i2s_set_adc_mode(ADC_UNIT_1, (adc1_channel_t)channels[0]);
+
+    // i2s_set_adc_mode() programs a single channel pattern: replace it with an X/Y/Z scan.
+    // Each 16 bit conversion then carries its channel in the top nibble.
+    adc_digi_pattern_table_t pattern[3];
+    for (uint8_t axis = 0; axis < 3; axis++) {
+        pattern[axis].atten = ADC_ATTEN_DB_11;
+        pattern[axis].bit_width = ADC_WIDTH_BIT_12;
+        pattern[axis].channel = channels[axis];
+    }
+    adc_digi_config_t digiConfig = {};
+    digiConfig.conv_limit_en = false;
+    digiConfig.adc1_pattern_len = 3;
+    digiConfig.adc1_pattern = pattern;
+    digiConfig.conv_mode = ADC_CONV_SINGLE_UNIT_1;
+    digiConfig.format = ADC_DIGI_FORMAT_12BIT;
+    if (adc_digi_controller_config(&digiConfig) != ESP_OK || i2s_adc_enable(ADXL335_I2S_PORT) != ESP_OK) {
+        i2s_driver_uninstall(ADXL335_I2S_PORT);
+        return false;
+    }
+
+    for (uint8_t axis = 0; axis < 3; axis++) {
+        sums[axis] = 0;
+        counts[axis] = 0;
+    }
+    decimatedHead = 0;
+    decimatedCount = 0;
+    continuous = true;
+    return true;
+#else
+    return false;
+#endif
+}
+
+void ADXL335::endContinuous() {
+#if defined(ARDUINO_ARCH_ESP32)
+    if (continuous) {
+        i2s_adc_disable(ADXL335_I2S_PORT);
+        i2s_driver_uninstall(ADXL335_I2S_PORT);
+        continuous = false;
+    }
+#endif
+}
+
+bool ADXL335::isContinuous() {
+    return continuous;
+}
+
+void ADXL335::pushDecimated() {
+    ADXL335Sample sample;
+    sample.x = toAcceleration((float)sums[0] / counts[0], ZERO_X);
+    sample.y = toAcceleration((float)sums[1] / counts[1], ZERO_Y);
+    sample.z = toAcceleration((float)sums[2] / counts[2], ZERO_Z);
+    sample.timestamp = 0;   // set by drainDma() once the whole batch is known
+
+    if (decimatedCount == ADXL335_DECIMATED_BUFFER) {
+        // Nobody read in time: drop the oldest
+        decimatedHead = (decimatedHead + 1) % ADXL335_DECIMATED_BUFFER;
+        decimatedCount--;
+        overruns++;
+    }
+    decimated[(decimatedHead + decimatedCount) % ADXL335_DECIMATED_BUFFER] = sample;
+    decimatedCount++;
+
+    for (uint8_t axis = 0; axis < 3; axis++) {
+        sums[axis] = 0;
+        counts[axis] = 0;
+    }
+}
+
+// Folds every completed DMA buffer into the averaging windows. The newest window
+// is stamped with the drain time, up to one DMA buffer (ADXL335_DMA_BUFFER_LEN
+// conversions) late, and the earlier ones are spaced back by the output period.
+void ADXL335::drainDma() {
+#if defined(ARDUINO_ARCH_ESP32)
+    uint16_t conversions[ADXL335_DMA_BUFFER_LEN];
+    size_t bytesRead;
+    uint32_t produced = 0;
+
+    while (i2s_read(ADXL335_I2S_PORT, conversions, sizeof(conversions), &bytesRead, 0) == ESP_OK && bytesRead > 0) {
+        for (size_t i = 0; i < bytesRead / sizeof(uint16_t); i++) {
+            uint8_t channel = conversions[i] >> 12;
+            uint16_t value = conversions[i] & 0x0FFF;
+            for (uint8_t axis = 0; axis < 3; axis++) {
+                if (channels[axis] == channel) {
+                    sums[axis] += value;
+                    counts[axis]++;
+                    break;
+                }
+            }
+            if (counts[0] >= oversampling && counts[1] > 0 && counts[2] > 0) {
+                pushDecimated();
+                produced++;
+            }
+        }
+    }
+
+    if (produced > decimatedCount) {
+        produced = decimatedCount;
+    }
+    if (produced > 0) {
+        uint32_t now = millis();
+        for (uint32_t i = 0; i < produced; i++) {
+            ADXL335Sample& sample = decimated[(decimatedHead + decimatedCount - 1 - i) % ADXL335_DECIMATED_BUFFER];
+            sample.timestamp = now - (uint32_t)((uint64_t)i * outputPeriodUs / 1000);
+        }
+        latest = decimated[(decimatedHead + decimatedCount - 1) % ADXL335_DECIMATED_BUFFER];
+    }
+#endif
+}
+
+size_t ADXL335::readDecimated(ADXL335Sample* samples, size_t n) {
+    drainDma();
+
+    size_t count = 0;
+    while (count < n && decimatedCount > 0) {
+        samples[count++] = decimated[decimatedHead];
+        decimatedHead = (decimatedHead + 1) % ADXL335_DECIMATED_BUFFER;
+        decimatedCount--;
+    }
+    return count;
+}
+
+size_t ADXL335::readAverage(float* ax, float* ay, float* az) {
+    drainDma();
+
+    size_t count = decimatedCount;
+    if (count == 0) {
+        *ax = latest.x;
+        *ay = latest.y;
+        *az = latest.z;
+        return 0;
+    }
+
+    float x = 0, y = 0, z = 0;
+    while (decimatedCount > 0) {
+        const ADXL335Sample& sample = decimated[decimatedHead];
+        x += sample.x;
+        y += sample.y;
+        z += sample.z;
+        decimatedHead = (decimatedHead + 1) % ADXL335_DECIMATED_BUFFER;
+        decimatedCount--;
+    }
+    *ax = x / count;
+    *ay = y / count;
+    *az = z / count;
+    return count;
+}
+
+uint32_t ADXL335::getOverruns() {
+    return overruns;
 }
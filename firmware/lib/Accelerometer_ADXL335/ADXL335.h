@@ -68,10 +68,45 @@
 #define SENSITIVITY 0.29
 #endif
 
+// continuous sampling (ESP32 only): the ADC scans X/Y/Z through the I2S DMA
+// and conversions are averaged down to the output rate
+#ifndef ADXL335_DMA_BUFFER_COUNT
+#define ADXL335_DMA_BUFFER_COUNT 32
+#endif
+#ifndef ADXL335_DMA_BUFFER_LEN
+#define ADXL335_DMA_BUFFER_LEN 128     // conversions, bounds the timestamp latency
+#endif
+#ifndef ADXL335_DECIMATED_BUFFER
+#define ADXL335_DECIMATED_BUFFER 64    // output samples kept between reads
+#endif
+
+// one averaged sample of the continuous backend
+struct ADXL335Sample {
+    float x;                // in g
+    float y;
+    float z;
+    uint32_t timestamp;     // in ms of uptime, end of the averaging window
+};
+
 class ADXL335 {
   private:
     void pinsInit();
+    void drainDma();
+    void pushDecimated();
+    float toAcceleration(float raw, float zero);
     float scale;
+    bool continuous = false;
+    uint16_t oversampling = 0;
+    uint32_t conversionRate = 0;
+    uint32_t outputPeriodUs = 0;
+    uint8_t channels[3];
+    uint32_t sums[3];
+    uint16_t counts[3];
+    ADXL335Sample decimated[ADXL335_DECIMATED_BUFFER];
+    uint8_t decimatedHead = 0;
+    uint8_t decimatedCount = 0;
+    uint32_t overruns = 0;
+    ADXL335Sample latest = {0, 0, 0, 0};
   public:
     void begin();
     void getXYZ(int* x, int* y, int* z);
@@ -79,6 +114,20 @@ class ADXL335 {
     float getAccelerationX();
     float getAccelerationY();
     float getAccelerationZ();
+
+    // Starts DMA sampling at outputRateHz averaged samples per second, each the
+    // mean of `oversamplingRatio` conversions per axis. Returns false (and keeps
+    // the analogRead() path) when the platform or the driver doesn't support it.
+    bool beginContinuous(uint32_t outputRateHz = 100, uint16_t oversamplingRatio = 32);
+    void endContinuous();
+    bool isContinuous();
+    // Removes up to n averaged samples, oldest first. Returns how many were copied.
+    size_t readDecimated(ADXL335Sample* samples, size_t n);
+    // Averages every sample produced since the previous read. Returns how many
+    // were averaged; with none pending the latest sample is reported.
+    size_t readAverage(float* ax, float* ay, float* az);
+    // Averaged samples lost because they weren't read in time
+    uint32_t getOverruns();
 };
 
 #endif
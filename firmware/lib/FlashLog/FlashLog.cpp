@@ -0,0 +1,297 @@
+#include "FlashLog.h"
+
+uint16_t flashLogCrc(const uint8_t* data, size_t length, uint16_t crc)
+{
+    for (size_t i = 0; i < length; i++) {
+        crc ^= (uint16_t)data[i] << 8;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+static uint16_t pageCrc(const FlashLogPage& page)
+{
+    FlashLogPageHeader header = page.header;
+    header.crc = 0;
+    uint16_t crc = flashLogCrc((const uint8_t*)&header, sizeof(header));
+    return flashLogCrc(page.records, sizeof(page.records), crc);
+}
+
+FlashLog::FlashLog() :
+    partition(NULL),
+    pageCount(0),
+    mutex(NULL),
+    recording(false),
+    eraseRequested(false),
+    erasing(false),
+    session(0),
+    firstSequence(0),
+    nextSequence(0),
+    sealedSequence(0),
+    dropped(0)
+{
+    current.header.count = 0;
+}
+
+bool FlashLog::begin(const char* label)
+{
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                         (esp_partition_subtype_t)FLASH_LOG_PARTITION_SUBTYPE, label);
+    if (partition == NULL) {
+        return false;
+    }
+    mutex = xSemaphoreCreateMutex();
+
+    // Whole sectors only, the ring erases one at a time
+    uint32_t sectors = partition->size / SPI_FLASH_SEC_SIZE;
+    pageCount = sectors * FLASH_LOG_PAGES_PER_SECTOR;
+
+    // The first page of every sector in use tells which part of the ring it holds
+    bool found = false;
+    uint32_t headSector = 0;
+    FlashLogPageHeader header;
+    for (uint32_t sector = 0; sector < sectors; sector++) {
+        uint32_t index = sector * FLASH_LOG_PAGES_PER_SECTOR;
+        if (!readHeader(index, &header) || header.sequence % pageCount != index) {
+            continue;
+        }
+        if (!found || header.sequence < firstSequence) {
+            firstSequence = header.sequence;
+        }
+        if (!found || header.sequence > nextSequence) {
+            nextSequence = header.sequence;
+            headSector = sector;
+            session = header.session;
+        }
+        found = true;
+    }
+
+    if (found) {
+        // Written pages of the newest sector, up to the first erased one. A page
+        // cut by a power loss is skipped by the readers, its slot stays used.
+        uint32_t base = headSector * FLASH_LOG_PAGES_PER_SECTOR;
+        uint32_t used = 1;
+        uint8_t magic;
+        while (used < FLASH_LOG_PAGES_PER_SECTOR &&
+               esp_partition_read(partition, (base + used) * FLASH_LOG_PAGE_SIZE, &magic, 1) == ESP_OK &&
+               magic != 0xFF) {
+            used++;
+        }
+        nextSequence += used;
+    }
+    sealedSequence = nextSequence;
+    return true;
+}
+
+bool FlashLog::isAvailable()
+{
+    return partition != NULL;
+}
+
+void FlashLog::start()
+{
+    if (!partition || recording) {
+        return;
+    }
+    session++;
+    current.header.count = 0;
+    recording = true;
+}
+
+void FlashLog::stop()
+{
+    if (!recording) {
+        return;
+    }
+    sealPage();
+    recording = false;
+}
+
+bool FlashLog::isRecording()
+{
+    return recording;
+}
+
+bool FlashLog::append(uint8_t mode, uint32_t timestamp, const void* record, uint8_t size)
+{
+    if (!recording || size < sizeof(uint16_t) || size > FLASH_LOG_PAGE_PAYLOAD) {
+        return false;
+    }
+
+    FlashLogPageHeader& header = current.header;
+    if (header.count > 0 &&
+        (mode != header.mode || size != header.recordSize ||
+         (size_t)(header.count + 1) * size > FLASH_LOG_PAGE_PAYLOAD ||
+         timestamp - header.timestamp > UINT16_MAX)) {
+        sealPage();
+    }
+
+    if (header.count == 0) {
+        header.magic = FLASH_LOG_PAGE_MAGIC;
+        header.version = FLASH_LOG_VERSION;
+        header.mode = mode;
+        header.recordSize = size;
+        header.session = session;
+        header.timestamp = timestamp;
+        // The unused tail stays as erased flash
+        memset(current.records, 0xFF, sizeof(current.records));
+    }
+
+    uint8_t* slot = current.records + header.count * size;
+    uint16_t dtMs = (uint16_t)(timestamp - header.timestamp);
+    memcpy(slot, record, size);
+    memcpy(slot, &dtMs, sizeof(dtMs));
+    header.count++;
+
+    if ((size_t)(header.count + 1) * size > FLASH_LOG_PAGE_PAYLOAD) {
+        sealPage();
+    }
+    return true;
+}
+
+void FlashLog::sealPage()
+{
+    if (current.header.count == 0) {
+        return;
+    }
+
+    current.header.sequence = sealedSequence;
+    current.header.crc = pageCrc(current);
+    if (pending.push(current)) {
+        sealedSequence++;
+    } else {
+        dropped += current.header.count;
+    }
+    current.header.count = 0;
+}
+
+void FlashLog::writePending()
+{
+    const FlashLogPage* pages;
+    size_t count;
+    while ((count = pending.popSpan(&pages)) > 0) {
+        for (size_t i = 0; i < count; i++) {
+            writePage(pages[i]);
+        }
+        pending.commitPop(count);
+    }
+
+    if (eraseRequested && !recording) {
+        erasing = true;
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        firstSequence = nextSequence;
+        xSemaphoreGive(mutex);
+
+        // One sector per call into the flash driver: the caches are only off for one erase at a time
+        for (uint32_t sector = 0; sector < pageCount / FLASH_LOG_PAGES_PER_SECTOR; sector++) {
+            eraseSector(sector);
+            vTaskDelay(1);
+        }
+        // Restart at a sector boundary, so the next page erases the sector it goes into
+        uint32_t next = (nextSequence + FLASH_LOG_PAGES_PER_SECTOR - 1) / FLASH_LOG_PAGES_PER_SECTOR *
+                        FLASH_LOG_PAGES_PER_SECTOR;
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        firstSequence = nextSequence = sealedSequence = next;
+        xSemaphoreGive(mutex);
+        eraseRequested = false;
+        erasing = false;
+    }
+}
+
+bool FlashLog::hasPending()
+{
+    return !pending.isEmpty() || eraseRequested;
+}
+
+void FlashLog::requestErase()
+{
+    if (partition && !recording) {
+        eraseRequested = true;
+    }
+}
+
+bool FlashLog::isErasing()
+{
+    return eraseRequested || erasing;
+}
+
+void FlashLog::writePage(const FlashLogPage& page)
+{
+    uint32_t sequence = page.header.sequence;
+    uint32_t index = sequence % pageCount;
+
+    if (index % FLASH_LOG_PAGES_PER_SECTOR == 0) {
+        // Entering a sector: it goes, with the oldest pages of the ring in it
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        if (sequence + FLASH_LOG_PAGES_PER_SECTOR > pageCount + firstSequence) {
+            firstSequence = sequence + FLASH_LOG_PAGES_PER_SECTOR - pageCount;
+        }
+        xSemaphoreGive(mutex);
+        eraseSector(index / FLASH_LOG_PAGES_PER_SECTOR);
+    }
+
+    esp_partition_write(partition, index * FLASH_LOG_PAGE_SIZE, &page, sizeof(page));
+
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    nextSequence = sequence + 1;
+    xSemaphoreGive(mutex);
+}
+
+void FlashLog::eraseSector(uint32_t sector)
+{
+    esp_partition_erase_range(partition, sector * SPI_FLASH_SEC_SIZE, SPI_FLASH_SEC_SIZE);
+}
+
+uint32_t FlashLog::getFirstSequence()
+{
+    return firstSequence;
+}
+
+uint32_t FlashLog::getNextSequence()
+{
+    return nextSequence;
+}
+
+uint32_t FlashLog::getCapacity()
+{
+    return pageCount;
+}
+
+uint32_t FlashLog::getDropped()
+{
+    return dropped;
+}
+
+bool FlashLog::readHeader(uint32_t index, FlashLogPageHeader* header)
+{
+    return esp_partition_read(partition, index * FLASH_LOG_PAGE_SIZE, header, sizeof(*header)) == ESP_OK &&
+           header->magic == FLASH_LOG_PAGE_MAGIC && header->version == FLASH_LOG_VERSION;
+}
+
+bool FlashLog::isValidPage(const FlashLogPage& page, uint32_t sequence)
+{
+    return page.header.magic == FLASH_LOG_PAGE_MAGIC && page.header.version == FLASH_LOG_VERSION &&
+           page.header.sequence == sequence && page.header.recordSize >= sizeof(uint16_t) &&
+           page.header.count * page.header.recordSize <= FLASH_LOG_PAGE_PAYLOAD &&
+           page.header.crc == pageCrc(page);
+}
+
+bool FlashLog::readPage(uint32_t sequence, FlashLogPage* page)
+{
+    if (!partition) {
+        return false;
+    }
+
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    bool held = sequence >= firstSequence && sequence < nextSequence;
+    xSemaphoreGive(mutex);
+    if (!held) {
+        return false;
+    }
+
+    // The writer may erase the sector meanwhile: the sequence check catches it
+    return esp_partition_read(partition, (sequence % pageCount) * FLASH_LOG_PAGE_SIZE, page, sizeof(*page)) == ESP_OK &&
+           isValidPage(*page, sequence);
+}
@@ -0,0 +1,125 @@
+#ifndef FLASH_LOG_H
+#define FLASH_LOG_H
+
+#include <Arduino.h>
+#include <esp_partition.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#include "SPSCBuffer.h"
+
+// Append-only ring log of fixed-size records on a raw data partition.
+//
+// Records are packed into 256 byte flash pages, each with a header holding
+// a page sequence number, the timestamp of its first record, the mode and
+// record size of its content, and a CRC. A record starts with a uint16_t
+// dtMs that append() fills, relative to the page timestamp. That is the
+// layout of the binary protocol's RawRecord, so a page is a frame header
+// away from a notification.
+//
+// Page n of the log lives at page n % pageCount of the partition: writing
+// walks the partition in order and erases each 4 KB sector just before its
+// first page, destroying the oldest sector of the ring. Every sector is
+// erased once per pass, which is all the wear levelling a raw NOR partition
+// needs. At boot the log is found again from the first page of each sector.
+//
+// append() only copies into a RAM page; full pages go through a lock-free
+// queue to writePending(), meant for a low priority task, so the flash
+// program and erase times (up to ~50 ms for an erase, during which the
+// caches are off) never land on the sampling path. Appends must be
+// serialized by the caller, reads may come from any task.
+
+#define FLASH_LOG_PARTITION         "flashlog"
+#define FLASH_LOG_PARTITION_SUBTYPE 0x40        // first custom data subtype, see partitions_flashlog.csv
+#define FLASH_LOG_PAGE_SIZE         256
+#define FLASH_LOG_PAGES_PER_SECTOR  (SPI_FLASH_SEC_SIZE / FLASH_LOG_PAGE_SIZE)
+#define FLASH_LOG_PAGE_MAGIC        0x4C
+#define FLASH_LOG_VERSION           1
+
+// Full pages waiting for the writer: 16 pages are 3.2s of 100Hz raw samples
+#ifndef FLASH_LOG_PENDING_PAGES
+#define FLASH_LOG_PENDING_PAGES     16
+#endif
+
+struct __attribute__((packed)) FlashLogPageHeader {
+    uint8_t magic;              // FLASH_LOG_PAGE_MAGIC, 0xFF on an erased page
+    uint8_t version;            // FLASH_LOG_VERSION
+    uint8_t mode;               // what the records are, set by the caller of append()
+    uint8_t recordSize;         // in bytes
+    uint8_t count;              // records in the page
+    uint8_t session;            // incremented by every start()
+    uint16_t crc;               // CRC-16/CCITT of the page, with this field zero
+    uint32_t sequence;          // page number since the log was created
+    uint32_t timestamp;         // in ms, device uptime of the first record
+};
+
+#define FLASH_LOG_PAGE_PAYLOAD      (FLASH_LOG_PAGE_SIZE - sizeof(FlashLogPageHeader))
+
+struct FlashLogPage {
+    FlashLogPageHeader header;
+    uint8_t records[FLASH_LOG_PAGE_PAYLOAD];
+};
+
+class FlashLog {
+public:
+    FlashLog();
+
+    // Finds the partition and the log in it. Returns false without a flashlog partition.
+    bool begin(const char* label = FLASH_LOG_PARTITION);
+    bool isAvailable();
+
+    // Appending only happens between start() and stop(). stop() queues the last, partial page.
+    void start();
+    void stop();
+    bool isRecording();
+
+    // Copies one record into the current page, with its first two bytes set to its dtMs.
+    // Returns false when it can't be logged: not recording, or a bad size.
+    bool append(uint8_t mode, uint32_t timestamp, const void* record, uint8_t size);
+
+    // Writer side: programs the queued pages, then runs a requested erase
+    void writePending();
+    // True when pages are queued or an erase is requested, to wake the writer
+    bool hasPending();
+
+    // Wipes the whole partition from writePending(), sector by sector
+    void requestErase();
+    bool isErasing();
+
+    // Pages currently held, oldest first: [getFirstSequence(), getNextSequence())
+    uint32_t getFirstSequence();
+    uint32_t getNextSequence();
+    uint32_t getCapacity();             // in pages
+    uint32_t getDropped();
+
+    // Reads the page of the given sequence number. Returns false if it is
+    // not in the log anymore, or got corrupted (power lost while writing).
+    bool readPage(uint32_t sequence, FlashLogPage* page);
+
+private:
+    bool readHeader(uint32_t index, FlashLogPageHeader* header);
+    bool isValidPage(const FlashLogPage& page, uint32_t sequence);
+    void sealPage();
+    void writePage(const FlashLogPage& page);
+    void eraseSector(uint32_t sector);
+
+    const esp_partition_t* partition;
+    uint32_t pageCount;
+    SemaphoreHandle_t mutex;            // guards the sequence range against the readers
+
+    volatile bool recording;
+    volatile bool eraseRequested;
+    volatile bool erasing;
+    uint8_t session;
+    uint32_t firstSequence;
+    uint32_t nextSequence;              // the next page to program
+    uint32_t sealedSequence;            // the next page to queue
+    uint32_t dropped;                   // records lost because the writer was behind
+
+    FlashLogPage current;               // filled by append()
+    SPSCBuffer<FlashLogPage, FLASH_LOG_PENDING_PAGES> pending;
+};
+
+uint16_t flashLogCrc(const uint8_t* data, size_t length, uint16_t crc = 0xFFFF);
+
+#endif
@@ -1,99 +0,0 @@
-#include <Arduino.h>
-#include <Wire.h>
-#include <BLEDevice.h>
-#include <BLEServer.h>
-#include <BLEUtils.h>
-#include <BLE2902.h>
-#include "ADXL335.h"
-#include "MAX30100_PulseOximeter.h"
-
-#define REPORTING_PERIOD_MS 500
-
-PulseOximeter pox;
-ADXL335 accel;
-
-float ax = 0.0, ay = 0.0, az = 0.0;
-uint32_t tsLastReport = 0;
-
-BLEServer* bleServer;
-BLEService* bleService;
-BLECharacteristic* customSensorChar;
-
-// Custom BLE UUIDs (randomly generated, stable)
-static const BLEUUID customServiceUUID("12345678-1234-5678-1234-56789abcdef0");
-static const BLEUUID customCharUUID("abcdefab-1234-5678-1234-56789abcdef1");
-
-void setup_oximeter() {
-  Serial.print("Initializing pulse oximeter... ");
-  if (!pox.begin()) {
-    Serial.println("FAILED");
-    while (1);
-  } else {
-    Serial.println("SUCCESS");
-  }
-  pox.setIRLedCurrent(MAX30100_LED_CURR_24MA);  // Set to 24mA for optimal HR/SpO2 signal strength
-}
-
-void setup_accel() {
-  accel.begin();
-}
-
-void setup_ble() {
-  BLEDevice::init("ESP32_Sensor");
-  bleServer = BLEDevice::createServer();
-
-  bleService = bleServer->createService(customServiceUUID);
-
-  customSensorChar = bleService->createCharacteristic(
-    customCharUUID,
-    BLECharacteristic::PROPERTY_NOTIFY | BLECharacteristic::PROPERTY_READ
-  );
-  customSensorChar->addDescriptor(new BLE2902());
-
-  bleService->start();
-
-  BLEAdvertising* bleAdv = BLEDevice::getAdvertising();
-  bleAdv->addServiceUUID(customServiceUUID);
-  bleAdv->setScanResponse(true);
-  bleAdv->setMinPreferred(0x06);  // Helps iPhone compatibility
-  bleAdv->setMinPreferred(0x12);
-  BLEDevice::startAdvertising();
-
-  Serial.println("BLE advertising started.");
-}
-
-void update(float hrf, float spo2f, float ax, float ay, float az) {
-  char buf[128];
-  snprintf(buf, sizeof(buf),
-    "{\"hr\":%.0f,\"spo2\":%.0f,\"ax\":%.2f,\"ay\":%.2f,\"az\":%.2f}",
-    hrf, spo2f, ax, ay, az
-  );
-  customSensorChar->setValue((uint8_t*)buf, strlen(buf));
-  customSensorChar->notify();
-  Serial.println(buf);  // Optional debug print
-}
-
-void setup() {
-  Serial.begin(115200);
-  Wire.begin();
-  Wire.setClock(100000);
-
-  setup_ble();
-  setup_oximeter();
-  setup_accel();
-}
-
-void loop() {
-  pox.update();
-
-  if (millis() - tsLastReport > REPORTING_PERIOD_MS) {
-    float hr = pox.getHeartRate();
-    float spo2 = pox.getSpO2();
-    accel.getAcceleration(&ax, &ay, &az);
-
-    Serial.printf("HR: %.1f | SpO2: %.1f | Accel: {%.2f, %.2f, %.2f}\n", hr, spo2, ax, ay, az);
-
-    update(hr, spo2, ax, ay, az);
-    tsLastReport = millis();
-  }
-}
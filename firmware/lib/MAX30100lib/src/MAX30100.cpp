@@ -16,64 +16,154 @@ You should have received a copy of the GNU General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <Arduino.h>
 #include <Wire.h>
 
 #include "MAX30100.h"
 
-MAX30100::MAX30100()
+// Sampling periods in us, indexed by SamplingRate
+static const uint16_t samplingPeriodsUs[] = {20000, 10000, 5988, 5000, 2500, 1667, 1250, 1000};
+
+MAX30100::MAX30100() :
+    samplingPeriodUs(samplingPeriodsUs[DEFAULT_SAMPLING_RATE]),
+    sampleClockFracUs(0),
+    sampleClockMs(0),
+    droppedSamples(0),
+    shadow(max30100Config(DEFAULT_MODE, DEFAULT_SAMPLING_RATE, DEFAULT_PULSE_WIDTH,
+            DEFAULT_IR_LED_CURRENT, DEFAULT_RED_LED_CURRENT, 0)),
+    shadowValid(false),
+    busSpeed(I2C_BUS_SPEED),
+    busErrors(0),
+    consecutiveBusErrors(0)
 {
 }
 
 bool MAX30100::begin()
 {
     Wire.begin();
-    Wire.setClock(I2C_BUS_SPEED);
+    Wire.setClock(busSpeed);
 
+    // Whatever the chip holds, every register gets written
+    shadowValid = false;
+
+    return applyConfig(max30100Config(DEFAULT_MODE, DEFAULT_SAMPLING_RATE, DEFAULT_PULSE_WIDTH,
+            DEFAULT_IR_LED_CURRENT, DEFAULT_RED_LED_CURRENT, 0));
+}
+
+bool MAX30100::applyConfig(const MAX30100Config& config)
+{
+    // Also tells a dead bus from a sensor that has nothing to change
     if (getPartId() != EXPECTED_PART_ID) {
         return false;
     }
 
-    setMode(DEFAULT_MODE);
-    setLedsPulseWidth(DEFAULT_PULSE_WIDTH);
-    setSamplingRate(DEFAULT_SAMPLING_RATE);
-    setLedsCurrent(DEFAULT_IR_LED_CURRENT, DEFAULT_RED_LED_CURRENT);
-    setHighresModeEnabled(true);
+    bool modeChanged = !shadowValid || shadow.modeConfiguration != config.modeConfiguration;
+    bool spo2Changed = !shadowValid || shadow.spo2Configuration != config.spo2Configuration;
+    bool ledChanged = !shadowValid || shadow.ledConfiguration != config.ledConfiguration;
+    bool interruptsChanged = !shadowValid || shadow.interruptEnable != config.interruptEnable;
+    bool written = true;
+
+    if (interruptsChanged) {
+        written &= writeRegister(MAX30100_REG_INTERRUPT_ENABLE, config.interruptEnable);
+    }
+    if (ledChanged) {
+        written &= writeRegister(MAX30100_REG_LED_CONFIGURATION, config.ledConfiguration);
+    }
+    // Mode and SpO2 configuration are contiguous: one transaction. The first conversion
+    // after a mode change takes a whole sampling period, the SpO2 setting is in by then.
+    if (modeChanged) {
+        const uint8_t values[] = {config.modeConfiguration, config.spo2Configuration};
+        written &= writeRegisters(MAX30100_REG_MODE_CONFIGURATION, values, spo2Changed ? 2 : 1);
+    } else if (spo2Changed) {
+        written &= writeRegister(MAX30100_REG_SPO2_CONFIGURATION, config.spo2Configuration);
+    }
+
+    // Only what the chip acknowledged is known to be there
+    shadow = config;
+    shadowValid = written;
+    samplingPeriodUs = samplingPeriodsUs[(config.spo2Configuration >> 2) & 0x07];
+
+    if ((modeChanged || spo2Changed) && !(config.modeConfiguration & MAX30100_MC_SHDN)) {
+        // What the FIFO holds was sampled with the previous settings
+        resetFifo();
+        anchorSampleClock();
+    }
+
+    if (modeChanged || spo2Changed || interruptsChanged) {
+        // Releases the INT line, a pending flag would keep it low and no edge would come
+        getInterruptStatus();
+    }
+
+    return written;
+}
+
+const MAX30100Config& MAX30100::getConfig()
+{
+    return shadow;
+}
+
+bool MAX30100::reset()
+{
+    // The registers go back to their power-on values, which the shadow doesn't track
+    shadowValid = false;
+    if (!writeRegister(MAX30100_REG_MODE_CONFIGURATION, MAX30100_MC_RESET)) {
+        return false;
+    }
+
+    for (uint8_t i = 0; i < MAX30100_RESET_POLLS; i++) {
+        uint8_t modeConfig = readRegister(MAX30100_REG_MODE_CONFIGURATION);
+        if (consecutiveBusErrors == 0 && !(modeConfig & MAX30100_MC_RESET)) {
+            return true;
+        }
+        delay(1);
+    }
 
-    return true;
+    return false;
 }
 
 void MAX30100::setMode(Mode mode)
 {
-    writeRegister(MAX30100_REG_MODE_CONFIGURATION, mode);
+    writeModeConfiguration(mode);
 }
 
 void MAX30100::setLedsPulseWidth(LEDPulseWidth ledPulseWidth)
 {
-    uint8_t previous = readRegister(MAX30100_REG_SPO2_CONFIGURATION);
-    writeRegister(MAX30100_REG_SPO2_CONFIGURATION, (previous & 0xfc) | ledPulseWidth);
+    writeSpO2Configuration((shadow.spo2Configuration & 0xfc) | ledPulseWidth);
 }
 
 void MAX30100::setSamplingRate(SamplingRate samplingRate)
 {
-    uint8_t previous = readRegister(MAX30100_REG_SPO2_CONFIGURATION);
-    writeRegister(MAX30100_REG_SPO2_CONFIGURATION, (previous & 0xe3) | (samplingRate << 2));
+    writeSpO2Configuration((shadow.spo2Configuration & 0xe3) | (samplingRate << 2));
+    samplingPeriodUs = samplingPeriodsUs[samplingRate];
 }
 
 void MAX30100::setLedsCurrent(LEDCurrent irLedCurrent, LEDCurrent redLedCurrent)
 {
-    writeRegister(MAX30100_REG_LED_CONFIGURATION, redLedCurrent << 4 | irLedCurrent);
+    shadow.ledConfiguration = redLedCurrent << 4 | irLedCurrent;
+    writeRegister(MAX30100_REG_LED_CONFIGURATION, shadow.ledConfiguration);
 }
 
 void MAX30100::setHighresModeEnabled(bool enabled)
 {
-    uint8_t previous = readRegister(MAX30100_REG_SPO2_CONFIGURATION);
     if (enabled) {
-        writeRegister(MAX30100_REG_SPO2_CONFIGURATION, previous | MAX30100_SPC_SPO2_HI_RES_EN);
+        writeSpO2Configuration(shadow.spo2Configuration | MAX30100_SPC_SPO2_HI_RES_EN);
     } else {
-        writeRegister(MAX30100_REG_SPO2_CONFIGURATION, previous & ~MAX30100_SPC_SPO2_HI_RES_EN);
+        writeSpO2Configuration(shadow.spo2Configuration & ~MAX30100_SPC_SPO2_HI_RES_EN);
     }
 }
 
+void MAX30100::setInterruptsEnabled(uint8_t interruptMask)
+{
+    shadow.interruptEnable = interruptMask;
+    writeRegister(MAX30100_REG_INTERRUPT_ENABLE, interruptMask);
+}
+
+uint8_t MAX30100::getInterruptStatus()
+{
+    // Reading the status register clears the pending flags and releases the INT line
+    return readRegister(MAX30100_REG_INTERRUPT_STATUS);
+}
+
 void MAX30100::update()
 {
     readFifoData();
@@ -82,7 +172,7 @@ void MAX30100::update()
 bool MAX30100::getRawValues(uint16_t *ir, uint16_t *red)
 {
     if (!readoutsBuffer.isEmpty()) {
-        SensorReadout readout = readoutsBuffer.pop();
+        SensorReadout readout = readoutsBuffer.shift();
 
         *ir = readout.ir;
         *red = readout.red;
@@ -93,69 +183,211 @@ bool MAX30100::getRawValues(uint16_t *ir, uint16_t *red)
     }
 }
 
+bool MAX30100::getReadout(SensorReadout *readout)
+{
+    if (!readoutsBuffer.isEmpty()) {
+        // Oldest first, so that timestamps are monotonic for the consumer
+        *readout = readoutsBuffer.shift();
+
+        return true;
+    } else {
+        return false;
+    }
+}
+
+size_t MAX30100::readAll(SensorReadout *readouts, size_t maxReadouts)
+{
+    size_t count = 0;
+
+    while (count < maxReadouts && !readoutsBuffer.isEmpty()) {
+        readouts[count++] = readoutsBuffer.shift();
+    }
+
+    return count;
+}
+
+uint32_t MAX30100::getDroppedSamples()
+{
+    return droppedSamples;
+}
+
 void MAX30100::resetFifo()
 {
-    writeRegister(MAX30100_REG_FIFO_WRITE_POINTER, 0);
-    writeRegister(MAX30100_REG_FIFO_READ_POINTER, 0);
-    writeRegister(MAX30100_REG_FIFO_OVERFLOW_COUNTER, 0);
+    // Write pointer, overflow counter and read pointer are contiguous
+    const uint8_t zeros[3] = {0, 0, 0};
+    writeRegisters(MAX30100_REG_FIFO_WRITE_POINTER, zeros, sizeof(zeros));
 }
 
 uint8_t MAX30100::readRegister(uint8_t address)
 {
-    Wire.beginTransmission(MAX30100_I2C_ADDRESS);
-    Wire.write(address);
-    Wire.endTransmission(false);
-    Wire.requestFrom(MAX30100_I2C_ADDRESS, 1);
+    uint8_t value = 0;
+    burstRead(address, &value, 1);
 
-    return Wire.read();
+    return value;
 }
 
-void MAX30100::writeRegister(uint8_t address, uint8_t data)
+bool MAX30100::writeRegister(uint8_t address, uint8_t data)
 {
-    Wire.beginTransmission(MAX30100_I2C_ADDRESS);
-    Wire.write(address);
-    Wire.write(data);
-    Wire.endTransmission();
+    return writeRegisters(address, &data, 1);
 }
 
-void MAX30100::burstRead(uint8_t baseAddress, uint8_t *buffer, uint8_t length)
+bool MAX30100::writeRegisters(uint8_t baseAddress, const uint8_t *data, uint8_t length)
 {
+    // The register pointer increments after each byte, as for the reads
     Wire.beginTransmission(MAX30100_I2C_ADDRESS);
     Wire.write(baseAddress);
-    Wire.endTransmission(false);
-    Wire.requestFrom((uint8_t)MAX30100_I2C_ADDRESS, length);
+    for (uint8_t i = 0; i < length; i++) {
+        Wire.write(data[i]);
+    }
+    bool acknowledged = Wire.endTransmission() == 0;
+    busTransferDone(acknowledged);
 
+    return acknowledged;
+}
+
+void MAX30100::writeModeConfiguration(uint8_t value)
+{
+    // The temperature enable bit clears itself, the shadow never holds it
+    shadow.modeConfiguration = value & ~MAX30100_MC_TEMP_EN;
+    writeRegister(MAX30100_REG_MODE_CONFIGURATION, value);
+}
+
+void MAX30100::writeSpO2Configuration(uint8_t value)
+{
+    shadow.spo2Configuration = value;
+    writeRegister(MAX30100_REG_SPO2_CONFIGURATION, value);
+}
+
+uint8_t MAX30100::burstRead(uint8_t baseAddress, uint8_t *buffer, uint8_t length)
+{
+    Wire.beginTransmission(MAX30100_I2C_ADDRESS);
+    Wire.write(baseAddress);
     uint8_t idx = 0;
-    while (Wire.available()) {
-        buffer[idx++] = Wire.read();
+    if (Wire.endTransmission(false) == 0) {
+        Wire.requestFrom((uint8_t)MAX30100_I2C_ADDRESS, length);
+        while (Wire.available() && idx < length) {
+            buffer[idx++] = Wire.read();
+        }
+    }
+    busTransferDone(idx == length);
+
+    return idx;
+}
+
+void MAX30100::busTransferDone(bool succeeded)
+{
+    if (succeeded) {
+        consecutiveBusErrors = 0;
+        return;
+    }
+
+    ++busErrors;
+    if (consecutiveBusErrors < UINT8_MAX) {
+        ++consecutiveBusErrors;
+    }
+
+    if (busSpeed > I2C_BUS_SPEED_FALLBACK && consecutiveBusErrors >= I2C_BUS_ERRORS_TO_FALLBACK) {
+        busSpeed = I2C_BUS_SPEED_FALLBACK;
+        Wire.setClock(busSpeed);
+        consecutiveBusErrors = 0;
     }
 }
 
 void MAX30100::readFifoData()
 {
     uint8_t buffer[MAX30100_FIFO_DEPTH*4];
+    uint8_t pointers[3];
     uint8_t toRead;
+    uint8_t requested;
+    uint32_t newest = 0;
+    // Taken before the pointers: every sample the FIFO holds was sampled before this
+    uint32_t pointersReadAt = millis();
+
+    // Write pointer, overflow counter and read pointer are contiguous: fetch them in one transaction
+    if (burstRead(MAX30100_REG_FIFO_WRITE_POINTER, pointers, 3) != 3) {
+        return;
+    }
+    toRead = (pointers[0] - pointers[2]) & (MAX30100_FIFO_DEPTH-1);
 
-    toRead = (readRegister(MAX30100_REG_FIFO_WRITE_POINTER) - readRegister(MAX30100_REG_FIFO_READ_POINTER)) & (MAX30100_FIFO_DEPTH-1);
+    // Pointers collide both when the FIFO is empty and when it's full: the overflow counter disambiguates
+    if (!toRead && pointers[1]) {
+        toRead = MAX30100_FIFO_DEPTH;
+    }
 
+    requested = toRead;
     if (toRead) {
-        burstRead(MAX30100_REG_FIFO_DATA, buffer, 4 * toRead);
+        // On a short read the samples left behind are still in the FIFO for the next drain
+        toRead = burstRead(MAX30100_REG_FIFO_DATA, buffer, 4 * toRead) / 4;
 
         for (uint8_t i=0 ; i < toRead ; ++i) {
             // Warning: the values are always left-aligned
-            readoutsBuffer.push({
+            // A false return means the oldest buffered readout has been overwritten
+            bool stored = readoutsBuffer.push({
                     .ir=(uint16_t)((buffer[i*4] << 8) | buffer[i*4 + 1]),
-                    .red=(uint16_t)((buffer[i*4 + 2] << 8) | buffer[i*4 + 3])});
+                    .red=(uint16_t)((buffer[i*4 + 2] << 8) | buffer[i*4 + 3]),
+                    .timestamp=sampleClockMs});
+            if (!stored) {
+                ++droppedSamples;
+            }
+            newest = sampleClockMs;
+            advanceSampleClock(1);
+        }
+    }
+
+    // Samples lost on overflow were taken after the ones still in the FIFO: skip their time slots
+    droppedSamples += pointers[1];
+    advanceSampleClock(pointers[1]);
+
+    if (toRead == requested) {
+        retimeSampleClock(pointersReadAt, toRead > 0, newest);
+    }
+}
+
+void MAX30100::advanceSampleClock(uint8_t samples)
+{
+    // The sample clock runs at the sensor's own pace, regardless of when the FIFO is drained
+    for (uint8_t i=0 ; i < samples ; ++i) {
+        sampleClockFracUs += samplingPeriodUs;
+        while (sampleClockFracUs >= 1000) {
+            sampleClockFracUs -= 1000;
+            ++sampleClockMs;
         }
     }
 }
 
-void MAX30100::startTemperatureSampling()
+void MAX30100::retimeSampleClock(uint32_t pointersReadAt, bool sampled, uint32_t newest)
 {
-    uint8_t modeConfig = readRegister(MAX30100_REG_MODE_CONFIGURATION);
-    modeConfig |= MAX30100_MC_TEMP_EN;
+    // The sensor's oscillator is off its nominal rate by a few percent, so counting periods
+    // alone drifts away from millis(), the time base of the other sensors. With the FIFO
+    // emptied, the next sample is taken within one period after the pointers were read:
+    // the clock is pulled back into that window on every drain.
+    uint32_t periodMs = (samplingPeriodUs + 999) / 1000;
+
+    if ((int32_t)(sampleClockMs - pointersReadAt) < 0) {
+        sampleClockMs = pointersReadAt;
+        sampleClockFracUs = 0;
+    } else if (sampled && (int32_t)(sampleClockMs - (pointersReadAt + periodMs)) > 0) {
+        // Ahead: back, but never to or before the newest sample handed out
+        sampleClockMs = pointersReadAt + periodMs;
+        if ((int32_t)(sampleClockMs - newest) <= 0) {
+            sampleClockMs = newest + 1;
+        }
+        sampleClockFracUs = 0;
+    }
+}
+
+void MAX30100::anchorSampleClock()
+{
+    // Sample times are anchored to the uptime at which sampling (re)starts and never run backwards
+    if ((int32_t)(millis() - sampleClockMs) > 0) {
+        sampleClockMs = millis();
+        sampleClockFracUs = 0;
+    }
+}
 
-    writeRegister(MAX30100_REG_MODE_CONFIGURATION, modeConfig);
+void MAX30100::startTemperatureSampling()
+{
+    writeModeConfiguration(shadow.modeConfiguration | MAX30100_MC_TEMP_EN);
 }
 
 bool MAX30100::isTemperatureReady()
@@ -165,29 +397,38 @@ bool MAX30100::isTemperatureReady()
 
 float MAX30100::retrieveTemperature()
 {
-    int8_t tempInteger = readRegister(MAX30100_REG_TEMPERATURE_DATA_INT);
-    float tempFrac = readRegister(MAX30100_REG_TEMPERATURE_DATA_FRAC);
+    uint8_t data[2] = {0, 0};
+    burstRead(MAX30100_REG_TEMPERATURE_DATA_INT, data, 2);
 
-    return tempFrac * 0.0625 + tempInteger;
+    return data[1] * 0.0625 + (int8_t)data[0];
 }
 
 void MAX30100::shutdown()
 {
-    uint8_t modeConfig = readRegister(MAX30100_REG_MODE_CONFIGURATION);
-    modeConfig |= MAX30100_MC_SHDN;
-
-    writeRegister(MAX30100_REG_MODE_CONFIGURATION, modeConfig);
+    writeModeConfiguration(shadow.modeConfiguration | MAX30100_MC_SHDN);
 }
 
 void MAX30100::resume()
 {
-    uint8_t modeConfig = readRegister(MAX30100_REG_MODE_CONFIGURATION);
-    modeConfig &= ~MAX30100_MC_SHDN;
-
-    writeRegister(MAX30100_REG_MODE_CONFIGURATION, modeConfig);
+    writeModeConfiguration(shadow.modeConfiguration & ~MAX30100_MC_SHDN);
 }
 
 uint8_t MAX30100::getPartId()
 {
     return readRegister(0xff);
 }
+
+uint32_t MAX30100::getBusSpeed()
+{
+    return busSpeed;
+}
+
+uint32_t MAX30100::getBusErrors()
+{
+    return busErrors;
+}
+
+bool MAX30100::isBusStalled()
+{
+    return busSpeed == I2C_BUS_SPEED_FALLBACK && consecutiveBusErrors >= I2C_BUS_ERRORS_STALLED;
+}
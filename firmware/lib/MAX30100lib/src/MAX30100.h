@@ -20,6 +20,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define MAX30100_H
 
 #include <stdint.h>
+#include <stddef.h>
 
 #define CIRCULAR_BUFFER_XS
 #include "CircularBuffer.h"
@@ -33,39 +34,125 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define EXPECTED_PART_ID            0x11
 #define RINGBUFFER_SIZE             16
 
-#define I2C_BUS_SPEED               100000UL  // Using 100kHz for better stability
+// Fast mode, a FIFO burst takes ~1.6ms instead of ~6.3ms at 100kHz. A bus that fails at it
+// (long wires, weak pull-ups) drops to standard mode for good.
+#ifndef I2C_BUS_SPEED
+#define I2C_BUS_SPEED               400000UL
+#endif
+#define I2C_BUS_SPEED_FALLBACK      100000UL
+#define I2C_BUS_ERRORS_TO_FALLBACK  3         // consecutive failed transactions at fast mode
+#define I2C_BUS_ERRORS_STALLED      8         // consecutive failed transactions, see isBusStalled()
+#define MAX30100_RESET_POLLS        10        // 1ms apart, the reset bit clears itself when done
+#define MAX30100_TEMPERATURE_CONVERSION_MS 29   // datasheet tTEMP, the die temperature is ready after it
 
 typedef struct {
     uint16_t ir;
     uint16_t red;
+    uint32_t timestamp;     // in ms of uptime, from the FIFO position and sampling rate, held to millis()
 } SensorReadout;
 
+// Nominal rate of a SamplingRate setting, in Hz
+constexpr uint16_t samplingRateHz(SamplingRate samplingRate)
+{
+    const uint16_t rates[] = {50, 100, 167, 200, 400, 600, 800, 1000};
+    return rates[samplingRate];
+}
+
+// The registers a sensing configuration is made of, as written to the chip
+typedef struct {
+    uint8_t modeConfiguration;      // Mode, with MAX30100_MC_SHDN to power down
+    uint8_t spo2Configuration;      // SamplingRate << 2 | LEDPulseWidth, MAX30100_SPC_SPO2_HI_RES_EN
+    uint8_t ledConfiguration;       // red LEDCurrent << 4 | IR LEDCurrent
+    uint8_t interruptEnable;        // MAX30100_IE_ENB_* mask
+} MAX30100Config;
+
+constexpr MAX30100Config max30100Config(Mode mode, SamplingRate samplingRate, LEDPulseWidth ledPulseWidth,
+        LEDCurrent irLedCurrent, LEDCurrent redLedCurrent, uint8_t interruptMask, bool highresEnabled=true)
+{
+    return {(uint8_t)mode,
+            (uint8_t)(samplingRate << 2 | ledPulseWidth | (highresEnabled ? MAX30100_SPC_SPO2_HI_RES_EN : 0)),
+            (uint8_t)(redLedCurrent << 4 | irLedCurrent),
+            interruptMask};
+}
+
+// Widest LED pulse width (hence highest ADC resolution) the SpO2 mode supports at a sampling rate
+constexpr LEDPulseWidth spO2MaxPulseWidth(SamplingRate samplingRate)
+{
+    return samplingRate <= MAX30100_SAMPRATE_100HZ ? MAX30100_SPC_PW_1600US_16BITS :
+            samplingRate <= MAX30100_SAMPRATE_200HZ ? MAX30100_SPC_PW_800US_15BITS :
+            samplingRate <= MAX30100_SAMPRATE_400HZ ? MAX30100_SPC_PW_400US_14BITS :
+            MAX30100_SPC_PW_200US_13BITS;
+}
+
 class MAX30100 {
 public:
     MAX30100();
     bool begin();
+    // Moves the sensor to a configuration, writing only the registers that differ from the
+    // shadow copy the driver keeps of them (all of them after begin() or reset()), mode and
+    // SpO2 configuration in one transaction. The FIFO and the sample clock only restart when
+    // sampling itself changes: mode, power, sampling rate or pulse width.
+    // Returns false when the part doesn't answer or a write isn't acknowledged.
+    bool applyConfig(const MAX30100Config& config);
+    // The configuration last written, the setters below keep it up to date
+    const MAX30100Config& getConfig();
+    // Power-on reset of the registers
+    bool reset();
     void setMode(Mode mode);
     void setLedsPulseWidth(LEDPulseWidth ledPulseWidth);
     void setSamplingRate(SamplingRate samplingRate);
     void setLedsCurrent(LEDCurrent irLedCurrent, LEDCurrent redLedCurrent);
     void setHighresModeEnabled(bool enabled);
+    void setInterruptsEnabled(uint8_t interruptMask);
+    uint8_t getInterruptStatus();
     void update();
     bool getRawValues(uint16_t *ir, uint16_t *red);
+    bool getReadout(SensorReadout *readout);
+    size_t readAll(SensorReadout *readouts, size_t maxReadouts);
+    uint32_t getDroppedSamples();
     void resetFifo();
+    // One die temperature conversion, alongside the SpO2/HR sampling. The result can be
+    // retrieved MAX30100_TEMPERATURE_CONVERSION_MS later without polling isTemperatureReady().
     void startTemperatureSampling();
     bool isTemperatureReady();
+    // Both temperature registers in one transaction
     float retrieveTemperature();
     void shutdown();
     void resume();
     uint8_t getPartId();
 
+    // I2C health: the bus speed in use, and failed transactions (NACK, timeout, short read)
+    uint32_t getBusSpeed();
+    uint32_t getBusErrors();
+    // True once several transactions in a row failed at the fallback speed: the bus is likely
+    // held by a slave stuck mid-byte, the owner of the pins has to clear it
+    bool isBusStalled();
+
 private:
     CircularBuffer<SensorReadout, RINGBUFFER_SIZE> readoutsBuffer;
+    uint16_t samplingPeriodUs;
+    uint16_t sampleClockFracUs;
+    uint32_t sampleClockMs;
+    uint32_t droppedSamples;
+    // Configuration registers as last written: the setters never read them back. Invalid
+    // until begin() or after reset(), when the chip state isn't known.
+    MAX30100Config shadow;
+    bool shadowValid;
+    uint32_t busSpeed;
+    uint32_t busErrors;
+    uint8_t consecutiveBusErrors;
 
     uint8_t readRegister(uint8_t address);
-    void writeRegister(uint8_t address, uint8_t data);
-    void burstRead(uint8_t baseAddress, uint8_t *buffer, uint8_t length);
+    bool writeRegister(uint8_t address, uint8_t data);
+    bool writeRegisters(uint8_t baseAddress, const uint8_t *data, uint8_t length);
+    void writeModeConfiguration(uint8_t value);
+    void writeSpO2Configuration(uint8_t value);
+    uint8_t burstRead(uint8_t baseAddress, uint8_t *buffer, uint8_t length);
+    void busTransferDone(bool succeeded);
     void readFifoData();
+    void advanceSampleClock(uint8_t samples);
+    void retimeSampleClock(uint32_t pointersReadAt, bool sampled, uint32_t newest);
+    void anchorSampleClock();
 };
 
 #endif
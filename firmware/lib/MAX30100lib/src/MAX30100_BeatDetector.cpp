@@ -16,8 +16,6 @@ You should have received a copy of the GNU General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
-#include <Arduino.h>
-
 #include "MAX30100_BeatDetector.h"
 
 #ifndef min
@@ -27,18 +25,20 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
      _a < _b ? _a : _b; })
 #endif
 
-BeatDetector::BeatDetector() :
+BeatDetector::BeatDetector(float samplesPeriod) :
     state(BEATDETECTOR_STATE_INIT),
-    threshold(BEATDETECTOR_MIN_THRESHOLD),
+    samplesPeriod(samplesPeriod),
+    threshold(DSP_SAMPLE(BEATDETECTOR_MIN_THRESHOLD)),
     beatPeriod(0),
     lastMaxValue(0),
+    thresholdFalloff(0),
     tsLastBeat(0)
 {
 }
 
-bool BeatDetector::addSample(float sample)
+bool BeatDetector::addSample(dsp_sample_t sample, uint32_t timestamp)
 {
-    return checkForBeat(sample);
+    return checkForBeat(sample, timestamp);
 }
 
 float BeatDetector::getRate()
@@ -50,32 +50,38 @@ float BeatDetector::getRate()
     }
 }
 
-float BeatDetector::getCurrentThreshold()
+dsp_sample_t BeatDetector::getCurrentThreshold()
 {
     return threshold;
 }
 
-bool BeatDetector::checkForBeat(float sample)
+uint32_t BeatDetector::getLastBeatTimestamp()
+{
+    return tsLastBeat;
+}
+
+bool BeatDetector::checkForBeat(dsp_sample_t sample, uint32_t timestamp)
 {
     bool beatDetected = false;
 
     switch (state) {
         case BEATDETECTOR_STATE_INIT:
-            if (millis() > BEATDETECTOR_INIT_HOLDOFF) {
+            if (timestamp > BEATDETECTOR_INIT_HOLDOFF) {
                 state = BEATDETECTOR_STATE_WAITING;
             }
             break;
 
         case BEATDETECTOR_STATE_WAITING:
             if (sample > threshold) {
-                threshold = min(sample, BEATDETECTOR_MAX_THRESHOLD);
+                threshold = min(sample, DSP_SAMPLE(BEATDETECTOR_MAX_THRESHOLD));
                 state = BEATDETECTOR_STATE_FOLLOWING_SLOPE;
             }
 
             // Tracking lost, resetting
-            if (millis() - tsLastBeat > BEATDETECTOR_INVALID_READOUT_DELAY) {
+            if (timestamp - tsLastBeat > BEATDETECTOR_INVALID_READOUT_DELAY) {
                 beatPeriod = 0;
                 lastMaxValue = 0;
+                thresholdFalloff = 0;
             }
 
             decreaseThreshold();
@@ -85,30 +91,31 @@ bool BeatDetector::checkForBeat(float sample)
             if (sample < threshold) {
                 state = BEATDETECTOR_STATE_MAYBE_DETECTED;
             } else {
-                threshold = min(sample, BEATDETECTOR_MAX_THRESHOLD);
+                threshold = min(sample, DSP_SAMPLE(BEATDETECTOR_MAX_THRESHOLD));
             }
             break;
 
         case BEATDETECTOR_STATE_MAYBE_DETECTED:
-            if (sample + BEATDETECTOR_STEP_RESILIENCY < threshold) {
+            if (sample + DSP_SAMPLE(BEATDETECTOR_STEP_RESILIENCY) < threshold) {
                 // Found a beat
                 beatDetected = true;
                 lastMaxValue = sample;
                 state = BEATDETECTOR_STATE_MASKING;
-                float delta = millis() - tsLastBeat;
+                float delta = timestamp - tsLastBeat;
                 if (delta) {
                     beatPeriod = BEATDETECTOR_BPFILTER_ALPHA * delta +
                             (1 - BEATDETECTOR_BPFILTER_ALPHA) * beatPeriod;
                 }
+                updateThresholdFalloff();
 
-                tsLastBeat = millis();
+                tsLastBeat = timestamp;
             } else {
                 state = BEATDETECTOR_STATE_FOLLOWING_SLOPE;
             }
             break;
 
         case BEATDETECTOR_STATE_MASKING:
-            if (millis() - tsLastBeat > BEATDETECTOR_MASKING_HOLDOFF) {
+            if (timestamp - tsLastBeat > BEATDETECTOR_MASKING_HOLDOFF) {
                 state = BEATDETECTOR_STATE_WAITING;
             }
             decreaseThreshold();
@@ -122,14 +129,29 @@ void BeatDetector::decreaseThreshold()
 {
     // When a valid beat rate readout is present, target the
     if (lastMaxValue > 0 && beatPeriod > 0) {
-        threshold -= lastMaxValue * (1 - BEATDETECTOR_THRESHOLD_FALLOFF_TARGET) /
-                (beatPeriod / BEATDETECTOR_SAMPLES_PERIOD);
+        threshold -= thresholdFalloff;
     } else {
         // Asymptotic decay
+#if MAX30100_FIXED_POINT
+        threshold = Q15_MUL(threshold, Q15(BEATDETECTOR_THRESHOLD_DECAY_FACTOR));
+#else
         threshold *= BEATDETECTOR_THRESHOLD_DECAY_FACTOR;
+#endif
     }
 
-    if (threshold < BEATDETECTOR_MIN_THRESHOLD) {
-        threshold = BEATDETECTOR_MIN_THRESHOLD;
+    if (threshold < DSP_SAMPLE(BEATDETECTOR_MIN_THRESHOLD)) {
+        threshold = DSP_SAMPLE(BEATDETECTOR_MIN_THRESHOLD);
+    }
+}
+
+void BeatDetector::updateThresholdFalloff()
+{
+    // Spreads the falloff over a beat period worth of samples: this only changes on
+    // beats, so the division stays out of the per-sample path
+    if (beatPeriod > 0) {
+        thresholdFalloff = lastMaxValue * (1 - BEATDETECTOR_THRESHOLD_FALLOFF_TARGET) /
+                (beatPeriod / samplesPeriod);
+    } else {
+        thresholdFalloff = 0;
     }
 }
@@ -21,6 +21,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <stdint.h>
 
+#include "MAX30100_FixedPoint.h"
+
 #define BEATDETECTOR_INIT_HOLDOFF                2000    // in ms, how long to wait before counting
 #define BEATDETECTOR_MASKING_HOLDOFF             200     // in ms, non-retriggerable window after beat detection
 #define BEATDETECTOR_BPFILTER_ALPHA              0.6     // EMA factor for the beat period value
@@ -30,7 +32,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define BEATDETECTOR_THRESHOLD_FALLOFF_TARGET    0.3     // thr chasing factor of the max value when beat
 #define BEATDETECTOR_THRESHOLD_DECAY_FACTOR      0.99    // thr chasing factor when no beat
 #define BEATDETECTOR_INVALID_READOUT_DELAY       2000    // in ms, no-beat time to cause a reset
-#define BEATDETECTOR_SAMPLES_PERIOD              10      // in ms, 1/Fs
+#define BEATDETECTOR_SAMPLES_PERIOD              10      // in ms, 1/Fs, default
 
 
 typedef enum BeatDetectorState {
@@ -45,19 +47,25 @@ typedef enum BeatDetectorState {
 class BeatDetector
 {
 public:
-    BeatDetector();
-    bool addSample(float sample);
+    BeatDetector(float samplesPeriod=BEATDETECTOR_SAMPLES_PERIOD);
+    bool addSample(dsp_sample_t sample, uint32_t timestamp);
     float getRate();
-    float getCurrentThreshold();
+    dsp_sample_t getCurrentThreshold();
+    // 0 until the first beat
+    uint32_t getLastBeatTimestamp();
 
 private:
-    bool checkForBeat(float value);
+    bool checkForBeat(dsp_sample_t value, uint32_t timestamp);
     void decreaseThreshold();
+    void updateThresholdFalloff();
 
     BeatDetectorState state;
-    float threshold;
+    float samplesPeriod;
+    dsp_sample_t threshold;
     float beatPeriod;
-    float lastMaxValue;
+    dsp_sample_t lastMaxValue;
+    // Per-sample threshold decrement while a beat rate is known, refreshed on every beat
+    dsp_sample_t thresholdFalloff;
     uint32_t tsLastBeat;
 };
 
@@ -19,19 +19,36 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #ifndef MAX30100_FILTERS_H
 #define MAX30100_FILTERS_H
 
+#include <stddef.h>
+#include <stdint.h>
+
+#include "MAX30100_FixedPoint.h"
+
 // http://www.schwietering.com/jayduino/filtuino/
 // Low pass butterworth filter order=1 alpha1=0.1
-// Fs=100Hz, Fc=6Hz
+// Fs=100Hz, Fc=10Hz (alpha1 is Fc/Fs)
+// Superseded by ButterworthLowpass<100, 10000, 1>, kept for existing sketches
 class  FilterBuLp1
 {
 	public:
 		FilterBuLp1()
 		{
-			v[0]=0.0;
+			v[0]=0;
+			v[1]=0;
 		}
 	private:
-		float v[2];
+		dsp_sample_t v[2];
 	public:
+#if MAX30100_FIXED_POINT
+		dsp_sample_t step(dsp_sample_t x) //class II
+		{
+			v[0] = v[1];
+			v[1] = (dsp_sample_t)(((int64_t)Q15(2.452372752527856026e-1) * x
+				 + (int64_t)Q15(0.50952544949442879485) * v[0] + (1 << 14)) >> 15);
+			return
+				 (v[0] + v[1]);
+		}
+#else
 		float step(float x) //class II
 		{
 			v[0] = v[1];
@@ -40,15 +57,31 @@ class  FilterBuLp1
 			return
 				 (v[0] + v[1]);
 		}
+#endif
 };
 
 // http://sam-koblenski.blogspot.de/2015/11/everyday-dsp-for-programmers-dc-and.html
+// Superseded by DCBlocker, kept for existing sketches
 class DCRemover
 {
 public:
 	DCRemover() : alpha(0), dcw(0)
 	{
 	}
+#if MAX30100_FIXED_POINT
+	DCRemover(float alpha_) : alpha(Q15(alpha_)), dcw(0)
+	{
+	}
+
+	// Takes raw ADC counts, returns the AC component as Q8 counts
+	dsp_sample_t step(uint16_t x)
+	{
+		dsp_sample_t olddcw = dcw;
+		dcw = ((dsp_sample_t)x << DSP_SAMPLE_FRAC_BITS) + Q15_MUL(alpha, dcw);
+
+		return dcw - olddcw;
+	}
+#else
 	DCRemover(float alpha_) : alpha(alpha_), dcw(0)
 	{
 	}
@@ -60,15 +93,290 @@ public:
 
 		return dcw - olddcw;
 	}
+#endif
 
-	float getDCW()
+	dsp_sample_t getDCW()
 	{
 		return dcw;
 	}
 
 private:
+#if MAX30100_FIXED_POINT
+	int32_t alpha;
+#else
 	float alpha;
-	float dcw;
+#endif
+	dsp_sample_t dcw;
+};
+
+// Filters designed at compile time for a sampling rate Fs (in Hz) and a cutoff
+// (in mHz: floating point template parameters need C++20). The design runs in
+// constexpr double precision, only the rounded coefficients end up in flash.
+namespace filterdesign {
+
+constexpr double PI = 3.14159265358979323846;
+
+// Taylor series, plenty of terms for doubles over the [-pi, pi] used here
+constexpr double sin(double x)
+{
+	double term = x, sum = x;
+	for (int n = 1; n < 20; n++) {
+		term *= -x * x / ((2 * n) * (2 * n + 1));
+		sum += term;
+	}
+	return sum;
+}
+
+constexpr double cos(double x)
+{
+	double term = 1, sum = 1;
+	for (int n = 1; n < 20; n++) {
+		term *= -x * x / ((2 * n - 1) * (2 * n));
+		sum += term;
+	}
+	return sum;
+}
+
+constexpr double tan(double x)
+{
+	return sin(x) / cos(x);
+}
+
+constexpr double exp(double x)
+{
+	double term = 1, sum = 1;
+	for (int n = 1; n < 40; n++) {
+		term *= x / n;
+		sum += term;
+	}
+	return sum;
+}
+
+// a0 normalised to 1
+struct BiquadCoefficients {
+	double b0, b1, b2, a1, a2;
+};
+
+// Bilinear transform with a prewarped cutoff, q <= 0 designs a first order section
+constexpr BiquadCoefficients lowpass(double fs, double fc, double q)
+{
+	double k = tan(PI * fc / fs);
+	if (q <= 0) {
+		return {k / (1 + k), k / (1 + k), 0, (k - 1) / (k + 1), 0};
+	}
+	double norm = 1 / (1 + k / q + k * k);
+	return {k * k * norm, 2 * k * k * norm, k * k * norm, 2 * (k * k - 1) * norm, (1 - k / q + k * k) * norm};
+}
+
+// Q of a pole pair of a Butterworth of the given order, 0 for the real pole of odd orders (last section)
+constexpr double butterworthQ(uint8_t order, uint8_t section)
+{
+	if (order % 2) {
+		return section == order / 2 ? 0 : 1 / (2 * cos(PI * (section + 1) / order));
+	}
+	return 1 / (2 * cos(PI * (2 * section + 1) / (2 * order)));
+}
+
+} // namespace filterdesign
+
+struct BiquadSection {
+	dsp_coeff_t b0, b1, b2, a1, a2;
+};
+
+struct BiquadState {
+	dsp_sample_t x1, x2, y1, y2;
+};
+
+// Direct form I: only inputs and outputs are kept, which is what fixed point wants
+inline dsp_sample_t stepBiquad(const BiquadSection& c, BiquadState& s, dsp_sample_t x, bool firstOrder)
+{
+#if MAX30100_FIXED_POINT
+	int64_t acc = (int64_t)c.b0 * x + (int64_t)c.b1 * s.x1 - (int64_t)c.a1 * s.y1;
+	if (!firstOrder) {
+		acc += (int64_t)c.b2 * s.x2 - (int64_t)c.a2 * s.y2;
+	}
+	dsp_sample_t y = (dsp_sample_t)((acc + (1L << (DSP_COEFF_FRAC_BITS - 1))) >> DSP_COEFF_FRAC_BITS);
+#else
+	dsp_sample_t y = c.b0 * x + c.b1 * s.x1 - c.a1 * s.y1;
+	if (!firstOrder) {
+		y += c.b2 * s.x2 - c.a2 * s.y2;
+	}
+#endif
+	s.x2 = s.x1;
+	s.x1 = x;
+	s.y2 = s.y1;
+	s.y1 = y;
+	return y;
+}
+
+// Same over a block, in place allowed: the state only goes back to memory at the end
+inline void stepBiquadBlock(const BiquadSection& c, BiquadState& state, const dsp_sample_t* in,
+		dsp_sample_t* out, size_t n, bool firstOrder)
+{
+	BiquadState s = state;
+	for (size_t i = 0; i < n; i++) {
+		out[i] = stepBiquad(c, s, in[i], firstOrder);
+	}
+	state = s;
+}
+
+// Butterworth low pass of any order, as a cascade of biquads (plus a first order section for odd orders)
+template<uint32_t Fs, uint32_t CutoffMilliHz, uint8_t Order = 2>
+class ButterworthLowpass
+{
+	static_assert(Order > 0, "The filter order must be at least 1");
+	static_assert(CutoffMilliHz > 0 && CutoffMilliHz < Fs * 500, "The cutoff must be between 0 and Fs/2");
+
+public:
+	ButterworthLowpass() : state()
+	{
+	}
+
+	dsp_sample_t step(dsp_sample_t x)
+	{
+		for (uint8_t i = 0; i < Sections; i++) {
+			x = stepBiquad(design.sections[i], state[i], x, Order % 2 && i == Sections - 1);
+		}
+		return x;
+	}
+
+	// One section at a time over the whole block, in place allowed
+	void stepBlock(const dsp_sample_t* in, dsp_sample_t* out, size_t n)
+	{
+		for (uint8_t i = 0; i < Sections; i++) {
+			stepBiquadBlock(design.sections[i], state[i], i == 0 ? in : out, out, n, Order % 2 && i == Sections - 1);
+		}
+	}
+
+private:
+	static constexpr uint8_t Sections = (Order + 1) / 2;
+
+	struct Design {
+		BiquadSection sections[Sections];
+	};
+
+	static constexpr Design makeDesign()
+	{
+		Design d = {};
+		for (uint8_t i = 0; i < Sections; i++) {
+			filterdesign::BiquadCoefficients c = filterdesign::lowpass(Fs, CutoffMilliHz / 1000.0,
+					filterdesign::butterworthQ(Order, i));
+			d.sections[i] = {DSP_COEFF(c.b0), DSP_COEFF(c.b1), DSP_COEFF(c.b2), DSP_COEFF(c.a1), DSP_COEFF(c.a2)};
+		}
+		return d;
+	}
+
+	static constexpr Design design = makeDesign();
+
+	BiquadState state[Sections];
+};
+
+// First order DC blocker, y[n] = x[n] - x[n-1] + alpha * y[n-1] with the pole placed
+// for the cutoff. Same response as DCRemover, but the state never exceeds the signal
+// swing, so it neither loses float precision nor overflows at kHz sampling rates
+template<uint32_t Fs, uint32_t CutoffMilliHz>
+class DCBlocker
+{
+	static_assert(CutoffMilliHz > 0 && CutoffMilliHz < Fs * 500, "The cutoff must be between 0 and Fs/2");
+
+public:
+	DCBlocker() : x1(0), y1(0)
+	{
+	}
+
+	dsp_sample_t step(dsp_sample_t x)
+	{
+#if MAX30100_FIXED_POINT
+		dsp_sample_t y = x - x1 + (dsp_sample_t)(((int64_t)alpha * y1 + (1L << (DSP_COEFF_FRAC_BITS - 1)))
+				>> DSP_COEFF_FRAC_BITS);
+#else
+		dsp_sample_t y = x - x1 + alpha * y1;
+		// On a constant input (an accelerometer axis at rest) y decays into denormals, which
+		// cost the FPU several times a normal operation in this and every stage after it
+		if (y > -DENORMAL_FLUSH && y < DENORMAL_FLUSH) {
+			y = 0;
+		}
+#endif
+		x1 = x;
+		y1 = y;
+		return y;
+	}
+
+	// In place allowed
+	void stepBlock(const dsp_sample_t* in, dsp_sample_t* out, size_t n)
+	{
+		for (size_t i = 0; i < n; i++) {
+			out[i] = step(in[i]);
+		}
+	}
+
+	// The DC level the last sample was stripped of
+	dsp_sample_t getDC()
+	{
+		return x1 - y1;
+	}
+
+private:
+	static constexpr dsp_coeff_t alpha = DSP_COEFF(filterdesign::exp(-2 * filterdesign::PI * CutoffMilliHz / 1000.0 / Fs));
+#if !MAX30100_FIXED_POINT
+	// Far below a count or a mg; squared or scaled by a weight, still far from the denormals
+	static constexpr float DENORMAL_FLUSH = 1e-10f;
+#endif
+
+	dsp_sample_t x1;
+	dsp_sample_t y1;
+};
+
+// Stages applied in order, e.g. FilterChain<DCBlocker<400, 500>, ButterworthLowpass<400, 6000, 4>>
+template<typename... Stages>
+class FilterChain;
+
+template<>
+class FilterChain<>
+{
+public:
+	dsp_sample_t step(dsp_sample_t x)
+	{
+		return x;
+	}
+
+	void stepBlock(const dsp_sample_t* in, dsp_sample_t* out, size_t n)
+	{
+		for (size_t i = 0; in != out && i < n; i++) {
+			out[i] = in[i];
+		}
+	}
+};
+
+template<typename First, typename... Rest>
+class FilterChain<First, Rest...>
+{
+public:
+	dsp_sample_t step(dsp_sample_t x)
+	{
+		return rest.step(first.step(x));
+	}
+
+	// Stage by stage over the whole block, in place allowed
+	void stepBlock(const dsp_sample_t* in, dsp_sample_t* out, size_t n)
+	{
+		first.stepBlock(in, out, n);
+		rest.stepBlock(out, out, n);
+	}
+
+	template<size_t I>
+	auto& stage()
+	{
+		if constexpr (I == 0) {
+			return first;
+		} else {
+			return rest.template stage<I - 1>();
+		}
+	}
+
+private:
+	First first;
+	FilterChain<Rest...> rest;
 };
 
 #endif
@@ -0,0 +1,65 @@
+/*
+Arduino-MAX30100 oximetry / heart rate integrated sensor library
+Copyright (C) 2016  OXullo Intersecans <x@brainrapers.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MAX30100_FIXEDPOINT_H
+#define MAX30100_FIXEDPOINT_H
+
+#include <stdint.h>
+
+// Build with -DMAX30100_FIXED_POINT=1 to run the per-sample chain (DC removal,
+// low-pass, beat detection, SpO2 accumulators) on integers only, for MCUs
+// without an FPU. Per-beat bookkeeping (beat period, rate) stays in float.
+#ifndef MAX30100_FIXED_POINT
+#define MAX30100_FIXED_POINT    0
+#endif
+
+#if MAX30100_FIXED_POINT
+
+// Signal values are Q8 ADC counts: a 16 bits readout times the 20x DC gain
+// of the DC remover still leaves 2 bits of headroom in an int32_t
+typedef int32_t dsp_sample_t;
+
+#define DSP_SAMPLE_FRAC_BITS    8
+#define DSP_SAMPLE(x)           ((dsp_sample_t)((x) * (1L << DSP_SAMPLE_FRAC_BITS)))
+#define DSP_TO_FLOAT(x)         ((float)(x) / (1L << DSP_SAMPLE_FRAC_BITS))
+
+// Q15 coefficients, products are taken on 64 bits and rounded back
+#define Q15(x)                  ((int32_t)((x) * 32768.0 + 0.5))
+#define Q15_MUL(a, b)           ((dsp_sample_t)(((int64_t)(a) * (b) + (1 << 14)) >> 15))
+
+// Filter coefficients are Q30: biquad feedback coefficients span (-2, 2), and
+// poles close to the unit circle at high sampling rates need the resolution
+typedef int32_t dsp_coeff_t;
+
+#define DSP_COEFF_FRAC_BITS     30
+#define DSP_COEFF(x)            ((dsp_coeff_t)((x) * (1L << DSP_COEFF_FRAC_BITS) + ((x) < 0 ? -0.5 : 0.5)))
+
+#else
+
+typedef float dsp_sample_t;
+
+#define DSP_SAMPLE(x)           ((dsp_sample_t)(x))
+#define DSP_TO_FLOAT(x)         ((float)(x))
+
+typedef float dsp_coeff_t;
+
+#define DSP_COEFF(x)            ((dsp_coeff_t)(x))
+
+#endif
+
+#endif
@@ -0,0 +1,156 @@
+/*
+Arduino-MAX30100 oximetry / heart rate integrated sensor library
+Copyright (C) 2016  OXullo Intersecans <x@brainrapers.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MAX30100_MOTIONCANCELLER_H
+#define MAX30100_MOTIONCANCELLER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "MAX30100_FixedPoint.h"
+#include "MAX30100_Filters.h"
+
+#define MOTIONCANCELLER_TAPS                4       // per axis, accelerometer history the artifact is fitted on
+#define MOTIONCANCELLER_STEP                0.02    // NLMS step size
+#define MOTIONCANCELLER_MIN_REFERENCE_MG    20      // rms per tap under which the weights hardly move
+
+// One accelerometer reading taken with a PPG sample, in mg
+struct MotionSample {
+	int16_t x;
+	int16_t y;
+	int16_t z;
+};
+
+/*
+ * Normalized LMS canceller of motion artifacts. The three accelerometer axes go
+ * through a DC blocker with the PPG's cutoff, so that both see motion the same
+ * way, and the last Taps readings of each are the reference. The filter output,
+ * the part of the AC signal the motion explains, is taken off it, and the
+ * weights follow the residual: what comes out is the pulse, uncorrelated with
+ * the motion.
+ *
+ * The step is normalized by the reference power plus a floor: at rest the
+ * accelerometer noise teaches the weights nothing, and they keep what they
+ * learned until the next movement. 3 * Taps multiply-accumulates twice per
+ * sample; the fixed point build normalizes by the power of two above the
+ * reference power, a shift instead of a division.
+ */
+template<uint32_t Fs, uint32_t DCCutoffMilliHz, uint8_t Taps = MOTIONCANCELLER_TAPS>
+class MotionCanceller
+{
+	static_assert(Taps > 0, "At least one tap per axis");
+
+public:
+	static const size_t Weights = 3 * Taps;
+
+	MotionCanceller()
+	{
+		reset();
+	}
+
+	void reset()
+	{
+		axes[0] = axes[1] = axes[2] = DCBlocker<Fs, DCCutoffMilliHz>();
+		for (size_t k = 0; k < Weights; k++) {
+			reference[k] = 0;
+			weights[k] = 0;
+		}
+	}
+
+	// Takes the AC value and the accelerometer reading of the same sample, returns the AC value less the artifact
+	dsp_sample_t step(dsp_sample_t x, const MotionSample& motion)
+	{
+		// Newest reading of each axis first
+		for (size_t k = Weights - 1; k >= 3; k--) {
+			reference[k] = reference[k - 3];
+		}
+		reference[0] = axes[0].step(DSP_SAMPLE(motion.x));
+		reference[1] = axes[1].step(DSP_SAMPLE(motion.y));
+		reference[2] = axes[2].step(DSP_SAMPLE(motion.z));
+
+#if MAX30100_FIXED_POINT
+		int64_t artifact = 0;
+		uint64_t power = REGULARIZATION;
+		for (size_t k = 0; k < Weights; k++) {
+			artifact += (int64_t)weights[k] * reference[k];
+			power += (uint64_t)((int64_t)reference[k] * reference[k]);
+		}
+		dsp_sample_t e = x - (dsp_sample_t)(artifact >> WEIGHT_FRAC_BITS);
+
+		// w += mu * e * r / power, with power rounded up to 2^bits: e * r and the power are both
+		// Q16, the weights Q16, mu Q15
+		int shift = 64 - __builtin_clzll(power) + 15 - WEIGHT_FRAC_BITS;
+		for (size_t k = 0; k < Weights; k++) {
+			weights[k] += (int32_t)(((int64_t)e * reference[k] * STEP) >> shift);
+		}
+#else
+		float artifact = 0;
+		float power = REGULARIZATION;
+		for (size_t k = 0; k < Weights; k++) {
+			artifact += weights[k] * reference[k];
+			power += reference[k] * reference[k];
+		}
+		dsp_sample_t e = x - artifact;
+
+		float step = STEP * e / power;
+		for (size_t k = 0; k < Weights; k++) {
+			weights[k] += step * reference[k];
+		}
+#endif
+		return e;
+	}
+
+	void stepBlock(const dsp_sample_t* in, const MotionSample* motion, dsp_sample_t* out, size_t n)
+	{
+		for (size_t i = 0; i < n; i++) {
+			out[i] = step(in[i], motion[i]);
+		}
+	}
+
+	// Artifact per mg of the k-th reference, newest taps first, x y z interleaved
+	float getWeight(size_t k)
+	{
+#if MAX30100_FIXED_POINT
+		return (float)weights[k] / (1L << WEIGHT_FRAC_BITS);
+#else
+		return weights[k];
+#endif
+	}
+
+private:
+#if MAX30100_FIXED_POINT
+	static const int WEIGHT_FRAC_BITS = 16;
+	static const int64_t STEP = Q15(MOTIONCANCELLER_STEP);
+	// Q16 squared mg
+	static const uint64_t REGULARIZATION = (uint64_t)Weights * MOTIONCANCELLER_MIN_REFERENCE_MG *
+			MOTIONCANCELLER_MIN_REFERENCE_MG << (2 * DSP_SAMPLE_FRAC_BITS);
+
+	int32_t weights[Weights];
+#else
+	static constexpr float STEP = MOTIONCANCELLER_STEP;
+	static constexpr float REGULARIZATION = (float)Weights * MOTIONCANCELLER_MIN_REFERENCE_MG *
+			MOTIONCANCELLER_MIN_REFERENCE_MG;
+
+	float weights[Weights];
+#endif
+
+	DCBlocker<Fs, DCCutoffMilliHz> axes[3];
+	dsp_sample_t reference[Weights];
+};
+
+#endif
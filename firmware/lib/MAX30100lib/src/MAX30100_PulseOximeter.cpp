@@ -23,12 +23,30 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 PulseOximeter::PulseOximeter() :
     state(PULSEOXIMETER_STATE_INIT),
+    debuggingMode(PULSEOXIMETER_DEBUGGINGMODE_NONE),
     tsFirstBeatDetected(0),
     tsLastBeatDetected(0),
     tsLastBiasCheck(0),
     tsLastCurrentAdjustment(0),
+    beatDetector(1000.0 / SAMPLING_FREQUENCY),
     redLedCurrentIndex((uint8_t)RED_LED_CURRENT_START),
     irLedCurrent(DEFAULT_IR_LED_CURRENT),
+    hrm(ownHrm),
+    onBeatDetected(NULL)
+{
+}
+
+PulseOximeter::PulseOximeter(MAX30100& sensor) :
+    state(PULSEOXIMETER_STATE_INIT),
+    debuggingMode(PULSEOXIMETER_DEBUGGINGMODE_NONE),
+    tsFirstBeatDetected(0),
+    tsLastBeatDetected(0),
+    tsLastBiasCheck(0),
+    tsLastCurrentAdjustment(0),
+    beatDetector(1000.0 / SAMPLING_FREQUENCY),
+    redLedCurrentIndex((uint8_t)RED_LED_CURRENT_START),
+    irLedCurrent(DEFAULT_IR_LED_CURRENT),
+    hrm(sensor),
     onBeatDetected(NULL)
 {
 }
@@ -46,17 +64,37 @@ bool PulseOximeter::begin(PulseOximeterDebuggingMode debuggingMode_)
         return false;
     }
 
-    hrm.setMode(MAX30100_MODE_SPO2_HR);
-    hrm.setLedsCurrent(irLedCurrent, (LEDCurrent)redLedCurrentIndex);
-
-    irDCRemover = DCRemover(DC_REMOVER_ALPHA);
-    redDCRemover = DCRemover(DC_REMOVER_ALPHA);
+    if (!hrm.applyConfig(sensorConfig(hrm.getConfig().interruptEnable))) {
+        return false;
+    }
 
     state = PULSEOXIMETER_STATE_IDLE;
 
     return true;
 }
 
+bool PulseOximeter::reconfigure(LEDCurrent irLedNewCurrent, uint8_t interruptMask)
+{
+    irLedCurrent = irLedNewCurrent;
+
+    if (!hrm.applyConfig(sensorConfig(interruptMask))) {
+        return false;
+    }
+
+    if (state == PULSEOXIMETER_STATE_INIT) {
+        state = PULSEOXIMETER_STATE_IDLE;
+    }
+
+    return true;
+}
+
+MAX30100Config PulseOximeter::sensorConfig(uint8_t interruptMask)
+{
+    return max30100Config(MAX30100_MODE_SPO2_HR, PULSEOXIMETER_SAMPLING_RATE,
+            spO2MaxPulseWidth(PULSEOXIMETER_SAMPLING_RATE), irLedCurrent, (LEDCurrent)redLedCurrentIndex,
+            interruptMask);
+}
+
 void PulseOximeter::update()
 {
     hrm.update();
@@ -67,12 +105,22 @@ void PulseOximeter::update()
 
 float PulseOximeter::getHeartRate()
 {
-    return beatDetector.getRate();
+    return vitalsEstimator.getHeartRate();
 }
 
 uint8_t PulseOximeter::getSpO2()
 {
-    return spO2calculator.getSpO2();
+    return vitalsEstimator.getSpO2();
+}
+
+uint8_t PulseOximeter::getConfidence()
+{
+    return vitalsEstimator.getConfidence();
+}
+
+uint32_t PulseOximeter::getLastBeatTimestamp()
+{
+    return beatDetector.getLastBeatTimestamp();
 }
 
 uint8_t PulseOximeter::getRedLedCurrentBias()
@@ -91,6 +139,16 @@ void PulseOximeter::setIRLedCurrent(LEDCurrent irLedNewCurrent)
     hrm.setLedsCurrent(irLedCurrent, (LEDCurrent)redLedCurrentIndex);
 }
 
+void PulseOximeter::setInterruptsEnabled(uint8_t interruptMask)
+{
+    hrm.setInterruptsEnabled(interruptMask);
+}
+
+uint8_t PulseOximeter::getInterruptStatus()
+{
+    return hrm.getInterruptStatus();
+}
+
 void PulseOximeter::shutdown()
 {
     hrm.shutdown();
@@ -103,54 +161,141 @@ void PulseOximeter::resume()
 
 void PulseOximeter::checkSample()
 {
-    uint16_t rawIRValue, rawRedValue;
+    SensorReadout readouts[PULSEOXIMETER_BLOCK_SIZE];
+    size_t n;
 
     // Dequeue all available samples, they're properly timed by the HRM
-    while (hrm.getRawValues(&rawIRValue, &rawRedValue)) {
-        float irACValue = irDCRemover.step(rawIRValue);
-        float redACValue = redDCRemover.step(rawRedValue);
+    while ((n = hrm.readAll(readouts, PULSEOXIMETER_BLOCK_SIZE)) > 0) {
+        processBlock(readouts, n);
+    }
+}
 
-        // The signal fed to the beat detector is mirrored since the cleanest monotonic spike is below zero
-        float filteredPulseValue = lpf.step(-irACValue);
-        bool beatDetected = beatDetector.addSample(filteredPulseValue);
+void PulseOximeter::processSample(const SensorReadout& readout)
+{
+    processBlock(&readout, 1);
+}
+
+void PulseOximeter::processBlock(const SensorReadout *readouts, size_t n)
+{
+    processBlock(readouts, NULL, n);
+}
+
+void PulseOximeter::processBlock(const SensorReadout *readouts, const MotionSample *motion, size_t n)
+{
+    while (n > 0) {
+        size_t chunk = n < PULSEOXIMETER_BLOCK_SIZE ? n : PULSEOXIMETER_BLOCK_SIZE;
+        processChunk(readouts, motion, chunk);
+        readouts += chunk;
+        if (motion) {
+            motion += chunk;
+        }
+        n -= chunk;
+    }
+}
+
+void PulseOximeter::processChunk(const SensorReadout *readouts, const MotionSample *motion, size_t n)
+{
+    dsp_sample_t irACValues[PULSEOXIMETER_BLOCK_SIZE];
+    dsp_sample_t redACValues[PULSEOXIMETER_BLOCK_SIZE];
+    dsp_sample_t filteredPulseValues[PULSEOXIMETER_BLOCK_SIZE];
+    dsp_sample_t thresholds[PULSEOXIMETER_BLOCK_SIZE];
+
+    for (size_t i = 0; i < n; i++) {
+        irACValues[i] = DSP_SAMPLE(readouts[i].ir);
+        redACValues[i] = DSP_SAMPLE(readouts[i].red);
+    }
+    irDCRemover.stepBlock(irACValues, irACValues, n);
+    redDCRemover.stepBlock(redACValues, redACValues, n);
+
+    // The signal fed to the beat detector is mirrored since the cleanest monotonic spike is below zero.
+    // What the accelerometer explains of it is taken off first; the SpO2 sums keep the IR as it is
+    if (motion) {
+        motionCanceller.stepBlock(irACValues, motion, filteredPulseValues, n);
+        for (size_t i = 0; i < n; i++) {
+            filteredPulseValues[i] = -filteredPulseValues[i];
+        }
+    } else {
+        for (size_t i = 0; i < n; i++) {
+            filteredPulseValues[i] = -irACValues[i];
+        }
+    }
+    pulseFilter.stepBlock(filteredPulseValues, filteredPulseValues, n);
+
+    // The beat detector is a state machine and stays serial. The vitals sums are taken over the
+    // runs of samples it reports a rate for, closed by each beat
+    bool tracePulse = debuggingMode == PULSEOXIMETER_DEBUGGINGMODE_PULSEDETECT;
+    uint8_t beatsDetected = 0;
+    size_t runStart = n;
+
+    for (size_t i = 0; i < n; i++) {
+        bool beatDetected = beatDetector.addSample(filteredPulseValues[i], readouts[i].timestamp);
+        if (tracePulse) {
+            thresholds[i] = beatDetector.getCurrentThreshold();
+        }
 
         if (beatDetector.getRate() > 0) {
             state = PULSEOXIMETER_STATE_DETECTING;
-            spO2calculator.update(irACValue, redACValue, beatDetected);
+            if (runStart == n) {
+                runStart = i;
+            }
+            if (beatDetected) {
+                vitalsEstimator.addSamples(irACValues + runStart, redACValues + runStart, i + 1 - runStart);
+                vitalsEstimator.addBeat(readouts[i].timestamp);
+                runStart = n;
+            }
         } else if (state == PULSEOXIMETER_STATE_DETECTING) {
             state = PULSEOXIMETER_STATE_IDLE;
-            spO2calculator.reset();
+            vitalsEstimator.reset();
+            runStart = n;
+        }
+        beatsDetected += beatDetected;
+    }
+    if (runStart < n) {
+        vitalsEstimator.addSamples(irACValues + runStart, redACValues + runStart, n - runStart);
+    }
+
+    // Serial output and callbacks only once the block is through
+    if (debuggingMode != PULSEOXIMETER_DEBUGGINGMODE_NONE) {
+        printDebugValues(readouts, irACValues, redACValues, filteredPulseValues, thresholds, n);
+    }
+
+    if (onBeatDetected) {
+        for (uint8_t i = 0; i < beatsDetected; i++) {
+            onBeatDetected();
         }
+    }
+}
 
+void PulseOximeter::printDebugValues(const SensorReadout *readouts, const dsp_sample_t *irACValues,
+        const dsp_sample_t *redACValues, const dsp_sample_t *filteredPulseValues,
+        const dsp_sample_t *thresholds, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
         switch (debuggingMode) {
             case PULSEOXIMETER_DEBUGGINGMODE_RAW_VALUES:
                 Serial.print("R:");
-                Serial.print(rawIRValue);
+                Serial.print(readouts[i].ir);
                 Serial.print(",");
-                Serial.println(rawRedValue);
+                Serial.println(readouts[i].red);
                 break;
 
             case PULSEOXIMETER_DEBUGGINGMODE_AC_VALUES:
                 Serial.print("R:");
-                Serial.print(irACValue);
+                Serial.print(DSP_TO_FLOAT(irACValues[i]));
                 Serial.print(",");
-                Serial.println(redACValue);
+                Serial.println(DSP_TO_FLOAT(redACValues[i]));
                 break;
 
             case PULSEOXIMETER_DEBUGGINGMODE_PULSEDETECT:
                 Serial.print("R:");
-                Serial.print(filteredPulseValue);
+                Serial.print(DSP_TO_FLOAT(filteredPulseValues[i]));
                 Serial.print(",");
-                Serial.println(beatDetector.getCurrentThreshold());
+                Serial.println(DSP_TO_FLOAT(thresholds[i]));
                 break;
 
             default:
                 break;
         }
-
-        if (beatDetected && onBeatDetected) {
-            onBeatDetected();
-        }
     }
 }
 
@@ -160,10 +305,12 @@ void PulseOximeter::checkCurrentBias()
     // red and IR leds. The numbers are really magic: the less possible to avoid oscillations
     if (millis() - tsLastBiasCheck > CURRENT_ADJUSTMENT_PERIOD_MS) {
         bool changed = false;
-        if (irDCRemover.getDCW() - redDCRemover.getDCW() > 70000 && redLedCurrentIndex < MAX30100_LED_CURR_50MA) {
+        if (irDCRemover.getDC() - redDCRemover.getDC() > DSP_SAMPLE(CURRENT_ADJUSTMENT_DC_DELTA) &&
+                redLedCurrentIndex < MAX30100_LED_CURR_50MA) {
             ++redLedCurrentIndex;
             changed = true;
-        } else if (redDCRemover.getDCW() - irDCRemover.getDCW() > 70000 && redLedCurrentIndex > 0) {
+        } else if (redDCRemover.getDC() - irDCRemover.getDC() > DSP_SAMPLE(CURRENT_ADJUSTMENT_DC_DELTA) &&
+                redLedCurrentIndex > 0) {
             --redLedCurrentIndex;
             changed = true;
         }
@@ -19,18 +19,32 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #ifndef MAX30100_PULSEOXIMETER_H
 #define MAX30100_PULSEOXIMETER_H
 
-#define SAMPLING_FREQUENCY                  100
+#ifndef PULSEOXIMETER_SAMPLING_RATE
+#define PULSEOXIMETER_SAMPLING_RATE         DEFAULT_SAMPLING_RATE
+#endif
+#define SAMPLING_FREQUENCY                  samplingRateHz(PULSEOXIMETER_SAMPLING_RATE)
 #define CURRENT_ADJUSTMENT_PERIOD_MS        500
+#define CURRENT_ADJUSTMENT_DC_DELTA         3500    // in ADC counts, DC mismatch that triggers a red led step
 #define DEFAULT_IR_LED_CURRENT              MAX30100_LED_CURR_50MA
 #define RED_LED_CURRENT_START               MAX30100_LED_CURR_27_1MA
-#define DC_REMOVER_ALPHA                    0.95
+#define DC_REMOVER_CUTOFF_MHZ               816     // 0.816Hz, a pole at 0.95 at 100Hz
+#define PULSE_FILTER_CUTOFF_MHZ             10000
+#define PULSE_FILTER_ORDER                  1
+#define PULSEOXIMETER_BLOCK_SIZE            MAX30100_FIFO_DEPTH     // samples run through the chain at once
 
 #include <stdint.h>
 
 #include "MAX30100.h"
 #include "MAX30100_BeatDetector.h"
 #include "MAX30100_Filters.h"
-#include "MAX30100_SpO2Calculator.h"
+#include "MAX30100_MotionCanceller.h"
+#include "MAX30100_VitalsEstimator.h"
+
+// The filters follow the sampling rate: changing it redesigns them at compile time
+typedef DCBlocker<SAMPLING_FREQUENCY, DC_REMOVER_CUTOFF_MHZ> PulseOximeterDCRemover;
+typedef FilterChain<ButterworthLowpass<SAMPLING_FREQUENCY, PULSE_FILTER_CUTOFF_MHZ, PULSE_FILTER_ORDER>>
+        PulseOximeterPulseFilter;
+typedef MotionCanceller<SAMPLING_FREQUENCY, DC_REMOVER_CUTOFF_MHZ> PulseOximeterMotionCanceller;
 
 typedef enum PulseOximeterState {
     PULSEOXIMETER_STATE_INIT,
@@ -49,20 +63,44 @@ typedef enum PulseOximeterDebuggingMode {
 class PulseOximeter {
 public:
     PulseOximeter();
+    // Runs on a driver owned by the caller, which then drains the FIFO itself
+    // and feeds the samples through processBlock() or processSample()
+    PulseOximeter(MAX30100& sensor);
 
     bool begin(PulseOximeterDebuggingMode debuggingMode_=PULSEOXIMETER_DEBUGGINGMODE_NONE);
+    // Takes the sensor over from another configuration with only the register writes that
+    // differ, keeping the DSP state and the red LED bias. Returns false when the sensor
+    // doesn't answer, begin() it then.
+    bool reconfigure(LEDCurrent irLedCurrent, uint8_t interruptMask);
     void update();
+    void processSample(const SensorReadout& readout);
+    // Whole FIFO bursts at once: each stage runs over the block before the next one
+    void processBlock(const SensorReadout *readouts, size_t n);
+    // Same, with the accelerometer reading taken with each sample: motion artifacts are
+    // cancelled from the IR signal the beats are detected on
+    void processBlock(const SensorReadout *readouts, const MotionSample *motion, size_t n);
+    void checkCurrentBias();
+    // Both over the last beats, refreshed on each one (see VitalsEstimator)
     float getHeartRate();
     uint8_t getSpO2();
+    // 0 to 100, how far the readings above can be trusted
+    uint8_t getConfidence();
+    uint32_t getLastBeatTimestamp();
     uint8_t getRedLedCurrentBias();
     void setOnBeatDetectedCallback(void (*cb)());
     void setIRLedCurrent(LEDCurrent irLedCurrent);
+    void setInterruptsEnabled(uint8_t interruptMask);
+    uint8_t getInterruptStatus();
     void shutdown();
     void resume();
 
 private:
     void checkSample();
-    void checkCurrentBias();
+    MAX30100Config sensorConfig(uint8_t interruptMask);
+    void processChunk(const SensorReadout *readouts, const MotionSample *motion, size_t n);
+    void printDebugValues(const SensorReadout *readouts, const dsp_sample_t *irACValues,
+            const dsp_sample_t *redACValues, const dsp_sample_t *filteredPulseValues,
+            const dsp_sample_t *thresholds, size_t n);
 
     PulseOximeterState state;
     PulseOximeterDebuggingMode debuggingMode;
@@ -71,13 +109,15 @@ private:
     uint32_t tsLastBiasCheck;
     uint32_t tsLastCurrentAdjustment;
     BeatDetector beatDetector;
-    DCRemover irDCRemover;
-    DCRemover redDCRemover;
-    FilterBuLp1 lpf;
+    PulseOximeterDCRemover irDCRemover;
+    PulseOximeterDCRemover redDCRemover;
+    PulseOximeterPulseFilter pulseFilter;
+    PulseOximeterMotionCanceller motionCanceller;
     uint8_t redLedCurrentIndex;
     LEDCurrent irLedCurrent;
-    SpO2Calculator spO2calculator;
-    MAX30100 hrm;
+    VitalsEstimator vitalsEstimator;
+    MAX30100 ownHrm;
+    MAX30100& hrm;
 
     void (*onBeatDetected)();
 };
@@ -20,12 +20,29 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "MAX30100_SpO2Calculator.h"
 
+// The float sums of squares are dot products, which ESP-DSP vectorizes on the S3 and
+// unrolls on the other Xtensa cores. Integer sums stay on the plain loop below
+#if !MAX30100_FIXED_POINT && defined(ESP_PLATFORM) && defined(__has_include)
+#if __has_include(<esp_dsp.h>)
+#include <esp_dsp.h>
+#define SPO2CALCULATOR_USE_ESP_DSP      1
+#endif
+#endif
+
 // SaO2 Look-up Table
 // http://www.ti.com/lit/an/slaa274b/slaa274b.pdf
 const uint8_t SpO2Calculator::spO2LUT[43] = {100,100,100,100,99,99,99,99,99,99,98,98,98,98,
                                              98,97,97,97,97,97,97,96,96,96,96,96,96,95,95,
                                              95,95,95,95,94,94,94,94,94,93,93,93,93,93};
 
+#if MAX30100_FIXED_POINT
+// log2(1 + i/32) in Q16
+const uint32_t SpO2Calculator::log2LUT[33] = {0,2909,5732,8473,11136,13727,16248,18704,21098,23433,25711,
+                                              27936,30109,32234,34312,36346,38336,40286,42196,44068,45904,
+                                              47705,49472,51207,52911,54584,56229,57845,59434,60997,62534,
+                                              64047,65536};
+#endif
+
 SpO2Calculator::SpO2Calculator() :
     irACValueSqSum(0),
     redACValueSqSum(0),
@@ -35,28 +52,92 @@ SpO2Calculator::SpO2Calculator() :
 {
 }
 
-void SpO2Calculator::update(float irACValue, float redACValue, bool beatDetected)
+void SpO2Calculator::update(dsp_sample_t irACValue, dsp_sample_t redACValue, bool beatDetected)
 {
-    irACValueSqSum += irACValue * irACValue;
-    redACValueSqSum += redACValue * redACValue;
-    ++samplesRecorded;
+    addSamples(&irACValue, &redACValue, 1);
 
     if (beatDetected) {
-        ++beatsDetectedNum;
-        if (beatsDetectedNum == CALCULATE_EVERY_N_BEATS) {
-            float acSqRatio = 100.0 * log(redACValueSqSum/samplesRecorded) / log(irACValueSqSum/samplesRecorded);
-            uint8_t index = 0;
-
-            if (acSqRatio > 66) {
-                index = (uint8_t)acSqRatio - 66;
-            } else if (acSqRatio > 50) {
-                index = (uint8_t)acSqRatio - 50;
-            }
-            reset();
-
-            spO2 = spO2LUT[index];
+        addBeat();
+    }
+}
+
+void SpO2Calculator::addSamples(const dsp_sample_t *irACValues, const dsp_sample_t *redACValues, size_t n)
+{
+    addSquares(irACValues, redACValues, n, &irACValueSqSum, &redACValueSqSum);
+    samplesRecorded += n;
+}
+
+void SpO2Calculator::addSquares(const dsp_sample_t *irACValues, const dsp_sample_t *redACValues, size_t n,
+        spo2_sum_t *irSqSum, spo2_sum_t *redSqSum)
+{
+#if MAX30100_FIXED_POINT
+    uint64_t irSum = 0;
+    uint64_t redSum = 0;
+    for (size_t i = 0; i < n; i++) {
+        irSum += (uint64_t)((int64_t)irACValues[i] * irACValues[i]);
+        redSum += (uint64_t)((int64_t)redACValues[i] * redACValues[i]);
+    }
+#elif SPO2CALCULATOR_USE_ESP_DSP
+    float irSum;
+    float redSum;
+    dsps_dotprod_f32(irACValues, irACValues, &irSum, n);
+    dsps_dotprod_f32(redACValues, redACValues, &redSum, n);
+#else
+    float irSum = 0;
+    float redSum = 0;
+    for (size_t i = 0; i < n; i++) {
+        irSum += irACValues[i] * irACValues[i];
+        redSum += redACValues[i] * redACValues[i];
+    }
+#endif
+    *irSqSum += irSum;
+    *redSqSum += redSum;
+}
+
+void SpO2Calculator::addBeat()
+{
+    ++beatsDetectedNum;
+    if (beatsDetectedNum == CALCULATE_EVERY_N_BEATS) {
+        uint8_t value = spO2FromSums(irACValueSqSum, redACValueSqSum, samplesRecorded);
+        reset();
+
+        spO2 = value;
+    }
+}
+
+uint8_t SpO2Calculator::spO2FromSums(spo2_sum_t irSqSum, spo2_sum_t redSqSum, uint32_t samples)
+{
+    if (!samples) {
+        return 0;
+    }
+
+#if MAX30100_FIXED_POINT
+    // The ratio of logarithms doesn't depend on their base, and log2(sum/n) = log2(sum) - log2(n):
+    // no division on 64 bits nor floats. The sums are Q16, hence the 16 to take off
+    int32_t acSqRatio = 0;
+    if (redSqSum && irSqSum) {
+        int32_t logSamples = log2(samples) + (16L << 16);
+        int32_t logRed = log2(redSqSum) - logSamples;
+        int32_t logIr = log2(irSqSum) - logSamples;
+        if (logIr != 0) {
+            acSqRatio = 100 * logRed / logIr;
         }
     }
+#else
+    float acSqRatio = 100.0 * log(redSqSum/samples) / log(irSqSum/samples);
+#endif
+    uint8_t index = 0;
+
+    if (acSqRatio > 66) {
+        index = (uint8_t)acSqRatio - 66;
+    } else if (acSqRatio > 50) {
+        index = (uint8_t)acSqRatio - 50;
+    }
+    if (index >= sizeof(spO2LUT)) {
+        index = sizeof(spO2LUT) - 1;
+    }
+
+    return spO2LUT[index];
 }
 
 void SpO2Calculator::reset()
@@ -72,3 +153,18 @@ uint8_t SpO2Calculator::getSpO2()
 {
     return spO2;
 }
+
+#if MAX30100_FIXED_POINT
+int32_t SpO2Calculator::log2(uint64_t x)
+{
+    // Leading bit position, then a linear interpolation on the next 5+11 bits of the mantissa:
+    // the error stays below 2e-4, far under the integer percent resolution of the ratio. x > 0
+    int32_t msb = 63 - __builtin_clzll(x);
+    uint32_t mantissa = msb >= 16 ? (uint32_t)(x >> (msb - 16)) : (uint32_t)(x << (16 - msb));
+    uint32_t index = (mantissa >> 11) & 0x1f;
+    uint32_t frac = mantissa & 0x7ff;
+
+    int32_t fraction = log2LUT[index] + (((log2LUT[index + 1] - log2LUT[index]) * frac) >> 11);
+    return (msb << 16) + fraction;
+}
+#endif
@@ -19,23 +19,48 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #ifndef MAX30100_SPO2CALCULATOR_H
 #define MAX30100_SPO2CALCULATOR_H
 
+#include <stddef.h>
 #include <stdint.h>
 
+#include "MAX30100_FixedPoint.h"
+
 #define CALCULATE_EVERY_N_BEATS         3
 
+#if MAX30100_FIXED_POINT
+// Q16 squared counts: 64 bits hold minutes of full scale AC
+typedef uint64_t spo2_sum_t;
+#else
+typedef float spo2_sum_t;
+#endif
+
 class SpO2Calculator {
 public:
     SpO2Calculator();
 
-    void update(float irACValue, float redACValue, bool beatDetected);
+    void update(dsp_sample_t irACValue, dsp_sample_t redACValue, bool beatDetected);
+    // Same as update() over a run of samples, followed by addBeat() if the run ends on one
+    void addSamples(const dsp_sample_t *irACValues, const dsp_sample_t *redACValues, size_t n);
+    void addBeat();
     void reset();
     uint8_t getSpO2();
 
+    // Adds the squares of n IR and red AC values to the sums
+    static void addSquares(const dsp_sample_t *irACValues, const dsp_sample_t *redACValues, size_t n,
+            spo2_sum_t *irSqSum, spo2_sum_t *redSqSum);
+    // Sums of squared IR and red AC values over some samples, through the ratio of their
+    // logarithms and the LUT. 0 when there is nothing to go on
+    static uint8_t spO2FromSums(spo2_sum_t irSqSum, spo2_sum_t redSqSum, uint32_t samples);
+
 private:
     static const uint8_t spO2LUT[43];
 
-    float irACValueSqSum;
-    float redACValueSqSum;
+#if MAX30100_FIXED_POINT
+    static const uint32_t log2LUT[33];
+    static int32_t log2(uint64_t x);
+#endif
+
+    spo2_sum_t irACValueSqSum;
+    spo2_sum_t redACValueSqSum;
     uint8_t beatsDetectedNum;
     uint32_t samplesRecorded;
     uint8_t spO2;
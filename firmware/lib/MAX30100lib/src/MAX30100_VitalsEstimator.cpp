@@ -0,0 +1,148 @@
+/*
+Arduino-MAX30100 oximetry / heart rate integrated sensor library
+Copyright (C) 2016  OXullo Intersecans <x@brainrapers.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <math.h>
+
+#include "MAX30100_VitalsEstimator.h"
+
+VitalsEstimator::VitalsEstimator()
+{
+    reset();
+}
+
+void VitalsEstimator::addSamples(const dsp_sample_t *irACValues, const dsp_sample_t *redACValues, size_t n)
+{
+    SpO2Calculator::addSquares(irACValues, redACValues, n, &irACValueSqSum, &redACValueSqSum);
+    samplesRecorded += n;
+}
+
+void VitalsEstimator::addBeat(uint32_t timestamp)
+{
+    Beat beat;
+    beat.irACValueSqSum = irACValueSqSum;
+    beat.redACValueSqSum = redACValueSqSum;
+    beat.samples = samplesRecorded;
+    beat.interval = tsLastBeat ? timestamp - tsLastBeat : 0;
+    beat.spO2 = SpO2Calculator::spO2FromSums(irACValueSqSum, redACValueSqSum, samplesRecorded);
+
+    // The oldest beat makes room
+    if (beatsCount == VITALSESTIMATOR_WINDOW_BEATS) {
+        removeFromWindow(beats[beatsHead]);
+    } else {
+        ++beatsCount;
+    }
+    beats[beatsHead] = beat;
+    beatsHead = (beatsHead + 1) % VITALSESTIMATOR_WINDOW_BEATS;
+    addToWindow(beat);
+
+    irACValueSqSum = 0;
+    redACValueSqSum = 0;
+    samplesRecorded = 0;
+    tsLastBeat = timestamp;
+
+    update();
+}
+
+void VitalsEstimator::reset()
+{
+    beatsHead = 0;
+    beatsCount = 0;
+    irACValueSqTotal = 0;
+    redACValueSqTotal = 0;
+    samplesTotal = 0;
+    intervalTotal = 0;
+    intervalSqTotal = 0;
+    intervalCount = 0;
+    spO2Total = 0;
+    spO2SqTotal = 0;
+    irACValueSqSum = 0;
+    redACValueSqSum = 0;
+    samplesRecorded = 0;
+    tsLastBeat = 0;
+    heartRate = 0;
+    spO2 = 0;
+    confidence = 0;
+}
+
+float VitalsEstimator::getHeartRate()
+{
+    return heartRate;
+}
+
+uint8_t VitalsEstimator::getSpO2()
+{
+    return spO2;
+}
+
+uint8_t VitalsEstimator::getConfidence()
+{
+    return confidence;
+}
+
+void VitalsEstimator::addToWindow(const Beat& beat)
+{
+    irACValueSqTotal += beat.irACValueSqSum;
+    redACValueSqTotal += beat.redACValueSqSum;
+    samplesTotal += beat.samples;
+    if (beat.interval) {
+        intervalTotal += beat.interval;
+        intervalSqTotal += (uint64_t)beat.interval * beat.interval;
+        ++intervalCount;
+    }
+    spO2Total += beat.spO2;
+    spO2SqTotal += (uint32_t)beat.spO2 * beat.spO2;
+}
+
+void VitalsEstimator::removeFromWindow(const Beat& beat)
+{
+    irACValueSqTotal -= beat.irACValueSqSum;
+    redACValueSqTotal -= beat.redACValueSqSum;
+    samplesTotal -= beat.samples;
+    if (beat.interval) {
+        intervalTotal -= beat.interval;
+        intervalSqTotal -= (uint64_t)beat.interval * beat.interval;
+        --intervalCount;
+    }
+    spO2Total -= beat.spO2;
+    spO2SqTotal -= (uint32_t)beat.spO2 * beat.spO2;
+}
+
+void VitalsEstimator::update()
+{
+    if (beatsCount < VITALSESTIMATOR_MIN_BEATS || !intervalCount) {
+        return;
+    }
+
+    spO2 = SpO2Calculator::spO2FromSums((spo2_sum_t)irACValueSqTotal, (spo2_sum_t)redACValueSqTotal, samplesTotal);
+    heartRate = 60000.0f * intervalCount / intervalTotal;
+
+    // Per-beat bookkeeping: float in both builds, from exact integer totals
+    float intervalMean = (float)intervalTotal / intervalCount;
+    float intervalVariance = (float)intervalSqTotal / intervalCount - intervalMean * intervalMean;
+    float intervalCV = intervalVariance > 0 ? sqrtf(intervalVariance) / intervalMean : 0;
+
+    float spO2Mean = (float)spO2Total / beatsCount;
+    float spO2Variance = (float)spO2SqTotal / beatsCount - spO2Mean * spO2Mean;
+    float spO2Spread = spO2Variance > 0 ? sqrtf(spO2Variance) : 0;
+
+    float regularity = 1 - intervalCV / VITALSESTIMATOR_MAX_INTERVAL_CV;
+    float agreement = 1 - spO2Spread / VITALSESTIMATOR_MAX_SPO2_SPREAD;
+    float value = 100.0f * beatsCount / VITALSESTIMATOR_WINDOW_BEATS *
+            (regularity > 0 ? regularity : 0) * (agreement > 0 ? agreement : 0);
+    confidence = (uint8_t)lroundf(value);
+}
@@ -0,0 +1,103 @@
+/*
+Arduino-MAX30100 oximetry / heart rate integrated sensor library
+Copyright (C) 2016  OXullo Intersecans <x@brainrapers.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MAX30100_VITALSESTIMATOR_H
+#define MAX30100_VITALSESTIMATOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "MAX30100_FixedPoint.h"
+#include "MAX30100_SpO2Calculator.h"
+
+#define VITALSESTIMATOR_WINDOW_BEATS        8       // beats HR and SpO2 are taken over
+#define VITALSESTIMATOR_MIN_BEATS           CALCULATE_EVERY_N_BEATS     // before anything is reported
+#define VITALSESTIMATOR_MAX_INTERVAL_CV     0.25    // beat interval variability that takes confidence to 0
+#define VITALSESTIMATOR_MAX_SPO2_SPREAD     4.0     // per-beat SpO2 deviation (%) that takes confidence to 0
+
+#if MAX30100_FIXED_POINT
+typedef uint64_t vitals_window_sum_t;
+#else
+// Float beat sums are added to the window and taken off it again: in a double
+// that is exact enough not to drift
+typedef double vitals_window_sum_t;
+#endif
+
+/*
+ * HR and SpO2 over a sliding window of the last beats, both refreshed on every
+ * beat. Each beat keeps its own sums (squared IR and red AC, samples, interval);
+ * the window totals add the new beat and take the oldest one off, so a beat
+ * costs the same however long the window is, and nothing is zeroed between
+ * readings. SpO2 is the ratio of ratios over the whole window, HR the beats
+ * over the time they span.
+ *
+ * The confidence (0 to 100) is how full the window is, times how regular the
+ * beat intervals are, times how well the beats agree on SpO2.
+ */
+class VitalsEstimator {
+public:
+    VitalsEstimator();
+
+    void addSamples(const dsp_sample_t *irACValues, const dsp_sample_t *redACValues, size_t n);
+    // Closes the beat the samples added since the previous one belong to
+    void addBeat(uint32_t timestamp);
+    // Tracking lost: the window starts over
+    void reset();
+    float getHeartRate();
+    uint8_t getSpO2();
+    uint8_t getConfidence();
+
+private:
+    struct Beat {
+        spo2_sum_t irACValueSqSum;
+        spo2_sum_t redACValueSqSum;
+        uint32_t samples;
+        uint32_t interval;      // in ms, 0 for the first beat after a reset
+        uint8_t spO2;           // of this beat alone
+    };
+
+    void addToWindow(const Beat& beat);
+    void removeFromWindow(const Beat& beat);
+    void update();
+
+    Beat beats[VITALSESTIMATOR_WINDOW_BEATS];
+    uint8_t beatsHead;
+    uint8_t beatsCount;
+
+    // Window totals
+    vitals_window_sum_t irACValueSqTotal;
+    vitals_window_sum_t redACValueSqTotal;
+    uint32_t samplesTotal;
+    uint32_t intervalTotal;
+    uint64_t intervalSqTotal;
+    uint8_t intervalCount;
+    uint32_t spO2Total;
+    uint32_t spO2SqTotal;
+
+    // The beat in progress
+    spo2_sum_t irACValueSqSum;
+    spo2_sum_t redACValueSqSum;
+    uint32_t samplesRecorded;
+    uint32_t tsLastBeat;
+
+    float heartRate;
+    uint8_t spO2;
+    uint8_t confidence;
+};
+
+#endif
@@ -0,0 +1,117 @@
+/*
+Arduino-MAX30100 oximetry / heart rate integrated sensor library
+Copyright (C) 2016  OXullo Intersecans <x@brainrapers.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SPSC_BUFFER_H
+#define SPSC_BUFFER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+/*
+ * Lock-free single-producer/single-consumer ring, the concurrent counterpart
+ * of CircularBuffer. One context (task or ISR) may push while another pops,
+ * without mutexes or critical sections.
+ *
+ * Storage is inline, S must be a power of two. head and tail are free-running
+ * counters: the producer only writes head, the consumer only writes tail.
+ * Unlike CircularBuffer::push(), a push on a full buffer fails instead of
+ * overwriting, since only the consumer may advance the tail.
+ */
+template<typename T, uint32_t S> class SPSCBuffer {
+	static_assert(S > 0 && (S & (S - 1)) == 0, "SPSCBuffer capacity must be a power of two");
+
+public:
+
+	SPSCBuffer();
+
+	/**
+	 * Starts both counters at `origin` instead of 0, so the host tests reach
+	 * their 32-bit wrap-around without pushing 2^32 elements first.
+	 */
+	explicit SPSCBuffer(uint32_t origin);
+
+	/**
+	 * Producer: appends an element, returns `false` if the buffer is full.
+	 */
+	bool push(const T& value);
+
+	/**
+	 * Producer: appends up to `n` elements, returns how many were stored.
+	 */
+	size_t push(const T* values, size_t n);
+
+	/**
+	 * Producer: exposes the contiguous free slots in `span`, returns their count.
+	 * Write into them, then make them visible to the consumer with commitPush().
+	 */
+	size_t pushSpan(T** span);
+
+	/**
+	 * Producer: publishes `n` elements written through pushSpan().
+	 */
+	void commitPush(size_t n);
+
+	/**
+	 * Consumer: removes the oldest element into `value`, returns `false` if the buffer is empty.
+	 */
+	bool pop(T* value);
+
+	/**
+	 * Consumer: removes up to `n` elements in FIFO order, returns how many were copied.
+	 */
+	size_t pop(T* values, size_t n);
+
+	/**
+	 * Consumer: exposes the contiguous queued elements in `span`, returns their count.
+	 * Release them with commitPop() once consumed.
+	 */
+	size_t popSpan(const T** span);
+
+	/**
+	 * Consumer: releases `n` elements read through popSpan().
+	 */
+	void commitPop(size_t n);
+
+	/**
+	 * Either side: elements currently queued (a snapshot, the other side may be moving).
+	 */
+	uint32_t size() const;
+
+	/**
+	 * Either side: free slots (a snapshot, the other side may be moving).
+	 */
+	uint32_t available() const;
+
+	uint32_t capacity() const;
+	bool isEmpty() const;
+	bool isFull() const;
+
+	/**
+	 * Consumer: drops every queued element.
+	 */
+	void clear();
+
+private:
+	T buffer[S];
+	std::atomic<uint32_t> head;
+	std::atomic<uint32_t> tail;
+};
+
+#include "SPSCBuffer.tpp"
+#endif
@@ -0,0 +1,141 @@
+/*
+Arduino-MAX30100 oximetry / heart rate integrated sensor library
+Copyright (C) 2016  OXullo Intersecans <x@brainrapers.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Each side reads its own index relaxed and the other side's with acquire,
+// and publishes its own index with release after touching the slots.
+
+template<typename T, uint32_t S>
+SPSCBuffer<T,S>::SPSCBuffer() :
+		head(0), tail(0) {
+}
+
+template<typename T, uint32_t S>
+SPSCBuffer<T,S>::SPSCBuffer(uint32_t origin) :
+		head(origin), tail(origin) {
+}
+
+template<typename T, uint32_t S>
+bool SPSCBuffer<T,S>::push(const T& value) {
+	uint32_t h = head.load(std::memory_order_relaxed);
+	if (h - tail.load(std::memory_order_acquire) == S) {
+		return false;
+	}
+	buffer[h & (S - 1)] = value;
+	head.store(h + 1, std::memory_order_release);
+	return true;
+}
+
+template<typename T, uint32_t S>
+size_t SPSCBuffer<T,S>::push(const T* values, size_t n) {
+	uint32_t h = head.load(std::memory_order_relaxed);
+	uint32_t free = S - (h - tail.load(std::memory_order_acquire));
+	if (n > free) {
+		n = free;
+	}
+	for (size_t i = 0; i < n; i++) {
+		buffer[(h + i) & (S - 1)] = values[i];
+	}
+	head.store(h + n, std::memory_order_release);
+	return n;
+}
+
+template<typename T, uint32_t S>
+size_t SPSCBuffer<T,S>::pushSpan(T** span) {
+	uint32_t h = head.load(std::memory_order_relaxed);
+	uint32_t free = S - (h - tail.load(std::memory_order_acquire));
+	uint32_t toEnd = S - (h & (S - 1));
+	*span = buffer + (h & (S - 1));
+	return free < toEnd ? free : toEnd;
+}
+
+template<typename T, uint32_t S>
+void SPSCBuffer<T,S>::commitPush(size_t n) {
+	head.store(head.load(std::memory_order_relaxed) + n, std::memory_order_release);
+}
+
+template<typename T, uint32_t S>
+bool SPSCBuffer<T,S>::pop(T* value) {
+	uint32_t t = tail.load(std::memory_order_relaxed);
+	if (head.load(std::memory_order_acquire) == t) {
+		return false;
+	}
+	*value = buffer[t & (S - 1)];
+	tail.store(t + 1, std::memory_order_release);
+	return true;
+}
+
+template<typename T, uint32_t S>
+size_t SPSCBuffer<T,S>::pop(T* values, size_t n) {
+	uint32_t t = tail.load(std::memory_order_relaxed);
+	uint32_t queued = head.load(std::memory_order_acquire) - t;
+	if (n > queued) {
+		n = queued;
+	}
+	for (size_t i = 0; i < n; i++) {
+		values[i] = buffer[(t + i) & (S - 1)];
+	}
+	tail.store(t + n, std::memory_order_release);
+	return n;
+}
+
+template<typename T, uint32_t S>
+size_t SPSCBuffer<T,S>::popSpan(const T** span) {
+	uint32_t t = tail.load(std::memory_order_relaxed);
+	uint32_t queued = head.load(std::memory_order_acquire) - t;
+	uint32_t toEnd = S - (t & (S - 1));
+	*span = buffer + (t & (S - 1));
+	return queued < toEnd ? queued : toEnd;
+}
+
+template<typename T, uint32_t S>
+void SPSCBuffer<T,S>::commitPop(size_t n) {
+	tail.store(tail.load(std::memory_order_relaxed) + n, std::memory_order_release);
+}
+
+template<typename T, uint32_t S>
+uint32_t SPSCBuffer<T,S>::size() const {
+	// Tail first: head can only have moved forward since, so the difference never underflows
+	uint32_t t = tail.load(std::memory_order_acquire);
+	uint32_t queued = head.load(std::memory_order_acquire) - t;
+	return queued < S ? queued : S;
+}
+
+template<typename T, uint32_t S>
+uint32_t SPSCBuffer<T,S>::available() const {
+	return S - size();
+}
+
+template<typename T, uint32_t S>
+uint32_t SPSCBuffer<T,S>::capacity() const {
+	return S;
+}
+
+template<typename T, uint32_t S>
+bool SPSCBuffer<T,S>::isEmpty() const {
+	return size() == 0;
+}
+
+template<typename T, uint32_t S>
+bool SPSCBuffer<T,S>::isFull() const {
+	return size() == S;
+}
+
+template<typename T, uint32_t S>
+void SPSCBuffer<T,S>::clear() {
+	tail.store(head.load(std::memory_order_acquire), std::memory_order_release);
+}
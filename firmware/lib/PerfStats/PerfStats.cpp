@@ -0,0 +1,82 @@
+#include "PerfStats.h"
+
+PerfStat::PerfStat(const char* name) :
+    name(name)
+{
+    reset();
+}
+
+#if PERF_STATS_ENABLED
+void PerfStat::record(uint32_t micros)
+{
+    if (micros < minMicros) minMicros = micros;
+    if (micros > maxMicros) maxMicros = micros;
+    totalMicros += micros;
+    window[windowIndex] = micros;
+    windowIndex = (windowIndex + 1) % PERF_STATS_WINDOW;
+    count++;
+}
+#else
+void PerfStat::record(uint32_t /*micros*/)
+{
+}
+#endif
+
+void PerfStat::reset()
+{
+    count = 0;
+    minMicros = UINT32_MAX;
+    maxMicros = 0;
+    totalMicros = 0;
+    windowIndex = 0;
+    memset(window, 0, sizeof(window));
+}
+
+const char* PerfStat::getName()
+{
+    return name;
+}
+
+uint32_t PerfStat::getCount()
+{
+    return count;
+}
+
+float PerfStat::getMin()
+{
+    return count > 0 ? minMicros : 0;
+}
+
+float PerfStat::getMean()
+{
+    return count > 0 ? (float)totalMicros / count : 0;
+}
+
+float PerfStat::getMax()
+{
+    return maxMicros;
+}
+
+float PerfStat::getP99()
+{
+    uint16_t filled = count < PERF_STATS_WINDOW ? count : PERF_STATS_WINDOW;
+    if (filled == 0) {
+        return 0;
+    }
+
+    // Rank of the p99 from the top, then a partial selection over a copy of the window:
+    // with 128 entries that is the 2nd largest, so this stays cheap enough for a command
+    uint16_t fromTop = filled / 100 + 1;
+    uint32_t sorted[PERF_STATS_WINDOW];
+    memcpy(sorted, window, filled * sizeof(uint32_t));
+    for (uint16_t i = 0; i < fromTop; i++) {
+        uint16_t largest = i;
+        for (uint16_t j = i + 1; j < filled; j++) {
+            if (sorted[j] > sorted[largest]) largest = j;
+        }
+        uint32_t tmp = sorted[i];
+        sorted[i] = sorted[largest];
+        sorted[largest] = tmp;
+    }
+    return sorted[fromTop - 1];
+}
@@ -0,0 +1,83 @@
+#ifndef PERF_STATS_H
+#define PERF_STATS_H
+
+#include <Arduino.h>
+#include <esp_timer.h>
+
+// Timing of hot paths, in microseconds of the esp_timer.
+//
+// A PerfStat accumulates min/mean/max since its last reset, and keeps the
+// most recent PERF_STATS_WINDOW durations for the p99. The CPU cycle counter
+// can't be used: with POWER:LOW, esp_pm scales the CPU clock between wake-ups,
+// so a cycle count has no fixed length. The esp_timer keeps time across
+// frequency switches, at a 1us resolution. Each stat must be recorded from a
+// single task. Readers on other tasks may see a slightly torn snapshot, which
+// is fine for diagnostics.
+//
+// Build with -DPERF_STATS_ENABLED=0 to compile every probe out.
+
+#ifndef PERF_STATS_ENABLED
+#define PERF_STATS_ENABLED 1
+#endif
+
+#ifndef PERF_STATS_WINDOW
+#define PERF_STATS_WINDOW 128
+#endif
+
+inline uint32_t perfMicros()
+{
+    return (uint32_t)esp_timer_get_time();
+}
+
+class PerfStat {
+public:
+    PerfStat(const char* name);
+
+    void record(uint32_t micros);
+    void reset();
+
+    const char* getName();
+    uint32_t getCount();
+    // in microseconds
+    float getMin();
+    float getMean();
+    float getMax();
+    float getP99();
+
+private:
+    const char* name;
+    uint32_t count;
+    uint32_t minMicros;
+    uint32_t maxMicros;
+    uint64_t totalMicros;
+    uint32_t window[PERF_STATS_WINDOW];
+    uint16_t windowIndex;
+};
+
+// Records the lifetime of the scope into a PerfStat, or up to stop() when that
+// comes first
+class PerfScope {
+public:
+#if PERF_STATS_ENABLED
+    PerfScope(PerfStat& stat) : stat(&stat), start(perfMicros()) {}
+    ~PerfScope() { stop(); }
+
+    void stop()
+    {
+        if (stat) {
+            stat->record(perfMicros() - start);
+            stat = NULL;
+        }
+    }
+
+private:
+    PerfStat* stat;
+    uint32_t start;
+#else
+    PerfScope(PerfStat& /*stat*/) {}
+
+    void stop() {}
+#endif
+};
+
+#endif
@@ -0,0 +1,162 @@
+#include <string.h>
+
+#include "SampleStages.h"
+
+AveragingStage::AveragingStage(uint16_t reportsPerBatch) :
+    reportsPerBatch(reportsPerBatch)
+{
+    reset();
+}
+
+void AveragingStage::start(const char* led, int distanceMm)
+{
+    strncpy(this->led, led, sizeof(this->led) - 1);
+    this->led[sizeof(this->led) - 1] = '\0';
+    this->distanceMm = distanceMm;
+    collecting = true;
+    irSum = 0;
+    redSum = 0;
+    sampleCount = 0;
+    reportCount = 0;
+    averageDue = false;
+}
+
+void AveragingStage::stop()
+{
+    collecting = false;
+}
+
+void AveragingStage::reset()
+{
+    start("none", 0);
+    collecting = false;
+}
+
+void AveragingStage::process(const SensorSample* samples, size_t count)
+{
+    if (!collecting) {
+        return;
+    }
+    for (size_t i = 0; i < count; i++) {
+        irSum += samples[i].readout.ir;
+        redSum += samples[i].readout.red;
+    }
+    sampleCount += count;
+}
+
+bool AveragingStage::nextReport()
+{
+    averageDue = collecting && sampleCount > 0 && ++reportCount % reportsPerBatch == 0;
+    return averageDue;
+}
+
+bool AveragingStage::isAverageDue()
+{
+    return averageDue;
+}
+
+bool AveragingStage::isCollecting()
+{
+    return collecting;
+}
+
+const char* AveragingStage::getLed()
+{
+    return led;
+}
+
+int AveragingStage::getDistance()
+{
+    return distanceMm;
+}
+
+uint32_t AveragingStage::getSampleCount()
+{
+    return sampleCount;
+}
+
+uint64_t AveragingStage::getIrSum()
+{
+    return irSum;
+}
+
+uint64_t AveragingStage::getRedSum()
+{
+    return redSum;
+}
+
+float AveragingStage::getAverageIr()
+{
+    return sampleCount > 0 ? (float)((double)irSum / sampleCount) : 0;
+}
+
+float AveragingStage::getAverageRed()
+{
+    return sampleCount > 0 ? (float)((double)redSum / sampleCount) : 0;
+}
+
+LabelingStage::LabelingStage(uint32_t durationMs) :
+    finished(false),
+    startTime(0),
+    durationMs(durationMs),
+    sampleCount(0)
+{
+    stop();
+}
+
+void LabelingStage::start(const char* label, uint32_t now)
+{
+    strncpy(this->label, label, sizeof(this->label) - 1);
+    this->label[sizeof(this->label) - 1] = '\0';
+    collecting = true;
+    finished = false;
+    startTime = now;
+    sampleCount = 0;
+}
+
+void LabelingStage::stop()
+{
+    strncpy(label, "waiting", sizeof(label));
+    collecting = false;
+}
+
+void LabelingStage::process(const SensorSample* samples, size_t count)
+{
+    if (!collecting) {
+        return;
+    }
+    for (size_t i = 0; i < count; i++) {
+        int32_t elapsed = (int32_t)(samples[i].readout.timestamp - startTime);
+        if (elapsed < 0) {
+            continue;       // queued before LABEL:
+        }
+        if ((uint32_t)elapsed >= durationMs) {
+            stop();
+            finished = true;
+            break;
+        }
+        sampleCount++;
+    }
+}
+
+bool LabelingStage::takeFinished()
+{
+    bool wasFinished = finished;
+    finished = false;
+    return wasFinished;
+}
+
+bool LabelingStage::isCollecting()
+{
+    return collecting;
+}
+
+const char* LabelingStage::getLabel()
+{
+    return label;
+}
+
+uint32_t LabelingStage::getSampleCount()
+{
+    return sampleCount;
+}
@@ -0,0 +1,80 @@
+#ifndef SAMPLE_STAGES_H
+#define SAMPLE_STAGES_H
+
+#include "SensorHAL.h"
+
+// The test procedures, as stages on the sample bus. They run on the DSP task;
+// the commands that start and stop them must hold the same lock.
+
+// DISTANCE_TEST and the QE measurement: IR and red averaged over every sample
+// since start(), published every reportsPerBatch reports
+class AveragingStage : public SampleStage {
+public:
+    AveragingStage(uint16_t reportsPerBatch = 10);
+
+    // Starts over with the sums at zero
+    void start(const char* led, int distanceMm);
+    void stop();
+    // Stopped, "none" at 0mm
+    void reset();
+
+    void process(const SensorSample* samples, size_t count) override;
+
+    // Once per report: whether this one carries the average
+    bool nextReport();
+    bool isAverageDue();
+
+    bool isCollecting();
+    const char* getLed();
+    int getDistance();
+    uint32_t getSampleCount();
+    uint64_t getIrSum();
+    uint64_t getRedSum();
+    float getAverageIr();
+    float getAverageRed();
+
+private:
+    char led[8];
+    int distanceMm;
+    bool collecting;
+    // Every FIFO sample since start(): 64-bit sums, so hours of 16-bit
+    // readings at 100 Hz don't wrap
+    uint64_t irSum;
+    uint64_t redSum;
+    uint32_t sampleCount;
+    uint16_t reportCount;
+    uint16_t reportsPerBatch;
+    bool averageDue;
+};
+
+// FORCE_TEST: the samples of a fixed window after LABEL:<name> carry the label.
+// The window is measured on the sample timestamps, so it holds its duration of
+// data however late the DSP task gets to it.
+class LabelingStage : public SampleStage {
+public:
+    LabelingStage(uint32_t durationMs = 10000);
+
+    // now: on the clock of the sample timestamps
+    void start(const char* label, uint32_t now);
+    // Back to "waiting"
+    void stop();
+
+    void process(const SensorSample* samples, size_t count) override;
+
+    // True once after process() closed a window
+    bool takeFinished();
+
+    bool isCollecting();
+    const char* getLabel();
+    uint32_t getSampleCount();
+
+private:
+    char label[16];
+    bool collecting;
+    bool finished;
+    uint32_t startTime;
+    uint32_t durationMs;
+    uint32_t sampleCount;
+};
+
+#endif
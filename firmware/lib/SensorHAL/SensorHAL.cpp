@@ -0,0 +1,71 @@
+#include <string.h>
+
+#include "SensorHAL.h"
+
+// Constant-initialized: sensors constructed by other translation units find it in place
+Sensor* Sensor::first = NULL;
+
+Sensor::Sensor(const char* name) :
+    name(name),
+    enabled(true),
+    next(NULL)
+{
+    Sensor** link = &first;
+    while (*link) {
+        link = &(*link)->next;
+    }
+    *link = this;
+}
+
+void Sensor::setEnabled(bool enabled)
+{
+    this->enabled = enabled;
+}
+
+bool Sensor::isEnabled()
+{
+    return enabled;
+}
+
+const char* Sensor::getName()
+{
+    return name;
+}
+
+Sensor* Sensor::getNext()
+{
+    return next;
+}
+
+Sensor* Sensor::getFirst()
+{
+    return first;
+}
+
+Sensor* Sensor::find(const char* name)
+{
+    for (Sensor* sensor = first; sensor; sensor = sensor->next) {
+        if (strcmp(sensor->name, name) == 0) {
+            return sensor;
+        }
+    }
+    return NULL;
+}
+
+void Sensor::pollAll(uint32_t now)
+{
+    for (Sensor* sensor = first; sensor; sensor = sensor->next) {
+        if (sensor->enabled) {
+            sensor->poll(now);
+        }
+    }
+}
+
+void Sensor::annotateAll(SensorSample& sample)
+{
+    for (Sensor* sensor = first; sensor; sensor = sensor->next) {
+        if (sensor->enabled) {
+            sensor->annotate(sample);
+        }
+    }
+}
@@ -0,0 +1,153 @@
+#ifndef SENSOR_HAL_H
+#define SENSOR_HAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "MAX30100.h"
+#include "SPSCBuffer.h"
+
+// Sensor abstraction shared by every mode of the firmware.
+//
+// The MAX30100 FIFO is the clock of the system: each of its samples becomes
+// a SensorSample, and every other sensor adds its reading to the samples it
+// was taken alongside. A Sensor registers itself when it is constructed, so
+// a board defines its sensors as globals and the acquisition task walks the
+// registry: poll() once per wake-up, for the bus transfers and conversions,
+// then annotate() on each PPG sample drained in that wake-up.
+//
+// The samples go to the processing side through a SampleBus, a lock-free
+// ring from the acquisition task to the DSP task, which hands each queued
+// span to the attached SampleStages in order. Modes and test procedures
+// (averaging, labelling) are stages, they all see the same samples.
+
+// A PPG sample and what the other sensors read with it
+struct SensorSample {
+    SensorReadout readout;
+    float ax;                   // in g
+    float ay;
+    float az;
+    uint16_t fsr;               // ADC counts
+    float temperature;          // in degrees C, the latest conversion
+};
+
+class Sensor {
+public:
+    // Appends the sensor to the registry: construct sensors as globals, before the tasks start
+    Sensor(const char* name);
+
+    // Acquisition task, once per wake-up before the PPG samples are read
+    virtual void poll(uint32_t /*now*/) {}
+    // Acquisition task, on every PPG sample of the wake-up: fills the sensor's fields
+    virtual void annotate(SensorSample& sample) = 0;
+    // A new session: conversions in flight are forgotten
+    virtual void reset() {}
+
+    // Disabled sensors are skipped by pollAll() and annotateAll(), their fields keep their defaults
+    void setEnabled(bool enabled);
+    bool isEnabled();
+    const char* getName();
+    Sensor* getNext();
+
+    // In registration order
+    static Sensor* getFirst();
+    static Sensor* find(const char* name);
+    static void pollAll(uint32_t now);
+    static void annotateAll(SensorSample& sample);
+
+private:
+    static Sensor* first;
+
+    const char* name;
+    bool enabled;
+    Sensor* next;
+};
+
+// Takes the samples off the bus, on the DSP task
+class SampleStage {
+public:
+    virtual void process(const SensorSample* samples, size_t count) = 0;
+};
+
+// A stage that is a plain function
+class CallbackStage : public SampleStage {
+public:
+    typedef void (*Callback)(const SensorSample* samples, size_t count);
+
+    CallbackStage(Callback callback) : callback(callback) {}
+
+    void process(const SensorSample* samples, size_t count) override
+    {
+        callback(samples, count);
+    }
+
+private:
+    Callback callback;
+};
+
+#ifndef SAMPLE_BUS_MAX_STAGES
+#define SAMPLE_BUS_MAX_STAGES 8
+#endif
+
+// Producer: the acquisition task. Consumer: whoever dispatches, the DSP task or a mode
+// switch clearing it. S must be a power of two.
+template<uint32_t S> class SampleBus {
+public:
+    SampleBus() : stageCount(0), dropped(0) {}
+
+    // Setup, before the tasks start. Returns false when SAMPLE_BUS_MAX_STAGES are attached.
+    bool attach(SampleStage* stage)
+    {
+        if (stageCount == SAMPLE_BUS_MAX_STAGES) {
+            return false;
+        }
+        stages[stageCount++] = stage;
+        return true;
+    }
+
+    // Producer: queues a sample, or counts it as dropped when the bus is full
+    bool publish(const SensorSample& sample)
+    {
+        if (queue.push(sample)) {
+            return true;
+        }
+        dropped++;
+        return false;
+    }
+
+    // Consumer: every queued span through the stages, in place. Returns the samples dispatched.
+    size_t dispatch()
+    {
+        const SensorSample* samples;
+        size_t count;
+        size_t total = 0;
+        while ((count = queue.popSpan(&samples)) > 0) {
+            for (size_t i = 0; i < stageCount; i++) {
+                stages[i]->process(samples, count);
+            }
+            queue.commitPop(count);
+            total += count;
+        }
+        return total;
+    }
+
+    // Consumer: drops what is queued
+    void clear()
+    {
+        queue.clear();
+    }
+
+    // Samples the bus had no room for, written by the producer only
+    uint32_t getDropped()
+    {
+        return dropped;
+    }
+
+private:
+    SPSCBuffer<SensorSample, S> queue;
+    SampleStage* stages[SAMPLE_BUS_MAX_STAGES];
+    size_t stageCount;
+    uint32_t dropped;
+};
+
+#endif
@@ -0,0 +1,89 @@
+#include <math.h>
+
+#include "quality_features.h"
+
+static int16_t clampToInt16(int32_t value)
+{
+    return value > INT16_MAX ? INT16_MAX : value < INT16_MIN ? INT16_MIN : (int16_t)value;
+}
+
+QualityFeatures::QualityFeatures()
+{
+    reset();
+}
+
+void QualityFeatures::reset()
+{
+    irDCRemover = PulseOximeterDCRemover();
+    irAC.reset();
+    accelMag.reset();
+    beatIntervals.reset();
+    lastAccelMag = 0;
+    tsLastBeat = 0;
+    hasPrevious = false;
+    previousHeartRate = 0;
+    previousSpO2 = 0;
+    previousAccelMag = 0;
+}
+
+void QualityFeatures::addSample(uint16_t ir, float ax, float ay, float az)
+{
+    // Same DC removal as the pulse oximeter, rounded back to ADC counts for the window
+    dsp_sample_t ac = irDCRemover.step(DSP_SAMPLE(ir));
+#if MAX30100_FIXED_POINT
+    int32_t acCounts = (ac + (1L << (DSP_SAMPLE_FRAC_BITS - 1))) >> DSP_SAMPLE_FRAC_BITS;
+#else
+    int32_t acCounts = lroundf(ac);
+#endif
+    irAC.push(clampToInt16(acCounts));
+
+    lastAccelMag = sqrtf(ax * ax + ay * ay + az * az);
+    accelMag.push(clampToInt16(lroundf(lastAccelMag * 1000)));
+}
+
+void QualityFeatures::addBeat(uint32_t timestamp)
+{
+    if (timestamp == tsLastBeat) {
+        return;
+    }
+
+    uint32_t interval = timestamp - tsLastBeat;
+    if (tsLastBeat == 0 || interval > QUALITY_MAX_BEAT_INTERVAL_MS) {
+        // First beat or tracking lost: intervals across the gap mean nothing
+        beatIntervals.reset();
+    } else {
+        beatIntervals.push((uint16_t)interval);
+    }
+    tsLastBeat = timestamp;
+}
+
+void QualityFeatures::extract(float hr, float spo2, float features[QUALITY_FEATURE_COUNT])
+{
+    if (!hasPrevious) {
+        previousHeartRate = hr;
+        previousSpO2 = spo2;
+        previousAccelMag = lastAccelMag;
+        hasPrevious = true;
+    }
+
+    float ppgAmplitude = sqrtf(irAC.variance());
+    float dc = DSP_TO_FLOAT(irDCRemover.getDC());
+    float intervalMean = beatIntervals.mean();
+
+    features[QUALITY_FEATURE_HEARTRATE] = hr;
+    features[QUALITY_FEATURE_SPO2] = spo2;
+    features[QUALITY_FEATURE_ACCEL_MAG] = lastAccelMag;
+    features[QUALITY_FEATURE_HR_CHANGE] = fabsf(hr - previousHeartRate);
+    features[QUALITY_FEATURE_SPO2_CHANGE] = fabsf(spo2 - previousSpO2);
+    features[QUALITY_FEATURE_ACCEL_CHANGE] = fabsf(lastAccelMag - previousAccelMag);
+    features[QUALITY_FEATURE_PERFUSION_INDEX] = dc > 0 ? 100 * ppgAmplitude / dc : 0;
+    features[QUALITY_FEATURE_PPG_AMPLITUDE] = ppgAmplitude;
+    features[QUALITY_FEATURE_ACCEL_ENERGY] = accelMag.variance() / 1e6f;
+    features[QUALITY_FEATURE_BEAT_INTERVAL_CV] =
+            beatIntervals.size() >= QUALITY_MIN_BEAT_INTERVALS && intervalMean > 0 ?
+            sqrtf(beatIntervals.variance()) / intervalMean : 0;
+
+    previousHeartRate = hr;
+    previousSpO2 = spo2;
+    previousAccelMag = lastAccelMag;
+}
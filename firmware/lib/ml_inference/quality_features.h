@@ -0,0 +1,121 @@
+#ifndef QUALITY_FEATURES_H
+#define QUALITY_FEATURES_H
+
+// Windowed signal quality features for the ML quality model.
+//
+// Fed every sample (IR level, accelerometer) and every beat, read once per
+// assessment. Each window keeps integer running sums next to its ring, so an
+// update is O(1) and the statistics never drift from what is in the window.
+// train_ml_model.py replays recordings through a Python twin of this class
+// (quality_features.py): keep the two in step.
+
+#include <stdint.h>
+
+#include "MAX30100_PulseOximeter.h"
+
+#define QUALITY_WINDOW_SAMPLES          200     // 2s at 100Hz, PPG and motion statistics
+#define QUALITY_BEAT_INTERVALS          8       // beat to beat intervals for the variability
+#define QUALITY_MIN_BEAT_INTERVALS      3       // below this the variability reads as 0
+#define QUALITY_MAX_BEAT_INTERVAL_MS    2000    // longer gaps restart the intervals
+
+// Order shared with quality_features.py and the generated model header
+enum QualityFeatureId {
+    QUALITY_FEATURE_HEARTRATE = 0,
+    QUALITY_FEATURE_SPO2,
+    QUALITY_FEATURE_ACCEL_MAG,
+    QUALITY_FEATURE_HR_CHANGE,          // since the previous assessment
+    QUALITY_FEATURE_SPO2_CHANGE,
+    QUALITY_FEATURE_ACCEL_CHANGE,
+    QUALITY_FEATURE_PERFUSION_INDEX,    // PPG amplitude over the IR DC level, in %
+    QUALITY_FEATURE_PPG_AMPLITUDE,      // standard deviation of the IR AC, in ADC counts
+    QUALITY_FEATURE_ACCEL_ENERGY,       // variance of the accel magnitude, in g^2
+    QUALITY_FEATURE_BEAT_INTERVAL_CV,   // standard deviation over mean of the beat intervals
+    QUALITY_FEATURE_COUNT
+};
+
+// Sliding window of integer values with running sum and sum of squares
+template<typename T, uint16_t N>
+class RunningWindow {
+public:
+    RunningWindow()
+    {
+        reset();
+    }
+
+    void reset()
+    {
+        head = 0;
+        count = 0;
+        sum = 0;
+        sumSq = 0;
+    }
+
+    void push(T value)
+    {
+        if (count == N) {
+            T oldest = values[head];
+            sum -= oldest;
+            sumSq -= (int64_t)oldest * oldest;
+        } else {
+            count++;
+        }
+        values[head] = value;
+        head = head + 1 == N ? 0 : head + 1;
+        sum += value;
+        sumSq += (int64_t)value * value;
+    }
+
+    uint16_t size() const
+    {
+        return count;
+    }
+
+    float mean() const
+    {
+        return count ? (float)sum / count : 0;
+    }
+
+    float variance() const
+    {
+        if (count < 2) {
+            return 0;
+        }
+        // n*sumSq - sum^2 is exact in integers, only the final scaling is float
+        int64_t spread = (int64_t)count * sumSq - (int64_t)sum * sum;
+        return spread > 0 ? (float)spread / ((float)count * count) : 0;
+    }
+
+private:
+    T values[N];
+    uint16_t head;
+    uint16_t count;
+    int32_t sum;
+    int64_t sumSq;
+};
+
+class QualityFeatures {
+public:
+    QualityFeatures();
+
+    void reset();
+    // Every sample: IR level and the accelerometer read alongside, in g
+    void addSample(uint16_t ir, float ax, float ay, float az);
+    // Timestamp of the latest beat, repeated values are ignored
+    void addBeat(uint32_t timestamp);
+    // Fills features[QUALITY_FEATURE_COUNT] and makes hr/spo2 the reference for the next changes
+    void extract(float hr, float spo2, float features[QUALITY_FEATURE_COUNT]);
+
+private:
+    PulseOximeterDCRemover irDCRemover;
+    RunningWindow<int16_t, QUALITY_WINDOW_SAMPLES> irAC;           // ADC counts
+    RunningWindow<int16_t, QUALITY_WINDOW_SAMPLES> accelMag;       // mg
+    RunningWindow<uint16_t, QUALITY_BEAT_INTERVALS> beatIntervals; // ms
+    float lastAccelMag;
+    uint32_t tsLastBeat;
+    bool hasPrevious;
+    float previousHeartRate;
+    float previousSpO2;
+    float previousAccelMag;
+};
+
+#endif // QUALITY_FEATURES_H
@@ -0,0 +1,97 @@
+#ifndef QUALITY_INFERENCE_H
+#define QUALITY_INFERENCE_H
+
+// Integer kernels behind the generated sensor_quality_model.h.
+//
+// train_ml_model.py folds the feature scaler into the model and quantizes
+// it with power of two scales only (quality_model_codegen.py), so that these
+// kernels run on int32 multiply-accumulates and shifts, without a divide:
+//
+// - features are taken to fixed point with a per-channel power of two
+//   (model_input_scales), saturated to 16 bits
+// - dense layers: the weights carry the scale of the input they multiply,
+//   hidden outputs go through ReLU and a per-neuron right shift into the
+//   next layer's scale. The offline bounds keep the accumulators in 32 bits
+// - tree ensembles: thresholds are in the input fixed point, leaves in a
+//   shared one, and the score is the sum of the reached leaves
+//
+// The models are binary: the score is positive for good quality.
+
+#include <stdint.h>
+
+#define QUALITY_INPUT_MAX       32767
+
+struct QualityDenseLayer {
+    uint8_t inputs;
+    uint8_t outputs;
+    const int32_t *weights;     // outputs x inputs, row major
+    const int32_t *biases;
+    const uint8_t *shifts;      // per output, hidden (ReLU) layers only
+    bool relu;
+};
+
+// Leaves have feature -1 and their value in threshold
+struct QualityTreeNode {
+    int16_t feature;
+    int16_t threshold;
+    uint16_t left;              // taken when input <= threshold
+    uint16_t right;
+};
+
+inline void quantize_quality_features(const float *features, const uint8_t *ids, const float *scales,
+                                      uint8_t count, int32_t *inputs) {
+    for (uint8_t i = 0; i < count; i++) {
+        // Powers of two: the multiply is exact, only the conversion rounds (toward zero)
+        float x = features[ids[i]] * scales[i];
+        inputs[i] = x >= QUALITY_INPUT_MAX ? QUALITY_INPUT_MAX :
+                    x <= -QUALITY_INPUT_MAX ? -QUALITY_INPUT_MAX : (int32_t)x;
+    }
+}
+
+// values holds the inputs on entry, scratch is as wide as the widest layer
+inline int32_t run_quality_dense(const QualityDenseLayer *layers, uint8_t count,
+                                 int32_t *values, int32_t *scratch) {
+    int32_t *in = values;
+    int32_t *out = scratch;
+
+    for (uint8_t l = 0; l < count; l++) {
+        const QualityDenseLayer &layer = layers[l];
+        const int32_t *w = layer.weights;
+
+        for (uint8_t j = 0; j < layer.outputs; j++) {
+            int32_t acc = layer.biases[j];
+            for (uint8_t i = 0; i < layer.inputs; i++) {
+                acc += w[i] * in[i];
+            }
+            w += layer.inputs;
+
+            if (layer.relu) {
+                acc = acc > 0 ? acc >> layer.shifts[j] : 0;
+            }
+            out[j] = acc;
+        }
+
+        int32_t *next = out;
+        out = in;
+        in = next;
+    }
+
+    return in[0];
+}
+
+inline int32_t run_quality_trees(const QualityTreeNode *nodes, const uint16_t *roots, uint8_t count,
+                                 const int32_t *inputs, int32_t bias) {
+    int32_t score = bias;
+
+    for (uint8_t t = 0; t < count; t++) {
+        const QualityTreeNode *node = &nodes[roots[t]];
+        while (node->feature >= 0) {
+            node = &nodes[inputs[node->feature] <= node->threshold ? node->left : node->right];
+        }
+        score += node->threshold;
+    }
+
+    return score;
+}
+
+#endif // QUALITY_INFERENCE_H
@@ -19,6 +19,7 @@ from flask import Flask, render_template, request, jsonify, send_file
 from flask_socketio import SocketIO, emit
 from bleak import BleakScanner, BleakClient
 import numpy as np
+from ingest import StreamIngest, COLUMNS
 
 # === Configuration ===
 BLE_CONFIG = {
@@ -45,6 +46,12 @@ DATA_CONFIG = {
     }
 }
 
+# Web client datasets, by the ingest column they show
+PLOT_COLUMNS = {
+    'hr': 'hr', 'spo2': 'spo2', 'temperature': 'temperature', 'force': 'fsr',
+    'ir': 'ir', 'red': 'red', 'quality': 'quality', 'accel_mag': 'accel_mag'
+}
+
 # === Logging Setup ===
 logging.basicConfig(
     level=logging.INFO,
@@ -70,19 +77,8 @@ class DashboardState:
         self.current_mode = "IDLE"
         self.mode_history = []
         
-        # Data Storage
-        max_size = DATA_CONFIG["max_buffer_size"]
-        self.data_buffers = {
-            'hr': deque(maxlen=max_size),
-            'spo2': deque(maxlen=max_size),
-            'temperature': deque(maxlen=max_size),
-            'force': deque(maxlen=max_size),
-            'ir': deque(maxlen=max_size),
-            'red': deque(maxlen=max_size),
-            'quality': deque(maxlen=max_size),
-            'accelerometer': {'x': deque(maxlen=max_size), 'y': deque(maxlen=max_size), 'z': deque(maxlen=max_size)},
-            'timestamps': deque(maxlen=max_size)
-        }
+        # Data Storage: decoded samples, one ring per stream
+        self.ingest = StreamIngest(capacity=DATA_CONFIG["max_buffer_size"])
         
         # Raw data storage for export
         self.raw_data_log = []
@@ -169,6 +165,9 @@ async def connect_to_device():
             logger.error("❌ Connection verification failed")
             return False
         
+        # The device restarts its frame sequence on every connection
+        state.ingest.reset()
+        
         # Setup notifications for all characteristics
         characteristics = BLE_CONFIG["characteristics"]
         
@@ -243,55 +242,62 @@ async def disconnect_device():
             state.connected = False
 
 def handle_data(characteristic, data):
-    """Enhanced data handler with statistics"""
+    """Enhanced data handler with statistics, one notification (JSON or binary frame) at a time"""
     try:
-        json_str = data.decode('utf-8')
-        data_obj = json.loads(json_str)
-        
-        current_time = datetime.now()
-        timestamp = current_time.timestamp() * 1000  # JS timestamp
-        
-        # Update statistics
-        state.stats['last_data_time'] = current_time
-        state.stats['total_samples'] += 1
-        
-        # Calculate data rate
-        if state.last_sample_time:
-            time_diff = (current_time - state.last_sample_time).total_seconds()
-            state.sample_times.append(time_diff)
-            if len(state.sample_times) > 1:
-                avg_interval = np.mean(list(state.sample_times))
-                state.stats['data_rate'] = 1.0 / avg_interval if avg_interval > 0 else 0
-        
-        state.last_sample_time = current_time
-        
-        # Store raw data for export
-        if state.recording and len(state.raw_data_log) < state.max_log_size:
-            state.raw_data_log.append({
-                'timestamp': current_time.isoformat(),
-                'mode': state.current_mode,
-                'data': data_obj.copy()
-            })
-        
-        # Process and store data based on mode
-        process_sensor_data(data_obj, timestamp)
-        
-        # Emit real-time data
-        socketio.emit('sensor_data', {
-            'mode': state.current_mode,
-            'data': data_obj,
-            'timestamp': timestamp,
-            'stats': {
-                'sample_count': state.stats['total_samples'],
-                'data_rate': round(state.stats['data_rate'], 2)
-            }
-        })
-        
-    except json.JSONDecodeError as e:
-        logger.error(f"❌ JSON parsing error: {e}")
+        batch = state.ingest.feed(data)
+    except ValueError as e:
+        logger.error(f"❌ Data parsing error: {e}")
         state.stats['packet_loss'] += 1
+        return
     except Exception as e:
         logger.error(f"❌ Data processing error: {e}")
+        return
+    if batch is None or not len(batch):
+        return
+    
+    current_time = datetime.now()
+    timestamp = current_time.timestamp() * 1000  # JS timestamp
+    samples = len(batch)
+    
+    # Update statistics
+    state.stats['last_data_time'] = current_time
+    state.stats['total_samples'] += samples
+    state.stats['packet_loss'] += batch.gap
+    
+    # Calculate data rate: a binary frame carries several samples
+    if state.last_sample_time:
+        time_diff = (current_time - state.last_sample_time).total_seconds()
+        state.sample_times.append(time_diff / samples)
+        if len(state.sample_times) > 1:
+            avg_interval = np.mean(state.sample_times)
+            state.stats['data_rate'] = 1.0 / avg_interval if avg_interval > 0 else 0
+    
+    state.last_sample_time = current_time
+    
+    records = batch.records()
+    
+    # Store raw data for export
+    if state.recording and len(state.raw_data_log) < state.max_log_size:
+        room = state.max_log_size - len(state.raw_data_log)
+        state.raw_data_log.extend({
+            'timestamp': current_time.isoformat(),
+            'mode': state.current_mode,
+            'data': record
+        } for record in records[:room])
+    
+    if batch.stream == state.current_mode:
+        update_realtime_stats(batch.stream)
+    
+    # Emit real-time data, the latest sample of the notification
+    socketio.emit('sensor_data', {
+        'mode': state.current_mode,
+        'data': records[-1],
+        'timestamp': timestamp,
+        'stats': {
+            'sample_count': state.stats['total_samples'],
+            'data_rate': round(state.stats['data_rate'], 2)
+        }
+    })
 
 def handle_specialized_data(characteristic, data):
     """Handle specialized data from vitals/quality characteristics"""
@@ -309,62 +315,44 @@ def handle_specialized_data(characteristic, data):
     except Exception as e:
         logger.error(f"❌ Specialized data error: {e}")
 
-def process_sensor_data(data_obj, timestamp):
-    """Process and store sensor data with statistics calculation"""
-    state.data_buffers['timestamps'].append(timestamp)
-    
-    # Process based on current mode
-    if state.current_mode == "HR_SPO2":
-        hr = data_obj.get('hr', 0)
-        spo2 = data_obj.get('spo2', 0)
-        
-        if hr > 0:  # Valid reading
-            state.data_buffers['hr'].append(hr)
-            update_realtime_stats('hr', hr)
-        
-        if spo2 > 0:  # Valid reading
-            state.data_buffers['spo2'].append(spo2)
-            update_realtime_stats('spo2', spo2)
-    
-    elif state.current_mode == "TEMPERATURE":
-        temp = data_obj.get('temperature', 0)
-        state.data_buffers['temperature'].append(temp)
-        update_realtime_stats('temperature', temp)
-    
-    elif state.current_mode in ["RAW_DATA", "QUALITY"]:
-        state.data_buffers['ir'].append(data_obj.get('ir', 0))
-        state.data_buffers['red'].append(data_obj.get('red', 0))
-        
-        if 'quality' in data_obj:
-            quality = data_obj['quality']
-            state.data_buffers['quality'].append(quality)
-            update_realtime_stats('quality', quality)
-    
-    elif state.current_mode == "FORCE_TEST":
-        force = data_obj.get('fsr', 0)
-        state.data_buffers['force'].append(force)
-    
-    # Handle accelerometer data if present
-    if 'ax' in data_obj:
-        state.data_buffers['accelerometer']['x'].append(data_obj.get('ax', 0))
-        state.data_buffers['accelerometer']['y'].append(data_obj.get('ay', 0))
-        state.data_buffers['accelerometer']['z'].append(data_obj.get('az', 0))
-
-def update_realtime_stats(metric, value):
-    """Update real-time statistics for a metric"""
-    if metric not in state.realtime_stats:
-        return
+def buffer_data():
+    """The buffered samples of the current mode, keyed like the web client's datasets"""
+    mode = state.current_mode
+    data = state.ingest.ring(mode).latest() if mode in COLUMNS else {}
     
-    stats = state.realtime_stats[metric]
-    stats['current'] = value
+    def column(name):
+        values = data.get(name)
+        # Fields a record lacks (the HR of a binary raw sample) are NaN in the ring
+        return [] if values is None else np.nan_to_num(values).tolist()
     
-    # Get current buffer for this metric
-    buffer = state.data_buffers.get(metric, deque())
-    if len(buffer) > 0:
-        values = list(buffer)
-        stats['min'] = min(values)
-        stats['max'] = max(values)
-        stats['avg'] = sum(values) / len(values)
+    return {
+        'timestamps': column('timestamp'),
+        'data': {
+            **{key: column(name) for key, name in PLOT_COLUMNS.items()},
+            'accelerometer': {'x': column('ax'), 'y': column('ay'), 'z': column('az')}
+        }
+    }
+
+def flat_buffer_data():
+    """buffer_data() without the accelerometer, for the exports"""
+    buffers = buffer_data()
+    return {'timestamps': buffers['timestamps'],
+            **{key: values for key, values in buffers['data'].items() if key != 'accelerometer'}}
+
+def update_realtime_stats(stream):
+    """Update real-time statistics from the buffered samples of a stream"""
+    data = state.ingest.ring(stream).latest()
+    for metric, stats in state.realtime_stats.items():
+        if metric not in data:
+            continue
+        values = data[metric].astype(float)
+        values = values[np.isfinite(values)]
+        if metric in ('hr', 'spo2'):
+            values = values[values > 0]  # Valid readings only
+        if len(values) == 0:
+            continue
+        stats.update({'current': float(values[-1]), 'min': float(values.min()),
+                      'max': float(values.max()), 'avg': float(values.mean())})
 
 def handle_status(characteristic, data):
     """Enhanced status handler"""
@@ -437,12 +425,7 @@ async def send_mode_command(mode):
 
 def clear_data_buffers():
     """Clear all data buffers"""
-    for key, buffer in state.data_buffers.items():
-        if isinstance(buffer, dict):
-            for sub_buffer in buffer.values():
-                sub_buffer.clear()
-        else:
-            buffer.clear()
+    state.ingest.clear()
     
     # Reset statistics
     for stats in state.realtime_stats.values():
@@ -493,16 +476,7 @@ def generate_json_export():
             'session_duration': str(datetime.now() - state.stats['session_start']) if state.stats['session_start'] else None
         },
         'data': state.raw_data_log,
-        'buffer_data': {
-            'timestamps': list(state.data_buffers['timestamps']),
-            'hr': list(state.data_buffers['hr']),
-            'spo2': list(state.data_buffers['spo2']),
-            'temperature': list(state.data_buffers['temperature']),
-            'force': list(state.data_buffers['force']),
-            'ir': list(state.data_buffers['ir']),
-            'red': list(state.data_buffers['red']),
-            'quality': list(state.data_buffers['quality'])
-        }
+        'buffer_data': flat_buffer_data()
     }
     
     return json.dumps(export_data, indent=2)
@@ -526,18 +500,7 @@ def generate_matlab_export():
     output.write(f'vitals_data.packet_loss = {state.stats["packet_loss"]};\n\n')
     
     # Export buffer data
-    buffer_data = {
-        'timestamps': list(state.data_buffers['timestamps']),
-        'hr': list(state.data_buffers['hr']),
-        'spo2': list(state.data_buffers['spo2']),
-        'temperature': list(state.data_buffers['temperature']),
-        'force': list(state.data_buffers['force']),
-        'ir': list(state.data_buffers['ir']),
-        'red': list(state.data_buffers['red']),
-        'quality': list(state.data_buffers['quality'])
-    }
-    
-    for field_name, data_list in buffer_data.items():
+    for field_name, data_list in flat_buffer_data().items():
         if data_list:
             output.write(f'% {field_name.upper()} Data\n')
             output.write(f'vitals_data.{field_name} = [')
@@ -655,8 +618,8 @@ def api_status():
             **state.stats,
             'session_duration': session_duration,
             'connection_quality': calculate_connection_quality(),
-            'buffer_sizes': {k: len(v) if not isinstance(v, dict) else {sk: len(sv) for sk, sv in v.items()} 
-                           for k, v in state.data_buffers.items()}
+            'buffer_sizes': {stream: len(ring) for stream, ring in state.ingest.rings.items()},
+            'lost_frames': state.ingest.lost_frames
         },
         'realtime_stats': state.realtime_stats,
         'recording': state.recording,
@@ -672,21 +635,7 @@ def api_status():
 def api_get_data():
     """Get current data buffers"""
     return jsonify({
-        'timestamps': list(state.data_buffers['timestamps']),
-        'data': {
-            'hr': list(state.data_buffers['hr']),
-            'spo2': list(state.data_buffers['spo2']),
-            'temperature': list(state.data_buffers['temperature']),
-            'force': list(state.data_buffers['force']),
-            'ir': list(state.data_buffers['ir']),
-            'red': list(state.data_buffers['red']),
-            'quality': list(state.data_buffers['quality']),
-            'accelerometer': {
-                'x': list(state.data_buffers['accelerometer']['x']),
-                'y': list(state.data_buffers['accelerometer']['y']),
-                'z': list(state.data_buffers['accelerometer']['z'])
-            }
-        },
+        **buffer_data(),
         'mode': state.current_mode,
         'stats': state.realtime_stats
     })
@@ -735,7 +684,7 @@ def api_clear_data():
 @app.route('/api/export/<format>')
 def api_export_data(format):
     """Export data in specified format"""
-    if not state.raw_data_log and sum(len(buffer) for buffer in state.data_buffers.values() if isinstance(buffer, deque)) == 0:
+    if not state.raw_data_log and sum(len(ring) for ring in state.ingest.rings.values()) == 0:
         return jsonify({'success': False, 'error': 'No data to export'})
     
     try:
@@ -870,18 +819,7 @@ def handle_toggle_recording():
 @socketio.on('request_data')
 def handle_data_request():
     """Handle client data request"""
-    emit('data_update', {
-        'timestamps': list(state.data_buffers['timestamps']),
-        'data': {
-            'hr': list(state.data_buffers['hr']),
-            'spo2': list(state.data_buffers['spo2']),
-            'temperature': list(state.data_buffers['temperature']),
-            'force': list(state.data_buffers['force']),
-            'ir': list(state.data_buffers['ir']),
-            'red': list(state.data_buffers['red']),
-            'quality': list(state.data_buffers['quality'])
-        }
-    })
+    emit('data_update', {**buffer_data(), 'mode': state.current_mode})
 
 @app.errorhandler(404)
 def not_found(error):
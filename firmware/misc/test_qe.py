@@ -10,7 +10,7 @@ import pandas as pd
 import matplotlib.pyplot as plt
 
 # === Settings ===
-DEVICE_NAME = "ESP32_Distance_Test"
+DEVICE_NAME = "ESP32_Unified_Sensor"     # any board, the name ends with its MAC
 CSV_FILENAME = f"distance_raw_{datetime.datetime.now().strftime('%Y%m%d_%H%M%S')}.csv"
 RESULTS_FILENAME = "qe_results.csv"
 
@@ -56,6 +56,9 @@ async def main():
 
     async with BleakClient(target.address) as client:
         await client.start_notify(RAW_DATA_CHAR_UUID, lambda _, data: handle_data(data))
+        # A reading every 100ms, an average every 10 readings
+        await send_control(client, "MODE:DISTANCE_TEST")
+        await send_control(client, "RATE:DISTANCE:10")
 
         for led in ["red", "ir", "green", "blue"]:
             await collect_data_for_led(client, led)
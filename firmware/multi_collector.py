@@ -0,0 +1,252 @@
+"""
+Collect from several ESP32 Unified Sensors at once, from one host.
+
+Every board advertises ESP32_Unified_Sensor_<last 3 MAC bytes>. One asyncio
+loop keeps a BleakClient session per board, reconnecting when one drops, and
+decodes the notifications through ingest.py. Each stream of each board goes to
+its own recording (recording.py), with a host_ms column that puts the device
+timestamps on the host clock, so the files of all boards line up. The
+recordings are written by a worker thread, the event loop never waits on disk.
+
+    python multi_collector.py [--devices N] [--mode RAW_DATA] [--duration S]
+
+<device>_<stream>.vtrec in <out>/multi_<time>/ reads back with
+recording.Recording(path) or recording.read_table(path).
+"""
+import argparse
+import asyncio
+import collections
+import concurrent.futures
+import datetime
+import json
+import time
+from pathlib import Path
+import numpy as np
+from bleak import BleakScanner, BleakClient
+from ingest import StreamIngest, COLUMNS, DEFAULT_RATES_HZ
+from recording import RecordingWriter, SUFFIX
+
+DEVICE_NAME_PREFIX = "ESP32_Unified_Sensor"
+
+SERVICE_UUID = "12345678-1234-5678-1234-56789abcdef0"
+DATA_CHAR_UUID = "abcdefab-1234-5678-1234-56789abcdef1"
+CONTROL_CHAR_UUID = "abcdefab-1234-5678-1234-56789abcdef2"
+STATUS_CHAR_UUID = "abcdefab-1234-5678-1234-56789abcdef3"
+
+CHUNK_RECORDS = 4096        # records per chunk
+CHUNK_SECONDS = 2.0         # or whatever came in that long
+RECONNECT_DELAY = 2.0
+STATUS_INTERVAL = 5.0
+CLOCK_WINDOW_SECONDS = 10.0
+CLOCK_WINDOWS = 30          # the offset follows the clock drift over 5 minutes
+
+
+class ClockAligner:
+    """
+    Maps a device's millis() to host time. Each notification gives host time
+    minus device time of its newest record: the smallest of those over the
+    last few minutes is the one that waited least in the radio and the host
+    stack. The minimum is kept per window so it follows the drift of the
+    device crystal instead of sticking to the first value.
+    """
+
+    def __init__(self):
+        self.windows = collections.deque(maxlen=CLOCK_WINDOWS)   # (host window start, min offset)
+        self.offset = None
+
+    def observe(self, host_ms, device_ms):
+        offset = host_ms - device_ms
+        start = host_ms - host_ms % int(CLOCK_WINDOW_SECONDS * 1000)
+        if self.windows and self.windows[-1][0] == start:
+            if offset < self.windows[-1][1]:
+                self.windows[-1] = (start, offset)
+        else:
+            self.windows.append((start, offset))
+        self.offset = min(window_offset for _, window_offset in self.windows)
+
+    def reset(self):
+        """The device rebooted or reconnected: its clock starts again"""
+        self.windows.clear()
+        self.offset = None
+
+
+class StreamWriter:
+    """One stream of one device: its records appended to a recording on the worker thread"""
+
+    def __init__(self, path, stream, mode, device, executor):
+        self.path = path
+        self.executor = executor
+        self.records = 0
+        self.last_flush = time.monotonic()
+        self.recording = RecordingWriter(path, stream, COLUMNS[stream] + [('host_ms', np.int64)], mode=mode,
+                                         sample_rate_hz=DEFAULT_RATES_HZ.get(stream), device=device,
+                                         time_columns={"host_ms": "ms"}, chunk_records=CHUNK_RECORDS)
+
+    def append(self, columns, host_ms):
+        # One worker thread: the records stay in order
+        self.executor.submit(self.recording.append, {**columns, 'host_ms': host_ms})
+        self.records += len(host_ms)
+        if time.monotonic() - self.last_flush >= CHUNK_SECONDS:
+            self.flush()
+
+    def flush(self):
+        self.last_flush = time.monotonic()
+        self.executor.submit(self.recording.flush)
+
+    def close(self):
+        self.executor.submit(self.recording.close)
+
+
+class DeviceSession:
+    """One board: connection, decoding, clock alignment and its writers"""
+
+    def __init__(self, device, mode, out_dir, executor, stop):
+        self.device = device
+        self.name = device.name
+        self.mode = mode
+        self.out_dir = out_dir
+        self.executor = executor
+        self.stop = stop
+        self.ingest = StreamIngest(capacity=1)   # the rings are not read: no plots here
+        self.clock = ClockAligner()
+        self.writers = {}
+        self.samples = 0
+        self.errors = 0
+        self.connected = False
+        self.status = {}
+
+    def on_data(self, data):
+        host_ms = int(time.time() * 1000)
+        try:
+            batch = self.ingest.feed(data)
+        except ValueError:
+            self.errors += 1
+            return
+        if batch is None or not len(batch) or batch.flash_log:
+            return
+
+        timestamps = batch['timestamp']
+        self.clock.observe(host_ms, int(timestamps[-1]))
+        writer = self.writers.get(batch.stream)
+        if writer is None:
+            path = self.out_dir / f"{self.name}_{batch.stream}{SUFFIX}"
+            writer = self.writers[batch.stream] = StreamWriter(path, batch.stream, self.mode, self.name, self.executor)
+        writer.append(batch.columns, timestamps + self.clock.offset)
+        self.samples += len(batch)
+
+    def on_status(self, data):
+        try:
+            self.status = json.loads(data.decode())
+        except Exception:
+            pass
+
+    def on_disconnect(self, client):
+        self.connected = False
+
+    async def run(self):
+        try:
+            while not self.stop.is_set():
+                try:
+                    await self.collect()
+                except Exception as e:
+                    print(f"❌ {self.name}: {e}")
+                self.connected = False
+                if not self.stop.is_set():
+                    await asyncio.sleep(RECONNECT_DELAY)
+        finally:
+            for writer in self.writers.values():
+                writer.close()
+
+    async def collect(self):
+        async with BleakClient(self.device, timeout=10.0, disconnected_callback=self.on_disconnect) as client:
+            # The device restarts its frame sequence on every connection
+            self.ingest.reset()
+            self.clock.reset()
+            self.connected = True
+            print(f"🔗 {self.name} connected (MTU {client.mtu_size})")
+            await client.start_notify(DATA_CHAR_UUID, lambda _, data: self.on_data(data))
+            await client.start_notify(STATUS_CHAR_UUID, lambda _, data: self.on_status(data))
+            for command in ("FORMAT:BINARY", f"MODE:{self.mode}"):
+                await client.write_gatt_char(CONTROL_CHAR_UUID, command.encode())
+
+            while self.connected and not self.stop.is_set():
+                try:
+                    await asyncio.wait_for(self.stop.wait(), timeout=STATUS_INTERVAL)
+                except asyncio.TimeoutError:
+                    pass
+                if self.connected and not self.stop.is_set():
+                    await client.write_gatt_char(CONTROL_CHAR_UUID, b"STATUS")
+
+            if self.connected:
+                # Stop streaming before the connection closes
+                await client.write_gatt_char(CONTROL_CHAR_UUID, b"MODE:IDLE")
+            for writer in self.writers.values():
+                writer.flush()
+
+
+async def find_devices(count, scan_seconds):
+    print(f"🔍 Scanning {scan_seconds:.0f}s for {DEVICE_NAME_PREFIX}_*...")
+    devices = await BleakScanner.discover(timeout=scan_seconds)
+    found = sorted((d for d in devices if d.name and d.name.startswith(DEVICE_NAME_PREFIX)), key=lambda d: d.name)
+    for device in found:
+        print(f"  - {device.name} @ {device.address}")
+    return found[:count] if count else found
+
+
+async def report(sessions, stop):
+    last = {session.name: 0 for session in sessions}
+    while not stop.is_set():
+        try:
+            await asyncio.wait_for(stop.wait(), timeout=STATUS_INTERVAL)
+        except asyncio.TimeoutError:
+            pass
+        for session in sessions:
+            rate = (session.samples - last[session.name]) / STATUS_INTERVAL
+            last[session.name] = session.samples
+            state = "connected" if session.connected else "reconnecting"
+            offset = f"{session.clock.offset} ms" if session.clock.offset is not None else "-"
+            print(f"📊 {session.name}: {state}, {rate:.0f} samples/s, lost frames {session.ingest.lost_frames}, "
+                  f"device dropped {session.status.get('raw_dropped', '-')}, clock offset {offset}")
+
+
+async def collect(args):
+    devices = await find_devices(args.devices, args.scan)
+    if not devices:
+        print(f"❌ No {DEVICE_NAME_PREFIX} found.")
+        return
+    if args.devices and len(devices) < args.devices:
+        print(f"⚠️ Only {len(devices)} of {args.devices} devices found")
+
+    out_dir = Path(args.out) / f"multi_{datetime.datetime.now().strftime('%Y%m%d_%H%M%S')}"
+    out_dir.mkdir(parents=True, exist_ok=True)
+
+    stop = asyncio.Event()
+    executor = concurrent.futures.ThreadPoolExecutor(max_workers=1)
+    sessions = [DeviceSession(device, args.mode, out_dir, executor, stop) for device in devices]
+    tasks = [asyncio.create_task(session.run()) for session in sessions]
+    tasks.append(asyncio.create_task(report(sessions, stop)))
+    try:
+        if args.duration:
+            await asyncio.sleep(args.duration)
+        else:
+            await asyncio.Event().wait()
+    finally:
+        stop.set()
+        await asyncio.gather(*tasks, return_exceptions=True)
+        executor.shutdown(wait=True)
+        for session in sessions:
+            for writer in session.writers.values():
+                print(f"💾 {writer.path} ({writer.records} records)")
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Collect from several ESP32 Unified Sensors at once")
+    parser.add_argument('--devices', type=int, default=0, help="number of boards to connect, all found by default")
+    parser.add_argument('--mode', default="RAW_DATA", help="mode started on every board (RAW_DATA, MULTI, ...)")
+    parser.add_argument('--scan', type=float, default=10.0, help="scan time in seconds")
+    parser.add_argument('--duration', type=float, default=0, help="seconds to collect, until Ctrl+C by default")
+    parser.add_argument('--out', default="../test_logs", help="directory the session folder goes in")
+    try:
+        asyncio.run(collect(parser.parse_args()))
+    except KeyboardInterrupt:
+        print("🛑 Interrupted by user.")
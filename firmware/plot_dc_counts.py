@@ -1,3 +1,4 @@
+import sys
 import matplotlib.pyplot as plt
 import numpy as np
 from collections import defaultdict
@@ -47,6 +48,20 @@ red_values = [
     4540.47, 4545.03
 ]
 
+# === Or a capture: python plot_dc_counts.py <recording or CSV> ===
+def load_capture(path):
+    """Distance, IR and Red of a distance capture: its averages when it has them"""
+    from recording import read_table
+    df = read_table(path)
+    if 'Avg_IR' in df and df['Avg_IR'].notna().any():
+        df = df[df['Avg_IR'].notna()]
+        return df['Distance_mm'].tolist(), df['Avg_IR'].tolist(), df['Avg_Red'].tolist()
+    df = df[df['IR'].notna() & df['Distance_mm'].notna()]
+    return df['Distance_mm'].tolist(), df['IR'].tolist(), df['Red'].tolist()
+
+if len(sys.argv) > 1:
+    distances, ir_values, red_values = load_capture(sys.argv[1])
+
 # === Group by distance and average ===
 ir_by_dist = defaultdict(list)
 red_by_dist = defaultdict(list)
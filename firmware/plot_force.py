@@ -7,20 +7,20 @@ from scipy.stats import pearsonr
 from sklearn.preprocessing import StandardScaler
 from sklearn.decomposition import PCA
 from sklearn.cluster import KMeans
-import glob
 import os
 from datetime import datetime
 import warnings
+from recording import read_table, glob_recordings
 warnings.filterwarnings('ignore')
 
 class VitalsDataAnalyzer:
     def __init__(self, csv_file=None):
-        """Initialize analyzer with CSV file"""
+        """Initialize analyzer with a recording or CSV file"""
         if csv_file is None:
-            # Find the most recent CSV file
-            csv_files = glob.glob("fsr_*data_*.csv")
+            # Find the most recent capture, .vtrec or .csv
+            csv_files = glob_recordings("fsr_*data_*")
             if not csv_files:
-                raise FileNotFoundError("No CSV files found. Run data collection first.")
+                raise FileNotFoundError("No recordings found. Run data collection first.")
             csv_file = max(csv_files, key=os.path.getctime)
             print(f"📁 Using most recent file: {csv_file}")
         
@@ -31,7 +31,7 @@ class VitalsDataAnalyzer:
     def load_data(self):
         """Load and preprocess data"""
         print("📊 Loading data...")
-        self.df = pd.read_csv(self.csv_file)
+        self.df = read_table(self.csv_file)
         
         # Convert timestamps
         self.df['Timestamp'] = pd.to_datetime(self.df['Timestamp'])
@@ -0,0 +1,452 @@
+"""
+Host twin of the firmware's windowed quality features (lib/ml_inference/quality_features.h).
+
+train_ml_model.py replays raw recordings (record_ml_model.py RAW_DATA captures: IR, Red,
+Ax, Ay, Az at the sensor rate) through PulseOximeterReplay, a float port of the default
+MAX30100lib chain, and QualityFeatures, so that the model is trained on the same numbers
+the device computes. Keep the constants and the feature order in step with the C++ side.
+"""
+
+import collections
+import math
+
+SAMPLING_FREQUENCY = 100            # PULSEOXIMETER_SAMPLING_RATE default
+DC_REMOVER_CUTOFF_HZ = 0.816
+PULSE_FILTER_CUTOFF_HZ = 10.0
+DENORMAL_FLUSH = 1e-10              # DCBlocker outputs below it are zeroed in the float build
+
+QUALITY_WINDOW_SAMPLES = 200
+QUALITY_BEAT_INTERVALS = 8
+QUALITY_MIN_BEAT_INTERVALS = 3
+QUALITY_MAX_BEAT_INTERVAL_MS = 2000
+
+# Same order as enum QualityFeatureId
+FEATURE_NAMES = [
+    'HeartRate',
+    'SpO2',
+    'Accel_Mag',
+    'HR_Change',
+    'SpO2_Change',
+    'Accel_Change',
+    'Perfusion_Index',
+    'PPG_Amplitude',
+    'Accel_Energy',
+    'Beat_Interval_CV',
+]
+
+# MotionCanceller
+MOTIONCANCELLER_TAPS = 4
+MOTIONCANCELLER_STEP = 0.02
+MOTIONCANCELLER_MIN_REFERENCE_MG = 20
+
+# BeatDetector
+BEATDETECTOR_INIT_HOLDOFF = 2000
+BEATDETECTOR_MASKING_HOLDOFF = 200
+BEATDETECTOR_BPFILTER_ALPHA = 0.6
+BEATDETECTOR_MIN_THRESHOLD = 20
+BEATDETECTOR_MAX_THRESHOLD = 800
+BEATDETECTOR_STEP_RESILIENCY = 30
+BEATDETECTOR_THRESHOLD_FALLOFF_TARGET = 0.3
+BEATDETECTOR_THRESHOLD_DECAY_FACTOR = 0.99
+BEATDETECTOR_INVALID_READOUT_DELAY = 2000
+
+# SpO2Calculator, VitalsEstimator
+CALCULATE_EVERY_N_BEATS = 3
+VITALSESTIMATOR_WINDOW_BEATS = 8
+VITALSESTIMATOR_MIN_BEATS = CALCULATE_EVERY_N_BEATS
+VITALSESTIMATOR_MAX_INTERVAL_CV = 0.25
+VITALSESTIMATOR_MAX_SPO2_SPREAD = 4.0
+SPO2_LUT = [100, 100, 100, 100, 99, 99, 99, 99, 99, 99, 98, 98, 98, 98,
+            98, 97, 97, 97, 97, 97, 97, 96, 96, 96, 96, 96, 96, 95, 95,
+            95, 95, 95, 95, 94, 94, 94, 94, 94, 93, 93, 93, 93, 93]
+
+
+def lround(x):
+    """C lroundf(): halves away from zero"""
+    return int(math.copysign(math.floor(abs(x) + 0.5), x))
+
+
+class DCBlocker:
+    def __init__(self, fs=SAMPLING_FREQUENCY, cutoff=DC_REMOVER_CUTOFF_HZ):
+        self.alpha = math.exp(-2 * math.pi * cutoff / fs)
+        self.x1 = 0.0
+        self.y1 = 0.0
+
+    def step(self, x):
+        y = x - self.x1 + self.alpha * self.y1
+        if -DENORMAL_FLUSH < y < DENORMAL_FLUSH:
+            y = 0.0
+        self.x1 = x
+        self.y1 = y
+        return y
+
+    def dc(self):
+        return self.x1 - self.y1
+
+
+class FirstOrderLowpass:
+    """ButterworthLowpass<Fs, fc, 1>"""
+
+    def __init__(self, fs=SAMPLING_FREQUENCY, cutoff=PULSE_FILTER_CUTOFF_HZ):
+        k = math.tan(math.pi * cutoff / fs)
+        self.b0 = k / (1 + k)
+        self.a1 = (k - 1) / (k + 1)
+        self.x1 = 0.0
+        self.y1 = 0.0
+
+    def step(self, x):
+        y = self.b0 * x + self.b0 * self.x1 - self.a1 * self.y1
+        self.x1 = x
+        self.y1 = y
+        return y
+
+
+class MotionCanceller:
+    """NLMS fit of the DC-blocked accelerometer history (mg) onto the AC value"""
+
+    def __init__(self, taps=MOTIONCANCELLER_TAPS):
+        self.axes = [DCBlocker() for _ in range(3)]
+        self.reference = [0.0] * (3 * taps)
+        self.weights = [0.0] * (3 * taps)
+        self.regularization = 3 * taps * MOTIONCANCELLER_MIN_REFERENCE_MG ** 2
+
+    def step(self, x, motion):
+        # Newest reading of each axis first
+        self.reference[3:] = self.reference[:-3]
+        self.reference[:3] = [axis.step(value) for axis, value in zip(self.axes, motion)]
+
+        artifact = sum(w * r for w, r in zip(self.weights, self.reference))
+        power = self.regularization + sum(r * r for r in self.reference)
+        e = x - artifact
+        step = MOTIONCANCELLER_STEP * e / power
+        self.weights = [w + step * r for w, r in zip(self.weights, self.reference)]
+        return e
+
+
+class BeatDetector:
+    INIT, WAITING, FOLLOWING_SLOPE, MAYBE_DETECTED, MASKING = range(5)
+
+    def __init__(self, samples_period=1000.0 / SAMPLING_FREQUENCY):
+        self.state = self.INIT
+        self.samples_period = samples_period
+        self.threshold = BEATDETECTOR_MIN_THRESHOLD
+        self.beat_period = 0.0
+        self.last_max_value = 0.0
+        self.threshold_falloff = 0.0
+        self.ts_last_beat = 0
+
+    def rate(self):
+        return 60000.0 / self.beat_period if self.beat_period else 0.0
+
+    def add_sample(self, sample, timestamp):
+        beat = False
+
+        if self.state == self.INIT:
+            if timestamp > BEATDETECTOR_INIT_HOLDOFF:
+                self.state = self.WAITING
+
+        elif self.state == self.WAITING:
+            if sample > self.threshold:
+                self.threshold = min(sample, BEATDETECTOR_MAX_THRESHOLD)
+                self.state = self.FOLLOWING_SLOPE
+            if timestamp - self.ts_last_beat > BEATDETECTOR_INVALID_READOUT_DELAY:
+                self.beat_period = 0.0
+                self.last_max_value = 0.0
+                self.threshold_falloff = 0.0
+            self._decrease_threshold()
+
+        elif self.state == self.FOLLOWING_SLOPE:
+            if sample < self.threshold:
+                self.state = self.MAYBE_DETECTED
+            else:
+                self.threshold = min(sample, BEATDETECTOR_MAX_THRESHOLD)
+
+        elif self.state == self.MAYBE_DETECTED:
+            if sample + BEATDETECTOR_STEP_RESILIENCY < self.threshold:
+                beat = True
+                self.last_max_value = sample
+                self.state = self.MASKING
+                delta = timestamp - self.ts_last_beat
+                if delta:
+                    self.beat_period = (BEATDETECTOR_BPFILTER_ALPHA * delta +
+                                        (1 - BEATDETECTOR_BPFILTER_ALPHA) * self.beat_period)
+                if self.beat_period > 0:
+                    self.threshold_falloff = (self.last_max_value * (1 - BEATDETECTOR_THRESHOLD_FALLOFF_TARGET) /
+                                              (self.beat_period / self.samples_period))
+                else:
+                    self.threshold_falloff = 0.0
+                self.ts_last_beat = timestamp
+            else:
+                self.state = self.FOLLOWING_SLOPE
+
+        elif self.state == self.MASKING:
+            if timestamp - self.ts_last_beat > BEATDETECTOR_MASKING_HOLDOFF:
+                self.state = self.WAITING
+            self._decrease_threshold()
+
+        return beat
+
+    def _decrease_threshold(self):
+        if self.last_max_value > 0 and self.beat_period > 0:
+            self.threshold -= self.threshold_falloff
+        else:
+            self.threshold *= BEATDETECTOR_THRESHOLD_DECAY_FACTOR
+        self.threshold = max(self.threshold, BEATDETECTOR_MIN_THRESHOLD)
+
+
+def spo2_from_sums(ir_sq_sum, red_sq_sum, samples):
+    """SpO2Calculator::spO2FromSums()"""
+    if not samples:
+        return 0
+    ratio = 0.0
+    log_ir = math.log(ir_sq_sum / samples) if ir_sq_sum > 0 else 0.0
+    if red_sq_sum > 0 and log_ir != 0:
+        ratio = 100.0 * math.log(red_sq_sum / samples) / log_ir
+    index = 0
+    if ratio > 66:
+        index = int(ratio) - 66
+    elif ratio > 50:
+        index = int(ratio) - 50
+    index = min(max(index, 0), len(SPO2_LUT) - 1)
+    return SPO2_LUT[index]
+
+
+class VitalsEstimator:
+    """HR, SpO2 and their confidence over a sliding window of beats"""
+
+    def __init__(self):
+        self.reset()
+
+    def reset(self):
+        self.beats = collections.deque()  # (ir_sq, red_sq, samples, interval, spo2)
+        self.ir_sq_total = self.red_sq_total = 0.0
+        self.samples_total = 0
+        self.interval_total = self.interval_sq_total = self.interval_count = 0
+        self.spo2_total = self.spo2_sq_total = 0
+        self.ir_sq_sum = self.red_sq_sum = 0.0
+        self.samples = 0
+        self.ts_last_beat = 0
+        self.heart_rate = 0.0
+        self.spo2 = 0
+        self.confidence = 0
+
+    def add_sample(self, ir_ac, red_ac):
+        self.ir_sq_sum += ir_ac * ir_ac
+        self.red_sq_sum += red_ac * red_ac
+        self.samples += 1
+
+    def add_beat(self, timestamp):
+        interval = timestamp - self.ts_last_beat if self.ts_last_beat else 0
+        beat = (self.ir_sq_sum, self.red_sq_sum, self.samples, interval,
+                spo2_from_sums(self.ir_sq_sum, self.red_sq_sum, self.samples))
+        if len(self.beats) == VITALSESTIMATOR_WINDOW_BEATS:
+            self._window(self.beats.popleft(), -1)
+        self.beats.append(beat)
+        self._window(beat, 1)
+
+        self.ir_sq_sum = self.red_sq_sum = 0.0
+        self.samples = 0
+        self.ts_last_beat = timestamp
+        self._update()
+
+    def _window(self, beat, sign):
+        ir_sq, red_sq, samples, interval, spo2 = beat
+        self.ir_sq_total += sign * ir_sq
+        self.red_sq_total += sign * red_sq
+        self.samples_total += sign * samples
+        if interval:
+            self.interval_total += sign * interval
+            self.interval_sq_total += sign * interval * interval
+            self.interval_count += sign
+        self.spo2_total += sign * spo2
+        self.spo2_sq_total += sign * spo2 * spo2
+
+    def _update(self):
+        count = len(self.beats)
+        if count < VITALSESTIMATOR_MIN_BEATS or not self.interval_count:
+            return
+        self.spo2 = spo2_from_sums(self.ir_sq_total, self.red_sq_total, self.samples_total)
+        self.heart_rate = 60000.0 * self.interval_count / self.interval_total
+
+        interval_mean = self.interval_total / self.interval_count
+        interval_variance = self.interval_sq_total / self.interval_count - interval_mean * interval_mean
+        interval_cv = math.sqrt(interval_variance) / interval_mean if interval_variance > 0 else 0.0
+        spo2_mean = self.spo2_total / count
+        spo2_variance = self.spo2_sq_total / count - spo2_mean * spo2_mean
+        spo2_spread = math.sqrt(spo2_variance) if spo2_variance > 0 else 0.0
+
+        regularity = max(0.0, 1 - interval_cv / VITALSESTIMATOR_MAX_INTERVAL_CV)
+        agreement = max(0.0, 1 - spo2_spread / VITALSESTIMATOR_MAX_SPO2_SPREAD)
+        self.confidence = lround(100.0 * count / VITALSESTIMATOR_WINDOW_BEATS * regularity * agreement)
+
+
+class PulseOximeterReplay:
+    """
+    PulseOximeter::processBlock() on the default configuration. With motion (ax, ay, az
+    in g, as recorded) the IR AC goes through the motion canceller before the beat
+    detector, as in the firmware.
+    """
+
+    IDLE, DETECTING = range(2)
+
+    def __init__(self):
+        self.ir_dc = DCBlocker()
+        self.red_dc = DCBlocker()
+        self.motion_canceller = MotionCanceller()
+        self.pulse_filter = FirstOrderLowpass()
+        self.beat_detector = BeatDetector()
+        self.vitals = VitalsEstimator()
+        self.state = self.IDLE
+
+    def process(self, ir, red, timestamp, motion=None):
+        ir_ac = self.ir_dc.step(ir)
+        red_ac = self.red_dc.step(red)
+        pulse = ir_ac
+        if motion is not None:
+            # toMilliG()
+            pulse = self.motion_canceller.step(ir_ac, [lround(g * 1000) for g in motion])
+        filtered = self.pulse_filter.step(-pulse)
+        beat = self.beat_detector.add_sample(filtered, timestamp)
+
+        if self.beat_detector.rate() > 0:
+            self.state = self.DETECTING
+            self.vitals.add_sample(ir_ac, red_ac)
+            if beat:
+                self.vitals.add_beat(timestamp)
+        elif self.state == self.DETECTING:
+            self.state = self.IDLE
+            self.vitals.reset()
+        return beat
+
+    @property
+    def heart_rate(self):
+        return self.vitals.heart_rate
+
+    @property
+    def spo2(self):
+        return self.vitals.spo2
+
+    @property
+    def confidence(self):
+        return self.vitals.confidence
+
+    @property
+    def last_beat_timestamp(self):
+        return self.beat_detector.ts_last_beat
+
+
+class RunningWindow:
+    def __init__(self, size):
+        self.size = size
+        self.reset()
+
+    def reset(self):
+        self.values = [0] * self.size
+        self.head = 0
+        self.count = 0
+        self.sum = 0
+        self.sum_sq = 0
+
+    def push(self, value):
+        if self.count == self.size:
+            oldest = self.values[self.head]
+            self.sum -= oldest
+            self.sum_sq -= oldest * oldest
+        else:
+            self.count += 1
+        self.values[self.head] = value
+        self.head = (self.head + 1) % self.size
+        self.sum += value
+        self.sum_sq += value * value
+
+    def mean(self):
+        return self.sum / self.count if self.count else 0.0
+
+    def variance(self):
+        if self.count < 2:
+            return 0.0
+        spread = self.count * self.sum_sq - self.sum * self.sum
+        return spread / (self.count * self.count) if spread > 0 else 0.0
+
+
+def clamp_int16(value):
+    return max(-32768, min(32767, value))
+
+
+class QualityFeatures:
+    def __init__(self):
+        self.reset()
+
+    def reset(self):
+        self.ir_dc = DCBlocker()
+        self.ir_ac = RunningWindow(QUALITY_WINDOW_SAMPLES)
+        self.accel_mag = RunningWindow(QUALITY_WINDOW_SAMPLES)
+        self.beat_intervals = RunningWindow(QUALITY_BEAT_INTERVALS)
+        self.last_accel_mag = 0.0
+        self.ts_last_beat = 0
+        self.previous = None
+
+    def add_sample(self, ir, ax, ay, az):
+        self.ir_ac.push(clamp_int16(lround(self.ir_dc.step(ir))))
+        self.last_accel_mag = math.sqrt(ax * ax + ay * ay + az * az)
+        self.accel_mag.push(clamp_int16(lround(self.last_accel_mag * 1000)))
+
+    def add_beat(self, timestamp):
+        if timestamp == self.ts_last_beat:
+            return
+        interval = timestamp - self.ts_last_beat
+        if self.ts_last_beat == 0 or interval > QUALITY_MAX_BEAT_INTERVAL_MS:
+            self.beat_intervals.reset()
+        else:
+            self.beat_intervals.push(interval)
+        self.ts_last_beat = timestamp
+
+    def extract(self, hr, spo2):
+        """Feature dict keyed by FEATURE_NAMES"""
+        if self.previous is None:
+            self.previous = (hr, spo2, self.last_accel_mag)
+        previous_hr, previous_spo2, previous_accel_mag = self.previous
+
+        ppg_amplitude = math.sqrt(self.ir_ac.variance())
+        dc = self.ir_dc.dc()
+        interval_mean = self.beat_intervals.mean()
+        interval_cv = 0.0
+        if self.beat_intervals.count >= QUALITY_MIN_BEAT_INTERVALS and interval_mean > 0:
+            interval_cv = math.sqrt(self.beat_intervals.variance()) / interval_mean
+
+        features = {
+            'HeartRate': hr,
+            'SpO2': spo2,
+            'Accel_Mag': self.last_accel_mag,
+            'HR_Change': abs(hr - previous_hr),
+            'SpO2_Change': abs(spo2 - previous_spo2),
+            'Accel_Change': abs(self.last_accel_mag - previous_accel_mag),
+            'Perfusion_Index': 100 * ppg_amplitude / dc if dc > 0 else 0.0,
+            'PPG_Amplitude': ppg_amplitude,
+            'Accel_Energy': self.accel_mag.variance() / 1e6,
+            'Beat_Interval_CV': interval_cv,
+        }
+        self.previous = (hr, spo2, self.last_accel_mag)
+        return features
+
+
+def replay_features(samples, assessment_period_ms=500):
+    """
+    Runs (timestamp_ms, ir, red, ax, ay, az, label) rows through the pulse oximeter and
+    the feature engine as the DSP task does, and yields (timestamp, features, label) at
+    every assessment, the label being the one of the sample that triggered it.
+    """
+    pox = PulseOximeterReplay()
+    engine = QualityFeatures()
+    ts_last_assessment = None
+
+    for timestamp, ir, red, ax, ay, az, label in samples:
+        pox.process(ir, red, timestamp, (ax, ay, az))
+        engine.add_beat(pox.last_beat_timestamp)
+        engine.add_sample(ir, ax, ay, az)
+
+        if ts_last_assessment is None:
+            ts_last_assessment = timestamp
+        if timestamp - ts_last_assessment >= assessment_period_ms:
+            ts_last_assessment = timestamp
+            yield timestamp, engine.extract(pox.heart_rate, pox.spo2), label
@@ -0,0 +1,414 @@
+"""
+Quantization and C code generation for the sensor quality models.
+
+Turns a trained model (logistic regression, small ReLU MLP or tree ensemble,
+with the StandardScaler in front of it) into a sensor_quality_model.h for the
+integer kernels of lib/ml_inference/quality_inference.h:
+
+- the scaler is folded into the first layer (or the tree thresholds)
+- every feature gets a power of two scale from its range, so it is a
+  saturated 16 bits integer on the device
+- dense weights carry the scale of the input they multiply, each layer's
+  accumulator scale comes from a worst case bound so that int32 never
+  overflows, and hidden layers requantize with a plain right shift
+- tree leaves share one scale, thresholds use the input ones
+
+Pure Python on purpose: train_ml_model.py does the sklearn side, this only
+needs the numbers (lists), so a header can be regenerated anywhere.
+
+    python quality_model_codegen.py --fixtures test/test_quality_model/fixture_models.h
+"""
+
+import argparse
+import math
+import random
+
+INPUT_BITS = 15             # |input| < 2^15, see QUALITY_INPUT_MAX
+HIDDEN_BITS = 14            # hidden activations stay below 2^14
+ACCUMULATOR_MAX = 2**31 - 1
+LEAF_MAX = 2**15 - 1
+INPUT_MAX = 32767           # QUALITY_INPUT_MAX
+
+# Largest magnitude each feature is expected to reach, sets its input scale.
+# Training data only ever widens these
+FEATURE_RANGES = {
+    'HeartRate': 250.0,
+    'SpO2': 100.0,
+    'Accel_Mag': 16.0,
+    'HR_Change': 250.0,
+    'SpO2_Change': 100.0,
+    'Accel_Change': 16.0,
+    'Perfusion_Index': 100.0,
+    'PPG_Amplitude': 32767.0,
+    'Accel_Energy': 16.0,
+    'Beat_Interval_CV': 4.0,
+}
+
+
+def input_shift(value_range):
+    """Largest s with value_range * 2^s below 2^(INPUT_BITS - 1)"""
+    if value_range <= 0:
+        return INPUT_BITS - 1
+    return INPUT_BITS - 1 - math.ceil(math.log2(value_range))
+
+
+def accumulator_shift(bound):
+    """Largest A with bound * 2^A within the int32 accumulator"""
+    if bound <= 0:
+        return 30
+    return min(30, math.floor(math.log2(ACCUMULATOR_MAX / bound)))
+
+
+def fold_scaler(weights, biases, mean, scale):
+    """Dense layer on standardized inputs -> same layer on raw inputs: W/s, b - W.m/s"""
+    folded_weights = [[w / s for w, s in zip(row, scale)] for row in weights]
+    folded_biases = [b - sum(w * m / s for w, m, s in zip(row, mean, scale))
+                     for row, b in zip(weights, biases)]
+    return folded_weights, folded_biases
+
+
+def quantize_dense(layers, shifts):
+    """
+    layers: [(weights[out][in], biases[out]), ...] on raw inputs, ReLU between them
+    shifts: per-input power of two scales
+    """
+    quantized = []
+    in_shifts = list(shifts)
+    in_bits = INPUT_BITS
+
+    for index, (weights, biases) in enumerate(layers):
+        hidden = index < len(layers) - 1
+        q_weights, q_biases, out_shifts, requant = [], [], [], []
+
+        for row, bias in zip(weights, biases):
+            # Worst case of the accumulator in real units, inputs at full swing
+            bound = abs(bias) + sum(abs(w) * 2.0 ** (in_bits - s) for w, s in zip(row, in_shifts))
+            a = accumulator_shift(bound)
+            q_weights.append([round(w * 2.0 ** (a - s)) for w, s in zip(row, in_shifts)])
+            q_biases.append(round(bias * 2.0 ** a))
+
+            if hidden:
+                h = HIDDEN_BITS - math.ceil(math.log2(bound)) if bound > 0 else HIDDEN_BITS
+                h = min(h, a)
+                requant.append(a - h)
+                out_shifts.append(h)
+
+        quantized.append({
+            'inputs': len(in_shifts),
+            'outputs': len(weights),
+            'weights': q_weights,
+            'biases': q_biases,
+            'shifts': requant if hidden else None,
+            'relu': hidden,
+        })
+        in_shifts = out_shifts
+        in_bits = HIDDEN_BITS
+
+    return quantized
+
+
+def quantize_trees(trees, bias, shifts, mean=None, scale=None):
+    """
+    trees: [{'feature': [...], 'threshold': [...], 'left': [...], 'right': [...], 'value': [...]}]
+    in sklearn's tree_ layout (feature -1 on leaves), thresholds on standardized inputs
+    when mean/scale are given. The score is bias + the sum of the reached leaf values.
+    """
+    max_leaf = max(abs(v) for tree in trees for v, f in zip(tree['value'], tree['feature']) if f < 0)
+    bound = abs(bias) + sum(max(abs(v) for v, f in zip(tree['value'], tree['feature']) if f < 0)
+                            for tree in trees)
+    leaf_shift = min(accumulator_shift(bound),
+                     INPUT_BITS - 1 - math.ceil(math.log2(max_leaf)) if max_leaf > 0 else INPUT_BITS - 1)
+
+    nodes, roots = [], []
+    for tree in trees:
+        base = len(nodes)
+        roots.append(base)
+        for node, feature in enumerate(tree['feature']):
+            if feature < 0:
+                value = max(-LEAF_MAX, min(LEAF_MAX, round(tree['value'][node] * 2.0 ** leaf_shift)))
+                nodes.append((-1, value, 0, 0))
+                continue
+            threshold = tree['threshold'][node]
+            if mean is not None:
+                threshold = threshold * scale[feature] + mean[feature]
+            # x <= t  <=>  trunc(x * 2^s) <= floor(t * 2^s) for the non-negative features
+            q = math.floor(threshold * 2.0 ** shifts[feature])
+            q = max(-LEAF_MAX, min(LEAF_MAX, q))
+            nodes.append((feature, q, base + tree['left'][node], base + tree['right'][node]))
+
+    return {'nodes': nodes, 'roots': roots, 'bias': round(bias * 2.0 ** leaf_shift)}
+
+
+def quantize_inputs(features, shifts):
+    """quantize_quality_features() on one feature vector (model order)"""
+    values = []
+    for x, s in zip(features, shifts):
+        q = x * 2.0 ** s
+        values.append(INPUT_MAX if q >= INPUT_MAX else -INPUT_MAX if q <= -INPUT_MAX else int(q))
+    return values
+
+
+def score_dense(quantized, shifts, features):
+    """run_quality_dense() on one feature vector, to check a model before flashing it"""
+    values = quantize_inputs(features, shifts)
+    for layer in quantized:
+        out = []
+        for j, (row, bias) in enumerate(zip(layer['weights'], layer['biases'])):
+            acc = bias + sum(w * v for w, v in zip(row, values))
+            if layer['relu']:
+                acc = acc >> layer['shifts'][j] if acc > 0 else 0
+            out.append(acc)
+        values = out
+    return values[0]
+
+
+def score_trees(quantized, shifts, features):
+    """run_quality_trees() on one feature vector"""
+    values = quantize_inputs(features, shifts)
+    score = quantized['bias']
+    for root in quantized['roots']:
+        feature, threshold, left, right = quantized['nodes'][root]
+        while feature >= 0:
+            feature, threshold, left, right = quantized['nodes'][left if values[feature] <= threshold else right]
+        score += threshold
+    return score
+
+
+def float_literal(value):
+    text = repr(float(value))
+    return text + 'f'
+
+
+def emit_array(ctype, name, values, comments=None, per_line=8):
+    lines = [f"const {ctype} {name}[{len(values)}] = {{"]
+    if comments:
+        for i, (value, comment) in enumerate(zip(values, comments)):
+            lines.append(f"    {value}{',' if i < len(values) - 1 else ''} // {comment}")
+    else:
+        for start in range(0, len(values), per_line):
+            chunk = ', '.join(str(v) for v in values[start:start + per_line])
+            lines.append(f"    {chunk}{',' if start + per_line < len(values) else ''}")
+    lines.append("};")
+    return '\n'.join(lines) + '\n\n'
+
+
+def emit_model(feature_names, shifts, kind, description, quantized, prefix='model', guard=None):
+    """C declarations and predict function for one quantized model"""
+    text = f"// {description}\n"
+    text += emit_array('uint8_t', f'{prefix}_features',
+                       [f"QUALITY_FEATURE_{name.upper()}" for name in feature_names], feature_names)
+    text += "// Per-channel input scales, powers of two\n"
+    text += emit_array('float', f'{prefix}_input_scales',
+                       [float_literal(2.0 ** s) for s in shifts], feature_names)
+
+    if kind == 'dense':
+        width = max([len(feature_names)] + [layer['outputs'] for layer in quantized])
+        entries = []
+        for index, layer in enumerate(quantized):
+            flat = [w for row in layer['weights'] for w in row]
+            text += emit_array('int32_t', f'{prefix}_layer{index}_weights', flat)
+            text += emit_array('int32_t', f'{prefix}_layer{index}_biases', layer['biases'])
+            shifts_name = 'NULL'
+            if layer['shifts'] is not None:
+                text += emit_array('uint8_t', f'{prefix}_layer{index}_shifts', layer['shifts'])
+                shifts_name = f'{prefix}_layer{index}_shifts'
+            entries.append(f"    {{{layer['inputs']}, {layer['outputs']}, {prefix}_layer{index}_weights, "
+                           f"{prefix}_layer{index}_biases, {shifts_name}, {'true' if layer['relu'] else 'false'}}}")
+        text += f"const QualityDenseLayer {prefix}_layers[{len(quantized)}] = {{\n" + ',\n'.join(entries) + "\n};\n\n"
+        text += f"""// Score of the model, positive for good quality
+inline int32_t {prefix}_score(const float features[QUALITY_FEATURE_COUNT]) {{
+    int32_t values[{width}];
+    int32_t scratch[{width}];
+    quantize_quality_features(features, {prefix}_features, {prefix}_input_scales, {len(feature_names)}, values);
+    return run_quality_dense({prefix}_layers, {len(quantized)}, values, scratch);
+}}
+
+"""
+    else:
+        text += f"const QualityTreeNode {prefix}_nodes[{len(quantized['nodes'])}] = {{\n"
+        text += ',\n'.join(f"    {{{f}, {t}, {l}, {r}}}" for f, t, l, r in quantized['nodes'])
+        text += "\n};\n\n"
+        text += emit_array('uint16_t', f'{prefix}_tree_roots', quantized['roots'])
+        text += f"""// Score of the model, positive for good quality
+inline int32_t {prefix}_score(const float features[QUALITY_FEATURE_COUNT]) {{
+    int32_t values[{len(feature_names)}];
+    quantize_quality_features(features, {prefix}_features, {prefix}_input_scales, {len(feature_names)}, values);
+    return run_quality_trees({prefix}_nodes, {prefix}_tree_roots, {len(quantized['roots'])}, values, {quantized['bias']});
+}}
+
+"""
+    return text
+
+
+def generate_header(path, feature_names, shifts, kind, description, quantized):
+    """sensor_quality_model.h for the firmware"""
+    content = f"""#ifndef SENSOR_QUALITY_MODEL_H
+#define SENSOR_QUALITY_MODEL_H
+
+// Lightweight Sensor Quality Assessment Model
+// Generated automatically by train_ml_model.py - DO NOT EDIT MANUALLY
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "quality_features.h"
+#include "quality_inference.h"
+
+#define NUM_FEATURES {len(feature_names)}
+
+"""
+    content += emit_model(feature_names, shifts, kind, description, quantized)
+    content += """// Returns: 1 for good quality, 0 for poor quality
+inline int predict_quality(const float features[QUALITY_FEATURE_COUNT]) {
+    return model_score(features) > 0 ? 1 : 0;
+}
+
+// Quality assessment from instantaneous features only, for sketches without
+// the windowed engine: the windowed features read as 0
+inline int assess_sensor_quality(float hr, float spo2, float ax, float ay, float az,
+                                float hr_prev, float spo2_prev, float accel_prev) {
+    float features[QUALITY_FEATURE_COUNT] = {0};
+
+    // Calculate features
+    float accel_mag = sqrt(ax*ax + ay*ay + az*az);
+
+    features[QUALITY_FEATURE_HEARTRATE] = hr;
+    features[QUALITY_FEATURE_SPO2] = spo2;
+    features[QUALITY_FEATURE_ACCEL_MAG] = accel_mag;
+    features[QUALITY_FEATURE_HR_CHANGE] = fabs(hr - hr_prev);
+    features[QUALITY_FEATURE_SPO2_CHANGE] = fabs(spo2 - spo2_prev);
+    features[QUALITY_FEATURE_ACCEL_CHANGE] = fabs(accel_mag - accel_prev);
+
+    return predict_quality(features);
+}
+
+#endif // SENSOR_QUALITY_MODEL_H
+"""
+    with open(path, 'w') as f:
+        f.write(content)
+
+
+def feature_shifts(feature_names, observed_max=None):
+    shifts = []
+    for name in feature_names:
+        value_range = FEATURE_RANGES.get(name, 1.0)
+        if observed_max and name in observed_max:
+            value_range = max(value_range, observed_max[name])
+        shifts.append(input_shift(value_range))
+    return shifts
+
+
+def emit_float_reference(prefix, feature_names, kind, params):
+    """Float evaluation of the same model, for the host tests"""
+    ids = ', '.join(f"QUALITY_FEATURE_{name.upper()}" for name in feature_names)
+    text = f"const uint8_t {prefix}_reference_features[{len(feature_names)}] = {{{ids}}};\n"
+    if kind == 'dense':
+        for index, (weights, biases) in enumerate(params):
+            flat = ', '.join(repr(w) for row in weights for w in row)
+            text += f"const double {prefix}_reference_w{index}[] = {{{flat}}};\n"
+            text += f"const double {prefix}_reference_b{index}[] = {{{', '.join(repr(b) for b in biases)}}};\n"
+        text += f"const size_t {prefix}_reference_sizes[] = {{{len(feature_names)}, "
+        text += ', '.join(str(len(b)) for _, b in params) + "};\n"
+        text += f"const double* const {prefix}_reference_weights[] = {{"
+        text += ', '.join(f"{prefix}_reference_w{i}" for i in range(len(params))) + "};\n"
+        text += f"const double* const {prefix}_reference_biases[] = {{"
+        text += ', '.join(f"{prefix}_reference_b{i}" for i in range(len(params))) + "};\n"
+        text += f"const size_t {prefix}_reference_layers = {len(params)};\n\n"
+    else:
+        trees, bias = params
+        for index, tree in enumerate(trees):
+            text += f"const int {prefix}_reference_t{index}_feature[] = {{{', '.join(str(f) for f in tree['feature'])}}};\n"
+            text += f"const double {prefix}_reference_t{index}_threshold[] = {{{', '.join(repr(t) for t in tree['threshold'])}}};\n"
+            text += f"const int {prefix}_reference_t{index}_left[] = {{{', '.join(str(v) for v in tree['left'])}}};\n"
+            text += f"const int {prefix}_reference_t{index}_right[] = {{{', '.join(str(v) for v in tree['right'])}}};\n"
+            text += f"const double {prefix}_reference_t{index}_value[] = {{{', '.join(repr(v) for v in tree['value'])}}};\n"
+        for field, ctype in [('feature', 'int'), ('threshold', 'double'), ('left', 'int'), ('right', 'int'), ('value', 'double')]:
+            text += f"const {ctype}* const {prefix}_reference_{field}[] = {{"
+            text += ', '.join(f"{prefix}_reference_t{i}_{field}" for i in range(len(trees))) + "};\n"
+        text += f"const size_t {prefix}_reference_trees = {len(trees)};\n"
+        text += f"const double {prefix}_reference_bias = {bias!r};\n\n"
+    return text
+
+
+def random_tree(rng, features, depth, leaf_value):
+    """sklearn-like flattened tree of the given depth on random splits"""
+    tree = {'feature': [], 'threshold': [], 'left': [], 'right': [], 'value': []}
+
+    def build(level):
+        node = len(tree['feature'])
+        for field in tree:
+            tree[field].append(-1 if field in ('feature', 'left', 'right') else 0.0)
+        if level == depth:
+            tree['value'][node] = leaf_value(rng)
+            return node
+        feature = rng.randrange(len(features))
+        low, high = features[feature]
+        tree['feature'][node] = feature
+        tree['threshold'][node] = rng.uniform(low, high)
+        tree['left'][node] = build(level + 1)
+        tree['right'][node] = build(level + 1)
+        return node
+
+    build(0)
+    return tree
+
+
+def generate_fixtures(path):
+    """Deterministic MLP and tree ensemble over the windowed features, for the host tests"""
+    rng = random.Random(16)
+    names = ['HeartRate', 'SpO2', 'HR_Change', 'Perfusion_Index', 'PPG_Amplitude', 'Accel_Energy', 'Beat_Interval_CV']
+    typical = {'HeartRate': (40, 120), 'SpO2': (85, 100), 'HR_Change': (0, 20), 'Perfusion_Index': (0.1, 5),
+               'PPG_Amplitude': (20, 2000), 'Accel_Energy': (0, 0.05), 'Beat_Interval_CV': (0, 0.5)}
+    shifts = feature_shifts(names)
+
+    # Standardized MLP 7-8-1, as MLPClassifier would hand it over
+    mean = [(typical[n][0] + typical[n][1]) / 2 for n in names]
+    scale = [(typical[n][1] - typical[n][0]) / 4 for n in names]
+    hidden = 8
+    w1 = [[rng.gauss(0, 0.8) for _ in names] for _ in range(hidden)]
+    b1 = [rng.gauss(0, 0.3) for _ in range(hidden)]
+    w2 = [[rng.gauss(0, 0.8) for _ in range(hidden)]]
+    b2 = [rng.gauss(0, 0.3)]
+    fw1, fb1 = fold_scaler(w1, b1, mean, scale)
+    mlp_layers = [(fw1, fb1), (w2, b2)]
+    mlp = quantize_dense(mlp_layers, shifts)
+
+    # Forest-like ensemble: leaves are P(good) - 0.5, on raw feature thresholds
+    trees = [random_tree(rng, [typical[n] for n in names], 3, lambda r: r.uniform(-0.5, 0.5)) for _ in range(8)]
+    forest = quantize_trees(trees, 0.0, shifts)
+
+    content = """#ifndef QUALITY_MODEL_FIXTURES_H
+#define QUALITY_MODEL_FIXTURES_H
+
+// Generated by quality_model_codegen.py --fixtures - DO NOT EDIT MANUALLY
+// Random MLP and tree ensemble over the windowed features, quantized for the
+// integer kernels, with the float models they come from as the reference
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "quality_features.h"
+#include "quality_inference.h"
+
+"""
+    content += emit_model(names, shifts, 'dense', 'MLP 7-8-1, ReLU', mlp, prefix='fixture_mlp')
+    content += emit_float_reference('fixture_mlp', names, 'dense', mlp_layers)
+    content += emit_model(names, shifts, 'trees', '8 trees of depth 3', forest, prefix='fixture_forest')
+    content += emit_float_reference('fixture_forest', names, 'trees', (trees, 0.0))
+    content += "#endif // QUALITY_MODEL_FIXTURES_H\n"
+
+    with open(path, 'w') as f:
+        f.write(content)
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Quality model code generation")
+    parser.add_argument('--fixtures', help="write the host test fixtures to this header")
+    args = parser.parse_args()
+
+    if args.fixtures:
+        generate_fixtures(args.fixtures)
+        print(f"✅ Fixtures generated: {args.fixtures}")
+    else:
+        parser.print_help()
@@ -1,16 +1,16 @@
 import asyncio
-import csv
 import datetime
-import json
+import time
 from bleak import BleakScanner, BleakClient
-from collections import deque
 import threading
-import time
 import queue
+import numpy as np
+from ingest import StreamIngest, DEFAULT_RATES_HZ
+from recording import RecordingWriter
 
 # === Settings ===
 LIVE_PLOT = True
-CSV_FILENAME = "../test_logs/oximeter_data.csv"
+RECORDING_FILENAME = "../test_logs/oximeter_data.vtrec"
 DEVICE_NAME = "ESP32_Sensor"
 
 # === BLE UUIDs ===
@@ -18,47 +18,35 @@ CUSTOM_SERVICE_UUID = "12345678-1234-5678-1234-56789abcdef0"
 CUSTOM_CHAR_UUID    = "abcdefab-1234-5678-1234-56789abcdef1"
 
 # === Data Storage ===
-hr_data = deque(maxlen=100)
-spo2_data = deque(maxlen=100)
-ax_data = deque(maxlen=100)
-ay_data = deque(maxlen=100)
-az_data = deque(maxlen=100)
-time_data = deque(maxlen=100)
+PLOT_POINTS = 100
+ingest = StreamIngest(capacity=PLOT_POINTS)
 
 # === Threading control ===
 ble_running = False
 data_queue = queue.Queue()
 
-# === CSV Setup ===
-csv_file = open(CSV_FILENAME, mode='w', newline='')
-csv_writer = csv.writer(csv_file)
-csv_writer.writerow(["Timestamp", "HeartRate", "SpO2", "Ax", "Ay", "Az"])
+# === Recording Setup ===
+recording = RecordingWriter(RECORDING_FILENAME, "HR_SPO2",
+                            [("Timestamp", np.int64), ("HeartRate", np.float64), ("SpO2", np.float64),
+                             ("Ax", np.float64), ("Ay", np.float64), ("Az", np.float64)],
+                            sample_rate_hz=DEFAULT_RATES_HZ["HR_SPO2"], time_columns={"Timestamp": "ms"})
 
 
 def parse_sensor_data(data: bytearray):
     try:
-        obj = json.loads(data.decode())
-        timestamp = datetime.datetime.now().isoformat()
-        hr = int(obj["hr"])
-        spo2 = int(obj["spo2"])
-        ax = float(obj["ax"])
-        ay = float(obj["ay"])
-        az = float(obj["az"])
-
-        print(f"[{timestamp}] HR: {hr} bpm | SpO₂: {spo2}% | Acc: x={ax:.2f} y={ay:.2f} z={az:.2f}")
-
-        # Put data in queue for main thread to process
-        data_queue.put({
-            'timestamp': timestamp,
-            'hr': hr,
-            'spo2': spo2,
-            'ax': ax,
-            'ay': ay,
-            'az': az
-        })
-
-    except Exception as e:
+        batch = ingest.feed(data)
+    except ValueError as e:
         print("❌ Parse error:", e)
+        return
+    if batch is None or batch.stream != "HR_SPO2":
+        return
+
+    timestamp = int(time.time() * 1000)
+    hr, spo2, ax, ay, az = (batch[name][-1] for name in ('hr', 'spo2', 'ax', 'ay', 'az'))
+    print(f"[{datetime.datetime.now().isoformat()}] HR: {hr:.0f} bpm | SpO₂: {spo2:.0f}% | Acc: x={ax:.2f} y={ay:.2f} z={az:.2f}")
+
+    # The ring has the plot data, the main thread writes the recording
+    data_queue.put((timestamp, batch))
 
 
 async def ble_worker():
@@ -111,31 +99,13 @@ def run_ble_in_thread():
 
 def process_data_queue():
     """Process queued data from BLE thread"""
-    while not data_queue.empty():
+    while True:
         try:
-            data = data_queue.get_nowait()
-            
-            # Update plot data
-            time_data.append(time.time())
-            hr_data.append(data['hr'])
-            spo2_data.append(data['spo2'])
-            ax_data.append(data['ax'])
-            ay_data.append(data['ay'])
-            az_data.append(data['az'])
-            
-            # Save to CSV
-            csv_writer.writerow([
-                data['timestamp'], 
-                data['hr'], 
-                data['spo2'], 
-                data['ax'], 
-                data['ay'], 
-                data['az']
-            ])
-            csv_file.flush()
-            
+            timestamp, batch = data_queue.get_nowait()
         except queue.Empty:
             break
+        recording.append({"Timestamp": timestamp, "HeartRate": batch['hr'], "SpO2": batch['spo2'],
+                          "Ax": batch['ax'], "Ay": batch['ay'], "Az": batch['az']})
 
 
 def main():
@@ -185,23 +155,24 @@ def main():
             # Process any new data from BLE thread
             process_data_queue()
             
-            if len(hr_data) == 0:
+            data = ingest.ring("HR_SPO2").latest()
+            n = len(data['hr'])
+            if n == 0:
                 return hr_line, spo2_line, ax_line, ay_line, az_line
             
             # Create x-axis as sample indices
-            x = list(range(len(hr_data)))
+            x = range(n)
             
             # Update data
-            hr_line.set_data(x, list(hr_data))
-            spo2_line.set_data(x, list(spo2_data))
-            ax_line.set_data(x, list(ax_data))
-            ay_line.set_data(x, list(ay_data))
-            az_line.set_data(x, list(az_data))
+            hr_line.set_data(x, data['hr'])
+            spo2_line.set_data(x, data['spo2'])
+            ax_line.set_data(x, data['ax'])
+            ay_line.set_data(x, data['ay'])
+            az_line.set_data(x, data['az'])
 
             # Update x-axis limits to show last 50 points
-            if len(hr_data) > 0:
-                axs[0].set_xlim(max(0, len(hr_data) - 50), len(hr_data))
-                axs[1].set_xlim(max(0, len(hr_data) - 50), len(hr_data))
+            axs[0].set_xlim(max(0, n - 50), n)
+            axs[1].set_xlim(max(0, n - 50), n)
 
             return hr_line, spo2_line, ax_line, ay_line, az_line
 
@@ -247,5 +218,5 @@ if __name__ == "__main__":
         main()
     finally:
         ble_running = False
-        csv_file.close()
-        print(f"💾 Data saved to {CSV_FILENAME}")
+        recording.close()
+        print(f"💾 Data saved to {RECORDING_FILENAME}")
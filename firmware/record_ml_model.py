@@ -1,70 +1,67 @@
 import asyncio
 import json
 import datetime
-import csv
 import numpy as np
 import matplotlib.pyplot as plt
 from matplotlib.animation import FuncAnimation
-from collections import deque
 import threading
 import time
 import queue
 from bleak import BleakScanner, BleakClient
+from ingest import StreamIngest, COLUMNS, DEFAULT_RATES_HZ
+from recording import RecordingWriter, CATEGORY, SUFFIX
 
 # === Settings ===
-DEVICE_NAME_QUALITY = "ESP32_Quality_Monitor"
-DEVICE_NAME_RAW = "ESP32_Raw_Collector"
+DEVICE_NAME = "ESP32_Unified_Sensor"
+STATUS_INTERVAL = 5.0  # seconds between STATUS requests, to log the device's drop counter
 
 # === BLE UUIDs ===
 SERVICE_UUID = "12345678-1234-5678-1234-56789abcdef0"
-VITALS_DATA_CHAR_UUID = "abcdefab-1234-5678-1234-56789abcdef3"
-QUALITY_CHAR_UUID = "abcdefab-1234-5678-1234-56789abcdef4"
+DATA_CHAR_UUID = "abcdefab-1234-5678-1234-56789abcdef1"
 CONTROL_CHAR_UUID = "abcdefab-1234-5678-1234-56789abcdef2"
-RAW_DATA_CHAR_UUID = "abcdefab-1234-5678-1234-56789abcdef1"
+STATUS_CHAR_UUID = "abcdefab-1234-5678-1234-56789abcdef3"
 
 # === Global variables ===
 ble_running = False
 data_queue = queue.Queue()
 command_queue = queue.Queue()
+current_label = "unlabeled"   # Raw mode labels are applied host-side, per sample
+ingest = StreamIngest()
 
 class QualityReceiver:
     def __init__(self, mode="quality", buffer_size=100):
         self.mode = mode
-        self.buffer_size = buffer_size
-        
-        # Data buffers for plotting
-        self.timestamps = deque(maxlen=buffer_size)
-        self.heart_rates = deque(maxlen=buffer_size)
-        self.spo2_values = deque(maxlen=buffer_size)
-        self.ax_values = deque(maxlen=buffer_size)
-        self.ay_values = deque(maxlen=buffer_size)
-        self.az_values = deque(maxlen=buffer_size)
-        self.accel_mag = deque(maxlen=buffer_size)
-        self.quality_values = deque(maxlen=buffer_size)
+        self.stream = "QUALITY" if mode == "quality" else "RAW_DATA"
+        self.buffer_size = buffer_size   # Samples on screen, read from the ingest ring
         
         # Statistics
         self.total_samples = 0
         self.good_samples = 0
         self.current_label = "unlabeled"
         
-        # Setup CSV
+        # Setup recording: the CSV's columns, Timestamp being host time in ms
         timestamp = datetime.datetime.now().strftime('%Y%m%d_%H%M%S')
         if mode == "quality":
-            self.csv_filename = f"quality_data_{timestamp}.csv"
-            self.csv_headers = ["Timestamp", "HR", "SpO2", "Ax", "Ay", "Az", "Quality", "Accel_Mag", "Device_Timestamp"]
+            self.filename = f"quality_data_{timestamp}{SUFFIX}"
+            self.sources = {"HR": 'hr', "SpO2": 'spo2', "Ax": 'ax', "Ay": 'ay', "Az": 'az',
+                            "Quality": 'quality', "Accel_Mag": 'accel_mag', "Device_Timestamp": 'timestamp'}
         else:
-            self.csv_filename = f"raw_data_{timestamp}.csv"
-            self.csv_headers = ["Timestamp", "HR", "SpO2", "Ax", "Ay", "Az", "Label", "Device_Timestamp"]
+            self.filename = f"raw_data_{timestamp}{SUFFIX}"
+            self.sources = {"IR": 'ir', "Red": 'red', "Ax": 'ax', "Ay": 'ay', "Az": 'az',
+                            "Label": None, "Device_Timestamp": 'timestamp'}
         
-        self.setup_csv()
+        self.setup_recording()
         self.setup_plots()
     
-    def setup_csv(self):
-        """Initialize CSV file"""
-        self.csv_file = open(self.csv_filename, mode='w', newline='')
-        self.csv_writer = csv.writer(self.csv_file)
-        self.csv_writer.writerow(self.csv_headers)
-        print(f"CSV file created: {self.csv_filename}")
+    def setup_recording(self):
+        """Initialize the recording file"""
+        dtypes = dict(COLUMNS[self.stream])
+        columns = [("Timestamp", np.int64)] + [
+            (name, dtypes[source] if source else CATEGORY) for name, source in self.sources.items()]
+        self.recording = RecordingWriter(self.filename, self.stream, columns,
+                                         sample_rate_hz=DEFAULT_RATES_HZ[self.stream],
+                                         time_columns={"Timestamp": "ms"})
+        print(f"Recording created: {self.filename}")
     
     def setup_plots(self):
         """Setup matplotlib plots"""
@@ -117,11 +114,11 @@ class QualityReceiver:
             self.fig, self.axes = plt.subplots(2, 2, figsize=(12, 8))
             self.fig.suptitle('Raw Data Collection Monitor', fontsize=16, fontweight='bold')
             
-            self.ax_hr = self.axes[0, 0]
-            self.ax_hr.set_title('Heart Rate (BPM)', fontweight='bold', color='red')
+            self.ax_ir = self.axes[0, 0]
+            self.ax_ir.set_title('IR (counts)', fontweight='bold', color='red')
             
-            self.ax_spo2 = self.axes[0, 1]
-            self.ax_spo2.set_title('Blood Oxygen (SpO2)', fontweight='bold', color='blue')
+            self.ax_red = self.axes[0, 1]
+            self.ax_red.set_title('Red (counts)', fontweight='bold', color='blue')
             
             self.ax_accel = self.axes[1, 0]
             self.ax_accel.set_title('Accelerometer', fontweight='bold', color='green')
@@ -133,63 +130,32 @@ class QualityReceiver:
         plt.tight_layout()
     
     def process_data_queue(self):
-        """Process queued data from BLE thread"""
-        while not data_queue.empty():
+        """Append the batches queued by the BLE thread to the recording"""
+        while True:
             try:
-                data = data_queue.get_nowait()
-                
-                # Update plot data
-                self.timestamps.append(time.time())
-                self.heart_rates.append(data['hr'])
-                self.spo2_values.append(data['spo2'])
-                self.ax_values.append(data['ax'])
-                self.ay_values.append(data['ay'])
-                self.az_values.append(data['az'])
-                self.accel_mag.append(data.get('accel_mag', 
-                    np.sqrt(data['ax']**2 + data['ay']**2 + data['az']**2)))
-                
-                if self.mode == "quality":
-                    self.quality_values.append(data['quality'])
-                    self.total_samples += 1
-                    if data['quality'] == 1:
-                        self.good_samples += 1
-                else:
-                    self.current_label = data.get('label', 'unlabeled')
-                
-                # Save to CSV
-                if self.mode == "quality":
-                    self.csv_writer.writerow([
-                        datetime.datetime.now().isoformat(),
-                        data['hr'], data['spo2'],
-                        data['ax'], data['ay'], data['az'],
-                        data['quality'],
-                        data.get('accel_mag', 0),
-                        data['timestamp']
-                    ])
-                else:
-                    self.csv_writer.writerow([
-                        datetime.datetime.now().isoformat(),
-                        data['hr'], data['spo2'],
-                        data['ax'], data['ay'], data['az'],
-                        data.get('label', 'unlabeled'),
-                        data['timestamp']
-                    ])
-                
-                self.csv_file.flush()
-                
+                timestamp, label, batch = data_queue.get_nowait()
             except queue.Empty:
                 break
+            
+            self.total_samples += len(batch)
+            if self.mode == "quality":
+                self.good_samples += int(np.count_nonzero(batch['quality'] == 1))
+            else:
+                self.current_label = label
+            columns = {name: batch[source] if source else label for name, source in self.sources.items()}
+            self.recording.append({"Timestamp": timestamp, **columns})
     
     def update_plots(self, frame):
         """Update all plots with latest data"""
         # Process any new data from BLE thread
         self.process_data_queue()
         
-        if len(self.timestamps) == 0:
+        data = ingest.ring(self.stream).latest(self.buffer_size)
+        if len(data['timestamp']) == 0:
             return
         
-        # Convert timestamps to relative seconds for x-axis
-        time_array = [t - self.timestamps[0] for t in self.timestamps]
+        # Samples arrive in bursts: plot against the device clock, in seconds
+        time_array = (data['timestamp'] - data['timestamp'][0]) / 1000.0
         
         if self.mode == "quality":
             # Clear all axes
@@ -197,20 +163,20 @@ class QualityReceiver:
                 ax.clear()
             
             # Heart Rate
-            self.ax_hr.plot(time_array, list(self.heart_rates), 'r-', linewidth=2)
+            self.ax_hr.plot(time_array, data['hr'], 'r-', linewidth=2)
             self.ax_hr.set_title('Heart Rate (BPM)', fontweight='bold', color='red')
             self.ax_hr.set_ylabel('BPM')
             self.ax_hr.grid(True, alpha=0.3)
             
             # SpO2
-            self.ax_spo2.plot(time_array, list(self.spo2_values), 'b-', linewidth=2)
+            self.ax_spo2.plot(time_array, data['spo2'], 'b-', linewidth=2)
             self.ax_spo2.set_title('Blood Oxygen (SpO2)', fontweight='bold', color='blue')
             self.ax_spo2.set_ylabel('SpO2 (%)')
             self.ax_spo2.grid(True, alpha=0.3)
             
             # Quality Assessment
-            quality_colors = ['red' if q == 0 else 'green' for q in self.quality_values]
-            self.ax_quality.scatter(time_array, list(self.quality_values), 
+            quality_colors = ['red' if q == 0 else 'green' for q in data['quality']]
+            self.ax_quality.scatter(time_array, data['quality'], 
                                   c=quality_colors, s=50, alpha=0.7)
             self.ax_quality.set_title('ML Quality Assessment', fontweight='bold', color='orange')
             self.ax_quality.set_ylabel('Quality (0=Poor, 1=Good)')
@@ -218,9 +184,9 @@ class QualityReceiver:
             self.ax_quality.set_ylim(-0.1, 1.1)
             
             # Accelerometer X,Y,Z
-            self.ax_accel.plot(time_array, list(self.ax_values), 'g-', linewidth=1, label='X', alpha=0.8)
-            self.ax_accel.plot(time_array, list(self.ay_values), 'b-', linewidth=1, label='Y', alpha=0.8)
-            self.ax_accel.plot(time_array, list(self.az_values), 'm-', linewidth=1, label='Z', alpha=0.8)
+            self.ax_accel.plot(time_array, data['ax'], 'g-', linewidth=1, label='X', alpha=0.8)
+            self.ax_accel.plot(time_array, data['ay'], 'b-', linewidth=1, label='Y', alpha=0.8)
+            self.ax_accel.plot(time_array, data['az'], 'm-', linewidth=1, label='Z', alpha=0.8)
             self.ax_accel.set_title('Accelerometer (X,Y,Z)', fontweight='bold', color='green')
             self.ax_accel.set_ylabel('Acceleration (g)')
             self.ax_accel.set_xlabel('Time (s)')
@@ -228,7 +194,7 @@ class QualityReceiver:
             self.ax_accel.legend()
             
             # Accelerometer Magnitude
-            self.ax_accel_mag.plot(time_array, list(self.accel_mag), 'purple', linewidth=2)
+            self.ax_accel_mag.plot(time_array, data['accel_mag'], 'purple', linewidth=2)
             self.ax_accel_mag.set_title('Acceleration Magnitude', fontweight='bold', color='purple')
             self.ax_accel_mag.set_ylabel('|Acceleration| (g)')
             self.ax_accel_mag.set_xlabel('Time (s)')
@@ -241,10 +207,10 @@ class QualityReceiver:
             
             if self.total_samples > 0:
                 quality_pct = (self.good_samples / self.total_samples) * 100
-                current_hr = self.heart_rates[-1] if self.heart_rates else 0
-                current_spo2 = self.spo2_values[-1] if self.spo2_values else 0
-                current_accel = self.accel_mag[-1] if self.accel_mag else 0
-                current_quality = "GOOD" if self.quality_values[-1] == 1 else "POOR"
+                current_hr = data['hr'][-1]
+                current_spo2 = data['spo2'][-1]
+                current_accel = data['accel_mag'][-1]
+                current_quality = "GOOD" if data['quality'][-1] == 1 else "POOR"
                 
                 stats_text = f"""CURRENT VALUES:
 Heart Rate: {current_hr:.1f} BPM
@@ -262,69 +228,71 @@ Runtime: {time_array[-1]:.1f}s
                 self.ax_stats.text(0.05, 0.95, stats_text, transform=self.ax_stats.transAxes,
                                  fontsize=9, verticalalignment='top', fontfamily='monospace',
                                  bbox=dict(boxstyle="round,pad=0.3", facecolor="lightgray", alpha=0.8))
+        else:
+            for ax in [self.ax_ir, self.ax_red, self.ax_accel, self.ax_label]:
+                ax.clear()
+            
+            self.ax_ir.plot(time_array, data['ir'], 'r-', linewidth=1)
+            self.ax_ir.set_title('IR (counts)', fontweight='bold', color='red')
+            self.ax_ir.grid(True, alpha=0.3)
+            
+            self.ax_red.plot(time_array, data['red'], 'b-', linewidth=1)
+            self.ax_red.set_title('Red (counts)', fontweight='bold', color='blue')
+            self.ax_red.grid(True, alpha=0.3)
+            
+            self.ax_accel.plot(time_array, data['ax'], 'g-', linewidth=1, label='X', alpha=0.8)
+            self.ax_accel.plot(time_array, data['ay'], 'b-', linewidth=1, label='Y', alpha=0.8)
+            self.ax_accel.plot(time_array, data['az'], 'm-', linewidth=1, label='Z', alpha=0.8)
+            self.ax_accel.set_title('Accelerometer', fontweight='bold', color='green')
+            self.ax_accel.set_xlabel('Device time (s)')
+            self.ax_accel.grid(True, alpha=0.3)
+            self.ax_accel.legend()
+            
+            self.ax_label.set_title('Current Label', fontweight='bold', color='orange')
+            self.ax_label.axis('off')
+            self.ax_label.text(0.05, 0.95,
+                               f"Label: {self.current_label}\nSamples: {self.total_samples}\nLost frames: {ingest.lost_frames}",
+                               transform=self.ax_label.transAxes, fontsize=11, verticalalignment='top',
+                               fontfamily='monospace')
         
         plt.tight_layout()
     
     def close(self):
         """Clean up resources"""
-        if self.csv_file:
-            self.csv_file.close()
-        print(f"Data saved to: {self.csv_filename}")
+        if self.recording:
+            self.recording.close()
+        print(f"Data saved to: {self.filename}")
 
 def parse_sensor_data(data: bytearray, mode: str):
-    """Parse sensor data and put in queue"""
+    """Decode a notification into the ingest rings and queue its records for the recording"""
     try:
-        obj = json.loads(data.decode())
-        timestamp = datetime.datetime.now().isoformat()
-        
-        if mode == "quality":
-            hr = obj.get('hr', 0)
-            spo2 = obj.get('spo2', 0)
-            ax = obj.get('ax', 0)
-            ay = obj.get('ay', 0)
-            az = obj.get('az', 0)
-            quality = obj.get('quality', 0)
-            accel_mag = obj.get('accel_mag', np.sqrt(ax**2 + ay**2 + az**2))
-            
-            print(f"[{timestamp}] HR: {hr:.1f} | SpO2: {spo2:.1f} | Quality: {'GOOD' if quality == 1 else 'POOR'} | Accel: {ax:.2f},{ay:.2f},{az:.2f}")
-            
-            # Put data in queue for main thread to process
-            data_queue.put({
-                'timestamp': timestamp,
-                'hr': hr,
-                'spo2': spo2,
-                'ax': ax,
-                'ay': ay,
-                'az': az,
-                'quality': quality,
-                'accel_mag': accel_mag,
-                'device_timestamp': obj.get('timestamp', 0)
-            })
-        else:
-            hr = obj.get('hr', 0)
-            spo2 = obj.get('spo2', 0)
-            ax = obj.get('ax', 0)
-            ay = obj.get('ay', 0)
-            az = obj.get('az', 0)
-            label = obj.get('label', 'unlabeled')
-            
-            print(f"[{timestamp}] HR: {hr:.1f} | SpO2: {spo2:.1f} | Label: {label} | Accel: {ax:.2f},{ay:.2f},{az:.2f}")
-            
-            # Put data in queue for main thread to process
-            data_queue.put({
-                'timestamp': timestamp,
-                'hr': hr,
-                'spo2': spo2,
-                'ax': ax,
-                'ay': ay,
-                'az': az,
-                'label': label,
-                'device_timestamp': obj.get('timestamp', 0)
-            })
-
-    except Exception as e:
+        batch = ingest.feed(data)
+    except ValueError as e:
         print(f"❌ Parse error: {e}")
         print(f"Raw data: {data}")
+        return
+    
+    # Raw mode only gets full-rate samples from binary frames
+    if batch is None or batch.stream != ("QUALITY" if mode == "quality" else "RAW_DATA"):
+        return
+    
+    timestamp = int(time.time() * 1000)
+    if mode == "quality":
+        hr, spo2, ax, ay, az, quality = (batch[name][-1] for name in ('hr', 'spo2', 'ax', 'ay', 'az', 'quality'))
+        print(f"[{datetime.datetime.now().isoformat()}] HR: {hr:.1f} | SpO2: {spo2:.1f} | Quality: {'GOOD' if quality == 1 else 'POOR'} | Accel: {ax:.2f},{ay:.2f},{az:.2f}")
+    
+    # One queue entry per notification, the label of the moment it came
+    data_queue.put((timestamp, current_label, batch))
+
+def parse_status(data: bytearray):
+    """Log device status, including the full-rate drop counter"""
+    try:
+        obj = json.loads(data.decode())
+    except Exception:
+        return
+    if 'raw_dropped' in obj:
+        print(f"📟 Device: mode={obj.get('mode')} queued={obj.get('raw_queued')} "
+              f"dropped={obj['raw_dropped']} | lost frames={ingest.lost_frames}")
 
 async def ble_worker(device_name: str, mode: str):
     """BLE worker function to run in separate thread"""
@@ -361,30 +329,32 @@ async def ble_worker(device_name: str, mode: str):
                 ble_running = False
                 return
 
-            print("🔗 Connected! Subscribing to sensor data...")
+            print(f"🔗 Connected (MTU {client.mtu_size})! Subscribing to sensor data...")
             
-            # Subscribe to appropriate characteristic based on mode
+            ingest.reset()
+            await client.start_notify(DATA_CHAR_UUID, lambda _, data: parse_sensor_data(data, mode))
+            await client.start_notify(STATUS_CHAR_UUID, lambda _, data: parse_status(data))
+            print("📊 Subscribed to data and status characteristics")
+            
+            # Raw mode streams every FIFO sample, which only the binary format carries
             if mode == "quality":
-                char_uuid = VITALS_DATA_CHAR_UUID
-                await client.start_notify(char_uuid, lambda _, data: parse_sensor_data(data, mode))
-                print("📊 Subscribed to vitals data characteristic")
-                
-                # Also subscribe to quality reports
-                try:
-                    await client.start_notify(QUALITY_CHAR_UUID, lambda _, data: print(f"Quality Report: {data.decode()}"))
-                    print("📈 Subscribed to quality report characteristic")
-                except Exception as e:
-                    print(f"⚠️ Could not subscribe to quality reports: {e}")
+                setup_commands = ["FORMAT:JSON", "MODE:QUALITY"]
             else:
-                char_uuid = RAW_DATA_CHAR_UUID
-                await client.start_notify(char_uuid, lambda _, data: parse_sensor_data(data, mode))
-                print("📊 Subscribed to raw data characteristic")
+                setup_commands = ["FORMAT:BINARY", "MODE:RAW_DATA"]
+            for command in setup_commands:
+                await client.write_gatt_char(CONTROL_CHAR_UUID, command.encode())
+                print(f"📤 Sent command: {command}")
 
             print("✅ Data collection started!")
             print("=" * 50)
 
             # Keep BLE connection alive and process commands
+            last_status = time.time()
             while ble_running:
+                if time.time() - last_status >= STATUS_INTERVAL:
+                    command_queue.put("STATUS")
+                    last_status = time.time()
+                
                 # Check for commands to send
                 try:
                     command = command_queue.get_nowait()
@@ -397,13 +367,10 @@ async def ble_worker(device_name: str, mode: str):
                 
                 await asyncio.sleep(0.1)
 
-            # Stop notifications
-            await client.stop_notify(char_uuid)
-            if mode == "quality":
-                try:
-                    await client.stop_notify(QUALITY_CHAR_UUID)
-                except:
-                    pass
+            # Stop streaming before the connection closes
+            await client.write_gatt_char(CONTROL_CHAR_UUID, b"MODE:IDLE")
+            await client.stop_notify(DATA_CHAR_UUID)
+            await client.stop_notify(STATUS_CHAR_UUID)
             print("🔌 BLE connection closed.")
             
     except Exception as e:
@@ -421,7 +388,7 @@ def run_ble_in_thread(device_name: str, mode: str):
         loop.close()
 
 def input_handler(mode: str):
-    global ble_running
+    global ble_running, current_label
     """Handle user input in separate thread"""
     print("\n💬 COMMAND INPUT:")
     print("=" * 30)
@@ -453,7 +420,7 @@ def input_handler(mode: str):
                     print("Available commands: reset, recalibrate, interval X, quit")
             else:  # raw mode
                 if command:
-                    command_queue.put(f"LABEL:{command}")
+                    current_label = command
                     print(f"✅ Label set to: '{command}'")
         except (EOFError, KeyboardInterrupt):
             ble_running = False
@@ -474,18 +441,19 @@ def main():
     
     if choice == "1":
         mode = "quality"
-        device_name = DEVICE_NAME_QUALITY
+        device_name = DEVICE_NAME
         print("🧠 Starting Quality Assessment Monitor...")
     elif choice == "2":
         mode = "raw"
-        device_name = DEVICE_NAME_RAW
+        device_name = DEVICE_NAME
         print("📊 Starting Raw Data Collection Monitor...")
     else:
         print("Invalid choice")
         return
     
     # Create receiver
-    receiver = QualityReceiver(mode, buffer_size=200)
+    # Raw mode receives 100 samples/s: keep 10s on screen
+    receiver = QualityReceiver(mode, buffer_size=200 if mode == "quality" else 1000)
     
     # Start BLE in separate thread
     ble_running = True
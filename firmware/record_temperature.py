@@ -1,16 +1,16 @@
 import asyncio
-import csv
 import datetime
-import json
+import time
 from bleak import BleakScanner, BleakClient
-from collections import deque
 import threading
-import time
 import queue
+import numpy as np
+from ingest import StreamIngest, DEFAULT_RATES_HZ
+from recording import RecordingWriter
 
 # === Settings ===
 LIVE_PLOT = True
-CSV_FILENAME = "../test_logs/temperature_data.csv"
+RECORDING_FILENAME = "../test_logs/temperature_data.vtrec"
 DEVICE_NAME = "ESP32_Temperature"
 
 # === BLE UUIDs ===
@@ -18,35 +18,33 @@ CUSTOM_SERVICE_UUID = "12345678-1234-5678-1234-56789abcdef0"
 CUSTOM_CHAR_UUID    = "abcdefab-1234-5678-1234-56789abcdef1"
 
 # === Data Storage ===
-temperature_data = deque(maxlen=100)
-time_data = deque(maxlen=100)
+PLOT_POINTS = 100
+ingest = StreamIngest(capacity=PLOT_POINTS)
 
 # === Threading control ===
 ble_running = False
 data_queue = queue.Queue()
 
-# === CSV Setup ===
-csv_file = open(CSV_FILENAME, mode='w', newline='')
-csv_writer = csv.writer(csv_file)
-csv_writer.writerow(["Timestamp", "Temperature"])
+# === Recording Setup ===
+recording = RecordingWriter(RECORDING_FILENAME, "TEMPERATURE",
+                            [("Timestamp", np.int64), ("Temperature", np.float64)],
+                            sample_rate_hz=DEFAULT_RATES_HZ["TEMPERATURE"], time_columns={"Timestamp": "ms"})
 
 
 def parse_sensor_data(data: bytearray):
     try:
-        obj = json.loads(data.decode())
-        timestamp = datetime.datetime.now().isoformat()
-        tmp = float(obj["temperature"])
-
-        print(f"[{timestamp}] temperature: {tmp:.3f}°C")
+        batch = ingest.feed(data)
+    except ValueError as e:
+        print("❌ Parse error:", e)
+        return
+    if batch is None or batch.stream != "TEMPERATURE":
+        return
 
-        # Put data in queue for main thread to process
-        data_queue.put({
-            'timestamp': timestamp,
-            'temperature': tmp
-        })
+    timestamp = int(time.time() * 1000)
+    print(f"[{datetime.datetime.now().isoformat()}] temperature: {batch['temperature'][-1]:.3f}°C")
 
-    except Exception as e:
-        print("❌ Parse error:", e)
+    # The ring has the plot data, the main thread writes the recording
+    data_queue.put((timestamp, batch))
 
 
 async def ble_worker():
@@ -99,23 +97,12 @@ def run_ble_in_thread():
 
 def process_data_queue():
     """Process queued data from BLE thread"""
-    while not data_queue.empty():
+    while True:
         try:
-            data = data_queue.get_nowait()
-            
-            # Update plot data
-            time_data.append(time.time())
-            temperature_data.append(data['temperature'])
-            
-            # Save to CSV
-            csv_writer.writerow([
-                data['timestamp'], 
-                data['temperature']
-            ])
-            csv_file.flush()
-            
+            timestamp, batch = data_queue.get_nowait()
         except queue.Empty:
             break
+        recording.append({"Timestamp": timestamp, "Temperature": batch['temperature']})
 
 
 def main():
@@ -155,27 +142,26 @@ def main():
             # Process any new data from BLE thread
             process_data_queue()
             
-            if len(temperature_data) == 0:
+            temp_values = ingest.ring("TEMPERATURE").latest()['temperature']
+            n = len(temp_values)
+            if n == 0:
                 return temp_line,
             
             # Create x-axis as sample indices
-            x = list(range(len(temperature_data)))
+            x = range(n)
             
             # Update data
-            temp_line.set_data(x, list(temperature_data))
+            temp_line.set_data(x, temp_values)
 
             # Update axis limits
-            if len(temperature_data) > 0:
-                ax.set_xlim(max(0, len(temperature_data) - 50), len(temperature_data))
-                
-                # Auto-scale y-axis with some padding
-                temp_values = list(temperature_data)
-                if temp_values:
-                    min_temp = min(temp_values)
-                    max_temp = max(temp_values)
-                    temp_range = max_temp - min_temp
-                    padding = temp_range * 0.1 if temp_range > 0 else 5
-                    ax.set_ylim(min_temp - padding, max_temp + padding)
+            ax.set_xlim(max(0, n - 50), n)
+            
+            # Auto-scale y-axis with some padding
+            min_temp = temp_values.min()
+            max_temp = temp_values.max()
+            temp_range = max_temp - min_temp
+            padding = temp_range * 0.1 if temp_range > 0 else 5
+            ax.set_ylim(min_temp - padding, max_temp + padding)
 
             return temp_line,
 
@@ -222,5 +208,5 @@ if __name__ == "__main__":
         main()
     finally:
         ble_running = False
-        csv_file.close()
-        print(f"💾 Data saved to {CSV_FILENAME}")
+        recording.close()
+        print(f"💾 Data saved to {RECORDING_FILENAME}")
@@ -0,0 +1,278 @@
+"""
+Chunked columnar recordings (.vtrec), written by the recorders and the
+dashboard and read by the analysis scripts.
+
+A recording starts with a JSON header that describes it: the stream, the
+firmware mode, the sample rate, the columns and their dtypes. Then come
+chunks, each holding every column for a run of records, each column on its
+own and zlib compressed. Integer columns are delta coded first: timestamps
+and PPG counts shrink to a few bytes per sample. A capture cut short by a
+crash keeps every chunk written before it.
+
+The reader maps the file and decodes a column only when it is asked for it.
+read_table() gives a pandas DataFrame with the columns the CSVs had, from
+either kind of file, for the scripts that take both:
+
+    with RecordingWriter("raw.vtrec", "RAW_DATA", [("IR", np.int64), ("Label", "category")]) as rec:
+        rec.append({"IR": batch["ir"], "Label": "still"})
+    ir = Recording("raw.vtrec")["IR"]
+    df = read_table("raw.vtrec")
+
+    python recording.py capture.vtrec [--csv capture.csv]
+"""
+import argparse
+import datetime
+import json
+import mmap
+import struct
+import zlib
+from pathlib import Path
+import numpy as np
+
+SUFFIX = ".vtrec"
+MAGIC = b"VTREC\x00\x01\n"          # format version 1
+HEADER_LENGTH = struct.Struct('<I')
+# magic, records, meta length, payload length
+CHUNK_HEADER = struct.Struct('<4sIII')
+CHUNK_MAGIC = b"CHNK"
+
+CATEGORY = "category"               # strings, stored as uint16 codes
+CATEGORY_DTYPE = np.dtype('<u2')
+DEFAULT_CHUNK_RECORDS = 4096     # 40s of raw samples
+COMPRESSION_LEVEL = 6
+
+
+def _column_spec(name, dtype):
+    if dtype == CATEGORY:
+        return {"name": name, "dtype": CATEGORY}
+    dtype = np.dtype(dtype).newbyteorder('<')
+    return {"name": name, "dtype": dtype.str, "delta": bool(np.issubdtype(dtype, np.integer))}
+
+
+class RecordingWriter:
+    """Buffers appended records and writes them a chunk at a time"""
+
+    def __init__(self, path, stream, columns, mode=None, sample_rate_hz=None, device=None,
+                 time_columns=None, chunk_records=DEFAULT_CHUNK_RECORDS, codec="zlib", **extra):
+        """
+        columns: (name, dtype) pairs, dtype being a numpy dtype or "category".
+        time_columns: {name: unit} of the columns read_table() turns into datetimes.
+        """
+        self.path = Path(path)
+        self.columns = [_column_spec(name, dtype) for name, dtype in columns]
+        self.chunk_records = chunk_records
+        self.codec = codec
+        self.records = 0
+        self.pending = {spec["name"]: [] for spec in self.columns}
+        self.pending_count = 0
+        self.categories = {spec["name"]: {} for spec in self.columns if spec["dtype"] == CATEGORY}
+        self.new_categories = {name: [] for name in self.categories}
+
+        header = {
+            "stream": stream, "mode": mode or stream, "sample_rate_hz": sample_rate_hz, "device": device,
+            "created": datetime.datetime.now().isoformat(), "codec": codec,
+            "columns": self.columns, "time_columns": time_columns or {}, **extra
+        }
+        encoded = json.dumps(header).encode()
+        self.file = open(self.path, 'wb')
+        self.file.write(MAGIC + HEADER_LENGTH.pack(len(encoded)) + encoded)
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+    def append(self, columns):
+        """
+        Append records given as {column: values}. Values are arrays or lists of
+        one length, or scalars repeated over it (the label of a batch).
+        """
+        n = next((len(values) for values in columns.values() if np.ndim(values) > 0), 1)
+        if n == 0:
+            return
+        for spec in self.columns:
+            name = spec["name"]
+            values = columns[name]
+            if spec["dtype"] == CATEGORY:
+                if np.ndim(values) == 0:
+                    values = np.full(n, self._code(name, str(values)), dtype=CATEGORY_DTYPE)
+                else:
+                    values = np.fromiter((self._code(name, str(v)) for v in values), CATEGORY_DTYPE, n)
+            elif np.ndim(values) == 0:
+                values = np.full(n, values, dtype=spec["dtype"])
+            self.pending[name].append(np.asarray(values))
+        self.pending_count += n
+        if self.pending_count >= self.chunk_records:
+            self.flush()
+
+    def _code(self, name, value):
+        codes = self.categories[name]
+        code = codes.get(value)
+        if code is None:
+            code = codes[value] = len(codes)
+            self.new_categories[name].append(value)
+        return code
+
+    def flush(self):
+        """Write what is buffered as one chunk"""
+        if self.pending_count == 0:
+            return
+        blobs = []
+        for spec in self.columns:
+            dtype = CATEGORY_DTYPE if spec["dtype"] == CATEGORY else np.dtype(spec["dtype"])
+            values = np.concatenate(self.pending[spec["name"]]).astype(dtype, copy=False)
+            if spec.get("delta"):
+                values = np.diff(values, prepend=dtype.type(0))
+            raw = values.tobytes()
+            blobs.append(zlib.compress(raw, COMPRESSION_LEVEL) if self.codec == "zlib" else raw)
+
+        meta = {"sizes": [len(blob) for blob in blobs],
+                "categories": {name: new for name, new in self.new_categories.items() if new}}
+        encoded = json.dumps(meta).encode()
+        payload = b"".join(blobs)
+        self.file.write(CHUNK_HEADER.pack(CHUNK_MAGIC, self.pending_count, len(encoded), len(payload)))
+        self.file.write(encoded)
+        self.file.write(payload)
+        self.file.flush()
+
+        self.records += self.pending_count
+        self.pending = {spec["name"]: [] for spec in self.columns}
+        self.pending_count = 0
+        self.new_categories = {name: [] for name in self.categories}
+
+    def close(self):
+        if self.file:
+            self.flush()
+            self.file.close()
+            self.file = None
+
+
+class Recording:
+    """A .vtrec file, memory-mapped; columns are decoded on first access"""
+
+    def __init__(self, path):
+        self.path = Path(path)
+        with open(self.path, 'rb') as f:
+            self.map = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+        if self.map[:len(MAGIC)] != MAGIC:
+            raise ValueError(f"{self.path}: not a recording")
+
+        offset = len(MAGIC)
+        (length,) = HEADER_LENGTH.unpack_from(self.map, offset)
+        offset += HEADER_LENGTH.size
+        self.header = json.loads(self.map[offset:offset + length])
+        offset += length
+
+        self.columns = [spec["name"] for spec in self.header["columns"]]
+        self.specs = {spec["name"]: spec for spec in self.header["columns"]}
+        self.categories = {name: [] for name, spec in self.specs.items() if spec["dtype"] == CATEGORY}
+        self.chunks = []    # (records, {column: (offset, size)})
+        self._index(offset)
+        self.cache = {}
+
+    def _index(self, offset):
+        end = len(self.map)
+        while offset + CHUNK_HEADER.size <= end:
+            magic, records, meta_length, payload_length = CHUNK_HEADER.unpack_from(self.map, offset)
+            start = offset + CHUNK_HEADER.size
+            if magic != CHUNK_MAGIC or start + meta_length + payload_length > end:
+                break   # cut short while it was written
+            meta = json.loads(self.map[start:start + meta_length])
+            for name, new in meta["categories"].items():
+                self.categories[name].extend(new)
+            position = start + meta_length
+            blobs = {}
+            for name, size in zip(self.columns, meta["sizes"]):
+                blobs[name] = (position, size)
+                position += size
+            self.chunks.append((records, blobs))
+            offset = position
+
+    @property
+    def stream(self):
+        return self.header["stream"]
+
+    @property
+    def mode(self):
+        return self.header["mode"]
+
+    @property
+    def sample_rate_hz(self):
+        return self.header["sample_rate_hz"]
+
+    def __len__(self):
+        return sum(records for records, _ in self.chunks)
+
+    def __getitem__(self, name):
+        return self.column(name)
+
+    def _decode(self, name, records, blob):
+        spec = self.specs[name]
+        offset, size = blob
+        dtype = CATEGORY_DTYPE if spec["dtype"] == CATEGORY else np.dtype(spec["dtype"])
+        data = memoryview(self.map)[offset:offset + size]
+        if self.header["codec"] == "zlib":
+            data = zlib.decompress(data)
+        values = np.frombuffer(data, dtype=dtype, count=records)
+        if spec.get("delta"):
+            values = np.cumsum(values, dtype=dtype)
+        return values
+
+    def codes(self, name):
+        """A column as stored: codes for a categorical one"""
+        values = self.cache.get(name)
+        if values is None:
+            parts = [self._decode(name, records, blobs[name]) for records, blobs in self.chunks]
+            values = np.concatenate(parts) if parts else np.empty(0, dtype=CATEGORY_DTYPE)
+            self.cache[name] = values
+        return values
+
+    def column(self, name):
+        """A whole column; categorical ones as an array of strings"""
+        values = self.codes(name)
+        if name in self.categories:
+            return np.asarray(self.categories[name], dtype=object)[values] if len(values) else values.astype(object)
+        return values
+
+    def to_dataframe(self, columns=None):
+        import pandas as pd
+        names = columns or self.columns
+        df = pd.DataFrame({name: self.column(name) for name in names})
+        for name, unit in self.header.get("time_columns", {}).items():
+            if name in df:
+                df[name] = pd.to_datetime(df[name], unit=unit)
+        return df
+
+    def close(self):
+        self.cache.clear()
+        self.map.close()
+
+
+def read_table(path, columns=None):
+    """A recording or a CSV capture as a DataFrame, with the CSV's column names"""
+    import pandas as pd
+    path = Path(path)
+    if path.suffix == SUFFIX:
+        return Recording(path).to_dataframe(columns)
+    return pd.read_csv(path, usecols=columns)
+
+
+def glob_recordings(pattern):
+    """The .vtrec and .csv files of a capture name pattern without its suffix"""
+    return sorted(set(Path().glob(pattern + SUFFIX)) | set(Path().glob(pattern + ".csv")), key=str)
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Show a .vtrec recording, or convert it to CSV")
+    parser.add_argument('recording')
+    parser.add_argument('--csv', help="write the records to this CSV file")
+    args = parser.parse_args()
+
+    recording = Recording(args.recording)
+    header = {key: value for key, value in recording.header.items() if key != "columns"}
+    print(json.dumps(header, indent=2))
+    print(f"{len(recording)} records in {len(recording.chunks)} chunks: {', '.join(recording.columns)}")
+    if args.csv:
+        recording.to_dataframe().to_csv(args.csv, index=False)
+        print(f"💾 {args.csv}")
@@ -5,10 +5,21 @@
 #include <BLEUtils.h>
 #include <BLE2902.h>
 #include <esp_wifi.h>
+#include <esp_pm.h>
+#include <esp_sleep.h>
+#include <esp_mac.h>
+#include <driver/gpio.h>
 #include "ADXL335.h"
 #include "MAX30100_PulseOximeter.h"
 #include "MAX30100.h"
+#include "SPSCBuffer.h"
+#include "PerfStats.h"
+#include "FlashLog.h"
+#include "quality_features.h"
 #include "sensor_quality_model.h"
+#include "binary_protocol.h"
+#include "SensorHAL.h"
+#include "SampleStages.h"
 
 // ==================================================
 // UNIFIED SENSOR SYSTEM - ALL MODES IN ONE
@@ -20,6 +31,21 @@
 // MODE:DISTANCE_TEST  - Distance/quantum efficiency testing
 // MODE:QUALITY        - ML-based quality assessment
 // MODE:RAW_DATA       - Raw sensor data collection
+// MODE:MULTI          - All of the above at once from one sample stream, see SUBSCRIBE
+// SUBSCRIBE:<stream>[:<ms>] - MODE:MULTI output: VITALS, RAW, TEMPERATURE, FORCE, QUALITY, ACCEL
+// UNSUBSCRIBE:<stream>
+// RATE:<stream>:<hz>  - Output rate of a stream, also ACCEL and STATUS in any mode (0 stops those)
+// FORMAT:JSON         - JSON notifications on the data characteristic (default)
+// FORMAT:BINARY       - Packed binary frames, see binary_protocol.h
+// FLUSH:<ms>          - Binary RAW_DATA flush interval (20-2000ms, default 100)
+// PERF                - Hot path timings and loss counters on the stats characteristic
+// PERF:RESET          - Clear the timings
+// LOG:START           - Record the current mode to flash, also while disconnected
+// LOG:STOP            - Stop recording
+// LOG:ERASE           - Wipe the flash log
+// DUMP                - Stream the flash log on the data characteristic
+// POWER:LOW           - Battery operation: light sleep, slower sensor and BLE timings
+// POWER:NORMAL        - Full rate again (default)
 
 // Operating modes
 enum OperatingMode {
@@ -29,18 +55,29 @@ enum OperatingMode {
     MODE_FORCE_TEST = 3,
     MODE_DISTANCE_TEST = 4,
     MODE_QUALITY = 5,
-    MODE_RAW_DATA = 6
+    MODE_RAW_DATA = 6,
+    MODE_MULTI = 7
+};
+
+// Wire formats of the data characteristic
+enum DataFormat {
+    FORMAT_JSON = 0,
+    FORMAT_BINARY = 1
 };
 
 // Global variables
 OperatingMode currentMode = MODE_IDLE;
-uint32_t tsLastReport = 0;
-uint32_t reportingPeriod = 500;  // Default 2Hz (500ms) for all modes
+DataFormat dataFormat = FORMAT_JSON;
+uint16_t frameSequence = 0;
 bool clientConnected = false;
+bool lowPower = false;           // POWER:LOW, kept across disconnects
+bool lightSleepEnabled = false;  // what the power management accepted
+esp_bd_addr_t peerAddress;
 
-// Sensor objects - static to avoid dynamic allocation
-PulseOximeter pox;
+// Sensor objects - static to avoid dynamic allocation.
+// One MAX30100 driver, owned by the acquisition task; the pulse oximeter only runs the DSP on it.
 MAX30100 rawSensor;
+PulseOximeter pox(rawSensor);
 ADXL335 accel;
 bool poxInitialized = false;
 bool rawSensorInitialized = false;
@@ -48,68 +85,407 @@ bool rawSensorInitialized = false;
 // Sensor data
 float ax = 0.0, ay = 0.0, az = 0.0;
 float heartRate = 0.0, spO2 = 0.0, temperature = 0.0;
+uint8_t vitalsConfidence = 0;   // 0-100, of heartRate and spO2
 uint16_t irValue = 0, redValue = 0, fsrValue = 0;
 
+// Full-rate RAW_DATA: every FIFO sample, with the accelerometer read when it was
+// drained, is queued here until the next binary flush. Allocated once at boot,
+// in PSRAM when the module has it.
+struct RawSample {
+    SensorReadout readout;
+    int16_t axMg;
+    int16_t ayMg;
+    int16_t azMg;
+};
+
+#define RAW_RING_SIZE 512           // ~5s at 100Hz in internal RAM
+#define RAW_RING_SIZE_PSRAM 8192    // ~80s at 100Hz
+#define RAW_FLUSH_INTERVAL_DEFAULT_MS 100
+#define RAW_FLUSH_INTERVAL_MIN_MS 20
+#define RAW_FLUSH_INTERVAL_MAX_MS 2000
+RawSample* rawRing = NULL;
+size_t rawRingCapacity = 0;
+size_t rawRingHead = 0;             // oldest queued sample
+size_t rawRingCount = 0;
+uint32_t rawDropped = 0;            // samples lost since RAW_DATA started: ring full or FIFO overflow
+uint32_t rawFifoDroppedSeen = 0;    // upstream losses (FIFO overflow, sample queue full) already seen
+uint32_t rawFlushInterval = RAW_FLUSH_INTERVAL_DEFAULT_MS;  // FLUSH:<ms>
+uint16_t rawDecimationCount = 0;    // samples since the last one queued, see RATE:RAW
+
+// Offline recording (LOG:START) into the flashlog partition: RAW_DATA logs
+// every sample, HR_SPO2 and QUALITY one vitals record per report. At 100Hz
+// raw samples fill the 1.9MB partition in ~25 min, vitals every 500ms last ~20h.
+// Pages are programmed by the flash log task; DUMP streams them back.
+#define FLASH_LOG_DUMP_BURST 8              // pages per transport wake-up while dumping
+#define FLASH_LOG_DUMP_RETRY_MS 5           // back-off when the BLE stack refuses a notification
+#define FLASH_LOG_DUMP_MAX_RETRIES 200      // 1s of refusals in a row and the dump is given up
+FlashLog flashLog;
+
+struct {
+    bool active = false;
+    uint32_t sequence = 0;                  // next page to send
+    uint32_t end = 0;                       // log head when DUMP was received
+    uint32_t pages = 0;
+    uint32_t skipped = 0;                   // overwritten or corrupted meanwhile
+} flashDump;
+
+// Largest ATT MTU we accept. The client starts the exchange; 247 fits a single
+// LL data PDU with data length extension, 517 is the ATT maximum.
+#define BLE_LOCAL_MTU 517
+#define BLE_MAX_NOTIFY_PAYLOAD (BLE_LOCAL_MTU - 3)
+
+// Hosts look for the prefix; the last three bytes of the Bluetooth MAC tell the
+// boards apart, so one host can collect from several at once
+#define BLE_DEVICE_NAME_PREFIX "ESP32_Unified_Sensor"
+char bleDeviceName[32];
+
 // BLE variables
 BLEServer* bleServer;
 BLEService* bleService;
 BLECharacteristic* dataChar;
+BLE2902* dataCccd;                          // whether the client enabled the data notifications
 BLECharacteristic* controlChar;
 BLECharacteristic* statusChar;
+BLECharacteristic* statsChar;
 
 // UUIDs - using consistent set
 static const BLEUUID serviceUUID("12345678-1234-5678-1234-56789abcdef0");
 static const BLEUUID dataCharUUID("abcdefab-1234-5678-1234-56789abcdef1");
 static const BLEUUID controlCharUUID("abcdefab-1234-5678-1234-56789abcdef2");
 static const BLEUUID statusCharUUID("abcdefab-1234-5678-1234-56789abcdef3");
+static const BLEUUID statsCharUUID("abcdefab-1234-5678-1234-56789abcdef4");
 
-// Mode-specific variables
-struct {
-    char currentLabel[16] = "waiting";
-    bool isCollecting = false;
-    uint32_t collectionStartTime = 0;
-    uint32_t collectionDuration = 10000;
-} forceTest;
-
-struct {
-    char currentLED[8] = "none";
-    int currentDistance = 0;
-    bool collectingData = false;
-    uint32_t irSum = 0;
-    uint32_t redSum = 0;
-    uint16_t sampleCount = 0;
-    uint16_t samplesPerBatch = 10;
-} distanceTest;
+// Hot path timings, each recorded from a single pinned task (see PerfStats.h)
+PerfStat perfFifoRead("fifo_read");         // acquisition: I2C FIFO drain
+PerfStat perfDspBlock("dsp_block");         // DSP: PulseOximeter pipeline, per queued span
+PerfStat perfQualityModel("quality_model"); // DSP: predict_quality()
+PerfStat perfFormat("format");              // transport: JSON/binary frame formatting
+PerfStat perfNotify("notify");              // transport: setValue() + notify()
+PerfStat* const perfStats[] = {&perfFifoRead, &perfDspBlock, &perfQualityModel, &perfFormat, &perfNotify};
+volatile uint32_t notifyFailures = 0;       // data notifications the stack reported as failed
 
-struct {
-    bool tempSamplingStarted = false;
-    uint32_t tsLastTempSample = 0;
-    uint32_t tempSamplingPeriod = 1000;
-} temperatureMode;
+// Mode-specific variables. The test procedures are stages on the sample bus, see startPipeline()
+#define FORCE_COLLECTION_MS 10000
+#define DISTANCE_REPORTS_PER_BATCH 10
+LabelingStage forceLabeling(FORCE_COLLECTION_MS);
+AveragingStage distanceAveraging(DISTANCE_REPORTS_PER_BATCH);
 
 struct {
-    float previousHeartRate = 0.0;
-    float previousSpO2 = 0.0;
-    float previousAccelMag = 0.0;
     bool hasPreviousData = false;
     uint32_t totalSamples = 0;
     uint32_t goodQualitySamples = 0;
+    int lastQuality = 0;
+    float lastQualityPercent = 0.0;
+    uint32_t tsLastAssessment = 0;       // sample time of the last model run
 } qualityMode;
 
+// Windowed features for the quality model, fed by the DSP task every sample
+QualityFeatures qualityFeatures;
+#define QUALITY_MOTION_ENERGY_MAX 0.01f   // g^2 of accel magnitude variance, the motion label of train_ml_model.py
+
+// Output streams. Each one has its own rate and a deadline the transport task schedules it by,
+// earliest first, so a 1Hz vitals report and 100Hz raw frames never wait on each other.
+// A single mode produces the stream of its records; MODE:MULTI runs the MAX30100 in SPO2_HR for
+// the pulse oximeter and hands the same samples to every subscribed stream. A stream sends the
+// records of the mode it stands for, so clients decode them as they do in that mode. ACCEL and
+// STATUS are not tied to a mode: once RATE or SUBSCRIBE turns them on they run alongside it.
+enum SensingStream {
+    STREAM_VITALS = 0,          // HR, SpO2 and accel (HR_SPO2 records)
+    STREAM_RAW,                 // every FIFO sample (RAW_DATA records)
+    STREAM_TEMPERATURE,         // die temperature, converted between PPG samples
+    STREAM_FORCE,               // FSR; stops the DMA accelerometer scan, which owns ADC1
+    STREAM_QUALITY,             // quality model
+    STREAM_DISTANCE,            // DISTANCE_TEST readings and averages
+    STREAM_IDLE,                // IDLE heartbeat
+    STREAM_ACCEL,               // accelerometer alone (AccelRecord), in modes that sample it
+    STREAM_STATUS,              // the status JSON, on the status characteristic
+    STREAM_COUNT
+};
+
+#define STREAM_FLAG_MULTI       (1 << 0)    // can be subscribed in MODE:MULTI
+#define STREAM_FLAG_ANY_MODE    (1 << 1)    // runs in every mode while subscribed
+
+struct OutputStream {
+    const char* name;
+    OperatingMode records;      // unused by ACCEL and STATUS, which have their own
+    uint8_t flags;
+    uint32_t defaultPeriodMs;
+    uint32_t periodMs;          // RATE:, SUBSCRIBE:<stream>:<ms>
+    uint16_t decimation;        // RAW in binary frames: one sample in N is queued
+    bool subscribed;
+    uint32_t deadline;          // in ms of uptime, the next report is due then
+};
+
+#define STREAM_PERIOD_MIN_MS 10
+#define STREAM_PERIOD_MAX_MS 60000
+OutputStream streams[STREAM_COUNT] = {
+    {"VITALS",      MODE_HR_SPO2,       STREAM_FLAG_MULTI,                        500,  500,  1, false, 0},
+    {"RAW",         MODE_RAW_DATA,      STREAM_FLAG_MULTI,                        500,  500,  1, false, 0},
+    {"TEMPERATURE", MODE_TEMPERATURE,   STREAM_FLAG_MULTI,                        500,  500,  1, false, 0},
+    {"FORCE",       MODE_FORCE_TEST,    STREAM_FLAG_MULTI,                        500,  500,  1, false, 0},
+    {"QUALITY",     MODE_QUALITY,       STREAM_FLAG_MULTI,                        500,  500,  1, false, 0},
+    {"DISTANCE",    MODE_DISTANCE_TEST, 0,                                        500,  500,  1, false, 0},
+    {"IDLE",        MODE_IDLE,          0,                                        500,  500,  1, false, 0},
+    {"ACCEL",       MODE_IDLE,          STREAM_FLAG_MULTI | STREAM_FLAG_ANY_MODE, 100,  100,  1, false, 0},
+    {"STATUS",      MODE_IDLE,          STREAM_FLAG_ANY_MODE,                     5000, 5000, 1, false, 0},
+};
+
+bool samplesAccelerometer(OperatingMode mode) {
+    return mode == MODE_HR_SPO2 || mode == MODE_QUALITY || mode == MODE_RAW_DATA || mode == MODE_MULTI;
+}
+
+bool isStreaming(SensingStream stream) {
+    const OutputStream& output = streams[stream];
+    if (output.flags & STREAM_FLAG_ANY_MODE) {
+        return output.subscribed && (stream != STREAM_ACCEL || samplesAccelerometer(currentMode));
+    }
+    if (currentMode == MODE_MULTI) {
+        return output.subscribed;
+    }
+    return output.records == currentMode;
+}
+
+// Binary raw frames flush on FLUSH:, the samples in them are thinned by the decimation
+uint32_t streamPeriod(SensingStream stream) {
+    return stream == STREAM_RAW && dataFormat == FORMAT_BINARY ? rawFlushInterval : streams[stream].periodMs;
+}
+
+// Due now: a stream starting, or whose period changed, reports right away
+void scheduleStream(SensingStream stream) {
+    streams[stream].deadline = millis();
+}
+
+void scheduleStreams() {
+    for (int i = 0; i < STREAM_COUNT; i++) {
+        scheduleStream((SensingStream)i);
+    }
+}
+
 // FSR sensor pin
 #define FSR_PIN 35
 
+// I2C pins, also driven by hand to clear a stuck bus. The MAX30100 driver picks the speed:
+// 400kHz, 100kHz once it saw the bus fail at it.
+#define I2C_SDA_PIN 21
+#define I2C_SCL_PIN 22
+#define I2C_RECOVERY_PULSES 9            // a slave stuck mid-byte lets go of SDA within 9 clocks
+#define I2C_RECOVERY_HALF_PERIOD_US 5    // 100kHz
+#define I2C_TIMEOUT_MS 10                // a 64 byte burst takes 6.3ms at 100kHz, the core waits 50ms
+
+// ADXL335 DMA sampling: averaged output matching the MAX30100 rate
+#define ACCEL_OUTPUT_RATE_HZ 100
+#define ACCEL_OVERSAMPLING 32
+
+// MAX30100 INT pin (open-drain, active low). Set to -1 when INT isn't wired:
+// the acquisition task then falls back to polling the FIFO.
+#define MAX30100_INT_PIN 27
+#define ACQUISITION_IRQ_TIMEOUT_MS 500   // Safety net in case an INT edge is missed
+#define ACQUISITION_POLL_PERIOD_MS 100   // Must stay below the 160ms it takes to fill the FIFO at 100Hz
+#define ACQUISITION_TASK_STACK 4096
+#define ACQUISITION_TASK_PRIORITY 3
+#define ACQUISITION_TASK_CORE 1
+
+// Processing pipeline:
+//   acquisition (core 1) - INT-driven FIFO drain, accelerometer/FSR/temperature reads
+//   DSP (core 0)         - pulse oximeter filters, beat detection, SpO2, quality model, raw queue
+//   transport (core 0)   - BLE notifications, flash log dumps
+//   flash log (core 0)   - programs the full flash log pages
+// Samples flow from acquisition to DSP through sampleBus, a lock-free ring: the acquisition
+// task never waits on the rest of the system, when the ring is full samples are counted as dropped.
+// Every stage attached to the bus sees each sample, in attach order.
+#define SAMPLE_QUEUE_LENGTH 64           // 640ms at 100Hz, must be a power of two
+#define DSP_TASK_STACK 4096
+#define DSP_TASK_PRIORITY 2
+#define DSP_TASK_CORE 0
+#define TRANSPORT_TASK_STACK 4096
+#define TRANSPORT_TASK_PRIORITY 1
+#define TRANSPORT_TASK_CORE 0
+#define FLASH_LOG_TASK_STACK 3072
+#define FLASH_LOG_TASK_PRIORITY 1
+#define FLASH_LOG_TASK_CORE 0
+
+// Low power operation (POWER:LOW). The CPU scales down and light-sleeps whenever every task is
+// blocked, woken by the MAX30100 INT pin, the BLE controller or the next task timeout. That needs
+// the IDF power management and tickless idle with a BLE sleep clock; without them the CPU stays
+// awake at LOW_POWER_CPU_MAX_MHZ. See "Power Budget" in UNIFIED_SYSTEM_GUIDE.md.
+#define NORMAL_CPU_MHZ 240
+#define LOW_POWER_CPU_MAX_MHZ 80                // lowest clock the BLE controller runs at
+#define LOW_POWER_CPU_MIN_MHZ 40                // XTAL, used when no driver holds the APB clock
+// The pulse oximeter filters are designed for PULSEOXIMETER_SAMPLING_RATE, so HR_SPO2 and QUALITY
+// only lower the IR LED current (the red LED follows it). The raw modes also sample more slowly
+// and shorter: 50Hz and 800us is a quarter of the LED on-time, with half the counts per sample.
+#define LOW_POWER_IR_LED_CURRENT MAX30100_LED_CURR_11MA
+#define LOW_POWER_SAMPLING_RATE MAX30100_SAMPRATE_50HZ
+#define LOW_POWER_PULSE_WIDTH MAX30100_SPC_PW_800US_15BITS
+#define LOW_POWER_LED_CURRENT MAX30100_LED_CURR_11MA
+// BLE timings, in the units of the spec: connection interval 1.25ms, supervision timeout 10ms,
+// advertising interval 0.625ms. The normal interval is the one advertised as preferred.
+#define NORMAL_CONN_INTERVAL_MIN 0x06           // 7.5ms
+#define NORMAL_CONN_INTERVAL_MAX 0x12           // 22.5ms
+#define NORMAL_CONN_LATENCY 0
+#define LOW_POWER_CONN_INTERVAL_MIN 80          // 100ms
+#define LOW_POWER_CONN_INTERVAL_MAX 160         // 200ms
+#define LOW_POWER_CONN_LATENCY 2                // up to 2 idle events skipped: commands wait <= 600ms
+#define CONN_SUPERVISION_TIMEOUT 400            // 4s
+#define NORMAL_ADV_INTERVAL_MIN 0x20            // 20ms
+#define NORMAL_ADV_INTERVAL_MAX 0x40            // 40ms
+#define LOW_POWER_ADV_INTERVAL_MIN 1600         // 1s
+#define LOW_POWER_ADV_INTERVAL_MAX 1760         // 1.1s
+
+TaskHandle_t acquisitionTaskHandle = NULL;
+TaskHandle_t dspTaskHandle = NULL;
+TaskHandle_t transportTaskHandle = NULL;
+TaskHandle_t flashLogTaskHandle = NULL;
+// Producer: acquisition task. Consumer: whoever holds dataMutex (the DSP task, or a mode switch
+// clearing it while the acquisition task is held off by sensorMutex).
+SampleBus<SAMPLE_QUEUE_LENGTH> sampleBus;
+
+// sensorMutex guards the I2C bus and sensor configuration (acquisition task, BLE commands).
+// dataMutex guards the processed state (DSP and transport tasks, BLE commands).
+// Lock order is sensorMutex then dataMutex.
+SemaphoreHandle_t sensorMutex = NULL;
+SemaphoreHandle_t dataMutex = NULL;
+
+// Control commands are copied out of the BLE write callback into a preallocated ring and run
+// by the Arduino loop task, so mode switches and sensor resets never block the BLE host task.
+// Longer writes are truncated.
+#define CONTROL_COMMAND_MAX 48
+#define CONTROL_QUEUE_LENGTH 8           // must be a power of two
+#define CONTROL_IDLE_REPORT_MS 10000     // free heap report when no command comes
+
+struct ControlCommand {
+    char text[CONTROL_COMMAND_MAX];
+};
+
+TaskHandle_t controlTaskHandle = NULL;
+// Producer: the BLE write callback. Consumer: the control (loop) task.
+SPSCBuffer<ControlCommand, CONTROL_QUEUE_LENGTH> controlQueue;
+uint32_t controlDropped = 0;             // commands lost to a full queue, BLE side only
+volatile bool connectPending = false;
+volatile bool disconnectPending = false;
+
+// ==================================================
+// SENSORS
+// ==================================================
+// The board's sensors next to the MAX30100 FIFO, which clocks the sample bus. They register
+// themselves: acquireSamples() polls them and annotates every sample with them in this order.
+
+// ADXL335, through the DMA scan's decimated output or one analogRead() per wake-up
+class AccelerometerSensor : public Sensor {
+public:
+    AccelerometerSensor(ADXL335& accel) : Sensor("accelerometer"), accel(accel) {}
+    
+    void poll(uint32_t /*now*/) override {
+        // Accelerometer samples produced since the last wake-up, oldest first
+        motionCount = accel.isContinuous() ? accel.readDecimated(motion, ADXL335_DECIMATED_BUFFER) : 0;
+        motionIndex = 0;
+        accel.getAcceleration(&latestX, &latestY, &latestZ);
+    }
+    
+    // Pairs each PPG sample with the latest accelerometer sample taken at or before it
+    void annotate(SensorSample& sample) override {
+        if (motionCount == 0) {
+            sample.ax = latestX;
+            sample.ay = latestY;
+            sample.az = latestZ;
+            return;
+        }
+        while (motionIndex + 1 < motionCount &&
+               (int32_t)(motion[motionIndex + 1].timestamp - sample.readout.timestamp) <= 0) {
+            motionIndex++;
+        }
+        sample.ax = motion[motionIndex].x;
+        sample.ay = motion[motionIndex].y;
+        sample.az = motion[motionIndex].z;
+    }
+    
+private:
+    ADXL335& accel;
+    ADXL335Sample motion[ADXL335_DECIMATED_BUFFER];
+    size_t motionCount = 0;
+    size_t motionIndex = 0;
+    float latestX = 0.0, latestY = 0.0, latestZ = 0.0;
+};
+
+// MAX30100 die temperature. The conversion runs alongside the PPG sampling: one write to start
+// it, one read of the result on the first wake-up after it is done, no polling in between.
+class DieTemperatureSensor : public Sensor {
+public:
+    DieTemperatureSensor(MAX30100& sensor) : Sensor("temperature"), sensor(sensor) {}
+    
+    void setPeriod(uint32_t periodMs) {
+        this->periodMs = periodMs;
+    }
+    
+    void poll(uint32_t now) override {
+        if (!samplingStarted && now - tsLastSample > periodMs) {
+            sensor.startTemperatureSampling();
+            samplingStarted = true;
+            tsLastSample = now;
+        }
+        if (samplingStarted && now - tsLastSample >= MAX30100_TEMPERATURE_CONVERSION_MS) {
+            temperature = sensor.retrieveTemperature();
+            samplingStarted = false;
+        }
+    }
+    
+    void annotate(SensorSample& sample) override {
+        sample.temperature = temperature;
+    }
+    
+    void reset() override {
+        samplingStarted = false;
+        tsLastSample = 0;
+    }
+    
+private:
+    MAX30100& sensor;
+    uint32_t periodMs = 500;
+    bool samplingStarted = false;
+    uint32_t tsLastSample = 0;
+    float temperature = 0.0;
+};
+
+// FSR on an ADC1 pin, read once per wake-up: the DMA accelerometer scan is stopped meanwhile
+class ForceSensor : public Sensor {
+public:
+    ForceSensor(uint8_t pin) : Sensor("fsr"), pin(pin) {}
+    
+    void poll(uint32_t /*now*/) override {
+        value = analogRead(pin);
+    }
+    
+    void annotate(SensorSample& sample) override {
+        sample.fsr = value;
+    }
+    
+private:
+    uint8_t pin;
+    uint16_t value = 0;
+};
+
+AccelerometerSensor accelSensor(accel);
+DieTemperatureSensor temperatureSensor(rawSensor);
+ForceSensor forceSensor(FSR_PIN);
+
 // ==================================================
 // FORWARD DECLARATIONS
 // ==================================================
 void onBeatDetected();
 void sendStatus();
+void sendPerfStats();
 void handleControlCommand(const char* command);
-void switchMode(const char* modeName);
+bool switchMode(const char* modeName);
 int assessDataQuality();
 bool checkMemory(const char* operation);
 void resetSensors();
 bool primeSensor(); // New function for priming
+uint32_t sendDueStreams();
+void logVitals(uint32_t timestamp);
+void streamFlashDump();
+void wakeFlashLogWriter();
+void setPowerMode(bool low);
+void applyConnectionParameters();
 
 // ==================================================
 // UTILITY FUNCTIONS
@@ -119,6 +495,12 @@ void onBeatDetected() {
     Serial.println("💓 Beat Detected!");
 }
 
+void IRAM_ATTR onMax30100Interrupt() {
+    BaseType_t higherPriorityTaskWoken = pdFALSE;
+    vTaskNotifyGiveFromISR(acquisitionTaskHandle, &higherPriorityTaskWoken);
+    portYIELD_FROM_ISR(higherPriorityTaskWoken);
+}
+
 bool checkMemory(const char* operation) {
     uint32_t freeHeap = ESP.getFreeHeap();
     Serial.printf("💾 %s - Free heap: %u bytes\n", operation, freeHeap);
@@ -129,36 +511,101 @@ bool checkMemory(const char* operation) {
     return true;
 }
 
+bool allocateRawRing() {
+    rawRingCapacity = psramFound() ? RAW_RING_SIZE_PSRAM : RAW_RING_SIZE;
+    size_t bytes = rawRingCapacity * sizeof(RawSample);
+    rawRing = (RawSample*)(psramFound() ? ps_malloc(bytes) : malloc(bytes));
+    if (rawRing == NULL) {
+        Serial.println("⚠️  WARNING: Raw sample ring allocation failed");
+        rawRingCapacity = 0;
+        return false;
+    }
+    Serial.printf("📦 Raw sample ring: %u samples in %s\n", rawRingCapacity, psramFound() ? "PSRAM" : "RAM");
+    return true;
+}
+
+void clearRawRing() {
+    rawRingHead = 0;
+    rawRingCount = 0;
+}
+
+// Queue a FIFO sample with the accelerometer reading taken when it was drained
+void pushRawSample(const SensorReadout& readout) {
+    if (rawRingCount == rawRingCapacity) {
+        rawDropped++;
+        return;
+    }
+    RawSample& sample = rawRing[(rawRingHead + rawRingCount) % rawRingCapacity];
+    sample.readout = readout;
+    sample.axMg = toMilliG(ax);
+    sample.ayMg = toMilliG(ay);
+    sample.azMg = toMilliG(az);
+    rawRingCount++;
+}
+
+// Logs a FIFO sample with the accelerometer reading taken when it was drained
+void logRawSample(const SensorReadout& readout) {
+    RawRecord record;
+    record.ir = readout.ir;
+    record.red = readout.red;
+    record.axMg = toMilliG(ax);
+    record.ayMg = toMilliG(ay);
+    record.azMg = toMilliG(az);
+    flashLog.append(MODE_RAW_DATA, readout.timestamp, &record, sizeof(record));
+}
+
+// A slave reset or interrupted in the middle of a read keeps SDA low and the controller can't
+// start a transaction. Clocking SCL by hand until SDA is released, then sending a STOP, frees it.
+// Returns false when a line is still held low (short, missing pull-up).
+bool recoverI2CBus() {
+    Wire.end();
+    
+    pinMode(I2C_SDA_PIN, INPUT_PULLUP);
+    pinMode(I2C_SCL_PIN, OUTPUT_OPEN_DRAIN);
+    digitalWrite(I2C_SCL_PIN, HIGH);
+    for (int i = 0; i < I2C_RECOVERY_PULSES && digitalRead(I2C_SDA_PIN) == LOW; i++) {
+        digitalWrite(I2C_SCL_PIN, LOW);
+        delayMicroseconds(I2C_RECOVERY_HALF_PERIOD_US);
+        digitalWrite(I2C_SCL_PIN, HIGH);
+        delayMicroseconds(I2C_RECOVERY_HALF_PERIOD_US);
+    }
+    
+    // STOP: SDA rising while SCL is high
+    pinMode(I2C_SDA_PIN, OUTPUT_OPEN_DRAIN);
+    digitalWrite(I2C_SDA_PIN, LOW);
+    delayMicroseconds(I2C_RECOVERY_HALF_PERIOD_US);
+    digitalWrite(I2C_SDA_PIN, HIGH);
+    delayMicroseconds(I2C_RECOVERY_HALF_PERIOD_US);
+    bool released = digitalRead(I2C_SDA_PIN) == HIGH && digitalRead(I2C_SCL_PIN) == HIGH;
+    
+    Wire.begin(I2C_SDA_PIN, I2C_SCL_PIN);
+    Wire.setClock(rawSensor.getBusSpeed());
+    Wire.setTimeOut(I2C_TIMEOUT_MS);
+    return released;
+}
+
+// Full teardown of the sensor and the I2C bus, the fallback when the fast mode switch fails
 void resetSensors() {
     Serial.println("🔄 Resetting sensors...");
     
     // First shutdown any active sensors
     if (poxInitialized) {
         pox.shutdown();
-        delay(50);  // Give time for shutdown to complete
         poxInitialized = false;
     }
     if (rawSensorInitialized) {
         rawSensor.shutdown();
-        delay(50);  // Give time for shutdown to complete
         rawSensorInitialized = false;
     }
     
-    // Reset I2C bus
-    Wire.end();
-    delay(100);  // Allow bus to fully reset
-    
-    // Reinitialize I2C
-    Wire.begin();
-    Wire.setClock(100000);  // 100kHz I2C for better stability
-    delay(50);  // Allow bus to stabilize
+    if (!recoverI2CBus()) {
+        Serial.println("⚠️  I2C bus still held low, check the wiring");
+    }
     
-    // Reset MAX30100 registers to default state
-    Wire.beginTransmission(0x57);  // MAX30100 I2C address
-    Wire.write(0xFF);  // Reset command register
-    Wire.write(0x40);  // Reset command
-    Wire.endTransmission();
-    delay(100);  // Wait for reset to complete
+    // Reset MAX30100 registers to default state, polled until done
+    if (!rawSensor.reset()) {
+        Serial.println("⚠️  MAX30100 reset not acknowledged");
+    }
     
     Serial.println("✅ Sensors and I2C bus reset");
 }
@@ -188,13 +635,13 @@ bool primeSensor(PulseOximeter& poxSensor, MAX30100& rawSensor, bool isPulseOxim
     
     // Step 2: Perform dummy reads to stabilize
     uint32_t startTime = millis();
-    uint16_t dummyIr, dummyRed;
+    SensorReadout dummyReadouts[RINGBUFFER_SIZE];
     for (int i = 0; i < 10; i++) { // 10 dummy reads
         if (isPulseOximeter) {
             poxSensor.update();
         } else {
             rawSensor.update();
-            rawSensor.getRawValues(&dummyIr, &dummyRed);
+            rawSensor.readAll(dummyReadouts, RINGBUFFER_SIZE);
         }
         delay(20); // 20ms per read, total ~200ms
         if (millis() - startTime > 500) { // Timeout after 500ms
@@ -219,34 +666,113 @@ bool primeSensor(PulseOximeter& poxSensor, MAX30100& rawSensor, bool isPulseOxim
 // ==================================================
 
 class ServerCallbacks: public BLEServerCallbacks {
-    void onConnect(BLEServer* pServer) {
+    void onConnect(BLEServer* pServer, esp_ble_gatts_cb_param_t* param) {
         clientConnected = true;
+        memcpy(peerAddress, param->connect.remote_bda, sizeof(peerAddress));
         Serial.println("📱 Client connected");
-        sendStatus();
+        applyConnectionParameters();
+        // The frame sequence and the first status are the control task's, under dataMutex
+        connectPending = true;
+        xTaskNotifyGive(controlTaskHandle);
     }
     
     void onDisconnect(BLEServer* pServer) {
         clientConnected = false;
-        Serial.println("📱 Client disconnected - restarting advertising");
-        resetSensors();
-        currentMode = MODE_IDLE;
-        reportingPeriod = 500;  // Consistent 2Hz (500ms) for all modes
-        tsLastReport = 0;
-        forceTest.isCollecting = false;
-        distanceTest.collectingData = false;
-        temperatureMode.tempSamplingStarted = false;
-        qualityMode.hasPreviousData = false;
-        BLEDevice::startAdvertising();
+        Serial.println("📱 Client disconnected");
+        // Torn down by the control task, which restarts advertising once done
+        disconnectPending = true;
+        xTaskNotifyGive(controlTaskHandle);
+    }
+};
+
+class DataCallbacks: public BLECharacteristicCallbacks {
+    void onStatus(BLECharacteristic* pCharacteristic, Status status, uint32_t code) {
+        if (status != SUCCESS_NOTIFY && status != SUCCESS_INDICATE) {
+            notifyFailures++;
+        }
     }
 };
 
 class ControlCallbacks: public BLECharacteristicCallbacks {
     void onWrite(BLECharacteristic* pCharacteristic) {
-        const char* value = pCharacteristic->getValue().c_str();
-        handleControlCommand(value);
+        // Straight from the characteristic's buffer into a queue slot, no std::string copy
+        ControlCommand* slot;
+        if (controlQueue.pushSpan(&slot) == 0) {
+            controlDropped++;
+            return;
+        }
+        size_t length = min(pCharacteristic->getLength(), (size_t)CONTROL_COMMAND_MAX - 1);
+        memcpy(slot->text, pCharacteristic->getData(), length);
+        slot->text[length] = '\0';
+        controlQueue.commitPush(1);
+        xTaskNotifyGive(controlTaskHandle);
     }
 };
 
+// Control task side: reverts to IDLE when the client leaves, unless the flash log records
+void handleDisconnect() {
+    flashDump.active = false;
+    if (flashLog.isRecording()) {
+        // Keep sampling into the flash log until a client sends LOG:STOP
+        Serial.println("💾 Flash log recording continues offline");
+        dataFormat = FORMAT_JSON;
+        clearRawRing();
+        return;
+    }
+    resetSensors();
+    accel.endContinuous();
+    currentMode = MODE_IDLE;
+    dataFormat = FORMAT_JSON;
+    clearRawRing();
+    rawFlushInterval = RAW_FLUSH_INTERVAL_DEFAULT_MS;
+    for (OutputStream& stream : streams) {
+        stream.periodMs = stream.defaultPeriodMs;
+        stream.decimation = 1;
+        stream.subscribed = false;
+    }
+    forceLabeling.stop();
+    distanceAveraging.stop();
+    temperatureSensor.reset();
+    qualityMode.hasPreviousData = false;
+    qualityFeatures.reset();
+}
+
+// A new client's session first, then the queued commands in order, then a pending disconnect:
+// advertising restarts only after it, so a new client never sees the previous one's session
+void processControlQueue() {
+    if (connectPending) {
+        connectPending = false;
+        xSemaphoreTake(dataMutex, portMAX_DELAY);
+        frameSequence = 0;
+        sendStatus();
+        xSemaphoreGive(dataMutex);
+    }
+    
+    const ControlCommand* commands;
+    size_t count;
+    while ((count = controlQueue.popSpan(&commands)) > 0) {
+        for (size_t i = 0; i < count; i++) {
+            xSemaphoreTake(sensorMutex, portMAX_DELAY);
+            xSemaphoreTake(dataMutex, portMAX_DELAY);
+            handleControlCommand(commands[i].text);
+            xSemaphoreGive(dataMutex);
+            xSemaphoreGive(sensorMutex);
+        }
+        controlQueue.commitPop(count);
+    }
+    
+    if (disconnectPending) {
+        disconnectPending = false;
+        xSemaphoreTake(sensorMutex, portMAX_DELAY);
+        xSemaphoreTake(dataMutex, portMAX_DELAY);
+        handleDisconnect();
+        xSemaphoreGive(dataMutex);
+        xSemaphoreGive(sensorMutex);
+        Serial.println("📡 Advertising restarted");
+        BLEDevice::startAdvertising();
+    }
+}
+
 // ==================================================
 // UTILITY FUNCTIONS
 // ==================================================
@@ -254,17 +780,107 @@ class ControlCallbacks: public BLECharacteristicCallbacks {
 void sendStatus() {
     if (!clientConnected) return;
     
-    const char* modeNames[] = {"IDLE", "HR_SPO2", "TEMPERATURE", "FORCE_TEST", "DISTANCE_TEST", "QUALITY", "RAW_DATA"};
-    char buffer[150];
+    const char* modeNames[] = {"IDLE", "HR_SPO2", "TEMPERATURE", "FORCE_TEST", "DISTANCE_TEST", "QUALITY", "RAW_DATA", "MULTI"};
+    const char* logState = !flashLog.isAvailable() ? "none" : flashLog.isErasing() ? "erasing" :
+                           flashDump.active ? "dumping" : flashLog.isRecording() ? "recording" : "idle";
+    // Running streams and their periods as "VITALS:1000,RAW:100"
+    char running[160] = "";
+    for (int i = 0; i < STREAM_COUNT; i++) {
+        if (isStreaming((SensingStream)i)) {
+            size_t used = strlen(running);
+            snprintf(running + used, sizeof(running) - used, "%s%s:%lu", used ? "," : "",
+                     streams[i].name, streamPeriod((SensingStream)i));
+        }
+    }
+    
+    char buffer[512];
     snprintf(buffer, sizeof(buffer),
-        "{\"status\":\"ready\",\"mode\":\"%s\",\"uptime\":%lu,\"free_heap\":%u}",
-        modeNames[currentMode], millis(), ESP.getFreeHeap()
+        "{\"status\":\"ready\",\"device\":\"%s\",\"mode\":\"%s\",\"streams\":\"%s\",\"format\":\"%s\",\"mtu\":%u,\"flush_ms\":%lu,\"raw_decimation\":%u,\"raw_queued\":%u,\"raw_dropped\":%lu,\"log\":\"%s\",\"log_pages\":%lu,\"power\":\"%s\",\"light_sleep\":%s,\"uptime\":%lu,\"free_heap\":%u}",
+        bleDeviceName, modeNames[currentMode], running, dataFormat == FORMAT_BINARY ? "binary" : "json",
+        bleServer->getPeerMTU(bleServer->getConnId()), rawFlushInterval, streams[STREAM_RAW].decimation,
+        rawRingCount, rawDropped,
+        logState, flashLog.getNextSequence() - flashLog.getFirstSequence(), lowPower ? "low" : "normal",
+        lightSleepEnabled ? "true" : "false", millis(), ESP.getFreeHeap()
     );
     
     statusChar->setValue((uint8_t*)buffer, strlen(buffer));
     statusChar->notify();
 }
 
+// One notification per timed path, then one with the loss counters. Each fits a 247 byte MTU.
+void sendPerfStats() {
+    char buffer[224];
+    
+    for (PerfStat* stat : perfStats) {
+        snprintf(buffer, sizeof(buffer),
+            "{\"perf\":\"%s\",\"n\":%lu,\"min_us\":%.1f,\"mean_us\":%.1f,\"max_us\":%.1f,\"p99_us\":%.1f}",
+            stat->getName(), stat->getCount(), stat->getMin(), stat->getMean(), stat->getMax(), stat->getP99()
+        );
+        Serial.printf("⏱️  %s\n", buffer);
+        if (clientConnected) {
+            statsChar->setValue((uint8_t*)buffer, strlen(buffer));
+            statsChar->notify();
+        }
+    }
+    
+    snprintf(buffer, sizeof(buffer),
+        "{\"counters\":{\"fifo_overflow\":%lu,\"queue_dropped\":%lu,\"raw_dropped\":%lu,\"accel_overruns\":%lu,\"notify_failures\":%lu,\"log_dropped\":%lu,\"i2c_errors\":%lu,\"i2c_khz\":%lu,\"cmd_dropped\":%lu}}",
+        rawSensor.getDroppedSamples(), sampleBus.getDropped(), rawDropped, accel.getOverruns(), notifyFailures,
+        flashLog.getDropped(), rawSensor.getBusErrors(), rawSensor.getBusSpeed() / 1000, controlDropped
+    );
+    Serial.printf("⏱️  %s\n", buffer);
+    statsChar->setValue((uint8_t*)buffer, strlen(buffer));
+    if (clientConnected) {
+        statsChar->notify();
+    }
+}
+
+// RAW_DATA, TEMPERATURE, FORCE_TEST and DISTANCE_TEST: both LEDs at 24mA, no LED follower.
+// In low power everything but DISTANCE_TEST, which characterises the LEDs at 24mA, is dimmed.
+// With DMA accelerometer sampling every FIFO sample gets a time-matched reading from one
+// wake-up per burst. Without it the raw stream wakes on every sample to read the accelerometer.
+uint8_t sensorInterrupts() {
+    return isStreaming(STREAM_RAW) && !accel.isContinuous() ? MAX30100_IE_ENB_SPO2_RDY : MAX30100_IE_ENB_A_FULL;
+}
+
+MAX30100Config rawSensorConfig() {
+    uint8_t interrupts = sensorInterrupts();
+    if (lowPower && currentMode != MODE_DISTANCE_TEST) {
+        return max30100Config(MAX30100_MODE_SPO2_HR, LOW_POWER_SAMPLING_RATE, LOW_POWER_PULSE_WIDTH,
+                              LOW_POWER_LED_CURRENT, LOW_POWER_LED_CURRENT, interrupts);
+    }
+    return max30100Config(MAX30100_MODE_SPO2_HR, DEFAULT_SAMPLING_RATE, DEFAULT_PULSE_WIDTH,
+                          MAX30100_LED_CURR_24MA, MAX30100_LED_CURR_24MA, interrupts);
+}
+
+LEDCurrent pulseOximeterIrCurrent() {
+    return lowPower ? LOW_POWER_IR_LED_CURRENT : MAX30100_LED_CURR_24MA;
+}
+
+// Fast mode switch: the sensor keeps sampling and only the registers that differ from what it
+// holds are written, a few ms of I2C instead of the ~1s reset and priming of
+// initializePulseOximeter()/initializeRawSensor(), which remain the fallback.
+bool reconfigurePulseOximeter() {
+    if (!pox.reconfigure(pulseOximeterIrCurrent(), sensorInterrupts())) {
+        Serial.println("⚠️  Pulse oximeter reconfiguration failed, resetting");
+        return false;
+    }
+    pox.setOnBeatDetectedCallback(onBeatDetected);
+    poxInitialized = true;
+    rawSensorInitialized = false;
+    return true;
+}
+
+bool reconfigureRawSensor() {
+    if (!rawSensor.applyConfig(rawSensorConfig())) {
+        Serial.println("⚠️  Raw sensor reconfiguration failed, resetting");
+        return false;
+    }
+    rawSensorInitialized = true;
+    poxInitialized = false;
+    return true;
+}
+
 bool initializePulseOximeter() {
     if (!checkMemory("Before pulse oximeter init")) {
         return false;
@@ -284,6 +900,9 @@ bool initializePulseOximeter() {
     while (retryCount < maxRetries) {
         if (primeSensor(pox, rawSensor, true)) {
             pox.setOnBeatDetectedCallback(onBeatDetected);
+            // Wake the acquisition task once per FIFO burst rather than once per sample
+            pox.reconfigure(pulseOximeterIrCurrent(), sensorInterrupts());
+            pox.getInterruptStatus();
             poxInitialized = true;
             Serial.println("✅ SUCCESS");
             checkMemory("After pulse oximeter init");
@@ -315,211 +934,799 @@ bool initializeRawSensor() {
         return false;
     }
     
+    rawSensor.applyConfig(rawSensorConfig());
+    rawSensor.getInterruptStatus();
     rawSensorInitialized = true;
     Serial.println("✅ SUCCESS");
     checkMemory("After raw sensor init");
     return true;
 }
 
+// Control task side, with sensorMutex and dataMutex held: the ~1s reset and priming needs the
+// sensor alone, so dataMutex is let go meanwhile and the transport task keeps sending. Marked
+// uninitialized first, the DSP task leaves the pulse oximeter alone until it is primed.
+bool primeWithoutDataLock(bool (*initialize)()) {
+    poxInitialized = false;
+    rawSensorInitialized = false;
+    xSemaphoreGive(dataMutex);
+    bool primed = initialize();
+    xSemaphoreTake(dataMutex, portMAX_DELAY);
+    return primed;
+}
+
 void initializeAccelerometer() {
+    // The DMA scan holds the APB clock, which would rule out light sleep, and ADC1, which the FSR needs
+    bool continuous = !lowPower && !isStreaming(STREAM_FORCE);
+    if (accel.isContinuous()) {
+        if (!continuous) {
+            accel.endContinuous();
+        }
+        return;
+    }
+    
     Serial.print("🏃 Initializing accelerometer... ");
     accel.begin();
-    Serial.println("✅ SUCCESS");
+    if (continuous && accel.beginContinuous(ACCEL_OUTPUT_RATE_HZ, ACCEL_OVERSAMPLING)) {
+        Serial.printf("✅ SUCCESS (DMA, %dHz x%d)\n", ACCEL_OUTPUT_RATE_HZ, ACCEL_OVERSAMPLING);
+    } else {
+        Serial.println("✅ SUCCESS (analogRead)");
+    }
 }
 
 // ==================================================
 // MODE SWITCHING AND CONTROL
 // ==================================================
 
-void handleControlCommand(const char* command) {
-    Serial.printf("📨 Command received: %s\n", command);
-    
-    if (strncmp(command, "MODE:", 5) == 0) {
-        switchMode(command + 5);
-    }
-    else if (strncmp(command, "LABEL:", 6) == 0) {
-        if (currentMode == MODE_FORCE_TEST) {
-            strncpy(forceTest.currentLabel, command + 6, sizeof(forceTest.currentLabel) - 1);
-            forceTest.currentLabel[sizeof(forceTest.currentLabel) - 1] = '\0';
-            forceTest.isCollecting = true;
-            forceTest.collectionStartTime = millis();
-            Serial.printf("🏷️  Force test started with label: %s\n", forceTest.currentLabel);
-        }
-    }
-    else if (strncmp(command, "START:", 6) == 0) {
-        if (currentMode == MODE_DISTANCE_TEST) {
-            const char* colon = strchr(command + 6, ':');
-            if (colon) {
-                strncpy(distanceTest.currentLED, command + 6, colon - (command + 6));
-                distanceTest.currentLED[colon - (command + 6)] = '\0';
-                distanceTest.currentDistance = atoi(colon + 1);
-            } else {
-                strncpy(distanceTest.currentLED, command + 6, sizeof(distanceTest.currentLED) - 1);
-                distanceTest.currentLED[sizeof(distanceTest.currentLED) - 1] = '\0';
-                distanceTest.currentDistance = 0;
-            }
-            distanceTest.collectingData = true;
-            distanceTest.sampleCount = 0;
-            distanceTest.irSum = 0;
-            distanceTest.redSum = 0;
-            Serial.printf("📏 Distance test started: %s at %dmm\n", 
-                         distanceTest.currentLED, distanceTest.currentDistance);
-        }
-    }
-    else if (strcmp(command, "STOP") == 0) {
-        if (currentMode == MODE_FORCE_TEST) {
-            forceTest.isCollecting = false;
-            strncpy(forceTest.currentLabel, "waiting", sizeof(forceTest.currentLabel));
-        } else if (currentMode == MODE_DISTANCE_TEST) {
-            distanceTest.collectingData = false;
-        }
-        Serial.println("⏹️  Collection stopped");
-    }
-    else if (strcmp(command, "RESET") == 0) {
-        resetSensors();
-    }
-    else if (strcmp(command, "STATUS") == 0) {
-        sendStatus();
+bool commandMode(const char* argument) {
+    return switchMode(argument);
+}
+
+bool commandLabel(const char* argument) {
+    if (!isStreaming(STREAM_FORCE)) {
+        return false;
     }
-    
-    sendStatus();
+    forceLabeling.start(argument, millis());
+    Serial.printf("🏷️  Force test started with label: %s\n", forceLabeling.getLabel());
+    return true;
 }
 
-void switchMode(const char* modeName) {
-    OperatingMode newMode = MODE_IDLE;
-    uint32_t newReportingPeriod = 500;  // Default to 2Hz (500ms) for all modes
-    
-    if (strcmp(modeName, "HR_SPO2") == 0) {
-        newMode = MODE_HR_SPO2;
-        newReportingPeriod = 500;
-    } else if (strcmp(modeName, "TEMPERATURE") == 0) {
-        newMode = MODE_TEMPERATURE;
-        newReportingPeriod = 500;  // Changed from 2000ms to 500ms for 2Hz
-    } else if (strcmp(modeName, "FORCE_TEST") == 0) {
-        newMode = MODE_FORCE_TEST;
-        newReportingPeriod = 500;  // Changed from 100ms to 500ms for 2Hz
-    } else if (strcmp(modeName, "DISTANCE_TEST") == 0) {
-        newMode = MODE_DISTANCE_TEST;
-        newReportingPeriod = 500;  // Changed from 100ms to 500ms for 2Hz
-    } else if (strcmp(modeName, "QUALITY") == 0) {
-        newMode = MODE_QUALITY;
-        newReportingPeriod = 500;  // Changed from 1000ms to 500ms for 2Hz
-    } else if (strcmp(modeName, "RAW_DATA") == 0) {
-        newMode = MODE_RAW_DATA;
-        newReportingPeriod = 500;
-    } else if (strcmp(modeName, "IDLE") == 0) {
-        newMode = MODE_IDLE;
-        newReportingPeriod = 500;  // Changed from 2000ms to 500ms for 2Hz
+bool commandStart(const char* argument) {
+    if (currentMode != MODE_DISTANCE_TEST) {
+        return false;
     }
-    
-    if (newMode == currentMode) {
-        Serial.printf("⚡ Already in %s mode\n", modeName);
-        return;
+    // START:<led>[:<distance mm>]
+    char led[8];
+    const char* colon = strchr(argument, ':');
+    size_t length = colon ? colon - argument : strlen(argument);
+    length = min(length, sizeof(led) - 1);
+    memcpy(led, argument, length);
+    led[length] = '\0';
+    distanceAveraging.start(led, colon ? atoi(colon + 1) : 0);
+    Serial.printf("📏 Distance test started: %s at %dmm\n", 
+                 distanceAveraging.getLed(), distanceAveraging.getDistance());
+    return true;
+}
+
+bool commandStop(const char* argument) {
+    if (isStreaming(STREAM_FORCE)) {
+        forceLabeling.stop();
+    } else if (currentMode == MODE_DISTANCE_TEST) {
+        distanceAveraging.stop();
     }
-    
-    Serial.printf("🔄 Switching to %s mode\n", modeName);
-    currentMode = newMode;
-    reportingPeriod = newReportingPeriod;
-    tsLastReport = 0;
-    
-    bool needsPulseOx = (newMode == MODE_HR_SPO2 || newMode == MODE_QUALITY);
-    bool needsRawSensor = (newMode == MODE_TEMPERATURE || newMode == MODE_FORCE_TEST || 
-                         newMode == MODE_DISTANCE_TEST || newMode == MODE_RAW_DATA);
-    bool needsAccel = (newMode == MODE_HR_SPO2 || newMode == MODE_QUALITY || newMode == MODE_RAW_DATA);
-    
-    if (newMode == MODE_IDLE) {
-        resetSensors();
+    Serial.println("⏹️  Collection stopped");
+    return true;
+}
+
+bool commandFormat(const char* argument) {
+    if (strcmp(argument, "BINARY") == 0) {
+        dataFormat = FORMAT_BINARY;
+    } else if (strcmp(argument, "JSON") == 0) {
+        dataFormat = FORMAT_JSON;
     } else {
-        // Always reinitialize the correct sensor type when switching modes
-        // This ensures proper LED settings and configuration
-        if (needsPulseOx) {
-            if (rawSensorInitialized) {
-                // Switching from raw sensor to pulse oximeter
-                Serial.println("🔄 Switching from raw sensor to pulse oximeter");
-                resetSensors(); // Clean reset before switching
-            }
-            initializePulseOximeter();
-        } else if (needsRawSensor) {
-            if (poxInitialized) {
-                // Switching from pulse oximeter to raw sensor  
-                Serial.println("🔄 Switching from pulse oximeter to raw sensor");
-                resetSensors(); // Clean reset before switching
-            }
-            initializeRawSensor();
-        }
-        
-        if (needsAccel) {
-            initializeAccelerometer();
-        }
-    }
-    
-    if (newMode == MODE_FORCE_TEST) {
-        forceTest.isCollecting = false;
-        strncpy(forceTest.currentLabel, "waiting", sizeof(forceTest.currentLabel));
-    } else if (newMode == MODE_DISTANCE_TEST) {
-        distanceTest.collectingData = false;
-        strncpy(distanceTest.currentLED, "none", sizeof(distanceTest.currentLED));
-        distanceTest.currentDistance = 0;
-    } else if (newMode == MODE_TEMPERATURE) {
-        temperatureMode.tempSamplingStarted = false;
-        temperatureMode.tsLastTempSample = 0;
-    } else if (newMode == MODE_QUALITY) {
-        qualityMode.hasPreviousData = false;
-        qualityMode.totalSamples = 0;
-        qualityMode.goodQualitySamples = 0;
+        return false;
     }
-    
-    Serial.println("✅ Mode switch complete");
+    clearRawRing();
+    scheduleStream(STREAM_RAW);
+    Serial.printf("📦 Data format: %s\n", dataFormat == FORMAT_BINARY ? "binary" : "json");
+    return true;
 }
 
-// ==================================================
-// SENSOR READING FUNCTIONS
-// ==================================================
-
-void readSensorData() {
-    accel.getAcceleration(&ax, &ay, &az);
-    
-    if (poxInitialized && (currentMode == MODE_HR_SPO2 || currentMode == MODE_QUALITY)) {
-        pox.update();
-        float newHeartRate = pox.getHeartRate();
-        float newSpO2 = pox.getSpO2();
-        
-        static uint32_t lastDebugOutput = 0;
-        if (millis() - lastDebugOutput > 5000 || 
-            abs(newHeartRate - heartRate) > 5 || 
-            abs(newSpO2 - spO2) > 2) {
-            Serial.printf("🔍 HR: %.1f -> %.1f, SpO2: %.1f -> %.1f\n", 
-                         heartRate, newHeartRate, spO2, newSpO2);
-            lastDebugOutput = millis();
-        }
-        
-        heartRate = newHeartRate;
-        spO2 = newSpO2;
-    }
-    
-    if (rawSensorInitialized) {
-        rawSensor.update();
-        rawSensor.getRawValues(&irValue, &redValue);
-        
-        if (currentMode == MODE_TEMPERATURE) {
-            if (millis() - temperatureMode.tsLastTempSample > temperatureMode.tempSamplingPeriod) {
-                if (!temperatureMode.tempSamplingStarted) {
-                    rawSensor.startTemperatureSampling();
-                    temperatureMode.tempSamplingStarted = true;
-                    temperatureMode.tsLastTempSample = millis();
-                }
-            }
-            
-            if (temperatureMode.tempSamplingStarted && rawSensor.isTemperatureReady()) {
-                temperature = rawSensor.retrieveTemperature();
-                temperatureMode.tempSamplingStarted = false;
-            }
-        }
-    }
-    
-    if (currentMode == MODE_FORCE_TEST) {
-        fsrValue = analogRead(FSR_PIN);
-    }
+bool commandFlush(const char* argument) {
+    int interval = atoi(argument);
+    if (interval < RAW_FLUSH_INTERVAL_MIN_MS) interval = RAW_FLUSH_INTERVAL_MIN_MS;
+    if (interval > RAW_FLUSH_INTERVAL_MAX_MS) interval = RAW_FLUSH_INTERVAL_MAX_MS;
+    rawFlushInterval = interval;
+    Serial.printf("📦 Raw flush interval: %lums\n", rawFlushInterval);
+    return true;
+}
+
+bool commandPerf(const char* argument) {
+    sendPerfStats();
+    return true;
+}
+
+bool commandPerfReset(const char* argument) {
+    for (PerfStat* stat : perfStats) {
+        stat->reset();
+    }
+    Serial.println("⏱️  Perf stats reset");
+    return true;
+}
+
+bool commandReset(const char* argument) {
+    resetSensors();
+    return true;
+}
+
+bool commandStatus(const char* argument) {
+    return true;    // the status notification follows every command
+}
+
+bool commandPower(const char* argument) {
+    if (strcmp(argument, "LOW") == 0) {
+        setPowerMode(true);
+    } else if (strcmp(argument, "NORMAL") == 0) {
+        setPowerMode(false);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool commandLogStart(const char* argument) {
+    if (!flashLog.isAvailable() || flashLog.isErasing()) {
+        Serial.println("⚠️  Flash log unavailable");
+        return false;
+    }
+    if (currentMode != MODE_RAW_DATA && currentMode != MODE_HR_SPO2 && currentMode != MODE_QUALITY &&
+        currentMode != MODE_MULTI) {
+        Serial.println("⚠️  Flash log records RAW_DATA, HR_SPO2, QUALITY or MULTI, select one first");
+        return false;
+    }
+    flashLog.start();
+    Serial.println("💾 Flash log recording");
+    return true;
+}
+
+bool commandLogStop(const char* argument) {
+    flashLog.stop();
+    wakeFlashLogWriter();
+    Serial.println("💾 Flash log stopped");
+    return true;
+}
+
+bool commandLogErase(const char* argument) {
+    if (flashLog.isRecording() || flashDump.active) {
+        Serial.println("⚠️  Flash log busy, LOG:STOP or wait for the dump first");
+        return false;
+    }
+    flashLog.requestErase();
+    wakeFlashLogWriter();
+    Serial.println("💾 Flash log erasing");
+    return true;
+}
+
+SensingStream findStream(const char* name, size_t length) {
+    for (int i = 0; i < STREAM_COUNT; i++) {
+        if (strlen(streams[i].name) == length && strncmp(streams[i].name, name, length) == 0) {
+            return (SensingStream)i;
+        }
+    }
+    return STREAM_COUNT;
+}
+
+// Sampling rate the MAX30100 runs at, from the configuration last written to it
+uint16_t sensorSamplingRateHz() {
+    return samplingRateHz((SamplingRate)((rawSensor.getConfig().spo2Configuration >> 2) & 0x07));
+}
+
+void setStreamPeriod(SensingStream stream, uint32_t period) {
+    if (period < STREAM_PERIOD_MIN_MS) period = STREAM_PERIOD_MIN_MS;
+    if (period > STREAM_PERIOD_MAX_MS) period = STREAM_PERIOD_MAX_MS;
+    streams[stream].periodMs = period;
+    scheduleStream(stream);
+}
+
+// A running MODE:MULTI session takes subscription changes like a mode switch
+void reapplySubscriptions(SensingStream changed) {
+    if (currentMode != MODE_MULTI || (streams[changed].flags & STREAM_FLAG_ANY_MODE)) {
+        return;
+    }
+    if (changed == STREAM_QUALITY) {
+        qualityMode.hasPreviousData = false;
+        qualityFeatures.reset();
+    } else if (changed == STREAM_TEMPERATURE) {
+        temperatureSensor.reset();
+    } else if (changed == STREAM_FORCE) {
+        forceLabeling.stop();
+        initializeAccelerometer();
+    }
+    // The interrupts follow the raw stream and the accelerometer sampling
+    if (!reconfigurePulseOximeter()) {
+        primeWithoutDataLock(initializePulseOximeter);
+    }
+}
+
+bool commandSubscribe(const char* argument) {
+    const char* colon = strchr(argument, ':');
+    SensingStream stream = findStream(argument, colon ? colon - argument : strlen(argument));
+    if (stream == STREAM_COUNT || !(streams[stream].flags & (STREAM_FLAG_MULTI | STREAM_FLAG_ANY_MODE))) {
+        return false;
+    }
+    setStreamPeriod(stream, colon ? atoi(colon + 1) : streams[stream].periodMs);
+    streams[stream].subscribed = true;
+    reapplySubscriptions(stream);
+    Serial.printf("📡 %s every %lums\n", streams[stream].name, streams[stream].periodMs);
+    return true;
+}
+
+bool commandUnsubscribe(const char* argument) {
+    SensingStream stream = findStream(argument, strlen(argument));
+    if (stream == STREAM_COUNT) {
+        return false;
+    }
+    streams[stream].subscribed = false;
+    reapplySubscriptions(stream);
+    Serial.printf("📡 %s off\n", streams[stream].name);
+    return true;
+}
+
+// RATE:<stream>:<hz>, fractions allowed. RAW takes the rate in both formats: as its JSON report
+// period, and in binary frames as the share of sensor samples queued, against the sampling rate
+// of the moment. ACCEL and STATUS start with RATE and stop at 0, the others stop with their mode.
+bool commandRate(const char* argument) {
+    const char* colon = strchr(argument, ':');
+    SensingStream stream = colon ? findStream(argument, colon - argument) : STREAM_COUNT;
+    if (stream == STREAM_COUNT) {
+        return false;
+    }
+    OutputStream& output = streams[stream];
+    float hz = atof(colon + 1);
+    if (hz <= 0) {
+        if (hz < 0 || !(output.flags & STREAM_FLAG_ANY_MODE)) {
+            return false;
+        }
+        output.subscribed = false;
+        Serial.printf("📡 %s off\n", output.name);
+        return true;
+    }
+    
+    setStreamPeriod(stream, (uint32_t)(1000.0f / hz + 0.5f));
+    if (stream == STREAM_RAW) {
+        float factor = sensorSamplingRateHz() / hz;
+        output.decimation = factor <= 1 ? 1 : factor >= UINT16_MAX ? UINT16_MAX : (uint16_t)(factor + 0.5f);
+        rawDecimationCount = 0;
+    }
+    if (output.flags & STREAM_FLAG_ANY_MODE) {
+        output.subscribed = true;
+    }
+    Serial.printf("📡 %s every %lums\n", output.name, output.periodMs);
+    return true;
+}
+
+bool commandDump(const char* argument) {
+    if (!flashLog.isAvailable() || flashLog.isErasing() || flashDump.active) {
+        return false;
+    }
+    if (!dataCccd->getNotifications()) {
+        // Every frame would be refused: the client has to subscribe to the data first
+        Serial.println("⚠️  DUMP needs the data notifications enabled");
+        return false;
+    }
+    // Up to what is programmed now, the page being filled is not included
+    flashDump.active = true;
+    flashDump.sequence = flashLog.getFirstSequence();
+    flashDump.end = flashLog.getNextSequence();
+    flashDump.pages = 0;
+    flashDump.skipped = 0;
+    Serial.printf("💾 Dumping %lu flash log pages\n", flashDump.end - flashDump.sequence);
+    return true;
+}
+
+// A command is its name alone, or NAME:argument for the ones taking an argument.
+// Handlers run on the control task with sensorMutex and dataMutex held (dataMutex is let go
+// only while a sensor is reset and primed, see primeWithoutDataLock()), and return false
+// when the command doesn't apply (wrong mode, bad argument, busy).
+struct ControlCommandHandler {
+    const char* name;
+    bool takesArgument;
+    bool (*handler)(const char* argument);
+};
+
+static const ControlCommandHandler controlCommands[] = {
+    {"MODE",        true,  commandMode},
+    {"LABEL",       true,  commandLabel},
+    {"START",       true,  commandStart},
+    {"STOP",        false, commandStop},
+    {"FORMAT",      true,  commandFormat},
+    {"FLUSH",       true,  commandFlush},
+    {"PERF",        false, commandPerf},
+    {"PERF:RESET",  false, commandPerfReset},
+    {"RESET",       false, commandReset},
+    {"STATUS",      false, commandStatus},
+    {"POWER",       true,  commandPower},
+    {"LOG:START",   false, commandLogStart},
+    {"LOG:STOP",    false, commandLogStop},
+    {"LOG:ERASE",   false, commandLogErase},
+    {"DUMP",        false, commandDump},
+    {"SUBSCRIBE",   true,  commandSubscribe},
+    {"UNSUBSCRIBE", true,  commandUnsubscribe},
+    {"RATE",        true,  commandRate},
+};
+
+// {"cmd":<name>,"result":"ok"|"rejected"|"unknown"} on the status characteristic, then the status
+void sendCommandResponse(const char* name, const char* result) {
+    if (!clientConnected) return;
+    
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "{\"cmd\":\"%s\",\"result\":\"%s\"}", name, result);
+    statusChar->setValue((uint8_t*)buffer, strlen(buffer));
+    statusChar->notify();
+}
+
+void handleControlCommand(const char* command) {
+    Serial.printf("📨 Command received: %s\n", command);
+    
+    for (const ControlCommandHandler& entry : controlCommands) {
+        size_t length = strlen(entry.name);
+        if (strncmp(command, entry.name, length) != 0) {
+            continue;
+        }
+        const char* argument = command + length;
+        if (entry.takesArgument ? *argument != ':' : *argument != '\0') {
+            continue;
+        }
+        if (entry.takesArgument) {
+            argument++;
+        }
+        sendCommandResponse(entry.name, entry.handler(argument) ? "ok" : "rejected");
+        sendStatus();
+        // The transport task may be asleep until a deadline the command just moved
+        xTaskNotifyGive(transportTaskHandle);
+        return;
+    }
+    
+    Serial.println("⚠️  Unknown command");
+    sendCommandResponse("", "unknown");
+    sendStatus();
+}
+
+// False for an unknown mode name, the running mode is then left as it is
+bool switchMode(const char* modeName) {
+    OperatingMode newMode;
+    
+    if (strcmp(modeName, "HR_SPO2") == 0) {
+        newMode = MODE_HR_SPO2;
+    } else if (strcmp(modeName, "TEMPERATURE") == 0) {
+        newMode = MODE_TEMPERATURE;
+    } else if (strcmp(modeName, "FORCE_TEST") == 0) {
+        newMode = MODE_FORCE_TEST;
+    } else if (strcmp(modeName, "DISTANCE_TEST") == 0) {
+        newMode = MODE_DISTANCE_TEST;
+    } else if (strcmp(modeName, "QUALITY") == 0) {
+        newMode = MODE_QUALITY;
+    } else if (strcmp(modeName, "RAW_DATA") == 0) {
+        newMode = MODE_RAW_DATA;
+    } else if (strcmp(modeName, "MULTI") == 0) {
+        newMode = MODE_MULTI;
+    } else if (strcmp(modeName, "IDLE") == 0) {
+        newMode = MODE_IDLE;
+    } else {
+        Serial.printf("❌ Unknown mode: %s\n", modeName);
+        return false;
+    }
+    
+    if (newMode == currentMode) {
+        Serial.printf("⚡ Already in %s mode\n", modeName);
+        return true;
+    }
+    
+    Serial.printf("🔄 Switching to %s mode\n", modeName);
+    uint32_t switchStart = millis();
+    bool needsPulseOx = (newMode == MODE_HR_SPO2 || newMode == MODE_QUALITY || newMode == MODE_MULTI);
+    bool needsRawSensor = (newMode == MODE_TEMPERATURE || newMode == MODE_FORCE_TEST || 
+                         newMode == MODE_DISTANCE_TEST || newMode == MODE_RAW_DATA);
+    bool needsAccel = samplesAccelerometer(newMode);
+    
+    currentMode = newMode;
+    if (newMode == MODE_MULTI) {
+        // Nothing subscribed yet: the vitals, every raw sample, the temperature
+        bool subscribed = false;
+        for (const OutputStream& stream : streams) {
+            subscribed |= stream.subscribed && !(stream.flags & STREAM_FLAG_ANY_MODE);
+        }
+        if (!subscribed) {
+            streams[STREAM_VITALS].subscribed = true;
+            streams[STREAM_RAW].subscribed = true;
+            streams[STREAM_TEMPERATURE].subscribed = true;
+        }
+    }
+    // Every stream of the new mode reports right away, then on its own period
+    scheduleStreams();
+    clearRawRing();
+    rawDecimationCount = 0;
+    rawDropped = 0;
+    rawFifoDroppedSeen = rawSensor.getDroppedSamples() + sampleBus.getDropped();
+    // Between HR_SPO2 and QUALITY the pulse oximeter keeps running: queued samples still feed it
+    if (!(needsPulseOx && poxInitialized)) {
+        sampleBus.clear();
+    }
+    
+    // Not read at all in the modes that don't report it: no analogRead()s on every wake-up
+    accelSensor.setEnabled(needsAccel);
+    // First, the raw sensor interrupts depend on whether the accelerometer is DMA sampled
+    if (needsAccel) {
+        initializeAccelerometer();
+    } else {
+        // The DMA scan owns ADC1, which analogRead() needs for the FSR
+        accel.endContinuous();
+    }
+    
+    if (newMode == MODE_IDLE) {
+        // Powered down with its configuration kept, the next mode only has to resume it
+        if (poxInitialized || rawSensorInitialized) {
+            rawSensor.shutdown();
+        }
+        poxInitialized = false;
+        rawSensorInitialized = false;
+    } else if (needsPulseOx) {
+        if (!reconfigurePulseOximeter()) {
+            primeWithoutDataLock(initializePulseOximeter);    // full reset and priming
+        }
+    } else if (needsRawSensor) {
+        if (!reconfigureRawSensor()) {
+            primeWithoutDataLock(initializeRawSensor);    // full reset and priming
+        }
+    }
+    
+    if (isStreaming(STREAM_FORCE)) {
+        forceLabeling.stop();
+    }
+    // Only DISTANCE_TEST starts it, every other mode leaves it stopped
+    distanceAveraging.reset();
+    if (isStreaming(STREAM_TEMPERATURE)) {
+        temperatureSensor.reset();
+    }
+    if (isStreaming(STREAM_QUALITY)) {
+        qualityMode.hasPreviousData = false;
+        qualityFeatures.reset();
+        qualityMode.totalSamples = 0;
+        qualityMode.goodQualitySamples = 0;
+    }
+    
+    Serial.printf("✅ Mode switch complete (%lums)\n", millis() - switchStart);
+    return true;
+}
+
+// Clock scaling and automatic light sleep. Light sleep needs tickless idle and, with BLE enabled,
+// a sleep clock for the controller; without them the CPU only scales, and without power
+// management support at all it is just clocked down.
+void configurePowerManagement() {
+    esp_pm_config_esp32_t config;
+    config.max_freq_mhz = lowPower ? LOW_POWER_CPU_MAX_MHZ : NORMAL_CPU_MHZ;
+    config.min_freq_mhz = lowPower ? LOW_POWER_CPU_MIN_MHZ : NORMAL_CPU_MHZ;
+    config.light_sleep_enable = lowPower;
+    
+    esp_err_t err = esp_pm_configure(&config);
+    if (err != ESP_OK && lowPower) {
+        config.light_sleep_enable = false;
+        err = esp_pm_configure(&config);
+    }
+    lightSleepEnabled = err == ESP_OK && config.light_sleep_enable;
+    if (err != ESP_OK) {
+        setCpuFrequencyMhz(config.max_freq_mhz);
+    }
+    Serial.printf("🔋 CPU %d-%dMHz, light sleep %s\n", err == ESP_OK ? config.min_freq_mhz : config.max_freq_mhz,
+                  config.max_freq_mhz, lightSleepEnabled ? "on" : "unavailable");
+}
+
+// Slower connection events with slave latency in low power: the radio wakes every 100-200ms
+// instead of every 7.5-22.5ms. The client may refuse, the link then keeps its interval.
+void applyConnectionParameters() {
+    if (!clientConnected) {
+        return;
+    }
+    if (lowPower) {
+        bleServer->updateConnParams(peerAddress, LOW_POWER_CONN_INTERVAL_MIN, LOW_POWER_CONN_INTERVAL_MAX,
+                                    LOW_POWER_CONN_LATENCY, CONN_SUPERVISION_TIMEOUT);
+    } else {
+        bleServer->updateConnParams(peerAddress, NORMAL_CONN_INTERVAL_MIN, NORMAL_CONN_INTERVAL_MAX,
+                                    NORMAL_CONN_LATENCY, CONN_SUPERVISION_TIMEOUT);
+    }
+}
+
+void applyAdvertisingInterval() {
+    BLEAdvertising* bleAdv = BLEDevice::getAdvertising();
+    bleAdv->setMinInterval(lowPower ? LOW_POWER_ADV_INTERVAL_MIN : NORMAL_ADV_INTERVAL_MIN);
+    bleAdv->setMaxInterval(lowPower ? LOW_POWER_ADV_INTERVAL_MAX : NORMAL_ADV_INTERVAL_MAX);
+}
+
+// POWER:LOW / POWER:NORMAL, in any mode. The running mode moves to its low power (or normal)
+// sensor configuration in place, like a mode switch.
+void setPowerMode(bool low) {
+    if (low == lowPower) {
+        Serial.printf("⚡ Already in %s power\n", low ? "low" : "normal");
+        return;
+    }
+    lowPower = low;
+    Serial.printf("🔋 Switching to %s power\n", low ? "low" : "normal");
+    
+    configurePowerManagement();
+    applyConnectionParameters();
+    applyAdvertisingInterval();
+    
+    // The accelerometer first: the RAW_DATA interrupts depend on it
+    if (lowPower) {
+        accel.endContinuous();
+    } else if (currentMode == MODE_HR_SPO2 || currentMode == MODE_QUALITY || currentMode == MODE_RAW_DATA ||
+               currentMode == MODE_MULTI) {
+        initializeAccelerometer();
+    }
+    
+    if (poxInitialized) {
+        if (!reconfigurePulseOximeter()) {
+            primeWithoutDataLock(initializePulseOximeter);
+        }
+    } else if (rawSensorInitialized) {
+        // A new sampling rate restarts the FIFO: what it held is dropped
+        sampleBus.clear();
+        if (!reconfigureRawSensor()) {
+            primeWithoutDataLock(initializeRawSensor);
+        }
+    }
+}
+
+// ==================================================
+// SENSOR READING FUNCTIONS
+// ==================================================
+
+// Acquisition task side: the sensor stopped answering mid-stream. The bus is cleared and the
+// sensor gets its configuration back, red LED bias included, without stopping the pipeline.
+// A sensor that is gone fails again and is retried on every wake-up.
+void recoverStalledSensor() {
+    MAX30100Config config = rawSensor.getConfig();
+    Serial.println("⚠️  I2C bus stalled, recovering");
+    recoverI2CBus();
+    if (rawSensor.reset() && rawSensor.applyConfig(config)) {
+        Serial.printf("✅ MAX30100 back at %lukHz\n", rawSensor.getBusSpeed() / 1000);
+    }
+}
+
+// Acquisition task side: everything that touches the I2C bus or the ADC
+void acquireSamples() {
+    if (!poxInitialized && !rawSensorInitialized) {
+        return;
+    }
+    
+    // The sensors a stream needs follow its subscription
+    temperatureSensor.setEnabled(isStreaming(STREAM_TEMPERATURE));
+    temperatureSensor.setPeriod(streamPeriod(STREAM_TEMPERATURE));
+    forceSensor.setEnabled(isStreaming(STREAM_FORCE));
+    Sensor::pollAll(millis());
+    
+    // Acknowledge the interrupt first so the INT line can fire again for the next burst
+    rawSensor.getInterruptStatus();
+    {
+        PerfScope scope(perfFifoRead);
+        rawSensor.update();
+    }
+    bool queued = false;
+    SensorSample sample = {};
+    while (rawSensor.getReadout(&sample.readout)) {
+        Sensor::annotateAll(sample);
+        queued |= sampleBus.publish(sample);
+    }
+    if (queued) {
+        xTaskNotifyGive(dspTaskHandle);
+    }
+    
+    if (rawSensor.isBusStalled()) {
+        recoverStalledSensor();
+        return;
+    }
+    
+    // The red LED follower writes to the sensor, so it runs here. It reads the DC estimates the
+    // DSP task maintains: a slightly stale value only shifts the adjustment by one sample.
+    if (poxInitialized) {
+        pox.checkCurrentBias();
+    }
+}
+
+void acquisitionTask(void* parameter) {
+    const TickType_t timeout = pdMS_TO_TICKS(MAX30100_INT_PIN >= 0 ?
+        ACQUISITION_IRQ_TIMEOUT_MS : ACQUISITION_POLL_PERIOD_MS);
+    
+    for (;;) {
+        // Sleep until the MAX30100 signals new samples, then drain the FIFO in one burst
+        ulTaskNotifyTake(pdTRUE, timeout);
+        
+        xSemaphoreTake(sensorMutex, portMAX_DELAY);
+        acquireSamples();
+        xSemaphoreGive(sensorMutex);
+    }
+}
+
+// DSP task side: per-sample bookkeeping, called with dataMutex held
+void processSample(const SensorSample& sample) {
+    const SensorReadout& readout = sample.readout;
+    ax = sample.ax;
+    ay = sample.ay;
+    az = sample.az;
+    irValue = readout.ir;
+    redValue = readout.red;
+    if (isStreaming(STREAM_FORCE)) {
+        fsrValue = sample.fsr;
+    }
+    if (isStreaming(STREAM_TEMPERATURE)) {
+        temperature = sample.temperature;
+    }
+    
+    if (isStreaming(STREAM_QUALITY)) {
+        qualityFeatures.addSample(readout.ir, ax, ay, az);
+        if (readout.timestamp - qualityMode.tsLastAssessment >= streamPeriod(STREAM_QUALITY)) {
+            qualityMode.lastQuality = assessDataQuality();
+            qualityMode.totalSamples++;
+            if (qualityMode.lastQuality > 0) qualityMode.goodQualitySamples++;
+            
+            qualityMode.lastQualityPercent = (qualityMode.totalSamples > 0) ? 
+                (float)qualityMode.goodQualitySamples / qualityMode.totalSamples * 100.0f : 0.0f;
+            qualityMode.tsLastAssessment = readout.timestamp;
+        }
+    }
+    
+    if (isStreaming(STREAM_RAW) && dataFormat == FORMAT_BINARY &&
+        ++rawDecimationCount >= streams[STREAM_RAW].decimation) {
+        rawDecimationCount = 0;
+        pushRawSample(readout);
+    }
+    // MODE:MULTI logs the raw samples too: the vitals can be replayed from them
+    if ((currentMode == MODE_RAW_DATA || currentMode == MODE_MULTI) && flashLog.isRecording()) {
+        logRawSample(readout);
+    }
+}
+
+// DSP task side: the pulse oximeter takes a whole span of samples at once,
+// called with dataMutex held
+void processSamples(const SensorSample* samples, size_t count) {
+    if ((currentMode == MODE_HR_SPO2 || currentMode == MODE_QUALITY || currentMode == MODE_MULTI) &&
+        poxInitialized) {
+        PerfScope scope(perfDspBlock);
+        SensorReadout readouts[PULSEOXIMETER_BLOCK_SIZE];
+        MotionSample motion[PULSEOXIMETER_BLOCK_SIZE];
+        // Only the DMA scan gives a reading per sample. The analogRead fallback (POWER:LOW, FSR
+        // streaming) takes one per burst: the taps would fit a stale staircase, so the canceller
+        // is skipped until the scan is back.
+        bool motionReference = accel.isContinuous();
+        for (size_t done = 0; done < count; ) {
+            size_t n = min(count - done, (size_t)PULSEOXIMETER_BLOCK_SIZE);
+            for (size_t i = 0; i < n; i++) {
+                const SensorSample& sample = samples[done + i];
+                readouts[i] = sample.readout;
+                if (motionReference) {
+                    // The accelerometer reading paired with the sample is the motion canceller's reference
+                    motion[i] = {toMilliG(sample.ax), toMilliG(sample.ay), toMilliG(sample.az)};
+                }
+            }
+            pox.processBlock(readouts, motionReference ? motion : NULL, n);
+            if (isStreaming(STREAM_QUALITY)) {
+                // A burst is too short to hold two beats, so the latest one is all there is
+                qualityFeatures.addBeat(pox.getLastBeatTimestamp());
+            }
+            done += n;
+        }
+        heartRate = pox.getHeartRate();
+        spO2 = pox.getSpO2();
+        vitalsConfidence = pox.getConfidence();
+    }
+    
+    for (size_t i = 0; i < count; i++) {
+        processSample(samples[i]);
+    }
+}
+
+void dspTask(void* parameter) {
+    for (;;) {
+        // Woken by the acquisition task once per drained burst
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        
+        float previousHeartRate = heartRate;
+        float previousSpO2 = spO2;
+        
+        // Process everything queued under a single lock, in place
+        xSemaphoreTake(dataMutex, portMAX_DELAY);
+        sampleBus.dispatch();
+        
+        // FIFO overflows and bus overruns both count as lost raw samples
+        uint32_t lost = rawSensor.getDroppedSamples() + sampleBus.getDropped();
+        if (isStreaming(STREAM_RAW)) {
+            rawDropped += lost - rawFifoDroppedSeen;
+        }
+        rawFifoDroppedSeen = lost;
+        xSemaphoreGive(dataMutex);
+        wakeFlashLogWriter();
+        
+        if (currentMode == MODE_HR_SPO2 || currentMode == MODE_QUALITY || currentMode == MODE_MULTI) {
+            static uint32_t lastDebugOutput = 0;
+            if (millis() - lastDebugOutput > 5000 || 
+                abs(heartRate - previousHeartRate) > 5 || 
+                abs(spO2 - previousSpO2) > 2) {
+                Serial.printf("🔍 HR: %.1f -> %.1f, SpO2: %.1f -> %.1f\n", 
+                             previousHeartRate, heartRate, previousSpO2, spO2);
+                lastDebugOutput = millis();
+            }
+        }
+    }
+}
+
+void transportTask(void* parameter) {
+    for (;;) {
+        if (flashDump.active) {
+            // The dump goes as fast as the link takes it, live reports wait
+            streamFlashDump();
+            vTaskDelay(1);
+            continue;
+        }
+        
+        // Asleep until the earliest stream deadline, or a command moving them
+        uint32_t wait = sendDueStreams();
+        ulTaskNotifyTake(pdTRUE, wait == UINT32_MAX ? portMAX_DELAY : max(pdMS_TO_TICKS(wait), (TickType_t)1));
+    }
+}
+
+void flashLogTask(void* parameter) {
+    for (;;) {
+        // Woken when pages are queued; flash program/erase never runs on the sampling tasks
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        bool erasing = flashLog.isErasing();
+        flashLog.writePending();
+        
+        if (erasing) {
+            Serial.println("💾 Flash log erased");
+            xSemaphoreTake(dataMutex, portMAX_DELAY);
+            sendStatus();
+            xSemaphoreGive(dataMutex);
+        }
+    }
+}
+
+void wakeFlashLogWriter() {
+    if (flashLog.hasPending() && flashLogTaskHandle != NULL) {
+        xTaskNotifyGive(flashLogTaskHandle);
+    }
+}
+
+// The DSP side of the bus: the pulse oximeter and the per-sample bookkeeping, then the test procedures
+CallbackStage firmwareStage(processSamples);
+
+void startPipeline() {
+    sampleBus.attach(&firmwareStage);
+    sampleBus.attach(&distanceAveraging);
+    sampleBus.attach(&forceLabeling);
+    Serial.print("🔌 Sensors: MAX30100");
+    for (Sensor* sensor = Sensor::getFirst(); sensor; sensor = sensor->getNext()) {
+        Serial.printf(", %s", sensor->getName());
+    }
+    Serial.println();
+    
+    xTaskCreatePinnedToCore(flashLogTask, "flash_log", FLASH_LOG_TASK_STACK, NULL,
+                            FLASH_LOG_TASK_PRIORITY, &flashLogTaskHandle, FLASH_LOG_TASK_CORE);
+    xTaskCreatePinnedToCore(dspTask, "dsp", DSP_TASK_STACK, NULL,
+                            DSP_TASK_PRIORITY, &dspTaskHandle, DSP_TASK_CORE);
+    xTaskCreatePinnedToCore(transportTask, "transport", TRANSPORT_TASK_STACK, NULL,
+                            TRANSPORT_TASK_PRIORITY, &transportTaskHandle, TRANSPORT_TASK_CORE);
+    xTaskCreatePinnedToCore(acquisitionTask, "acquisition", ACQUISITION_TASK_STACK, NULL,
+                            ACQUISITION_TASK_PRIORITY, &acquisitionTaskHandle, ACQUISITION_TASK_CORE);
+    
+    if (MAX30100_INT_PIN >= 0) {
+        pinMode(MAX30100_INT_PIN, INPUT_PULLUP);
+        attachInterrupt(digitalPinToInterrupt(MAX30100_INT_PIN), onMax30100Interrupt, FALLING);
+        // INT stays low until the status register is read, so it also ends a light sleep
+        gpio_wakeup_enable((gpio_num_t)MAX30100_INT_PIN, GPIO_INTR_LOW_LEVEL);
+        esp_sleep_enable_gpio_wakeup();
+        Serial.printf("⚡ Interrupt-driven acquisition on GPIO %d\n", MAX30100_INT_PIN);
+    } else {
+        Serial.printf("⚡ Polling acquisition every %dms\n", ACQUISITION_POLL_PERIOD_MS);
+    }
 }
 
 // ==================================================
@@ -527,26 +1734,22 @@ void readSensorData() {
 // ==================================================
 
 int assessDataQuality() {
+    float features[QUALITY_FEATURE_COUNT];
+    qualityFeatures.extract(heartRate, spO2, features);
+    
     if (!qualityMode.hasPreviousData) {
         qualityMode.hasPreviousData = true;
-        qualityMode.previousHeartRate = heartRate;
-        qualityMode.previousSpO2 = spO2;
-        qualityMode.previousAccelMag = sqrt(ax*ax + ay*ay + az*az);
         return 1;
     }
     
-    float currentAccelMag = sqrt(ax*ax + ay*ay + az*az);
+    PerfScope scope(perfQualityModel);
+    int quality = predict_quality(features);
+    scope.stop();
     
-    int quality = assess_sensor_quality(
-        heartRate, spO2, ax, ay, az,
-        abs(heartRate - qualityMode.previousHeartRate),
-        abs(spO2 - qualityMode.previousSpO2),
-        qualityMode.previousAccelMag
-    );
-    
-    qualityMode.previousHeartRate = heartRate;
-    qualityMode.previousSpO2 = spO2;
-    qualityMode.previousAccelMag = currentAccelMag;
+    // Motion gate on the windowed accel energy: the model may not read it
+    if (features[QUALITY_FEATURE_ACCEL_ENERGY] > QUALITY_MOTION_ENERGY_MAX) {
+        quality = 0;
+    }
     
     return quality;
 }
@@ -555,17 +1758,45 @@ int assessDataQuality() {
 // DATA TRANSMISSION FUNCTIONS
 // ==================================================
 
-void sendData() {
-    if (!clientConnected) return;
+// Per-mode bookkeeping done once per report, shared by both wire formats.
+// Returns false when this report must be skipped.
+bool updateReportState(OperatingMode records) {
+    switch (records) {
+        case MODE_FORCE_TEST:
+            // The labelling stage closes the window on the sample that ends it
+            if (forceLabeling.takeFinished()) {
+                Serial.printf("🏁 Force collection finished (%lu samples)\n", forceLabeling.getSampleCount());
+                return false;
+            }
+            break;
+            
+        case MODE_DISTANCE_TEST:
+            // Averages cover every FIFO sample since START, published every DISTANCE_REPORTS_PER_BATCH reports
+            distanceAveraging.nextReport();
+            break;
+            
+        default:
+            break;
+    }
     
+    return true;
+}
+
+void notifyData(uint8_t* data, size_t length) {
+    PerfScope scope(perfNotify);
+    dataChar->setValue(data, length);
+    dataChar->notify();
+}
+
+void sendJsonData(OperatingMode records, uint32_t timestamp) {
     char buffer[300];
-    uint32_t timestamp = millis();
     
-    switch (currentMode) {
+    PerfScope scope(perfFormat);
+    switch (records) {
         case MODE_HR_SPO2:
             snprintf(buffer, sizeof(buffer),
-                "{\"hr\":%.1f,\"spo2\":%.1f,\"ax\":%.2f,\"ay\":%.2f,\"az\":%.2f,\"timestamp\":%lu}",
-                heartRate, spO2, ax, ay, az, timestamp
+                "{\"hr\":%.1f,\"spo2\":%.1f,\"confidence\":%u,\"ax\":%.2f,\"ay\":%.2f,\"az\":%.2f,\"timestamp\":%lu}",
+                heartRate, spO2, vitalsConfidence, ax, ay, az, timestamp
             );
             break;
             
@@ -577,60 +1808,36 @@ void sendData() {
             break;
             
         case MODE_FORCE_TEST:
-            if (forceTest.isCollecting) {
-                if (millis() - forceTest.collectionStartTime >= forceTest.collectionDuration) {
-                    forceTest.isCollecting = false;
-                    strncpy(forceTest.currentLabel, "waiting", sizeof(forceTest.currentLabel));
-                    Serial.println("🏁 Force collection finished");
-                    return;
-                }
-            }
-            
             snprintf(buffer, sizeof(buffer),
                 "{\"ir\":%u,\"red\":%u,\"fsr\":%u,\"label\":\"%s\",\"collecting\":%s,\"timestamp\":%lu}",
-                irValue, redValue, fsrValue, forceTest.currentLabel, 
-                forceTest.isCollecting ? "true" : "false", timestamp
+                irValue, redValue, fsrValue, forceLabeling.getLabel(), 
+                forceLabeling.isCollecting() ? "true" : "false", timestamp
             );
             break;
             
         case MODE_DISTANCE_TEST:
-            if (distanceTest.collectingData) {
-                distanceTest.irSum += irValue;
-                distanceTest.redSum += redValue;
-                distanceTest.sampleCount++;
-                
-                if (distanceTest.sampleCount % distanceTest.samplesPerBatch == 0) {
-                    float avgIR = (float)distanceTest.irSum / distanceTest.sampleCount;
-                    float avgRed = (float)distanceTest.redSum / distanceTest.sampleCount;
-                    
-                    snprintf(buffer, sizeof(buffer),
-                        "{\"type\":\"average\",\"led\":\"%s\",\"distance_mm\":%d,\"avg_ir\":%.2f,\"avg_red\":%.2f,\"samples\":%u,\"timestamp\":%lu}",
-                        distanceTest.currentLED, distanceTest.currentDistance, avgIR, avgRed, distanceTest.sampleCount, timestamp
-                    );
-                }
+            if (distanceAveraging.isAverageDue()) {
+                snprintf(buffer, sizeof(buffer),
+                    "{\"type\":\"average\",\"led\":\"%s\",\"distance_mm\":%d,\"avg_ir\":%.2f,\"avg_red\":%.2f,\"samples\":%lu,\"timestamp\":%lu}",
+                    distanceAveraging.getLed(), distanceAveraging.getDistance(), distanceAveraging.getAverageIr(),
+                    distanceAveraging.getAverageRed(), distanceAveraging.getSampleCount(), timestamp
+                );
             } else {
                 snprintf(buffer, sizeof(buffer),
                     "{\"ir\":%u,\"red\":%u,\"led\":\"%s\",\"distance_mm\":%d,\"collecting\":%s,\"timestamp\":%lu}",
-                    irValue, redValue, distanceTest.currentLED, distanceTest.currentDistance, 
-                    distanceTest.collectingData ? "true" : "false", timestamp
+                    irValue, redValue, distanceAveraging.getLed(), distanceAveraging.getDistance(), 
+                    distanceAveraging.isCollecting() ? "true" : "false", timestamp
                 );
             }
             break;
             
-        case MODE_QUALITY: {
-            int quality = assessDataQuality();
-            qualityMode.totalSamples++;
-            if (quality > 0) qualityMode.goodQualitySamples++;
-            
-            float qualityPercent = (qualityMode.totalSamples > 0) ? 
-                (float)qualityMode.goodQualitySamples / qualityMode.totalSamples * 100.0f : 0.0f;
-                
+        case MODE_QUALITY:
             snprintf(buffer, sizeof(buffer),
                 "{\"hr\":%.1f,\"spo2\":%.1f,\"ax\":%.3f,\"ay\":%.3f,\"az\":%.3f,\"quality\":%d,\"quality_percent\":%.1f,\"accel_mag\":%.3f,\"timestamp\":%lu}",
-                heartRate, spO2, ax, ay, az, quality, qualityPercent, sqrt(ax*ax + ay*ay + az*az), timestamp
+                heartRate, spO2, ax, ay, az, qualityMode.lastQuality, qualityMode.lastQualityPercent,
+                sqrt(ax*ax + ay*ay + az*az), timestamp
             );
             break;
-        }
             
         case MODE_RAW_DATA:
             snprintf(buffer, sizeof(buffer),
@@ -647,9 +1854,351 @@ void sendData() {
             );
             break;
     }
+    scope.stop();
     
-    dataChar->setValue((uint8_t*)buffer, strlen(buffer));
-    dataChar->notify();
+    notifyData((uint8_t*)buffer, strlen(buffer));
+}
+
+void fillVitalsRecord(VitalsRecord* record) {
+    record->heartRateX10 = toFixedX10(heartRate);
+    record->spO2X10 = toFixedX10(spO2);
+    record->axMg = toMilliG(ax);
+    record->ayMg = toMilliG(ay);
+    record->azMg = toMilliG(az);
+}
+
+void fillFrameHeader(BinaryFrameHeader* header, uint8_t mode, uint8_t recordSize, uint8_t sampleCount,
+                     uint32_t timestamp) {
+    header->magic = BINARY_FRAME_MAGIC;
+    header->version = BINARY_PROTOCOL_VERSION;
+    header->mode = mode;
+    header->recordSize = recordSize;
+    header->sampleCount = sampleCount;
+    header->sequence = frameSequence++;
+    header->timestamp = timestamp;
+}
+
+// Largest notification the connected client accepts (negotiated MTU minus the 3 byte ATT header)
+size_t maxNotifyPayload() {
+    size_t payload = bleServer->getPeerMTU(bleServer->getConnId()) - 3;
+    return payload < BLE_MAX_NOTIFY_PAYLOAD ? payload : BLE_MAX_NOTIFY_PAYLOAD;
+}
+
+// Drains every queued raw sample, packing as many records per notification as the MTU allows
+void sendRawBatch() {
+    uint8_t buffer[BLE_MAX_NOTIFY_PAYLOAD];
+    BinaryFrameHeader* header = (BinaryFrameHeader*)buffer;
+    RawRecord* records = (RawRecord*)(buffer + sizeof(BinaryFrameHeader));
+    size_t perFrame = (maxNotifyPayload() - sizeof(BinaryFrameHeader)) / sizeof(RawRecord);
+    if (perFrame == 0) {
+        // The default 23 byte MTU can't carry a single record: wait for the client to raise it
+        rawDropped += rawRingCount;
+        clearRawRing();
+        return;
+    }
+    
+    while (rawRingCount > 0) {
+        size_t count = rawRingCount < perFrame ? rawRingCount : perFrame;
+        uint32_t timestamp = rawRing[rawRingHead].readout.timestamp;
+        PerfScope scope(perfFormat);
+        
+        for (size_t i = 0; i < count; i++) {
+            const RawSample& sample = rawRing[rawRingHead];
+            records[i].dtMs = (uint16_t)(sample.readout.timestamp - timestamp);
+            records[i].ir = sample.readout.ir;
+            records[i].red = sample.readout.red;
+            records[i].axMg = sample.axMg;
+            records[i].ayMg = sample.ayMg;
+            records[i].azMg = sample.azMg;
+            rawRingHead = (rawRingHead + 1) % rawRingCapacity;
+            rawRingCount--;
+        }
+        
+        fillFrameHeader(header, MODE_RAW_DATA, sizeof(RawRecord), (uint8_t)count, timestamp);
+        scope.stop();
+        notifyData(buffer, sizeof(BinaryFrameHeader) + count * sizeof(RawRecord));
+    }
+}
+
+void sendBinaryData(OperatingMode mode, uint32_t timestamp) {
+    uint8_t buffer[BLE_MAX_NOTIFY_PAYLOAD];
+    BinaryFrameHeader* header = (BinaryFrameHeader*)buffer;
+    uint8_t* records = buffer + sizeof(BinaryFrameHeader);
+    uint8_t recordSize = 0;
+    uint8_t sampleCount = 1;
+    
+    if (mode == MODE_RAW_DATA) {
+        // Raw samples are streamed in their own MTU-sized frames
+        sendRawBatch();
+        return;
+    }
+    
+    PerfScope scope(perfFormat);
+    switch (mode) {
+        case MODE_HR_SPO2:
+            recordSize = sizeof(VitalsRecord);
+            fillVitalsRecord((VitalsRecord*)records);
+            break;
+            
+        case MODE_TEMPERATURE: {
+            TemperatureRecord* record = (TemperatureRecord*)records;
+            recordSize = sizeof(TemperatureRecord);
+            record->temperatureCentiC = (int16_t)(temperature * 100);
+            break;
+        }
+            
+        case MODE_FORCE_TEST: {
+            ForceRecord* record = (ForceRecord*)records;
+            recordSize = sizeof(ForceRecord);
+            record->ir = irValue;
+            record->red = redValue;
+            record->fsr = fsrValue;
+            record->flags = forceLabeling.isCollecting() ? BINARY_FLAG_COLLECTING : 0;
+            break;
+        }
+            
+        case MODE_DISTANCE_TEST: {
+            DistanceRecord* record = (DistanceRecord*)records;
+            recordSize = sizeof(DistanceRecord);
+            if (distanceAveraging.isAverageDue()) {
+                uint32_t samples = distanceAveraging.getSampleCount();
+                record->irX100 = (uint32_t)(distanceAveraging.getIrSum() * 100 / samples);
+                record->redX100 = (uint32_t)(distanceAveraging.getRedSum() * 100 / samples);
+                record->samples = samples > UINT16_MAX ? UINT16_MAX : (uint16_t)samples;
+            } else {
+                record->irX100 = (uint32_t)irValue * 100;
+                record->redX100 = (uint32_t)redValue * 100;
+                record->samples = 1;
+            }
+            record->distanceMm = (uint16_t)distanceAveraging.getDistance();
+            record->flags = (distanceAveraging.isCollecting() ? BINARY_FLAG_COLLECTING : 0) |
+                            (distanceAveraging.isAverageDue() ? BINARY_FLAG_AVERAGE : 0);
+            break;
+        }
+            
+        case MODE_QUALITY: {
+            QualityRecord* record = (QualityRecord*)records;
+            recordSize = sizeof(QualityRecord);
+            fillVitalsRecord(&record->vitals);
+            record->quality = (uint8_t)qualityMode.lastQuality;
+            record->qualityPercentX10 = toFixedX10(qualityMode.lastQualityPercent);
+            break;
+        }
+            
+        case MODE_IDLE:
+        default: {
+            StatusRecord* record = (StatusRecord*)records;
+            recordSize = sizeof(StatusRecord);
+            record->freeHeap = ESP.getFreeHeap();
+            break;
+        }
+    }
+    scope.stop();
+    
+    fillFrameHeader(header, mode, recordSize, sampleCount, timestamp);
+    notifyData(buffer, sizeof(BinaryFrameHeader) + sampleCount * recordSize);
+}
+
+// Logs the vitals of this report while LOG:START is on, connected or not
+void logVitals(uint32_t timestamp) {
+    if (!flashLog.isRecording() || (currentMode != MODE_HR_SPO2 && currentMode != MODE_QUALITY)) {
+        return;
+    }
+    LoggedVitalsRecord record;
+    fillVitalsRecord(&record.vitals);
+    flashLog.append(currentMode, timestamp, &record, sizeof(record));
+}
+
+// Sends one notification, retrying while the BLE stack has no room for it. False when the
+// client left, turned the notifications off or refused FLASH_LOG_DUMP_MAX_RETRIES in a row.
+bool notifyDumpFrame(uint8_t* data, size_t length) {
+    for (int retries = 0; ; retries++) {
+        uint32_t failures = notifyFailures;
+        notifyData(data, length);
+        if (notifyFailures == failures) {
+            return true;
+        }
+        if (!clientConnected || !dataCccd->getNotifications() || retries == FLASH_LOG_DUMP_MAX_RETRIES) {
+            return false;
+        }
+        vTaskDelay(pdMS_TO_TICKS(FLASH_LOG_DUMP_RETRY_MS));
+    }
+}
+
+// Ends the dump, telling the client how it went on the status characteristic. dataMutex held.
+void finishFlashDump(const char* result) {
+    char summary[96];
+    snprintf(summary, sizeof(summary), "{\"dump\":\"%s\",\"pages\":%lu,\"skipped\":%lu}",
+             result, flashDump.pages, flashDump.skipped);
+    Serial.printf("💾 %s\n", summary);
+    flashDump.active = false;
+    statusChar->setValue((uint8_t*)summary, strlen(summary));
+    statusChar->notify();
+}
+
+// Streams the next few flash log pages, each as one frame when the MTU allows it.
+// dataMutex is only held to move the dump along, never while a notification waits for room:
+// the pages are read through the flash log's own lock.
+void streamFlashDump() {
+    uint8_t buffer[BLE_MAX_NOTIFY_PAYLOAD];
+    BinaryFrameHeader* header = (BinaryFrameHeader*)buffer;
+    uint8_t* records = buffer + sizeof(BinaryFrameHeader);
+    FlashLogPage page;
+    
+    for (int burst = 0; burst < FLASH_LOG_DUMP_BURST; burst++) {
+        xSemaphoreTake(dataMutex, portMAX_DELAY);
+        if (!flashDump.active || flashDump.sequence == flashDump.end) {
+            xSemaphoreGive(dataMutex);
+            break;
+        }
+        // The ring may have overwritten the oldest pages while dumping
+        if ((int32_t)(flashLog.getFirstSequence() - flashDump.sequence) > 0) {
+            flashDump.skipped += flashLog.getFirstSequence() - flashDump.sequence;
+            flashDump.sequence = flashLog.getFirstSequence();
+            xSemaphoreGive(dataMutex);
+            continue;
+        }
+        uint32_t sequence = flashDump.sequence;
+        size_t payload = maxNotifyPayload() - sizeof(BinaryFrameHeader);
+        xSemaphoreGive(dataMutex);
+        
+        bool valid = flashLog.readPage(sequence, &page);
+        size_t size = page.header.recordSize;
+        size_t perFrame = valid ? payload / size : 0;
+        for (size_t done = 0; valid && perFrame > 0 && done < page.header.count; ) {
+            size_t count = min((size_t)page.header.count - done, perFrame);
+            header->magic = BINARY_FRAME_MAGIC;
+            header->version = BINARY_PROTOCOL_VERSION;
+            header->mode = BINARY_MODE_FLASH_LOG | page.header.mode;
+            header->recordSize = (uint8_t)size;
+            header->sampleCount = (uint8_t)count;
+            header->sequence = (uint16_t)page.header.sequence;
+            header->timestamp = page.header.timestamp;
+            memcpy(records, page.records + done * size, count * size);
+            if (!notifyDumpFrame(buffer, sizeof(BinaryFrameHeader) + count * size)) {
+                xSemaphoreTake(dataMutex, portMAX_DELAY);
+                if (!clientConnected) {
+                    flashDump.active = false;
+                } else if (flashDump.active) {
+                    finishFlashDump("failed");
+                }
+                xSemaphoreGive(dataMutex);
+                return;
+            }
+            done += count;
+        }
+        
+        xSemaphoreTake(dataMutex, portMAX_DELAY);
+        if (flashDump.active) {
+            if (!valid) {
+                flashDump.skipped++;
+                flashDump.sequence++;
+            } else if (perFrame == 0) {
+                // The default 23 byte MTU can't carry a single record
+                flashDump.end = flashDump.sequence;
+            } else {
+                flashDump.sequence++;
+                flashDump.pages++;
+            }
+        }
+        xSemaphoreGive(dataMutex);
+    }
+    
+    xSemaphoreTake(dataMutex, portMAX_DELAY);
+    if (flashDump.active && flashDump.sequence == flashDump.end) {
+        finishFlashDump("done");
+    }
+    xSemaphoreGive(dataMutex);
+}
+
+// One report of a mode, or of a stream as the records of the mode it stands for
+void sendRecords(OperatingMode records) {
+    if (!clientConnected) return;
+    
+    if (!updateReportState(records)) {
+        return;
+    }
+    
+    uint32_t timestamp = millis();
+    if (dataFormat == FORMAT_BINARY) {
+        sendBinaryData(records, timestamp);
+    } else {
+        sendJsonData(records, timestamp);
+    }
+}
+
+// STREAM_ACCEL: the accelerometer reading of the latest sample
+void sendAccelData() {
+    if (!clientConnected) return;
+    
+    uint32_t timestamp = millis();
+    PerfScope scope(perfFormat);
+    if (dataFormat == FORMAT_BINARY) {
+        uint8_t buffer[sizeof(BinaryFrameHeader) + sizeof(AccelRecord)];
+        AccelRecord* record = (AccelRecord*)(buffer + sizeof(BinaryFrameHeader));
+        record->axMg = toMilliG(ax);
+        record->ayMg = toMilliG(ay);
+        record->azMg = toMilliG(az);
+        fillFrameHeader((BinaryFrameHeader*)buffer, BINARY_MODE_ACCEL, sizeof(AccelRecord), 1, timestamp);
+        scope.stop();
+        notifyData(buffer, sizeof(buffer));
+    } else {
+        char buffer[96];
+        snprintf(buffer, sizeof(buffer), "{\"ax\":%.3f,\"ay\":%.3f,\"az\":%.3f,\"timestamp\":%lu}",
+                 ax, ay, az, timestamp);
+        scope.stop();
+        notifyData((uint8_t*)buffer, strlen(buffer));
+    }
+}
+
+void sendStream(SensingStream stream) {
+    if (stream == STREAM_STATUS) {
+        sendStatus();
+        return;
+    }
+    if (stream == STREAM_ACCEL) {
+        sendAccelData();
+        return;
+    }
+    // The mode's own report is what the flash log keeps of the vitals, connected or not
+    if (streams[stream].records == currentMode) {
+        logVitals(millis());
+    }
+    sendRecords(streams[stream].records);
+}
+
+// Transport side: sends every running stream whose deadline has passed, earliest first, and
+// returns the ms until the next deadline, UINT32_MAX when no stream runs. A deadline moves on by
+// its period from where it was, so the time spent sending doesn't add up as drift; a stream a
+// whole period late (stalled link) restarts from now instead of catching up in a burst.
+uint32_t sendDueStreams() {
+    for (;;) {
+        xSemaphoreTake(dataMutex, portMAX_DELAY);
+        uint32_t now = millis();
+        int due = -1;
+        int32_t earliest = INT32_MAX;
+        for (int i = 0; i < STREAM_COUNT; i++) {
+            int32_t remaining = (int32_t)(streams[i].deadline - now);
+            if (isStreaming((SensingStream)i) && remaining < earliest) {
+                due = i;
+                earliest = remaining;
+            }
+        }
+        if (due < 0 || earliest > 0) {
+            xSemaphoreGive(dataMutex);
+            wakeFlashLogWriter();
+            return due < 0 ? UINT32_MAX : (uint32_t)earliest;
+        }
+        
+        sendStream((SensingStream)due);
+        OutputStream& stream = streams[due];
+        uint32_t period = streamPeriod((SensingStream)due);
+        stream.deadline += period;
+        if ((int32_t)(millis() - stream.deadline) >= 0) {
+            stream.deadline = millis() + period;
+        }
+        xSemaphoreGive(dataMutex);
+    }
 }
 
 // ==================================================
@@ -657,7 +2206,11 @@ void sendData() {
 // ==================================================
 
 void setup_ble() {
-    BLEDevice::init("ESP32_Unified_Sensor");
+    uint8_t mac[6];
+    esp_read_mac(mac, ESP_MAC_BT);
+    snprintf(bleDeviceName, sizeof(bleDeviceName), "%s_%02X%02X%02X", BLE_DEVICE_NAME_PREFIX, mac[3], mac[4], mac[5]);
+    BLEDevice::init(bleDeviceName);
+    BLEDevice::setMTU(BLE_LOCAL_MTU);
     bleServer = BLEDevice::createServer();
     bleServer->setCallbacks(new ServerCallbacks());
     
@@ -667,7 +2220,9 @@ void setup_ble() {
         dataCharUUID,
         BLECharacteristic::PROPERTY_NOTIFY | BLECharacteristic::PROPERTY_READ
     );
-    dataChar->addDescriptor(new BLE2902());
+    dataCccd = new BLE2902();
+    dataChar->addDescriptor(dataCccd);
+    dataChar->setCallbacks(new DataCallbacks());
 
     controlChar = bleService->createCharacteristic(
         controlCharUUID,
@@ -681,6 +2236,12 @@ void setup_ble() {
     );
     statusChar->addDescriptor(new BLE2902());
 
+    statsChar = bleService->createCharacteristic(
+        statsCharUUID,
+        BLECharacteristic::PROPERTY_NOTIFY | BLECharacteristic::PROPERTY_READ
+    );
+    statsChar->addDescriptor(new BLE2902());
+
     bleService->start();
 
     BLEAdvertising* bleAdv = BLEDevice::getAdvertising();
@@ -688,9 +2249,10 @@ void setup_ble() {
     bleAdv->setScanResponse(true);
     bleAdv->setMinPreferred(0x06);
     bleAdv->setMinPreferred(0x12);
+    applyAdvertisingInterval();
     BLEDevice::startAdvertising();
     
-    Serial.println("📡 BLE advertising started - ESP32_Unified_Sensor");
+    Serial.printf("📡 BLE advertising started - %s\n", bleDeviceName);
 }
 
 // ==================================================
@@ -716,16 +2278,29 @@ void setup() {
     
     esp_wifi_stop(); // Disable Wi-Fi to save power
     
-    Wire.begin();
-    Wire.setClock(100000);  // Use 100kHz I2C speed for better stability
+    Wire.begin(I2C_SDA_PIN, I2C_SCL_PIN);
+    Wire.setClock(rawSensor.getBusSpeed());
+    Wire.setTimeOut(I2C_TIMEOUT_MS);
     
     pinMode(FSR_PIN, INPUT);
     
-    initializeAccelerometer();
+    sensorMutex = xSemaphoreCreateMutex();
+    dataMutex = xSemaphoreCreateMutex();
+    controlTaskHandle = xTaskGetCurrentTaskHandle();  // setup() and loop() share the loop task
+    
+    accel.begin();  // DMA sampling starts with the first mode that needs motion data
+    allocateRawRing();
+    if (flashLog.begin()) {
+        Serial.printf("💾 Flash log: %lu of %lu pages in use\n",
+                      flashLog.getNextSequence() - flashLog.getFirstSequence(), flashLog.getCapacity());
+    } else {
+        Serial.println("⚠️  WARNING: No flashlog partition, offline recording disabled");
+    }
     
     Serial.printf("💾 After accel init - Free heap: %u bytes\n", ESP.getFreeHeap());
     
     setup_ble();
+    startPipeline();
     
     Serial.printf("💾 After BLE init - Free heap: %u bytes\n", ESP.getFreeHeap());
     Serial.println("✅ System ready - waiting for mode selection via BLE");
@@ -733,16 +2308,9 @@ void setup() {
 }
 
 void loop() {
-    static uint32_t lastMemoryCheck = 0;
-    if (millis() - lastMemoryCheck > 10000) {
+    // The sampling work happens in the pipeline tasks, this one runs the control commands
+    if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(CONTROL_IDLE_REPORT_MS)) == 0) {
         Serial.printf("💾 Free heap: %u bytes\n", ESP.getFreeHeap());
-        lastMemoryCheck = millis();
-    }
-    
-    readSensorData();
-    
-    if (millis() - tsLastReport >= reportingPeriod) {
-        sendData();
-        tsLastReport = millis();
     }
-}
\ No newline at end of file
+    processControlQueue();
+}
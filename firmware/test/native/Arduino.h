@@ -0,0 +1,58 @@
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+// Just enough of the Arduino core for the MAX30100 library to build on the
+// host (env:native). Time does not pass by itself: the harness drives it with
+// setHostMillis(), typically from the timestamps of a replayed recording.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+inline uint32_t& hostMillis()
+{
+    static uint32_t ms = 0;
+    return ms;
+}
+
+inline void setHostMillis(uint32_t ms)
+{
+    hostMillis() = ms;
+}
+
+inline uint32_t millis()
+{
+    return hostMillis();
+}
+
+inline uint32_t micros()
+{
+    return hostMillis() * 1000;
+}
+
+inline void delay(uint32_t ms)
+{
+    hostMillis() += ms;
+}
+
+class HostSerial {
+public:
+    void begin(unsigned long) {}
+
+    size_t print(const char* s) { return printf("%s", s); }
+    size_t print(char c) { return printf("%c", c); }
+    size_t print(int v) { return printf("%d", v); }
+    size_t print(unsigned int v) { return printf("%u", v); }
+    size_t print(long v) { return printf("%ld", v); }
+    size_t print(unsigned long v) { return printf("%lu", v); }
+    size_t print(double v, int digits = 2) { return printf("%.*f", digits, v); }
+
+    template<typename T>
+    size_t println(T v) { return print(v) + printf("\n"); }
+    size_t println() { return printf("\n"); }
+};
+
+inline HostSerial Serial;
+
+#endif
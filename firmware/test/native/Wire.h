@@ -0,0 +1,79 @@
+#ifndef HOST_WIRE_H
+#define HOST_WIRE_H
+
+// Host stand-in for the Arduino TwoWire bus: a single device modelled as a
+// 256-byte register file with an auto-incrementing pointer, so drivers can
+// read back what they wrote. Seed it (e.g. the part ID) through registers;
+// writes counts the register writes and transactions the bus transactions,
+// to check what a driver sends. Bits set in selfClearing are cleared as
+// soon as written (a device done right away), nack makes the device stop
+// answering, clock is the last setClock().
+
+#include <stdint.h>
+#include <stddef.h>
+
+class TwoWire {
+public:
+    uint8_t registers[256] = {};
+    size_t writes = 0;
+    size_t transactions = 0;
+    uint8_t selfClearing[256] = {};
+    bool nack = false;
+    uint32_t clock = 100000;
+
+    bool begin() { return true; }
+    void setClock(uint32_t frequency) { clock = frequency; }
+
+    void beginTransmission(uint8_t)
+    {
+        addressed = false;
+        ++transactions;
+    }
+
+    size_t write(uint8_t data)
+    {
+        if (!addressed) {
+            pointer = data;
+            addressed = true;
+        } else if (!nack) {
+            registers[pointer] = data & ~selfClearing[pointer];
+            ++pointer;
+            ++writes;
+        }
+        return 1;
+    }
+
+    uint8_t endTransmission(bool = true)
+    {
+        return nack ? 2 : 0;    // 2: address NACK, as the Arduino API reports it
+    }
+
+    uint8_t requestFrom(int, int length)
+    {
+        pending = nack ? 0 : length;
+        return pending;
+    }
+
+    int available()
+    {
+        return pending;
+    }
+
+    int read()
+    {
+        if (!pending) {
+            return -1;
+        }
+        --pending;
+        return registers[pointer++];
+    }
+
+private:
+    uint8_t pointer = 0;
+    bool addressed = false;
+    int pending = 0;
+};
+
+inline TwoWire Wire;
+
+#endif
@@ -0,0 +1,289 @@
+#ifndef DSP_CHAIN_RECORDING_H
+#define DSP_CHAIN_RECORDING_H
+
+// Loading of recorded sessions for the DSP chain harness.
+//
+// Two layouts are understood, detected from the header line:
+// - extras/recorder output: tab separated "timestamp ir_level red_level"
+// - CSVs from the record_*.py scripts and the ML_Model_Inference logs, with
+//   any of Timestamp / IR / Red / HR (HeartRate, bpm) / SpO2 columns
+//
+// A recording needs IR and Red to be replayed. HR/SpO2 columns, in the same
+// file or in a paired one, are used as the reference for the error figures.
+
+#include <ctype.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+struct RecordedSample {
+    uint32_t timestamp;     // in ms, relative to the first row
+    uint16_t ir;
+    uint16_t red;
+};
+
+struct ReferencePoint {
+    uint32_t timestamp;     // in ms, relative to the first row
+    float hr;               // bpm, 0 if missing
+    float spo2;             // %, 0 if missing
+};
+
+struct Recording {
+    std::string path;
+    std::vector<RecordedSample> samples;
+    std::vector<ReferencePoint> reference;
+};
+
+namespace recording {
+
+inline std::vector<std::string> split(const std::string& line, char delimiter)
+{
+    std::vector<std::string> fields;
+    size_t start = 0;
+    while (true) {
+        size_t end = line.find(delimiter, start);
+        fields.push_back(line.substr(start, end == std::string::npos ? std::string::npos : end - start));
+        if (end == std::string::npos) {
+            break;
+        }
+        start = end + 1;
+    }
+    return fields;
+}
+
+inline std::string lower(std::string s)
+{
+    for (size_t i = 0; i < s.size(); i++) {
+        s[i] = tolower((unsigned char)s[i]);
+    }
+    // Trailing CR from files written on Windows
+    while (!s.empty() && isspace((unsigned char)s.back())) {
+        s.pop_back();
+    }
+    return s;
+}
+
+inline int findColumn(const std::vector<std::string>& header, const char* const* names)
+{
+    for (const char* const* name = names; *name; name++) {
+        for (size_t i = 0; i < header.size(); i++) {
+            if (header[i] == *name) {
+                return i;
+            }
+        }
+    }
+    return -1;
+}
+
+// Timestamps are either plain milliseconds or ISO datetimes (host side logs):
+// the latter are reduced to milliseconds of the day
+inline bool parseTimestamp(const std::string& field, double* ms)
+{
+    char* end;
+    double value = strtod(field.c_str(), &end);
+    if (end != field.c_str() && *end == '\0') {
+        *ms = value;
+        return true;
+    }
+
+    size_t timeStart = field.find_first_of("Tt ");
+    int hours, minutes;
+    double seconds;
+    if (timeStart == std::string::npos ||
+            sscanf(field.c_str() + timeStart + 1, "%d:%d:%lf", &hours, &minutes, &seconds) != 3) {
+        return false;
+    }
+    *ms = ((hours * 60 + minutes) * 60 + seconds) * 1000;
+    return true;
+}
+
+inline bool parseNumber(const std::vector<std::string>& fields, int column, float* value)
+{
+    if (column < 0 || column >= (int)fields.size()) {
+        return false;
+    }
+    char* end;
+    *value = strtof(fields[column].c_str(), &end);
+    return end != fields[column].c_str();
+}
+
+} // namespace recording
+
+/**
+ * Appends the rows of `path` to `rec`: samples if the file has IR and Red,
+ * reference points if it has HR or SpO2. Returns false if unreadable.
+ */
+inline bool loadRecordingFile(const char* path, Recording* rec)
+{
+    using namespace recording;
+
+    static const char* const timestampNames[] = {"timestamp", "device_timestamp", NULL};
+    static const char* const irNames[] = {"ir", "ir_level", NULL};
+    static const char* const redNames[] = {"red", "red_level", NULL};
+    static const char* const hrNames[] = {"hr", "heartrate", "bpm", NULL};
+    static const char* const spo2Names[] = {"spo2", NULL};
+
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        return false;
+    }
+
+    std::vector<std::string> header;
+    char delimiter = ',';
+    int timestampColumn = -1, irColumn = -1, redColumn = -1, hrColumn = -1, spo2Column = -1;
+    bool haveOrigin = false;
+    double origin = 0, lastMs = 0, dayOffset = 0;
+
+    char buffer[512];
+    while (fgets(buffer, sizeof(buffer), file)) {
+        std::string line(buffer);
+
+        if (header.empty()) {
+            delimiter = line.find('\t') != std::string::npos ? '\t' : ',';
+            header = split(lower(line), delimiter);
+            timestampColumn = findColumn(header, timestampNames);
+            irColumn = findColumn(header, irNames);
+            redColumn = findColumn(header, redNames);
+            hrColumn = findColumn(header, hrNames);
+            spo2Column = findColumn(header, spo2Names);
+            continue;
+        }
+
+        std::vector<std::string> fields = split(lower(line), delimiter);
+        double ms;
+        if (timestampColumn < 0 || timestampColumn >= (int)fields.size() ||
+                !parseTimestamp(fields[timestampColumn], &ms)) {
+            continue;
+        }
+
+        // Datetimes reduced to the time of day wrap at midnight
+        ms += dayOffset;
+        if (haveOrigin && ms < lastMs - 12 * 3600 * 1000.0) {
+            dayOffset += 24 * 3600 * 1000.0;
+            ms += 24 * 3600 * 1000.0;
+        }
+        if (!haveOrigin) {
+            origin = ms;
+            haveOrigin = true;
+        }
+        lastMs = ms;
+        uint32_t timestamp = (uint32_t)(ms - origin + 0.5);
+
+        float ir, red;
+        if (parseNumber(fields, irColumn, &ir) && parseNumber(fields, redColumn, &red)) {
+            rec->samples.push_back({timestamp, (uint16_t)ir, (uint16_t)red});
+        }
+
+        ReferencePoint point = {timestamp, 0, 0};
+        bool hasHr = parseNumber(fields, hrColumn, &point.hr);
+        bool hasSpo2 = parseNumber(fields, spo2Column, &point.spo2);
+        if (hasHr || hasSpo2) {
+            rec->reference.push_back(point);
+        }
+    }
+
+    fclose(file);
+    return true;
+}
+
+/**
+ * Loads a recording spec, either "raw.csv" or "raw.csv=reference.csv".
+ */
+inline bool loadRecording(const std::string& spec, Recording* rec)
+{
+    size_t separator = spec.find('=');
+    rec->path = spec;
+
+    if (!loadRecordingFile(spec.substr(0, separator).c_str(), rec)) {
+        return false;
+    }
+    if (separator != std::string::npos) {
+        rec->reference.clear();
+        Recording paired;
+        if (!loadRecordingFile(spec.substr(separator + 1).c_str(), &paired)) {
+            return false;
+        }
+        rec->reference = paired.reference;
+    }
+    return true;
+}
+
+/**
+ * Reference heart rate for recordings without one: the first strong
+ * autocorrelation peak of the detrended IR signal over `windowMs`
+ * ending at sample `end`, searched in the 40-180 bpm range.
+ * Returns 0 if there is no clear periodicity.
+ */
+inline float estimateReferenceHeartRate(const std::vector<RecordedSample>& samples, size_t end, uint32_t windowMs)
+{
+    size_t start = end;
+    while (start > 0 && samples[end].timestamp - samples[start - 1].timestamp <= windowMs) {
+        start--;
+    }
+
+    size_t n = end - start + 1;
+    if (n < 100) {
+        return 0;
+    }
+    float periodMs = (float)(samples[end].timestamp - samples[start].timestamp) / (n - 1);
+
+    // Mean and a short moving average, so the correlation only sees the pulse band
+    double mean = 0;
+    for (size_t i = start; i <= end; i++) {
+        mean += samples[i].ir;
+    }
+    mean /= n;
+
+    std::vector<float> x(n);
+    const size_t smoothing = 3;
+    for (size_t i = 0; i < n; i++) {
+        float acc = 0;
+        size_t taps = 0;
+        for (size_t k = 0; k < smoothing && k <= i; k++, taps++) {
+            acc += samples[start + i - k].ir - mean;
+        }
+        x[i] = acc / taps;
+    }
+
+    size_t minLag = (size_t)(60000.0f / 180 / periodMs);
+    size_t maxLag = (size_t)(60000.0f / 40 / periodMs);
+    if (maxLag >= n / 2) {
+        return 0;
+    }
+
+    double energy = 0;
+    for (size_t i = 0; i < n; i++) {
+        energy += x[i] * x[i];
+    }
+    if (energy == 0) {
+        return 0;
+    }
+
+    // First local maximum above half the zero lag energy: picking the global
+    // one would often land on a multiple of the period
+    std::vector<double> r(maxLag + 2, 0);
+    for (size_t lag = minLag - 1; lag <= maxLag + 1; lag++) {
+        for (size_t i = lag; i < n; i++) {
+            r[lag] += x[i] * x[i - lag];
+        }
+        r[lag] /= energy * (n - lag) / n;
+    }
+
+    for (size_t lag = minLag; lag <= maxLag; lag++) {
+        if (r[lag] > 0.5 && r[lag] >= r[lag - 1] && r[lag] >= r[lag + 1]) {
+            // Parabolic interpolation of the peak for sub-sample resolution
+            double denom = r[lag - 1] - 2 * r[lag] + r[lag + 1];
+            double offset = denom != 0 ? 0.5 * (r[lag - 1] - r[lag + 1]) / denom : 0;
+            return 60000.0f / ((lag + offset) * periodMs);
+        }
+    }
+
+    return 0;
+}
+
+#endif
@@ -0,0 +1,686 @@
+// Host benchmark and regression harness for the MAX30100 DSP chain
+// (DC removal, motion canceller, pulse filter, BeatDetector, SpO2Calculator,
+// VitalsEstimator, PulseOximeter).
+//
+//   pio test -e native -v
+//
+// Recordings are replayed through the same PulseOximeter::processSample()
+// the firmware runs, with the host clock driven by the sample timestamps,
+// and timed through processBlock() in FIFO sized bursts as well.
+// Set DSP_BENCH_RECORDINGS to a comma separated list of recordings to replay
+// instead of the bundled one; an entry may pair a raw capture with a log
+// holding the reference HR/SpO2, e.g. "raw_data_X.csv=oximeter_X.csv".
+
+#include <Arduino.h>
+#include <Wire.h>
+#include <unity.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "MAX30100_Filters.h"
+#include "MAX30100_MotionCanceller.h"
+#include "MAX30100_BeatDetector.h"
+#include "MAX30100_SpO2Calculator.h"
+#include "MAX30100_VitalsEstimator.h"
+#include "MAX30100_PulseOximeter.h"
+
+#include "recording.h"
+
+#define DEFAULT_RECORDINGS          "lib/MAX30100lib/extras/recorder/test.out.sample"
+#define BENCH_RUNS                  20
+#define EVALUATION_PERIOD_MS        1000    // how often the chain output is compared with the reference
+#define REFERENCE_WINDOW_MS         8000    // autocorrelation window when the recording has no reference
+#define REFERENCE_MAX_AGE_MS        2000    // reference points older than this are not matched
+
+// Regression bounds for the bundled recording, loose on purpose: they catch
+// a broken chain, the printed figures are what to compare between changes
+#define SAMPLE_MAX_HR_MAE           10.0
+#define SAMPLE_MIN_HR_COVERAGE      0.5
+
+typedef std::chrono::steady_clock Clock;
+
+struct ReplayReport {
+    size_t samples;
+    double chainNsPerSample;
+    double blockNsPerSample;
+    size_t evaluations;
+    size_t hrReadings;
+    size_t spo2Readings;
+    double spo2Mean;
+    size_t hrCompared;
+    double hrMae;
+    double hrRmse;
+    size_t spo2Compared;
+    double spo2Mae;
+    bool selfReference;
+};
+
+static std::vector<std::string> recordingSpecs()
+{
+    const char* env = getenv("DSP_BENCH_RECORDINGS");
+    return recording::split(env && *env ? env : DEFAULT_RECORDINGS, ',');
+}
+
+static double elapsedNs(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+}
+
+// Keeps the optimizer from dropping results that are otherwise unused
+static volatile float benchSink;
+
+static PulseOximeter* startPulseOximeter(MAX30100& sensor)
+{
+    memset(Wire.registers, 0, sizeof(Wire.registers));
+    Wire.registers[0xff] = EXPECTED_PART_ID;
+    setHostMillis(0);
+
+    PulseOximeter* pox = new PulseOximeter(sensor);
+    TEST_ASSERT_TRUE(pox->begin());
+    return pox;
+}
+
+static const ReferencePoint* findReference(const Recording& rec, uint32_t timestamp)
+{
+    const ReferencePoint* best = NULL;
+    for (size_t i = 0; i < rec.reference.size() && rec.reference[i].timestamp <= timestamp; i++) {
+        best = &rec.reference[i];
+    }
+    if (best && timestamp - best->timestamp > REFERENCE_MAX_AGE_MS) {
+        return NULL;
+    }
+    return best;
+}
+
+static ReplayReport replay(const Recording& rec)
+{
+    ReplayReport report = {};
+    report.samples = rec.samples.size();
+    report.selfReference = rec.reference.empty();
+
+    // Accuracy pass
+    MAX30100 sensor;
+    PulseOximeter* pox = startPulseOximeter(sensor);
+    double hrAbs = 0, hrSq = 0, spo2Abs = 0;
+    uint32_t tsNextEvaluation = BEATDETECTOR_INIT_HOLDOFF;
+
+    for (size_t i = 0; i < rec.samples.size(); i++) {
+        const RecordedSample& sample = rec.samples[i];
+        setHostMillis(sample.timestamp);
+        pox->processSample({sample.ir, sample.red, sample.timestamp});
+
+        if (sample.timestamp < tsNextEvaluation) {
+            continue;
+        }
+        tsNextEvaluation += EVALUATION_PERIOD_MS;
+        report.evaluations++;
+
+        float hr = pox->getHeartRate();
+        float spo2 = pox->getSpO2();
+        if (hr > 0) {
+            report.hrReadings++;
+        }
+        if (spo2 > 0) {
+            report.spo2Readings++;
+            report.spo2Mean += spo2;
+        }
+
+        float refHr = 0, refSpo2 = 0;
+        if (report.selfReference) {
+            refHr = estimateReferenceHeartRate(rec.samples, i, REFERENCE_WINDOW_MS);
+        } else {
+            const ReferencePoint* ref = findReference(rec, sample.timestamp);
+            if (ref) {
+                refHr = ref->hr;
+                refSpo2 = ref->spo2;
+            }
+        }
+
+        if (hr > 0 && refHr > 0) {
+            hrAbs += fabs(hr - refHr);
+            hrSq += (hr - refHr) * (hr - refHr);
+            report.hrCompared++;
+        }
+        if (spo2 > 0 && refSpo2 > 0) {
+            spo2Abs += fabs(spo2 - refSpo2);
+            report.spo2Compared++;
+        }
+    }
+    delete pox;
+
+    if (report.hrCompared) {
+        report.hrMae = hrAbs / report.hrCompared;
+        report.hrRmse = sqrt(hrSq / report.hrCompared);
+    }
+    if (report.spo2Compared) {
+        report.spo2Mae = spo2Abs / report.spo2Compared;
+    }
+    if (report.spo2Readings) {
+        report.spo2Mean /= report.spo2Readings;
+    }
+
+    // Timing passes: best of a few runs, on a fresh chain each time
+    std::vector<SensorReadout> readouts(rec.samples.size());
+    for (size_t i = 0; i < rec.samples.size(); i++) {
+        readouts[i] = {rec.samples[i].ir, rec.samples[i].red, rec.samples[i].timestamp};
+    }
+
+    double best = 0;
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        MAX30100 benchSensor;
+        PulseOximeter* benchPox = startPulseOximeter(benchSensor);
+
+        Clock::time_point start = Clock::now();
+        for (size_t i = 0; i < readouts.size(); i++) {
+            benchPox->processSample(readouts[i]);
+        }
+        double ns = elapsedNs(start);
+        benchSink = benchPox->getHeartRate();
+        delete benchPox;
+
+        if (run == 0 || ns < best) {
+            best = ns;
+        }
+    }
+    report.chainNsPerSample = report.samples ? best / report.samples : 0;
+
+    best = 0;
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        MAX30100 benchSensor;
+        PulseOximeter* benchPox = startPulseOximeter(benchSensor);
+
+        Clock::time_point start = Clock::now();
+        for (size_t i = 0; i < readouts.size(); i += PULSEOXIMETER_BLOCK_SIZE) {
+            size_t n = readouts.size() - i < PULSEOXIMETER_BLOCK_SIZE ? readouts.size() - i : PULSEOXIMETER_BLOCK_SIZE;
+            benchPox->processBlock(&readouts[i], n);
+        }
+        double ns = elapsedNs(start);
+        benchSink = benchPox->getHeartRate();
+        delete benchPox;
+
+        if (run == 0 || ns < best) {
+            best = ns;
+        }
+    }
+    report.blockNsPerSample = report.samples ? best / report.samples : 0;
+
+    return report;
+}
+
+static void printStageBenchmarks(const Recording& rec)
+{
+    size_t n = rec.samples.size();
+    std::vector<dsp_sample_t> irAc(n), redAc(n), filtered(n);
+    double best;
+
+    // Each stage runs on the previous stage's output, only the stage itself is timed
+    best = 0;
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        PulseOximeterDCRemover irDCRemover;
+        PulseOximeterDCRemover redDCRemover;
+        Clock::time_point start = Clock::now();
+        for (size_t i = 0; i < n; i++) {
+            irAc[i] = irDCRemover.step(DSP_SAMPLE(rec.samples[i].ir));
+            redAc[i] = redDCRemover.step(DSP_SAMPLE(rec.samples[i].red));
+        }
+        double ns = elapsedNs(start);
+        best = run == 0 || ns < best ? ns : best;
+    }
+    printf("    DC removal x2   %8.1f ns/sample\n", best / n);
+
+    // The recordings hold no accelerometer data: a synthetic one, with z at rest so that its
+    // DC blocked reference decays toward zero as a still wrist's does
+    std::vector<dsp_sample_t> cancelled(n);
+    best = 0;
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        PulseOximeterMotionCanceller motionCanceller;
+        Clock::time_point start = Clock::now();
+        for (size_t i = 0; i < n; i++) {
+            MotionSample motion = {(int16_t)(i % 64), (int16_t)(i % 16), 1000};
+            cancelled[i] = motionCanceller.step(irAc[i], motion);
+        }
+        double ns = elapsedNs(start);
+        benchSink = DSP_TO_FLOAT(cancelled[n - 1]);
+        best = run == 0 || ns < best ? ns : best;
+    }
+    printf("    Motion cancel   %8.1f ns/sample\n", best / n);
+
+    best = 0;
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        PulseOximeterPulseFilter pulseFilter;
+        Clock::time_point start = Clock::now();
+        for (size_t i = 0; i < n; i++) {
+            filtered[i] = pulseFilter.step(-irAc[i]);
+        }
+        double ns = elapsedNs(start);
+        best = run == 0 || ns < best ? ns : best;
+    }
+    printf("    Pulse filter    %8.1f ns/sample\n", best / n);
+
+    std::vector<uint8_t> beats(n);
+    best = 0;
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        BeatDetector beatDetector(1000.0 / SAMPLING_FREQUENCY);
+        Clock::time_point start = Clock::now();
+        for (size_t i = 0; i < n; i++) {
+            beats[i] = beatDetector.addSample(filtered[i], rec.samples[i].timestamp);
+        }
+        double ns = elapsedNs(start);
+        best = run == 0 || ns < best ? ns : best;
+    }
+    printf("    BeatDetector    %8.1f ns/sample\n", best / n);
+
+    best = 0;
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        SpO2Calculator spO2calculator;
+        Clock::time_point start = Clock::now();
+        for (size_t i = 0; i < n; i++) {
+            spO2calculator.update(irAc[i], redAc[i], beats[i]);
+        }
+        double ns = elapsedNs(start);
+        benchSink = spO2calculator.getSpO2();
+        best = run == 0 || ns < best ? ns : best;
+    }
+    printf("    SpO2Calculator  %8.1f ns/sample\n", best / n);
+
+    best = 0;
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        VitalsEstimator vitalsEstimator;
+        Clock::time_point start = Clock::now();
+        for (size_t i = 0; i < n; i++) {
+            vitalsEstimator.addSamples(&irAc[i], &redAc[i], 1);
+            if (beats[i]) {
+                vitalsEstimator.addBeat(rec.samples[i].timestamp);
+            }
+        }
+        double ns = elapsedNs(start);
+        benchSink = vitalsEstimator.getHeartRate();
+        best = run == 0 || ns < best ? ns : best;
+    }
+    printf("    VitalsEstimator %8.1f ns/sample\n", best / n);
+}
+
+static void printReport(const Recording& rec, const ReplayReport& report)
+{
+    double seconds = rec.samples.empty() ? 0 : rec.samples.back().timestamp / 1000.0;
+
+    printf("\n%s: %zu samples, %.1f s\n", rec.path.c_str(), report.samples, seconds);
+    printf("    PulseOximeter   %8.1f ns/sample\n", report.chainNsPerSample);
+    printf("      in blocks     %8.1f ns/sample, %d samples per block\n",
+            report.blockNsPerSample, PULSEOXIMETER_BLOCK_SIZE);
+    printStageBenchmarks(rec);
+
+    printf("    HR readout      %zu/%zu evaluations\n", report.hrReadings, report.evaluations);
+    printf("    SpO2 readout    %zu/%zu evaluations, mean %.1f %%\n",
+            report.spo2Readings, report.evaluations, report.spo2Mean);
+    if (report.hrCompared) {
+        printf("    HR error        MAE %.2f bpm, RMSE %.2f bpm over %zu points (%s)\n",
+                report.hrMae, report.hrRmse, report.hrCompared,
+                report.selfReference ? "autocorrelation reference" : "recorded reference");
+    } else {
+        printf("    HR error        n/a, no overlapping reference\n");
+    }
+    if (report.spo2Compared) {
+        printf("    SpO2 error      MAE %.2f %% over %zu points\n", report.spo2Mae, report.spo2Compared);
+    } else {
+        printf("    SpO2 error      n/a, %s\n",
+                report.selfReference ? "the recording has no SpO2 reference" : "no overlapping reference");
+    }
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+// Steady state gain of a filter for a sine at `frequency`
+template<typename Filter>
+static float measureGain(float fs, float frequency)
+{
+    Filter filter;
+    float peak = 0;
+    int settle = (int)(fs * 2), total = settle + (int)(fs * 2);
+    for (int i = 0; i < total; i++) {
+        float out = DSP_TO_FLOAT(filter.step(DSP_SAMPLE(1000 * sin(2 * M_PI * frequency * i / fs))));
+        if (i > settle && fabs(out) > peak) {
+            peak = fabs(out);
+        }
+    }
+    return peak / 1000;
+}
+
+void test_dc_blocker_removes_baseline()
+{
+    PulseOximeterDCRemover dcRemover;
+    dsp_sample_t ac = 0;
+    for (int i = 0; i < 500; i++) {
+        ac = dcRemover.step(DSP_SAMPLE(40000));
+    }
+    TEST_ASSERT_FLOAT_WITHIN(1.0, 0.0, DSP_TO_FLOAT(ac));
+    TEST_ASSERT_FLOAT_WITHIN(1.0, 40000, DSP_TO_FLOAT(dcRemover.getDC()));
+}
+
+void test_filters_match_legacy_at_100hz()
+{
+    // The designed filters must reproduce the hand-tuned ones they replaced
+    DCRemover legacyDCRemover(0.95);
+    FilterBuLp1 legacyLpf;
+    DCBlocker<100, DC_REMOVER_CUTOFF_MHZ> dcBlocker;
+    ButterworthLowpass<100, 10000, 1> lpf;
+
+    for (int i = 0; i < 1000; i++) {
+        uint16_t x = 40000 + 300 * sin(2 * M_PI * 1.2 * i / 100) + (i * 7919 % 61);
+        dsp_sample_t legacyAc = legacyDCRemover.step(x);
+        dsp_sample_t ac = dcBlocker.step(DSP_SAMPLE(x));
+        dsp_sample_t legacyFiltered = legacyLpf.step(legacyAc);
+        dsp_sample_t filtered = lpf.step(legacyAc);
+
+        // The pole is off by 2e-5, which only shows on the initial step of the baseline
+        if (i > 200) {
+            TEST_ASSERT_FLOAT_WITHIN(0.5, DSP_TO_FLOAT(legacyAc), DSP_TO_FLOAT(ac));
+        }
+        TEST_ASSERT_FLOAT_WITHIN(0.5, DSP_TO_FLOAT(legacyFiltered), DSP_TO_FLOAT(filtered));
+    }
+}
+
+void test_butterworth_design_across_rates()
+{
+    // Flat passband, -3dB at the cutoff, and the expected rolloff an octave above it
+    TEST_ASSERT_FLOAT_WITHIN(0.01, 1.0, (measureGain<ButterworthLowpass<100, 6000, 2>>(100, 1)));
+    TEST_ASSERT_FLOAT_WITHIN(0.02, M_SQRT1_2, (measureGain<ButterworthLowpass<100, 6000, 2>>(100, 6)));
+    TEST_ASSERT_FLOAT_WITHIN(0.01, 1.0, (measureGain<ButterworthLowpass<400, 6000, 4>>(400, 1)));
+    TEST_ASSERT_FLOAT_WITHIN(0.02, M_SQRT1_2, (measureGain<ButterworthLowpass<400, 6000, 4>>(400, 6)));
+    TEST_ASSERT_FLOAT_WITHIN(0.01, 1 / sqrt(1 + pow(2, 8)), (measureGain<ButterworthLowpass<400, 6000, 4>>(400, 12)));
+    TEST_ASSERT_FLOAT_WITHIN(0.01, 1.0, (measureGain<ButterworthLowpass<1000, 6000, 3>>(1000, 1)));
+    TEST_ASSERT_FLOAT_WITHIN(0.02, M_SQRT1_2, (measureGain<ButterworthLowpass<1000, 6000, 3>>(1000, 6)));
+    TEST_ASSERT_FLOAT_WITHIN(0.02, M_SQRT1_2, (measureGain<DCBlocker<1000, 500>>(1000, 0.5)));
+
+    FilterChain<DCBlocker<400, 500>, ButterworthLowpass<400, 6000, 2>> chain;
+    dsp_sample_t out = 0;
+    for (int i = 0; i < 4000; i++) {
+        out = chain.step(DSP_SAMPLE(40000));
+    }
+    TEST_ASSERT_FLOAT_WITHIN(1.0, 0, DSP_TO_FLOAT(out));
+    TEST_ASSERT_FLOAT_WITHIN(1.0, 40000, DSP_TO_FLOAT(chain.stage<0>().getDC()));
+}
+
+void test_beat_detector_tracks_synthetic_pulse()
+{
+    const float bpm = 72;
+    BeatDetector beatDetector(1000.0 / SAMPLING_FREQUENCY);
+    PulseOximeterDCRemover dcRemover;
+    PulseOximeterPulseFilter pulseFilter;
+
+    for (uint32_t ts = 0; ts < 20000; ts += 1000 / SAMPLING_FREQUENCY) {
+        // Sharp systolic rise followed by a slower decay, on a DC baseline
+        float phase = fmod(ts * bpm / 60000.0, 1.0);
+        float pulse = phase < 0.15 ? phase / 0.15 : exp(-(phase - 0.15) * 5);
+        beatDetector.addSample(pulseFilter.step(-dcRemover.step(DSP_SAMPLE(40000 + 400 * pulse))), ts);
+    }
+
+    TEST_ASSERT_FLOAT_WITHIN(3, bpm, beatDetector.getRate());
+}
+
+void test_spo2_calculator_maps_ratio_through_lut()
+{
+    SpO2Calculator spO2calculator;
+
+    // Mean squares 500000 (IR) vs 20000 (red): 100*ln(20000)/ln(500000) = 75.5, LUT[9]
+    for (int i = 0; i < 300; i++) {
+        float s = sin(2 * M_PI * i / 100);
+        spO2calculator.update(DSP_SAMPLE(1000 * s), DSP_SAMPLE(200 * s), i % 100 == 99);
+    }
+
+    TEST_ASSERT_EQUAL_UINT8(99, spO2calculator.getSpO2());
+}
+
+// Wrist motion at 100Hz, in mg: a sway and a faster shake, mostly on x
+static MotionSample syntheticMotion(int i)
+{
+    float t = i / 100.0;
+    float sway = 400 * sin(2 * M_PI * 0.5 * t);
+    float shake = 250 * sin(2 * M_PI * 3.1 * t + 1);
+    return {(int16_t)(sway + shake), (int16_t)(0.3 * shake), (int16_t)(1000 + 0.2 * sway)};
+}
+
+void test_motion_canceller_removes_correlated_artifact()
+{
+    PulseOximeterMotionCanceller motionCanceller;
+    // Reference for the artifact itself: the accelerometer seen through the PPG's DC blocker
+    PulseOximeterDCRemover axBlocker, azBlocker;
+    float axPrevious = 0;
+    double artifactSq = 0, residualSq = 0;
+
+    for (int i = 0; i < 3000; i++) {
+        MotionSample motion = syntheticMotion(i);
+        float ax = DSP_TO_FLOAT(axBlocker.step(DSP_SAMPLE(motion.x)));
+        float az = DSP_TO_FLOAT(azBlocker.step(DSP_SAMPLE(motion.z)));
+        // The sensor moving on the skin: counts per mg, with a lag
+        float artifact = 1.5 * ax - 0.8 * axPrevious + 2.0 * az;
+        float pulse = 150 * sin(2 * M_PI * 1.2 * i / 100.0);
+        axPrevious = ax;
+
+        float out = DSP_TO_FLOAT(motionCanceller.step(DSP_SAMPLE(pulse + artifact), motion));
+        // Past the convergence: seconds 20 to 30
+        if (i >= 2000) {
+            artifactSq += artifact * artifact;
+            residualSq += (out - pulse) * (out - pulse);
+        }
+    }
+
+    // Over 20 dB of the artifact gone, the pulse left
+    TEST_ASSERT_TRUE(residualSq < 0.01 * artifactSq);
+}
+
+void test_motion_canceller_passes_signal_at_rest()
+{
+    PulseOximeterMotionCanceller motionCanceller;
+    double errorSq = 0, pulseSq = 0;
+
+    for (int i = 0; i < 3000; i++) {
+        // Gravity and a few mg of accelerometer noise
+        MotionSample motion = {(int16_t)(i * 7919 % 5 - 2), (int16_t)(i * 104729 % 5 - 2), 1000};
+        float pulse = 150 * sin(2 * M_PI * 1.2 * i / 100.0);
+        float out = DSP_TO_FLOAT(motionCanceller.step(DSP_SAMPLE(pulse), motion));
+        if (i >= 500) {
+            errorSq += (out - pulse) * (out - pulse);
+            pulseSq += pulse * pulse;
+        }
+    }
+
+    TEST_ASSERT_TRUE(errorSq < 0.001 * pulseSq);
+}
+
+void test_pulse_oximeter_tracks_pulse_through_motion()
+{
+    const float bpm = 72;
+    MAX30100 sensor;
+    PulseOximeter* pox = startPulseOximeter(sensor);
+
+    int i = 0;
+    for (uint32_t ts = 0; ts < 30000; ts += 10 * PULSEOXIMETER_BLOCK_SIZE) {
+        SensorReadout readouts[PULSEOXIMETER_BLOCK_SIZE];
+        MotionSample motion[PULSEOXIMETER_BLOCK_SIZE];
+        for (int k = 0; k < PULSEOXIMETER_BLOCK_SIZE; k++, i++) {
+            uint32_t t = ts + 10 * k;
+            float phase = fmod(t * bpm / 60000.0, 1.0);
+            float pulse = phase < 0.15 ? phase / 0.15 : exp(-(phase - 0.15) * 5);
+            motion[k] = syntheticMotion(i);
+            // The motion shows in the light several times stronger than the pulse: without
+            // the accelerometer the beat detector locks onto the shake
+            float artifact = 3.0 * motion[k].x;
+            readouts[k] = {(uint16_t)(40000 + 400 * pulse + artifact), (uint16_t)(38000 + 200 * pulse + artifact), t};
+        }
+        setHostMillis(ts);
+        pox->processBlock(readouts, motion, PULSEOXIMETER_BLOCK_SIZE);
+    }
+
+    TEST_ASSERT_FLOAT_WITHIN(3, bpm, pox->getHeartRate());
+    delete pox;
+}
+
+// One beat of sine AC values, IR and red amplitudes given, over `samples` samples
+static void addSineBeat(VitalsEstimator& vitalsEstimator, float irAmplitude, float redAmplitude, int samples,
+        uint32_t* timestamp)
+{
+    for (int i = 0; i < samples; i++) {
+        float s = sin(2 * M_PI * i / samples);
+        dsp_sample_t ir = DSP_SAMPLE(irAmplitude * s);
+        dsp_sample_t red = DSP_SAMPLE(redAmplitude * s);
+        vitalsEstimator.addSamples(&ir, &red, 1);
+    }
+    *timestamp += samples * 10;
+    vitalsEstimator.addBeat(*timestamp);
+}
+
+void test_vitals_estimator_updates_every_beat()
+{
+    VitalsEstimator vitalsEstimator;
+    uint32_t timestamp = 3000;
+
+    // Nothing until the window holds enough beats
+    for (int beat = 0; beat < VITALSESTIMATOR_MIN_BEATS - 1; beat++) {
+        addSineBeat(vitalsEstimator, 1000, 200, 100, &timestamp);
+        TEST_ASSERT_EQUAL_UINT8(0, vitalsEstimator.getSpO2());
+        TEST_ASSERT_EQUAL_FLOAT(0, vitalsEstimator.getHeartRate());
+    }
+
+    // Same ratio as the SpO2Calculator test, 1s beats: read on every beat from then on, never zeroed
+    for (int beat = VITALSESTIMATOR_MIN_BEATS - 1; beat < 3 * VITALSESTIMATOR_WINDOW_BEATS; beat++) {
+        addSineBeat(vitalsEstimator, 1000, 200, 100, &timestamp);
+        TEST_ASSERT_EQUAL_UINT8(99, vitalsEstimator.getSpO2());
+        TEST_ASSERT_FLOAT_WITHIN(0.01, 60, vitalsEstimator.getHeartRate());
+    }
+    TEST_ASSERT_EQUAL_UINT8(100, vitalsEstimator.getConfidence());
+
+    // Mean squares 500000 vs 32000: 100*ln(32000)/ln(500000) = 79.1, LUT[13]. The window slides over
+    // to it one beat at a time
+    uint8_t previous = vitalsEstimator.getSpO2();
+    for (int beat = 0; beat < VITALSESTIMATOR_WINDOW_BEATS; beat++) {
+        addSineBeat(vitalsEstimator, 1000, 253, 100, &timestamp);
+        TEST_ASSERT_TRUE(vitalsEstimator.getSpO2() <= previous);
+        TEST_ASSERT_TRUE(vitalsEstimator.getSpO2() >= 98);
+        previous = vitalsEstimator.getSpO2();
+    }
+    TEST_ASSERT_EQUAL_UINT8(98, vitalsEstimator.getSpO2());
+
+    vitalsEstimator.reset();
+    TEST_ASSERT_EQUAL_UINT8(0, vitalsEstimator.getSpO2());
+    TEST_ASSERT_EQUAL_FLOAT(0, vitalsEstimator.getHeartRate());
+    TEST_ASSERT_EQUAL_UINT8(0, vitalsEstimator.getConfidence());
+}
+
+void test_vitals_estimator_confidence()
+{
+    VitalsEstimator regular, irregular;
+    uint32_t tsRegular = 3000, tsIrregular = 3000;
+
+    // 75 bpm either way, one with beat intervals 20% apart from each other
+    for (int beat = 0; beat < 2 * VITALSESTIMATOR_WINDOW_BEATS; beat++) {
+        addSineBeat(regular, 1000, 200, 80, &tsRegular);
+        addSineBeat(irregular, 1000, 200, beat % 2 ? 72 : 88, &tsIrregular);
+    }
+    TEST_ASSERT_FLOAT_WITHIN(0.5, 75, regular.getHeartRate());
+    TEST_ASSERT_FLOAT_WITHIN(0.5, 75, irregular.getHeartRate());
+    TEST_ASSERT_EQUAL_UINT8(100, regular.getConfidence());
+    // Interval CV 0.1 of the 0.25 allowed
+    TEST_ASSERT_UINT8_WITHIN(2, 60, irregular.getConfidence());
+
+    // A half full window halves it
+    VitalsEstimator filling;
+    uint32_t tsFilling = 3000;
+    for (int beat = 0; beat < VITALSESTIMATOR_WINDOW_BEATS / 2; beat++) {
+        addSineBeat(filling, 1000, 200, 80, &tsFilling);
+    }
+    TEST_ASSERT_EQUAL_UINT8(50, filling.getConfidence());
+}
+
+void test_block_matches_per_sample()
+{
+    Recording rec;
+    if (!loadRecording(DEFAULT_RECORDINGS, &rec) || rec.samples.empty()) {
+        TEST_IGNORE_MESSAGE("Bundled recording not found, run from the project directory");
+    }
+
+    MAX30100 sensor, blockSensor;
+    PulseOximeter* pox = startPulseOximeter(sensor);
+    PulseOximeter* blockPox = startPulseOximeter(blockSensor);
+
+    // Bursts of every size up to a FIFO and beyond, as the drain produces them
+    size_t hrReadings = 0;
+    size_t burst = 1;
+    for (size_t i = 0; i < rec.samples.size(); i += burst, burst = burst % (2 * PULSEOXIMETER_BLOCK_SIZE) + 1) {
+        size_t n = rec.samples.size() - i < burst ? rec.samples.size() - i : burst;
+        SensorReadout readouts[2 * PULSEOXIMETER_BLOCK_SIZE];
+        for (size_t k = 0; k < n; k++) {
+            const RecordedSample& sample = rec.samples[i + k];
+            readouts[k] = {sample.ir, sample.red, sample.timestamp};
+            pox->processSample(readouts[k]);
+        }
+        blockPox->processBlock(readouts, n);
+
+        TEST_ASSERT_EQUAL_FLOAT(pox->getHeartRate(), blockPox->getHeartRate());
+        // Float sums of squares are added in another order, which may round the ratio across a LUT step
+        TEST_ASSERT_UINT8_WITHIN(MAX30100_FIXED_POINT ? 0 : 1, pox->getSpO2(), blockPox->getSpO2());
+        hrReadings += pox->getHeartRate() > 0;
+    }
+    TEST_ASSERT_TRUE(hrReadings > 0);
+
+    delete pox;
+    delete blockPox;
+}
+
+void test_replay_recordings()
+{
+    std::vector<std::string> specs = recordingSpecs();
+    size_t replayed = 0;
+
+    for (size_t i = 0; i < specs.size(); i++) {
+        Recording rec;
+        if (!loadRecording(specs[i], &rec)) {
+            printf("\n%s: not readable, skipped\n", specs[i].c_str());
+            continue;
+        }
+        if (rec.samples.empty()) {
+            printf("\n%s: no IR/Red columns, usable only as a reference (raw=reference)\n", specs[i].c_str());
+            continue;
+        }
+
+        ReplayReport report = replay(rec);
+        printReport(rec, report);
+        replayed++;
+
+        if (specs[i] == DEFAULT_RECORDINGS) {
+            TEST_ASSERT_TRUE(report.hrReadings >= SAMPLE_MIN_HR_COVERAGE * report.evaluations);
+            TEST_ASSERT_TRUE(report.hrCompared > 0);
+            TEST_ASSERT_LESS_THAN_FLOAT(SAMPLE_MAX_HR_MAE, report.hrMae);
+        }
+    }
+
+    if (!replayed) {
+        TEST_IGNORE_MESSAGE("No replayable recording found, run from the project directory or set DSP_BENCH_RECORDINGS");
+    }
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_dc_blocker_removes_baseline);
+    RUN_TEST(test_filters_match_legacy_at_100hz);
+    RUN_TEST(test_butterworth_design_across_rates);
+    RUN_TEST(test_beat_detector_tracks_synthetic_pulse);
+    RUN_TEST(test_spo2_calculator_maps_ratio_through_lut);
+    RUN_TEST(test_motion_canceller_removes_correlated_artifact);
+    RUN_TEST(test_motion_canceller_passes_signal_at_rest);
+    RUN_TEST(test_pulse_oximeter_tracks_pulse_through_motion);
+    RUN_TEST(test_vitals_estimator_updates_every_beat);
+    RUN_TEST(test_vitals_estimator_confidence);
+    RUN_TEST(test_block_matches_per_sample);
+    RUN_TEST(test_replay_recordings);
+    return UNITY_END();
+}
@@ -0,0 +1,290 @@
+#ifndef QUALITY_MODEL_FIXTURES_H
+#define QUALITY_MODEL_FIXTURES_H
+
+// Generated by quality_model_codegen.py --fixtures - DO NOT EDIT MANUALLY
+// Random MLP and tree ensemble over the windowed features, quantized for the
+// integer kernels, with the float models they come from as the reference
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "quality_features.h"
+#include "quality_inference.h"
+
+// MLP 7-8-1, ReLU
+const uint8_t fixture_mlp_features[7] = {
+    QUALITY_FEATURE_HEARTRATE, // HeartRate
+    QUALITY_FEATURE_SPO2, // SpO2
+    QUALITY_FEATURE_HR_CHANGE, // HR_Change
+    QUALITY_FEATURE_PERFUSION_INDEX, // Perfusion_Index
+    QUALITY_FEATURE_PPG_AMPLITUDE, // PPG_Amplitude
+    QUALITY_FEATURE_ACCEL_ENERGY, // Accel_Energy
+    QUALITY_FEATURE_BEAT_INTERVAL_CV // Beat_Interval_CV
+};
+
+// Per-channel input scales, powers of two
+const float fixture_mlp_input_scales[7] = {
+    64.0f, // HeartRate
+    128.0f, // SpO2
+    64.0f, // HR_Change
+    128.0f, // Perfusion_Index
+    0.5f, // PPG_Amplitude
+    1024.0f, // Accel_Energy
+    4096.0f // Beat_Interval_CV
+};
+
+const int32_t fixture_mlp_layer0_weights[56] = {
+    -484, 1529, -2473, 2901, -4182, 51667, -129, 3716,
+    5916, 566, -6032, 6456, -9344, -5642, 200, -2120,
+    -61, 5660, 891, -45468, 892, 496, -4098, -6283,
+    2959, 11523, -23874, 11525, -396, 1498, -3974, -10192,
+    -272, 18948, 3056, -405, 1067, -6179, 591, 3910,
+    -48697, 3433, 465, 544, -29, -430, 1081, -31863,
+    812, -364, 545, -2767, -4771, -2599, 36166, 130
+};
+
+const int32_t fixture_mlp_layer0_biases[8] = {
+    -14031677, -83435304, 21930592, 33170368, -13484985, -11575148, -9301213, -671262
+};
+
+const uint8_t fixture_mlp_layer0_shifts[8] = {
+    17, 17, 17, 17, 17, 17, 17, 17
+};
+
+const int32_t fixture_mlp_layer1_weights[8] = {
+    21905, -1675, -27054, -5003, 840, 2993, 11124, 3685
+};
+
+const int32_t fixture_mlp_layer1_biases[1] = {
+    55026
+};
+
+const QualityDenseLayer fixture_mlp_layers[2] = {
+    {7, 8, fixture_mlp_layer0_weights, fixture_mlp_layer0_biases, fixture_mlp_layer0_shifts, true},
+    {8, 1, fixture_mlp_layer1_weights, fixture_mlp_layer1_biases, NULL, false}
+};
+
+// Score of the model, positive for good quality
+inline int32_t fixture_mlp_score(const float features[QUALITY_FEATURE_COUNT]) {
+    int32_t values[8];
+    int32_t scratch[8];
+    quantize_quality_features(features, fixture_mlp_features, fixture_mlp_input_scales, 7, values);
+    return run_quality_dense(fixture_mlp_layers, 2, values, scratch);
+}
+
+const uint8_t fixture_mlp_reference_features[7] = {QUALITY_FEATURE_HEARTRATE, QUALITY_FEATURE_SPO2, QUALITY_FEATURE_HR_CHANGE, QUALITY_FEATURE_PERFUSION_INDEX, QUALITY_FEATURE_PPG_AMPLITUDE, QUALITY_FEATURE_ACCEL_ENERGY, QUALITY_FEATURE_BEAT_INTERVAL_CV};
+const double fixture_mlp_reference_w0[] = {-0.029515424859497784, 0.18661818045846962, -0.15092532395474406, 0.35418606568239136, -0.0019942704587877073, 50.45558623718945, -0.5053069615427787, 0.05670216573690835, 0.18055221514522715, 0.008629199254912, -0.1840740531136644, 0.0007695713710279603, -2.2812461916022215, -5.509841116545273, 0.02442003756382923, -0.5174712800946284, -0.0074595999576782, 1.3819324041303267, 0.0008495979290113431, -88.80550298197197, 6.966226275899563, 0.007561933573600249, -0.12504649238071613, -0.095868818842105, 0.09029086138468793, 0.0013736461682494058, -5.828560714047297, 11.2545337949159, -0.0241860733450856, 0.18285162322234935, -0.2425667565607205, -1.2441536988300819, -0.00012947774879814672, 18.503664646568662, 11.937339757112184, -0.01235351037947091, 0.06511060248407062, -0.18856188808857313, 0.03607998674378684, 0.0009320982652234287, -23.77779772319028, 6.705079575360251, 0.056795051539017496, 0.132736782312362, -0.0035948469058235052, -0.10490331053894462, 0.0010312861068577802, -62.23234141861419, 6.340090318290089, -0.022186345215798008, 0.066548855626489, -0.16886916575500427, -0.5823887329181056, -0.0012392385958510245, 35.31850136201097, 0.5084149828880399};
+const double fixture_mlp_reference_b0[] = {-13.381650341757931, -19.892526533203508, 41.82928462612732, 7.908432056886824, -12.860283785835888, -5.519460566328863, -17.74065629399497, -0.6401651787458766};
+const double fixture_mlp_reference_w1[] = {1.3369555063084444, -0.40885637020696297, -0.8256149077674749, -1.2215003144549565, 0.051276102807412474, 0.36540253599656425, 0.3394768402501638, 0.22491664720517568};
+const double fixture_mlp_reference_b1[] = {0.4198165893456161};
+const size_t fixture_mlp_reference_sizes[] = {7, 8, 1};
+const double* const fixture_mlp_reference_weights[] = {fixture_mlp_reference_w0, fixture_mlp_reference_w1};
+const double* const fixture_mlp_reference_biases[] = {fixture_mlp_reference_b0, fixture_mlp_reference_b1};
+const size_t fixture_mlp_reference_layers = 2;
+
+// 8 trees of depth 3
+const uint8_t fixture_forest_features[7] = {
+    QUALITY_FEATURE_HEARTRATE, // HeartRate
+    QUALITY_FEATURE_SPO2, // SpO2
+    QUALITY_FEATURE_HR_CHANGE, // HR_Change
+    QUALITY_FEATURE_PERFUSION_INDEX, // Perfusion_Index
+    QUALITY_FEATURE_PPG_AMPLITUDE, // PPG_Amplitude
+    QUALITY_FEATURE_ACCEL_ENERGY, // Accel_Energy
+    QUALITY_FEATURE_BEAT_INTERVAL_CV // Beat_Interval_CV
+};
+
+// Per-channel input scales, powers of two
+const float fixture_forest_input_scales[7] = {
+    64.0f, // HeartRate
+    128.0f, // SpO2
+    64.0f, // HR_Change
+    128.0f, // Perfusion_Index
+    0.5f, // PPG_Amplitude
+    1024.0f, // Accel_Energy
+    4096.0f // Beat_Interval_CV
+};
+
+const QualityTreeNode fixture_forest_nodes[120] = {
+    {6, 232, 1, 8},
+    {5, 2, 2, 5},
+    {6, 1567, 3, 4},
+    {-1, -11365, 0, 0},
+    {-1, 4534, 0, 0},
+    {2, 306, 6, 7},
+    {-1, 2691, 0, 0},
+    {-1, -8555, 0, 0},
+    {1, 12644, 9, 12},
+    {0, 5841, 10, 11},
+    {-1, -7615, 0, 0},
+    {-1, -3048, 0, 0},
+    {3, 304, 13, 14},
+    {-1, 7545, 0, 0},
+    {-1, -1286, 0, 0},
+    {0, 2862, 16, 23},
+    {5, 10, 17, 20},
+    {5, 13, 18, 19},
+    {-1, 15309, 0, 0},
+    {-1, -3794, 0, 0},
+    {6, 442, 21, 22},
+    {-1, -2754, 0, 0},
+    {-1, -12837, 0, 0},
+    {0, 4893, 24, 27},
+    {1, 12493, 25, 26},
+    {-1, -8600, 0, 0},
+    {-1, 12548, 0, 0},
+    {3, 284, 28, 29},
+    {-1, -9015, 0, 0},
+    {-1, -10335, 0, 0},
+    {5, 25, 31, 38},
+    {1, 12532, 32, 35},
+    {1, 12143, 33, 34},
+    {-1, 11363, 0, 0},
+    {-1, -386, 0, 0},
+    {4, 302, 36, 37},
+    {-1, -12329, 0, 0},
+    {-1, -13887, 0, 0},
+    {6, 624, 39, 42},
+    {3, 164, 40, 41},
+    {-1, 4731, 0, 0},
+    {-1, -9531, 0, 0},
+    {3, 327, 43, 44},
+    {-1, -317, 0, 0},
+    {-1, -13778, 0, 0},
+    {5, 50, 46, 53},
+    {0, 6266, 47, 50},
+    {2, 74, 48, 49},
+    {-1, -13746, 0, 0},
+    {-1, -115, 0, 0},
+    {6, 107, 51, 52},
+    {-1, -5412, 0, 0},
+    {-1, -10765, 0, 0},
+    {5, 18, 54, 57},
+    {2, 500, 55, 56},
+    {-1, -9078, 0, 0},
+    {-1, -1503, 0, 0},
+    {5, 0, 58, 59},
+    {-1, -16377, 0, 0},
+    {-1, -5467, 0, 0},
+    {4, 626, 61, 68},
+    {0, 3938, 62, 65},
+    {5, 1, 63, 64},
+    {-1, 4098, 0, 0},
+    {-1, -11557, 0, 0},
+    {4, 694, 66, 67},
+    {-1, -9091, 0, 0},
+    {-1, 118, 0, 0},
+    {6, 1286, 69, 72},
+    {4, 666, 70, 71},
+    {-1, 4538, 0, 0},
+    {-1, 7942, 0, 0},
+    {2, 657, 73, 74},
+    {-1, 3775, 0, 0},
+    {-1, 9773, 0, 0},
+    {4, 970, 76, 83},
+    {3, 376, 77, 80},
+    {2, 174, 78, 79},
+    {-1, -1287, 0, 0},
+    {-1, 7165, 0, 0},
+    {1, 11088, 81, 82},
+    {-1, -15648, 0, 0},
+    {-1, 14132, 0, 0},
+    {5, 14, 84, 87},
+    {5, 41, 85, 86},
+    {-1, 14856, 0, 0},
+    {-1, -11294, 0, 0},
+    {1, 12665, 88, 89},
+    {-1, 6188, 0, 0},
+    {-1, 6247, 0, 0},
+    {5, 48, 91, 98},
+    {1, 11541, 92, 95},
+    {4, 441, 93, 94},
+    {-1, -10417, 0, 0},
+    {-1, -13440, 0, 0},
+    {0, 7083, 96, 97},
+    {-1, 2429, 0, 0},
+    {-1, -11385, 0, 0},
+    {5, 39, 99, 102},
+    {6, 420, 100, 101},
+    {-1, -14987, 0, 0},
+    {-1, -4773, 0, 0},
+    {5, 44, 103, 104},
+    {-1, -2950, 0, 0},
+    {-1, -12360, 0, 0},
+    {3, 386, 106, 113},
+    {2, 951, 107, 110},
+    {2, 554, 108, 109},
+    {-1, -5119, 0, 0},
+    {-1, 10697, 0, 0},
+    {1, 12706, 111, 112},
+    {-1, -2912, 0, 0},
+    {-1, 9289, 0, 0},
+    {4, 219, 114, 117},
+    {6, 1499, 115, 116},
+    {-1, 1735, 0, 0},
+    {-1, -14958, 0, 0},
+    {3, 231, 118, 119},
+    {-1, 4972, 0, 0},
+    {-1, -2722, 0, 0}
+};
+
+const uint16_t fixture_forest_tree_roots[8] = {
+    0, 15, 30, 45, 60, 75, 90, 105
+};
+
+// Score of the model, positive for good quality
+inline int32_t fixture_forest_score(const float features[QUALITY_FEATURE_COUNT]) {
+    int32_t values[7];
+    quantize_quality_features(features, fixture_forest_features, fixture_forest_input_scales, 7, values);
+    return run_quality_trees(fixture_forest_nodes, fixture_forest_tree_roots, 8, values, 0);
+}
+
+const uint8_t fixture_forest_reference_features[7] = {QUALITY_FEATURE_HEARTRATE, QUALITY_FEATURE_SPO2, QUALITY_FEATURE_HR_CHANGE, QUALITY_FEATURE_PERFUSION_INDEX, QUALITY_FEATURE_PPG_AMPLITUDE, QUALITY_FEATURE_ACCEL_ENERGY, QUALITY_FEATURE_BEAT_INTERVAL_CV};
+const int fixture_forest_reference_t0_feature[] = {6, 5, 6, -1, -1, 2, -1, -1, 1, 0, -1, -1, 3, -1, -1};
+const double fixture_forest_reference_t0_threshold[] = {0.05680020055877383, 0.0024110592680338886, 0.3826913512970665, 0.0, 0.0, 4.792901900134499, 0.0, 0.0, 98.78475749299965, 91.27223798467968, 0.0, 0.0, 2.3758388469345832, 0.0, 0.0};
+const int fixture_forest_reference_t0_left[] = {1, 2, 3, -1, -1, 6, -1, -1, 9, 10, -1, -1, 13, -1, -1};
+const int fixture_forest_reference_t0_right[] = {8, 5, 4, -1, -1, 7, -1, -1, 12, 11, -1, -1, 14, -1, -1};
+const double fixture_forest_reference_t0_value[] = {0.0, 0.0, 0.0, -0.3468200571854063, 0.1383519969391287, 0.0, 0.08211141833022217, -0.26108124460724513, 0.0, 0.0, -0.23240071990838762, -0.09300790698390882, 0.0, 0.2302518968761219, -0.039246460349287915};
+const int fixture_forest_reference_t1_feature[] = {0, 5, 5, -1, -1, 6, -1, -1, 0, 1, -1, -1, 3, -1, -1};
+const double fixture_forest_reference_t1_threshold[] = {44.72856583018769, 0.009910123582029175, 0.012768333004763372, 0.0, 0.0, 0.10796216172609407, 0.0, 0.0, 76.46209325432378, 97.60782678421934, 0.0, 0.0, 2.2209399533025285, 0.0, 0.0};
+const int fixture_forest_reference_t1_left[] = {1, 2, 3, -1, -1, 6, -1, -1, 9, 10, -1, -1, 13, -1, -1};
+const int fixture_forest_reference_t1_right[] = {8, 5, 4, -1, -1, 7, -1, -1, 12, 11, -1, -1, 14, -1, -1};
+const double fixture_forest_reference_t1_value[] = {0.0, 0.0, 0.0, 0.4671928622040482, -0.11577919793657232, 0.0, -0.08405641740149594, -0.3917570838051728, 0.0, 0.0, -0.26246105040698353, 0.38294347473406987, 0.0, -0.27512420419199557, -0.315398943705004};
+const int fixture_forest_reference_t2_feature[] = {5, 1, 1, -1, -1, 4, -1, -1, 6, 3, -1, -1, 3, -1, -1};
+const double fixture_forest_reference_t2_threshold[] = {0.02480375052455619, 97.90767026037163, 94.8736827179705, 0.0, 0.0, 604.016269959309, 0.0, 0.0, 0.1524838571889407, 1.283694496142763, 0.0, 0.0, 2.5619662177138522, 0.0, 0.0};
+const int fixture_forest_reference_t2_left[] = {1, 2, 3, -1, -1, 6, -1, -1, 9, 10, -1, -1, 13, -1, -1};
+const int fixture_forest_reference_t2_right[] = {8, 5, 4, -1, -1, 7, -1, -1, 12, 11, -1, -1, 14, -1, -1};
+const double fixture_forest_reference_t2_value[] = {0.0, 0.0, 0.0, 0.3467734830227621, -0.011782241577966812, 0.0, -0.37624354774124424, -0.4237972963491633, 0.0, 0.0, 0.14438483470825614, -0.29085070200652297, 0.0, -0.00968250219974387, -0.4204657244437028};
+const int fixture_forest_reference_t3_feature[] = {5, 0, 2, -1, -1, 6, -1, -1, 5, 2, -1, -1, 5, -1, -1};
+const double fixture_forest_reference_t3_threshold[] = {0.04956004979787894, 97.91814605010806, 1.1624040398553093, 0.0, 0.0, 0.02622970012334741, 0.0, 0.0, 0.018217954562005412, 7.823506901380377, 0.0, 0.0, 0.0006537808593533479, 0.0, 0.0};
+const int fixture_forest_reference_t3_left[] = {1, 2, 3, -1, -1, 6, -1, -1, 9, 10, -1, -1, 13, -1, -1};
+const int fixture_forest_reference_t3_right[] = {8, 5, 4, -1, -1, 7, -1, -1, 12, 11, -1, -1, 14, -1, -1};
+const double fixture_forest_reference_t3_value[] = {0.0, 0.0, 0.0, -0.41949540520975015, -0.0035118182906449524, 0.0, -0.16516407183085058, -0.3285334102821814, 0.0, 0.0, -0.2770328507509673, -0.045883072839127514, 0.0, -0.49978880419101746, -0.16684326980130093};
+const int fixture_forest_reference_t4_feature[] = {4, 0, 5, -1, -1, 4, -1, -1, 6, 4, -1, -1, 2, -1, -1};
+const double fixture_forest_reference_t4_threshold[] = {1253.7584595581382, 61.542909683198125, 0.0011463133194429432, 0.0, 0.0, 1389.8207916679567, 0.0, 0.0, 0.3140160957503432, 1332.355236834741, 0.0, 0.0, 10.275138620769965, 0.0, 0.0};
+const int fixture_forest_reference_t4_left[] = {1, 2, 3, -1, -1, 6, -1, -1, 9, 10, -1, -1, 13, -1, -1};
+const int fixture_forest_reference_t4_right[] = {8, 5, 4, -1, -1, 7, -1, -1, 12, 11, -1, -1, 14, -1, -1};
+const double fixture_forest_reference_t4_value[] = {0.0, 0.0, 0.0, 0.12505058987185025, -0.3526928896745467, 0.0, -0.2774217411365336, 0.003605312026064844, 0.0, 0.0, 0.1384883129953025, 0.24236068087593599, 0.0, 0.11519416878069766, 0.2982496604632079};
+const int fixture_forest_reference_t5_feature[] = {4, 3, 2, -1, -1, 1, -1, -1, 5, 5, -1, -1, 1, -1, -1};
+const double fixture_forest_reference_t5_threshold[] = {1941.4377606880266, 2.94458071185435, 2.734255450096159, 0.0, 0.0, 86.63151914510384, 0.0, 0.0, 0.01433804444873006, 0.040691966802992884, 0.0, 0.0, 98.9454939528828, 0.0, 0.0};
+const int fixture_forest_reference_t5_left[] = {1, 2, 3, -1, -1, 6, -1, -1, 9, 10, -1, -1, 13, -1, -1};
+const int fixture_forest_reference_t5_right[] = {8, 5, 4, -1, -1, 7, -1, -1, 12, 11, -1, -1, 14, -1, -1};
+const double fixture_forest_reference_t5_value[] = {0.0, 0.0, 0.0, -0.03927044013092884, 0.21865415503439822, 0.0, -0.47753797403030895, 0.431277598245565, 0.0, 0.0, 0.45336515528781873, -0.34465436609037814, 0.0, 0.18883891968396826, 0.19062834320618427};
+const int fixture_forest_reference_t6_feature[] = {5, 1, 4, -1, -1, 0, -1, -1, 5, 6, -1, -1, 5, -1, -1};
+const double fixture_forest_reference_t6_threshold[] = {0.04740773654029362, 90.16837718377604, 883.8318437315071, 0.0, 0.0, 110.6746405557725, 0.0, 0.0, 0.03899600921489957, 0.10257616049607005, 0.0, 0.0, 0.04324375219756792, 0.0, 0.0};
+const int fixture_forest_reference_t6_left[] = {1, 2, 3, -1, -1, 6, -1, -1, 9, 10, -1, -1, 13, -1, -1};
+const int fixture_forest_reference_t6_right[] = {8, 5, 4, -1, -1, 7, -1, -1, 12, 11, -1, -1, 14, -1, -1};
+const double fixture_forest_reference_t6_value[] = {0.0, 0.0, 0.0, -0.3179159988867436, -0.4101587574066452, 0.0, 0.07412795834682817, -0.3474473977135871, 0.0, 0.0, -0.4573756772811317, -0.14566681448230134, 0.0, -0.09001286134844899, -0.377199250378349};
+const int fixture_forest_reference_t7_feature[] = {3, 2, 2, -1, -1, 1, -1, -1, 4, 6, -1, -1, 3, -1, -1};
+const double fixture_forest_reference_t7_threshold[] = {3.016514663757749, 14.859572863745269, 8.660839798592537, 0.0, 0.0, 99.27290190573495, 0.0, 0.0, 439.13030562150635, 0.366076747581305, 0.0, 0.0, 1.809397258640603, 0.0, 0.0};
+const int fixture_forest_reference_t7_left[] = {1, 2, 3, -1, -1, 6, -1, -1, 9, 10, -1, -1, 13, -1, -1};
+const int fixture_forest_reference_t7_right[] = {8, 5, 4, -1, -1, 7, -1, -1, 12, 11, -1, -1, 14, -1, -1};
+const double fixture_forest_reference_t7_value[] = {0.0, 0.0, 0.0, -0.15621844535665308, 0.32644652634952964, 0.0, -0.08885946954991819, 0.2834652442838219, 0.0, 0.0, 0.05293398604981314, -0.4564847460643858, 0.0, 0.15172169466841634, -0.08305512938109183};
+const int* const fixture_forest_reference_feature[] = {fixture_forest_reference_t0_feature, fixture_forest_reference_t1_feature, fixture_forest_reference_t2_feature, fixture_forest_reference_t3_feature, fixture_forest_reference_t4_feature, fixture_forest_reference_t5_feature, fixture_forest_reference_t6_feature, fixture_forest_reference_t7_feature};
+const double* const fixture_forest_reference_threshold[] = {fixture_forest_reference_t0_threshold, fixture_forest_reference_t1_threshold, fixture_forest_reference_t2_threshold, fixture_forest_reference_t3_threshold, fixture_forest_reference_t4_threshold, fixture_forest_reference_t5_threshold, fixture_forest_reference_t6_threshold, fixture_forest_reference_t7_threshold};
+const int* const fixture_forest_reference_left[] = {fixture_forest_reference_t0_left, fixture_forest_reference_t1_left, fixture_forest_reference_t2_left, fixture_forest_reference_t3_left, fixture_forest_reference_t4_left, fixture_forest_reference_t5_left, fixture_forest_reference_t6_left, fixture_forest_reference_t7_left};
+const int* const fixture_forest_reference_right[] = {fixture_forest_reference_t0_right, fixture_forest_reference_t1_right, fixture_forest_reference_t2_right, fixture_forest_reference_t3_right, fixture_forest_reference_t4_right, fixture_forest_reference_t5_right, fixture_forest_reference_t6_right, fixture_forest_reference_t7_right};
+const double* const fixture_forest_reference_value[] = {fixture_forest_reference_t0_value, fixture_forest_reference_t1_value, fixture_forest_reference_t2_value, fixture_forest_reference_t3_value, fixture_forest_reference_t4_value, fixture_forest_reference_t5_value, fixture_forest_reference_t6_value, fixture_forest_reference_t7_value};
+const size_t fixture_forest_reference_trees = 8;
+const double fixture_forest_reference_bias = 0.0;
+
+#endif // QUALITY_MODEL_FIXTURES_H
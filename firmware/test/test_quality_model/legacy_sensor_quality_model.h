@@ -0,0 +1,96 @@
+#ifndef LEGACY_SENSOR_QUALITY_MODEL_H
+#define LEGACY_SENSOR_QUALITY_MODEL_H
+
+// Lightweight Sensor Quality Assessment Model
+// The decimal scaled model as generated before the integer kernels, kept to
+// benchmark the generated sensor_quality_model.h against: the divide-based
+// predict_quality(), with the parameters it held
+
+#include <math.h>
+#include <stdint.h>
+
+#include "quality_features.h"
+
+#define NUM_FEATURES 6
+#define SCALE_FACTOR 1000
+
+// Features the model reads, out of the QualityFeatures set
+const uint8_t model_features[NUM_FEATURES] = {
+    QUALITY_FEATURE_HEARTRATE,
+    QUALITY_FEATURE_SPO2,
+    QUALITY_FEATURE_ACCEL_MAG,
+    QUALITY_FEATURE_HR_CHANGE,
+    QUALITY_FEATURE_SPO2_CHANGE,
+    QUALITY_FEATURE_ACCEL_CHANGE
+};
+
+// Quantized model coefficients (scaled by 1000)
+const int16_t model_coefficients[NUM_FEATURES] = {
+    2759, // HeartRate
+    3931, // SpO2
+    169, // Accel_Mag
+    -1874, // HR_Change
+    -2038, // SpO2_Change
+    -4785 // Accel_Change
+};
+
+// Quantized model intercept
+const int16_t model_intercept = 2335;
+
+// Quantized scaler mean values
+const int32_t scaler_mean[NUM_FEATURES] = {
+    -1251, // HeartRate
+    27550, // SpO2
+    992, // Accel_Mag
+    2451, // HR_Change
+    863, // SpO2_Change
+    51 // Accel_Change
+};
+
+// Quantized scaler scale values
+const int32_t scaler_scale[NUM_FEATURES] = {
+    11711, // HeartRate
+    17091, // SpO2
+    111, // Accel_Mag
+    5410, // HR_Change
+    8871, // SpO2_Change
+    127 // Accel_Change
+};
+
+
+// Fast integer-based quality prediction on a QualityFeatures::extract() set
+// Returns: 1 for good quality, 0 for poor quality
+inline int predict_quality(const float features[QUALITY_FEATURE_COUNT]) {
+    int32_t score = model_intercept;
+
+    for (int i = 0; i < NUM_FEATURES; i++) {
+        // Scale the feature: (feature - mean) / scale
+        int64_t centered = (int64_t)(features[model_features[i]] * SCALE_FACTOR) - scaler_mean[i];
+        int32_t scaled_feature = (int32_t)(centered * SCALE_FACTOR / scaler_scale[i]);
+        score += (scaled_feature * model_coefficients[i]) / SCALE_FACTOR;
+    }
+
+    // Apply sigmoid approximation: if score > 0, predict 1, else 0
+    return (score > 0) ? 1 : 0;
+}
+
+// Quality assessment from instantaneous features only, for sketches without
+// the windowed engine: the windowed features read as 0
+inline int assess_sensor_quality(float hr, float spo2, float ax, float ay, float az,
+                                float hr_prev, float spo2_prev, float accel_prev) {
+    float features[QUALITY_FEATURE_COUNT] = {0};
+
+    // Calculate features
+    float accel_mag = sqrt(ax*ax + ay*ay + az*az);
+
+    features[QUALITY_FEATURE_HEARTRATE] = hr;
+    features[QUALITY_FEATURE_SPO2] = spo2;
+    features[QUALITY_FEATURE_ACCEL_MAG] = accel_mag;
+    features[QUALITY_FEATURE_HR_CHANGE] = fabs(hr - hr_prev);
+    features[QUALITY_FEATURE_SPO2_CHANGE] = fabs(spo2 - spo2_prev);
+    features[QUALITY_FEATURE_ACCEL_CHANGE] = fabs(accel_mag - accel_prev);
+
+    return predict_quality(features);
+}
+
+#endif // LEGACY_SENSOR_QUALITY_MODEL_H
@@ -0,0 +1,274 @@
+// Host checks and benchmark for the integer quality model kernels
+// (lib/ml_inference/quality_inference.h and the generated sensor_quality_model.h).
+//
+//   pio test -e native -f test_quality_model -v
+//
+// The shipped model is compared with the float model it was quantized from,
+// next to the decimal scaled predict_quality() it replaces, on the feature
+// sets of the bundled recording (replayed through PulseOximeter and
+// QualityFeatures at the QUALITY mode period) and on a deterministic sweep.
+// fixture_models.h holds an MLP and a tree ensemble generated by
+// quality_model_codegen.py --fixtures, checked against their float references.
+
+#include <Arduino.h>
+#include <Wire.h>
+#include <unity.h>
+
+#include <chrono>
+#include <vector>
+
+#include "MAX30100_PulseOximeter.h"
+#include "quality_features.h"
+#include "sensor_quality_model.h"
+#include "fixture_models.h"
+
+namespace legacy {
+#include "legacy_sensor_quality_model.h"
+}
+
+#include "../test_dsp_chain/recording.h"
+
+#define DEFAULT_RECORDING           "lib/MAX30100lib/extras/recorder/test.out.sample"
+#define ASSESSMENT_PERIOD_MS        500
+#define SWEEP_POINTS                4000
+#define BENCH_RUNS                  20
+
+// The quantized models may only disagree with the float ones right at the
+// decision boundary
+#define MIN_AGREEMENT               0.99
+
+typedef std::chrono::steady_clock Clock;
+typedef int (*PredictFunction)(const float features[QUALITY_FEATURE_COUNT]);
+
+struct FeatureSet {
+    float values[QUALITY_FEATURE_COUNT];
+};
+
+// Keeps the optimizer from dropping results that are otherwise unused
+static volatile int benchSink;
+
+// Deterministic uniform numbers for the sweeps
+static uint32_t sweepState;
+
+static float sweepUniform(float low, float high)
+{
+    sweepState = sweepState * 1664525u + 1013904223u;
+    return low + (high - low) * (sweepState >> 8) / 16777216.0f;
+}
+
+static FeatureSet sweepFeatureSet()
+{
+    FeatureSet set;
+    set.values[QUALITY_FEATURE_HEARTRATE] = sweepUniform(0, 200);
+    set.values[QUALITY_FEATURE_SPO2] = sweepUniform(0, 100);
+    set.values[QUALITY_FEATURE_ACCEL_MAG] = sweepUniform(0, 3);
+    set.values[QUALITY_FEATURE_HR_CHANGE] = sweepUniform(0, 60);
+    set.values[QUALITY_FEATURE_SPO2_CHANGE] = sweepUniform(0, 20);
+    set.values[QUALITY_FEATURE_ACCEL_CHANGE] = sweepUniform(0, 2);
+    set.values[QUALITY_FEATURE_PERFUSION_INDEX] = sweepUniform(0, 10);
+    set.values[QUALITY_FEATURE_PPG_AMPLITUDE] = sweepUniform(0, 3000);
+    set.values[QUALITY_FEATURE_ACCEL_ENERGY] = sweepUniform(0, 0.1f);
+    set.values[QUALITY_FEATURE_BEAT_INTERVAL_CV] = sweepUniform(0, 1);
+    return set;
+}
+
+static std::vector<FeatureSet> sweepFeatureSets(uint32_t seed, size_t count)
+{
+    sweepState = seed;
+    std::vector<FeatureSet> sets(count);
+    for (size_t i = 0; i < count; i++) {
+        sets[i] = sweepFeatureSet();
+    }
+    return sets;
+}
+
+// The QUALITY mode feature sets of a recording, wrist still
+static std::vector<FeatureSet> recordingFeatureSets(const Recording& rec)
+{
+    memset(Wire.registers, 0, sizeof(Wire.registers));
+    Wire.registers[0xff] = EXPECTED_PART_ID;
+    setHostMillis(0);
+
+    MAX30100 sensor;
+    PulseOximeter pox(sensor);
+    TEST_ASSERT_TRUE(pox.begin());
+    QualityFeatures features;
+    std::vector<FeatureSet> sets;
+    uint32_t tsNextAssessment = ASSESSMENT_PERIOD_MS;
+
+    for (size_t i = 0; i < rec.samples.size(); i++) {
+        const RecordedSample& sample = rec.samples[i];
+        setHostMillis(sample.timestamp);
+        pox.processSample({sample.ir, sample.red, sample.timestamp});
+        features.addBeat(pox.getLastBeatTimestamp());
+        features.addSample(sample.ir, 0, 0, 1);
+
+        if (sample.timestamp >= tsNextAssessment) {
+            tsNextAssessment += ASSESSMENT_PERIOD_MS;
+            FeatureSet set;
+            features.extract(pox.getHeartRate(), pox.getSpO2(), set.values);
+            sets.push_back(set);
+        }
+    }
+    return sets;
+}
+
+// The logistic regression the shipped header holds, in double
+static int referencePredict(const float features[QUALITY_FEATURE_COUNT])
+{
+    double score = legacy::model_intercept / 1000.0;
+    for (int i = 0; i < NUM_FEATURES; i++) {
+        double mean = legacy::scaler_mean[i] / 1000.0;
+        double scale = legacy::scaler_scale[i] / 1000.0;
+        score += legacy::model_coefficients[i] / 1000.0 * (features[legacy::model_features[i]] - mean) / scale;
+    }
+    return score > 0 ? 1 : 0;
+}
+
+static double agreement(PredictFunction predict, const std::vector<FeatureSet>& sets)
+{
+    size_t agreed = 0;
+    for (size_t i = 0; i < sets.size(); i++) {
+        agreed += predict(sets[i].values) == referencePredict(sets[i].values);
+    }
+    return sets.empty() ? 1 : (double)agreed / sets.size();
+}
+
+static double nsPerPredict(PredictFunction predict, const std::vector<FeatureSet>& sets)
+{
+    double best = 0;
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        int sum = 0;
+        Clock::time_point start = Clock::now();
+        for (size_t i = 0; i < sets.size(); i++) {
+            sum += predict(sets[i].values);
+        }
+        double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+        benchSink = sum;
+
+        if (run == 0 || ns < best) {
+            best = ns;
+        }
+    }
+    return sets.empty() ? 0 : best / sets.size();
+}
+
+static void printComparison(const char* name, const std::vector<FeatureSet>& sets)
+{
+    printf("\n%s: %zu feature sets\n", name, sets.size());
+    printf("    decimal scaled  %6.1f ns/predict, %.2f %% agreement with float\n",
+            nsPerPredict(legacy::predict_quality, sets), 100 * agreement(legacy::predict_quality, sets));
+    printf("    integer kernel  %6.1f ns/predict, %.2f %% agreement with float\n",
+            nsPerPredict(predict_quality, sets), 100 * agreement(predict_quality, sets));
+}
+
+static double referenceMlpScore(const float features[QUALITY_FEATURE_COUNT])
+{
+    double values[8], next[8];
+    for (size_t i = 0; i < fixture_mlp_reference_sizes[0]; i++) {
+        values[i] = features[fixture_mlp_reference_features[i]];
+    }
+    for (size_t l = 0; l < fixture_mlp_reference_layers; l++) {
+        size_t inputs = fixture_mlp_reference_sizes[l], outputs = fixture_mlp_reference_sizes[l + 1];
+        for (size_t j = 0; j < outputs; j++) {
+            double acc = fixture_mlp_reference_biases[l][j];
+            for (size_t i = 0; i < inputs; i++) {
+                acc += fixture_mlp_reference_weights[l][j * inputs + i] * values[i];
+            }
+            next[j] = l + 1 < fixture_mlp_reference_layers && acc < 0 ? 0 : acc;
+        }
+        memcpy(values, next, outputs * sizeof(double));
+    }
+    return values[0];
+}
+
+static double referenceForestScore(const float features[QUALITY_FEATURE_COUNT])
+{
+    double score = fixture_forest_reference_bias;
+    for (size_t t = 0; t < fixture_forest_reference_trees; t++) {
+        int node = 0;
+        while (fixture_forest_reference_feature[t][node] >= 0) {
+            float x = features[fixture_forest_reference_features[fixture_forest_reference_feature[t][node]]];
+            node = x <= fixture_forest_reference_threshold[t][node] ?
+                    fixture_forest_reference_left[t][node] : fixture_forest_reference_right[t][node];
+        }
+        score += fixture_forest_reference_value[t][node];
+    }
+    return score;
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_inputs_saturate_to_16_bits()
+{
+    float features[QUALITY_FEATURE_COUNT] = {0};
+    features[QUALITY_FEATURE_HEARTRATE] = 1e9f;
+    features[QUALITY_FEATURE_SPO2] = -1e9f;
+    features[QUALITY_FEATURE_ACCEL_MAG] = 1.5f;
+
+    int32_t inputs[3];
+    const uint8_t ids[3] = {QUALITY_FEATURE_HEARTRATE, QUALITY_FEATURE_SPO2, QUALITY_FEATURE_ACCEL_MAG};
+    const float scales[3] = {64.0f, 128.0f, 1024.0f};
+    quantize_quality_features(features, ids, scales, 3, inputs);
+
+    TEST_ASSERT_EQUAL_INT32(QUALITY_INPUT_MAX, inputs[0]);
+    TEST_ASSERT_EQUAL_INT32(-QUALITY_INPUT_MAX, inputs[1]);
+    TEST_ASSERT_EQUAL_INT32(1536, inputs[2]);
+
+    // Full swing inputs stay within the accumulator bound the weights were sized for
+    TEST_ASSERT_TRUE(predict_quality(features) == 0 || predict_quality(features) == 1);
+}
+
+void test_mlp_kernel_matches_float_reference()
+{
+    std::vector<FeatureSet> sets = sweepFeatureSets(1, SWEEP_POINTS);
+    size_t agreed = 0;
+    for (size_t i = 0; i < sets.size(); i++) {
+        agreed += (fixture_mlp_score(sets[i].values) > 0) == (referenceMlpScore(sets[i].values) > 0);
+    }
+    printf("\nMLP 7-8-1: %.2f %% agreement with float\n", 100.0 * agreed / sets.size());
+    TEST_ASSERT_TRUE(agreed >= MIN_AGREEMENT * sets.size());
+}
+
+void test_tree_kernel_matches_float_reference()
+{
+    std::vector<FeatureSet> sets = sweepFeatureSets(2, SWEEP_POINTS);
+    size_t agreed = 0;
+    for (size_t i = 0; i < sets.size(); i++) {
+        agreed += (fixture_forest_score(sets[i].values) > 0) == (referenceForestScore(sets[i].values) > 0);
+    }
+    printf("\nTree ensemble: %.2f %% agreement with float\n", 100.0 * agreed / sets.size());
+    TEST_ASSERT_TRUE(agreed >= MIN_AGREEMENT * sets.size());
+}
+
+void test_shipped_model_against_decimal_scaled()
+{
+    std::vector<FeatureSet> sweep = sweepFeatureSets(3, SWEEP_POINTS);
+    printComparison("Sweep", sweep);
+    TEST_ASSERT_TRUE(agreement(predict_quality, sweep) >= MIN_AGREEMENT);
+    TEST_ASSERT_TRUE(agreement(predict_quality, sweep) >= agreement(legacy::predict_quality, sweep));
+
+    Recording rec;
+    if (!loadRecording(DEFAULT_RECORDING, &rec) || rec.samples.empty()) {
+        TEST_IGNORE_MESSAGE("Bundled recording not found, run from the project directory");
+    }
+    std::vector<FeatureSet> recorded = recordingFeatureSets(rec);
+    printComparison(DEFAULT_RECORDING, recorded);
+    TEST_ASSERT_TRUE(agreement(predict_quality, recorded) >= MIN_AGREEMENT);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_inputs_saturate_to_16_bits);
+    RUN_TEST(test_mlp_kernel_matches_float_reference);
+    RUN_TEST(test_tree_kernel_matches_float_reference);
+    RUN_TEST(test_shipped_model_against_decimal_scaled);
+    return UNITY_END();
+}
@@ -0,0 +1,118 @@
+"""
+Host round trip of the capture path: binary frames decoded by ingest.py,
+written to a .vtrec by recording.py and read back column by column.
+
+    cd firmware && python -m unittest discover -s test -p "test_*.py" -v
+"""
+import os
+import sys
+import tempfile
+import unittest
+from pathlib import Path
+
+sys.path.insert(0, str(Path(__file__).resolve().parent.parent))
+
+import numpy as np
+from binary_protocol import HEADER, FRAME_MAGIC, PROTOCOL_VERSION, MODE_RAW_DATA, RECORDS
+from ingest import StreamIngest, COLUMNS
+from recording import RecordingWriter, Recording, CHUNK_HEADER, SUFFIX
+
+
+def raw_frame(sequence, timestamp, samples):
+    """A RAW_DATA frame of (dt, ir, red, ax, ay, az) records, as the firmware packs it"""
+    record = RECORDS[MODE_RAW_DATA]
+    header = HEADER.pack(FRAME_MAGIC, PROTOCOL_VERSION, MODE_RAW_DATA, record.size, len(samples),
+                         sequence, timestamp)
+    return header + b"".join(record.pack(*sample) for sample in samples)
+
+
+class RecordingRoundTrip(unittest.TestCase):
+
+    def setUp(self):
+        self.dir = tempfile.TemporaryDirectory()
+        self.path = Path(self.dir.name) / ("capture" + SUFFIX)
+
+    def tearDown(self):
+        self.dir.cleanup()
+
+    def test_columns_come_back_across_chunks(self):
+        rng = np.random.default_rng(7)
+        n = 1000
+        timestamps = np.cumsum(rng.integers(9, 12, n)).astype(np.int64) + 4_000_000_000
+        ir = rng.integers(0, 65536, n).astype(np.int64)
+        ax = rng.normal(0, 1, n)
+        labels = np.array(["rest", "light", "firm"], dtype=object)[rng.integers(0, 3, n)]
+
+        columns = [("timestamp", np.int64), ("ir", np.int64), ("ax", np.float64), ("label", "category")]
+        with RecordingWriter(self.path, "FORCE_TEST", columns, sample_rate_hz=100.0, chunk_records=128) as rec:
+            # Uneven appends, so chunks don't line up with them
+            for start in range(0, n, 77):
+                end = min(start + 77, n)
+                rec.append({"timestamp": timestamps[start:end], "ir": ir[start:end],
+                            "ax": ax[start:end], "label": labels[start:end]})
+
+        recording = Recording(self.path)
+        self.assertEqual(len(recording), n)
+        self.assertGreater(len(recording.chunks), 1)
+        self.assertEqual(recording.stream, "FORCE_TEST")
+        self.assertEqual(recording.sample_rate_hz, 100.0)
+        self.assertEqual(recording.columns, ["timestamp", "ir", "ax", "label"])
+        np.testing.assert_array_equal(recording["timestamp"], timestamps)
+        np.testing.assert_array_equal(recording["ir"], ir)
+        np.testing.assert_array_equal(recording["ax"], ax)
+        np.testing.assert_array_equal(recording["label"], labels)
+        recording.close()
+
+    def test_scalars_repeat_over_the_append(self):
+        with RecordingWriter(self.path, "FORCE_TEST", [("fsr", np.int64), ("label", "category")]) as rec:
+            rec.append({"fsr": [1, 2, 3], "label": "hard_press"})
+            rec.append({"fsr": [4], "label": "rest"})
+
+        recording = Recording(self.path)
+        np.testing.assert_array_equal(recording["fsr"], [1, 2, 3, 4])
+        self.assertEqual(list(recording["label"]), ["hard_press"] * 3 + ["rest"])
+        recording.close()
+
+    def test_cut_short_capture_keeps_whole_chunks(self):
+        with RecordingWriter(self.path, "RAW_DATA", [("ir", np.int64)], chunk_records=100) as rec:
+            for start in range(0, 250, 50):
+                rec.append({"ir": np.arange(start, start + 50)})
+        # A crash in the middle of the last chunk
+        size = os.path.getsize(self.path)
+        with open(self.path, "r+b") as f:
+            f.truncate(size - CHUNK_HEADER.size)
+
+        recording = Recording(self.path)
+        self.assertEqual(len(recording), 200)
+        np.testing.assert_array_equal(recording["ir"], np.arange(200))
+        recording.close()
+
+    def test_ingested_frames_round_trip(self):
+        ingest = StreamIngest(capacity=64)
+        frames = [
+            raw_frame(10, 1000, [(0, 50000, 40000, 10, -20, 980), (10, 50010, 40005, 11, -21, 981)]),
+            # Sequence 11 lost on the way
+            raw_frame(12, 1040, [(0, 50100, 40100, 12, -22, 982)]),
+        ]
+        columns = COLUMNS["RAW_DATA"]
+        with RecordingWriter(self.path, "RAW_DATA", columns, chunk_records=2) as rec:
+            for frame in frames:
+                batch = ingest.feed(frame)
+                self.assertEqual(batch.stream, "RAW_DATA")
+                rec.append(batch.columns)
+        self.assertEqual(ingest.lost_frames, 1)
+
+        recording = Recording(self.path)
+        np.testing.assert_array_equal(recording["timestamp"], [1000, 1010, 1040])
+        np.testing.assert_array_equal(recording["ir"], [50000, 50010, 50100])
+        np.testing.assert_array_equal(recording["red"], [40000, 40005, 40100])
+        np.testing.assert_allclose(recording["ax"], [0.010, 0.011, 0.012])
+        np.testing.assert_allclose(recording["az"], [0.980, 0.981, 0.982])
+        # Not in binary raw records: NaN, like the ring
+        self.assertTrue(np.isnan(recording["hr"]).all())
+        np.testing.assert_array_equal(ingest.ring("RAW_DATA").latest()["ir"], recording["ir"])
+        recording.close()
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,329 @@
+// Host checks for the MAX30100 register shadow and reconfiguration, the
+// fast path of the firmware's mode switches (MAX30100::applyConfig() and
+// PulseOximeter::reconfigure()), and for the I2C speed fallback, against
+// the register file of the Wire stand-in. Also the temperature read that runs
+// alongside the sampling.
+//
+//   pio test -e native -f test_sensor_driver -v
+
+#include <Arduino.h>
+#include <Wire.h>
+#include <unity.h>
+
+#include "MAX30100.h"
+#include "MAX30100_PulseOximeter.h"
+
+// The firmware's RAW_DATA configuration and the pulse oximeter's, which
+// only differ in the red LED current
+static const MAX30100Config rawConfig = max30100Config(MAX30100_MODE_SPO2_HR, DEFAULT_SAMPLING_RATE,
+        DEFAULT_PULSE_WIDTH, MAX30100_LED_CURR_24MA, MAX30100_LED_CURR_24MA, MAX30100_IE_ENB_A_FULL);
+
+static bool holds(const MAX30100Config& config)
+{
+    return Wire.registers[MAX30100_REG_MODE_CONFIGURATION] == config.modeConfiguration &&
+           Wire.registers[MAX30100_REG_SPO2_CONFIGURATION] == config.spo2Configuration &&
+           Wire.registers[MAX30100_REG_LED_CONFIGURATION] == config.ledConfiguration &&
+           Wire.registers[MAX30100_REG_INTERRUPT_ENABLE] == config.interruptEnable;
+}
+
+void setUp()
+{
+    // Power-on register state
+    memset(Wire.registers, 0, sizeof(Wire.registers));
+    memset(Wire.selfClearing, 0, sizeof(Wire.selfClearing));
+    Wire.registers[MAX30100_REG_PART_ID] = EXPECTED_PART_ID;
+    Wire.selfClearing[MAX30100_REG_MODE_CONFIGURATION] = MAX30100_MC_RESET;
+    Wire.nack = false;
+    setHostMillis(0);
+}
+
+void tearDown()
+{
+}
+
+void test_apply_config_from_reset_writes_everything()
+{
+    MAX30100 sensor;
+    Wire.writes = 0;
+    TEST_ASSERT_TRUE(sensor.applyConfig(rawConfig));
+    TEST_ASSERT_TRUE(holds(rawConfig));
+    // Four configuration registers, then the three FIFO pointers of the restart
+    TEST_ASSERT_EQUAL(7, Wire.writes);
+}
+
+void test_apply_config_writes_only_differences()
+{
+    MAX30100 sensor;
+    TEST_ASSERT_TRUE(sensor.applyConfig(rawConfig));
+
+    // Same configuration: nothing to write
+    Wire.writes = 0;
+    TEST_ASSERT_TRUE(sensor.applyConfig(rawConfig));
+    TEST_ASSERT_EQUAL(0, Wire.writes);
+
+    // LED current only: sampling goes on, FIFO untouched
+    Wire.registers[MAX30100_REG_FIFO_WRITE_POINTER] = 5;
+    MAX30100Config brighter = rawConfig;
+    brighter.ledConfiguration = MAX30100_LED_CURR_27_1MA << 4 | MAX30100_LED_CURR_24MA;
+    Wire.writes = 0;
+    TEST_ASSERT_TRUE(sensor.applyConfig(brighter));
+    TEST_ASSERT_EQUAL(1, Wire.writes);
+    TEST_ASSERT_TRUE(holds(brighter));
+    TEST_ASSERT_EQUAL(5, Wire.registers[MAX30100_REG_FIFO_WRITE_POINTER]);
+}
+
+void test_apply_config_resumes_shutdown_sensor()
+{
+    MAX30100 sensor;
+    TEST_ASSERT_TRUE(sensor.applyConfig(rawConfig));
+    sensor.shutdown();
+    Wire.registers[MAX30100_REG_FIFO_WRITE_POINTER] = 9;
+
+    // The mode register alone, then the FIFO restarts
+    Wire.writes = 0;
+    TEST_ASSERT_TRUE(sensor.applyConfig(rawConfig));
+    TEST_ASSERT_EQUAL(4, Wire.writes);
+    TEST_ASSERT_TRUE(holds(rawConfig));
+    TEST_ASSERT_EQUAL(0, Wire.registers[MAX30100_REG_FIFO_WRITE_POINTER]);
+}
+
+void test_apply_config_ignores_pending_temperature()
+{
+    MAX30100 sensor;
+    TEST_ASSERT_TRUE(sensor.applyConfig(rawConfig));
+    sensor.startTemperatureSampling();
+
+    Wire.writes = 0;
+    TEST_ASSERT_TRUE(sensor.applyConfig(rawConfig));
+    TEST_ASSERT_EQUAL(0, Wire.writes);
+}
+
+void test_apply_config_fails_without_sensor()
+{
+    MAX30100 sensor;
+    Wire.registers[MAX30100_REG_PART_ID] = 0;
+    Wire.writes = 0;
+    TEST_ASSERT_FALSE(sensor.applyConfig(rawConfig));
+    TEST_ASSERT_EQUAL(0, Wire.writes);
+}
+
+void test_begin_writes_defaults_in_three_transactions()
+{
+    MAX30100 sensor;
+    Wire.transactions = 0;
+    TEST_ASSERT_TRUE(sensor.begin());
+    TEST_ASSERT_TRUE(holds(sensor.getConfig()));
+    TEST_ASSERT_TRUE(holds(max30100Config(DEFAULT_MODE, DEFAULT_SAMPLING_RATE, DEFAULT_PULSE_WIDTH,
+            DEFAULT_IR_LED_CURRENT, DEFAULT_RED_LED_CURRENT, 0)));
+    // Part ID, interrupt enable, LEDs, mode and SpO2 together, FIFO reset, interrupt status
+    TEST_ASSERT_EQUAL(6, Wire.transactions);
+}
+
+void test_setters_are_write_only()
+{
+    MAX30100 sensor;
+    TEST_ASSERT_TRUE(sensor.begin());
+
+    Wire.transactions = 0;
+    Wire.writes = 0;
+    sensor.setSamplingRate(MAX30100_SAMPRATE_50HZ);
+    sensor.setLedsPulseWidth(MAX30100_SPC_PW_800US_15BITS);
+    sensor.setHighresModeEnabled(false);
+    sensor.setLedsCurrent(MAX30100_LED_CURR_11MA, MAX30100_LED_CURR_14_2MA);
+    sensor.shutdown();
+    sensor.resume();
+    TEST_ASSERT_EQUAL(6, Wire.transactions);
+    TEST_ASSERT_EQUAL(6, Wire.writes);
+    TEST_ASSERT_TRUE(holds(sensor.getConfig()));
+    TEST_ASSERT_TRUE(holds(max30100Config(DEFAULT_MODE, MAX30100_SAMPRATE_50HZ, MAX30100_SPC_PW_800US_15BITS,
+            MAX30100_LED_CURR_11MA, MAX30100_LED_CURR_14_2MA, 0, false)));
+}
+
+void test_reset_invalidates_shadow()
+{
+    MAX30100 sensor;
+    TEST_ASSERT_TRUE(sensor.applyConfig(rawConfig));
+    TEST_ASSERT_TRUE(sensor.reset());
+    // What else the chip does on reset, the stand-in doesn't model it
+    memset(Wire.registers, 0, MAX30100_REG_LED_CONFIGURATION + 1);
+
+    Wire.writes = 0;
+    TEST_ASSERT_TRUE(sensor.applyConfig(rawConfig));
+    TEST_ASSERT_EQUAL(7, Wire.writes);
+    TEST_ASSERT_TRUE(holds(rawConfig));
+}
+
+void test_bus_falls_back_to_standard_mode()
+{
+    MAX30100 sensor;
+    TEST_ASSERT_TRUE(sensor.begin());
+    TEST_ASSERT_EQUAL(I2C_BUS_SPEED, Wire.clock);
+
+    // A single glitch doesn't count
+    Wire.nack = true;
+    sensor.getPartId();
+    Wire.nack = false;
+    sensor.getPartId();
+    TEST_ASSERT_EQUAL(I2C_BUS_SPEED, sensor.getBusSpeed());
+
+    Wire.nack = true;
+    for (int i = 0; i < I2C_BUS_ERRORS_TO_FALLBACK; i++) {
+        sensor.getPartId();
+    }
+    TEST_ASSERT_EQUAL(I2C_BUS_SPEED_FALLBACK, sensor.getBusSpeed());
+    TEST_ASSERT_EQUAL(I2C_BUS_SPEED_FALLBACK, Wire.clock);
+    TEST_ASSERT_EQUAL(I2C_BUS_ERRORS_TO_FALLBACK + 1, sensor.getBusErrors());
+    TEST_ASSERT_FALSE(sensor.isBusStalled());
+
+    // Still failing at standard mode: the bus needs clearing
+    for (int i = 0; i < I2C_BUS_ERRORS_STALLED; i++) {
+        sensor.getPartId();
+    }
+    TEST_ASSERT_TRUE(sensor.isBusStalled());
+
+    // Answering again: it stays at standard mode, also across begin()
+    Wire.nack = false;
+    TEST_ASSERT_TRUE(sensor.begin());
+    TEST_ASSERT_FALSE(sensor.isBusStalled());
+    TEST_ASSERT_EQUAL(I2C_BUS_SPEED_FALLBACK, Wire.clock);
+}
+
+void test_apply_config_fails_on_bus_errors()
+{
+    MAX30100 sensor;
+    TEST_ASSERT_TRUE(sensor.applyConfig(rawConfig));
+
+    MAX30100Config brighter = rawConfig;
+    brighter.ledConfiguration = MAX30100_LED_CURR_27_1MA << 4 | MAX30100_LED_CURR_24MA;
+    Wire.nack = true;
+    TEST_ASSERT_FALSE(sensor.applyConfig(brighter));
+    TEST_ASSERT_TRUE(holds(rawConfig));
+
+    // Nothing got through, the next attempt still knows what the chip holds
+    Wire.nack = false;
+    Wire.writes = 0;
+    TEST_ASSERT_TRUE(sensor.applyConfig(brighter));
+    TEST_ASSERT_EQUAL(1, Wire.writes);
+    TEST_ASSERT_TRUE(holds(brighter));
+}
+
+void test_fifo_read_survives_bus_errors()
+{
+    MAX30100 sensor;
+    TEST_ASSERT_TRUE(sensor.applyConfig(rawConfig));
+    Wire.registers[MAX30100_REG_FIFO_WRITE_POINTER] = 4;
+
+    Wire.nack = true;
+    sensor.update();
+    SensorReadout readout;
+    TEST_ASSERT_FALSE(sensor.getReadout(&readout));
+    TEST_ASSERT_EQUAL(0, sensor.getDroppedSamples());
+}
+
+void test_temperature_is_interleaved()
+{
+    MAX30100 sensor;
+    TEST_ASSERT_TRUE(sensor.applyConfig(rawConfig));
+    Wire.registers[MAX30100_REG_FIFO_WRITE_POINTER] = 5;
+
+    // One write that leaves the sampling alone
+    Wire.writes = 0;
+    sensor.startTemperatureSampling();
+    TEST_ASSERT_EQUAL(1, Wire.writes);
+    TEST_ASSERT_EQUAL(rawConfig.modeConfiguration | MAX30100_MC_TEMP_EN,
+            Wire.registers[MAX30100_REG_MODE_CONFIGURATION]);
+    TEST_ASSERT_EQUAL(5, Wire.registers[MAX30100_REG_FIFO_WRITE_POINTER]);
+
+    // -12.25 C, read back in one transaction
+    Wire.registers[MAX30100_REG_TEMPERATURE_DATA_INT] = (uint8_t)-13;
+    Wire.registers[MAX30100_REG_TEMPERATURE_DATA_FRAC] = 12;
+    Wire.transactions = 0;
+    TEST_ASSERT_EQUAL_FLOAT(-12.25f, sensor.retrieveTemperature());
+    TEST_ASSERT_EQUAL(1, Wire.transactions);
+}
+
+void test_pulse_oximeter_takes_over_raw_configuration()
+{
+    MAX30100 sensor;
+    PulseOximeter pox(sensor);
+    TEST_ASSERT_TRUE(sensor.applyConfig(rawConfig));
+
+    // From RAW_DATA at the default rate only the red LED current differs
+    Wire.writes = 0;
+    TEST_ASSERT_TRUE(pox.reconfigure(MAX30100_LED_CURR_24MA, MAX30100_IE_ENB_A_FULL));
+    TEST_ASSERT_EQUAL(PULSEOXIMETER_SAMPLING_RATE == DEFAULT_SAMPLING_RATE ? 1 : 5, Wire.writes);
+    TEST_ASSERT_EQUAL(pox.getRedLedCurrentBias() << 4 | MAX30100_LED_CURR_24MA,
+            Wire.registers[MAX30100_REG_LED_CONFIGURATION]);
+
+    // Between HR_SPO2 and QUALITY: nothing
+    Wire.writes = 0;
+    TEST_ASSERT_TRUE(pox.reconfigure(MAX30100_LED_CURR_24MA, MAX30100_IE_ENB_A_FULL));
+    TEST_ASSERT_EQUAL(0, Wire.writes);
+}
+
+// A sensor whose oscillator runs `ratePercent` of the nominal 100Hz, drained every 50ms
+// for 20s of uptime; returns the worst gap between a drain's newest timestamp and millis()
+static int32_t runDriftingSensor(uint32_t ratePercent)
+{
+    setHostMillis(0);
+    MAX30100 sensor;
+    TEST_ASSERT_TRUE(sensor.applyConfig(rawConfig));
+
+    uint32_t produced = 0;
+    uint32_t previous = 0;
+    bool first = true;
+    int32_t worst = 0;
+    for (uint32_t now = 50; now <= 20000; now += 50) {
+        setHostMillis(now);
+        uint32_t due = now * ratePercent / 1000;
+        Wire.registers[MAX30100_REG_FIFO_WRITE_POINTER] = (uint8_t)(due - produced);
+        Wire.registers[MAX30100_REG_FIFO_READ_POINTER] = 0;
+        produced = due;
+        sensor.update();
+
+        SensorReadout readout;
+        while (sensor.getReadout(&readout)) {
+            if (!first) {
+                TEST_ASSERT_TRUE(readout.timestamp > previous);
+            }
+            first = false;
+            previous = readout.timestamp;
+            int32_t gap = (int32_t)(readout.timestamp - now);
+            if (gap < 0) {
+                gap = -gap;
+            }
+            if (gap > worst) {
+                worst = gap;
+            }
+        }
+    }
+    return worst;
+}
+
+void test_sample_clock_follows_uptime_with_a_drifting_oscillator()
+{
+    // Counted periods alone would be 1s off after 20s at 5% off the nominal rate
+    TEST_ASSERT_TRUE(runDriftingSensor(105) <= 60);
+    TEST_ASSERT_TRUE(runDriftingSensor(95) <= 60);
+    TEST_ASSERT_TRUE(runDriftingSensor(100) <= 60);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_apply_config_from_reset_writes_everything);
+    RUN_TEST(test_apply_config_writes_only_differences);
+    RUN_TEST(test_apply_config_resumes_shutdown_sensor);
+    RUN_TEST(test_apply_config_ignores_pending_temperature);
+    RUN_TEST(test_apply_config_fails_without_sensor);
+    RUN_TEST(test_begin_writes_defaults_in_three_transactions);
+    RUN_TEST(test_setters_are_write_only);
+    RUN_TEST(test_reset_invalidates_shadow);
+    RUN_TEST(test_bus_falls_back_to_standard_mode);
+    RUN_TEST(test_apply_config_fails_on_bus_errors);
+    RUN_TEST(test_fifo_read_survives_bus_errors);
+    RUN_TEST(test_temperature_is_interleaved);
+    RUN_TEST(test_pulse_oximeter_takes_over_raw_configuration);
+    RUN_TEST(test_sample_clock_follows_uptime_with_a_drifting_oscillator);
+    return UNITY_END();
+}
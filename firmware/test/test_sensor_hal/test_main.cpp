@@ -0,0 +1,270 @@
+// Host checks for the sensor abstraction layer (lib/SensorHAL): the sensor
+// registry, the sample bus from the acquisition to the DSP side, and the test
+// procedures that run as stages on it (distance averaging, force labelling).
+//
+//   pio test -e native -f test_sensor_hal -v
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include <string.h>
+
+#include "SensorHAL.h"
+#include "SampleStages.h"
+
+// Stands in for a board sensor: counts its calls, stamps a value
+class CountingSensor : public Sensor {
+public:
+    CountingSensor(const char* name, uint16_t value) : Sensor(name), value(value), polls(0) {}
+
+    void poll(uint32_t now) override
+    {
+        polls++;
+        lastPoll = now;
+    }
+
+    void annotate(SensorSample& sample) override
+    {
+        sample.fsr = sample.fsr * 10 + value;
+    }
+
+    uint16_t value;
+    int polls;
+    uint32_t lastPoll;
+};
+
+// Registered at static initialization, in this order
+static CountingSensor firstSensor("first", 1);
+static CountingSensor secondSensor("second", 2);
+
+// Keeps what it was handed
+class RecordingStage : public SampleStage {
+public:
+    RecordingStage() : count(0), calls(0) {}
+
+    void process(const SensorSample* samples, size_t n) override
+    {
+        for (size_t i = 0; i < n && count < 64; i++) {
+            timestamps[count++] = samples[i].readout.timestamp;
+        }
+        calls++;
+    }
+
+    uint32_t timestamps[64];
+    size_t count;
+    int calls;
+};
+
+static SensorSample sampleAt(uint32_t timestamp, uint16_t ir = 0, uint16_t red = 0)
+{
+    SensorSample sample = {};
+    sample.readout.ir = ir;
+    sample.readout.red = red;
+    sample.readout.timestamp = timestamp;
+    return sample;
+}
+
+void setUp()
+{
+    firstSensor.setEnabled(true);
+    secondSensor.setEnabled(true);
+    firstSensor.polls = secondSensor.polls = 0;
+}
+
+void tearDown()
+{
+}
+
+void test_sensors_register_in_definition_order()
+{
+    TEST_ASSERT_EQUAL_PTR(&firstSensor, Sensor::getFirst());
+    TEST_ASSERT_EQUAL_PTR(&secondSensor, firstSensor.getNext());
+    TEST_ASSERT_NULL(secondSensor.getNext());
+    TEST_ASSERT_EQUAL_PTR(&secondSensor, Sensor::find("second"));
+    TEST_ASSERT_NULL(Sensor::find("third"));
+}
+
+void test_disabled_sensors_are_skipped()
+{
+    SensorSample sample = {};
+    Sensor::pollAll(42);
+    Sensor::annotateAll(sample);
+    TEST_ASSERT_EQUAL(1, firstSensor.polls);
+    TEST_ASSERT_EQUAL(1, secondSensor.polls);
+    TEST_ASSERT_EQUAL_UINT32(42, secondSensor.lastPoll);
+    // Annotated first, then second
+    TEST_ASSERT_EQUAL_UINT16(12, sample.fsr);
+
+    firstSensor.setEnabled(false);
+    sample = SensorSample();
+    Sensor::pollAll(43);
+    Sensor::annotateAll(sample);
+    TEST_ASSERT_EQUAL(1, firstSensor.polls);
+    TEST_ASSERT_EQUAL(2, secondSensor.polls);
+    TEST_ASSERT_EQUAL_UINT16(2, sample.fsr);
+}
+
+void test_bus_hands_every_span_to_every_stage()
+{
+    SampleBus<8> bus;
+    RecordingStage first, second;
+    TEST_ASSERT_TRUE(bus.attach(&first));
+    TEST_ASSERT_TRUE(bus.attach(&second));
+
+    // Past the end of the ring: the second dispatch sees two spans
+    for (uint32_t t = 0; t < 6; t++) {
+        TEST_ASSERT_TRUE(bus.publish(sampleAt(t)));
+    }
+    TEST_ASSERT_EQUAL(6, bus.dispatch());
+    for (uint32_t t = 6; t < 12; t++) {
+        TEST_ASSERT_TRUE(bus.publish(sampleAt(t)));
+    }
+    TEST_ASSERT_EQUAL(6, bus.dispatch());
+    TEST_ASSERT_EQUAL(0, bus.dispatch());
+
+    TEST_ASSERT_EQUAL(12, first.count);
+    TEST_ASSERT_EQUAL(12, second.count);
+    TEST_ASSERT_EQUAL(3, first.calls);
+    for (uint32_t t = 0; t < 12; t++) {
+        TEST_ASSERT_EQUAL_UINT32(t, first.timestamps[t]);
+        TEST_ASSERT_EQUAL_UINT32(t, second.timestamps[t]);
+    }
+}
+
+void test_bus_counts_what_it_cannot_hold()
+{
+    SampleBus<4> bus;
+    RecordingStage stage;
+    bus.attach(&stage);
+
+    for (uint32_t t = 0; t < 6; t++) {
+        bus.publish(sampleAt(t));
+    }
+    TEST_ASSERT_EQUAL_UINT32(2, bus.getDropped());
+    TEST_ASSERT_EQUAL(4, bus.dispatch());
+    TEST_ASSERT_EQUAL_UINT32(3, stage.timestamps[3]);
+
+    bus.publish(sampleAt(10));
+    bus.clear();
+    TEST_ASSERT_EQUAL(0, bus.dispatch());
+}
+
+void test_bus_refuses_stages_past_the_limit()
+{
+    SampleBus<4> bus;
+    RecordingStage stage;
+    for (int i = 0; i < SAMPLE_BUS_MAX_STAGES; i++) {
+        TEST_ASSERT_TRUE(bus.attach(&stage));
+    }
+    TEST_ASSERT_FALSE(bus.attach(&stage));
+}
+
+void test_averaging_stage_averages_since_start()
+{
+    AveragingStage averaging(3);
+    SensorSample samples[4] = {sampleAt(0, 1000, 2000), sampleAt(10, 1001, 2002),
+                               sampleAt(20, 1002, 2004), sampleAt(30, 1003, 2006)};
+
+    // Stopped: nothing counted, no average
+    averaging.process(samples, 4);
+    TEST_ASSERT_EQUAL_UINT16(0, averaging.getSampleCount());
+    TEST_ASSERT_EQUAL_STRING("none", averaging.getLed());
+    TEST_ASSERT_FALSE(averaging.nextReport());
+
+    averaging.start("ir", 25);
+    averaging.process(samples, 4);
+    TEST_ASSERT_TRUE(averaging.isCollecting());
+    TEST_ASSERT_EQUAL_STRING("ir", averaging.getLed());
+    TEST_ASSERT_EQUAL(25, averaging.getDistance());
+    TEST_ASSERT_EQUAL_UINT16(4, averaging.getSampleCount());
+    TEST_ASSERT_FLOAT_WITHIN(0.001, 1001.5, averaging.getAverageIr());
+    TEST_ASSERT_FLOAT_WITHIN(0.001, 2003, averaging.getAverageRed());
+
+    // Every third report carries it
+    TEST_ASSERT_FALSE(averaging.nextReport());
+    TEST_ASSERT_FALSE(averaging.nextReport());
+    TEST_ASSERT_TRUE(averaging.nextReport());
+    TEST_ASSERT_TRUE(averaging.isAverageDue());
+    TEST_ASSERT_FALSE(averaging.nextReport());
+
+    // A new START starts over
+    averaging.start("red_led_long", 10);
+    TEST_ASSERT_EQUAL_STRING("red_led", averaging.getLed());
+    TEST_ASSERT_EQUAL_UINT16(0, averaging.getSampleCount());
+    TEST_ASSERT_EQUAL_UINT32(0, averaging.getIrSum());
+}
+
+void test_averaging_stage_holds_past_16_bits_of_samples()
+{
+    AveragingStage averaging(3);
+    averaging.start("ir", 25);
+
+    // Over 11 minutes at 100 Hz of near full scale readings: past a 16-bit
+    // count and a 32-bit sum
+    SensorSample samples[100];
+    for (int i = 0; i < 100; i++) {
+        samples[i] = sampleAt(10 * i, i % 2 ? 65001 : 64999, 60000);
+    }
+    for (int batch = 0; batch < 700; batch++) {
+        averaging.process(samples, 100);
+    }
+
+    TEST_ASSERT_EQUAL_UINT32(70000, averaging.getSampleCount());
+    TEST_ASSERT_TRUE(averaging.getIrSum() > UINT32_MAX);
+    TEST_ASSERT_TRUE(averaging.getIrSum() == 65000ull * 70000);
+    TEST_ASSERT_FLOAT_WITHIN(0.01, 65000, averaging.getAverageIr());
+    TEST_ASSERT_FLOAT_WITHIN(0.01, 60000, averaging.getAverageRed());
+}
+
+void test_labeling_stage_closes_window_on_sample_time()
+{
+    LabelingStage labeling(100);
+    TEST_ASSERT_EQUAL_STRING("waiting", labeling.getLabel());
+
+    labeling.start("light_press", 1000);
+    TEST_ASSERT_TRUE(labeling.isCollecting());
+    TEST_ASSERT_EQUAL_STRING("light_press", labeling.getLabel());
+
+    // Queued before LABEL:, then 10 samples in the window, then the one that closes it
+    SensorSample samples[13];
+    samples[0] = sampleAt(990);
+    for (int i = 0; i < 12; i++) {
+        samples[i + 1] = sampleAt(1000 + 10 * i);
+    }
+    labeling.process(samples, 6);
+    TEST_ASSERT_TRUE(labeling.isCollecting());
+    TEST_ASSERT_FALSE(labeling.takeFinished());
+    labeling.process(samples + 6, 7);
+
+    TEST_ASSERT_FALSE(labeling.isCollecting());
+    TEST_ASSERT_EQUAL_STRING("waiting", labeling.getLabel());
+    TEST_ASSERT_EQUAL_UINT32(10, labeling.getSampleCount());
+    TEST_ASSERT_TRUE(labeling.takeFinished());
+    TEST_ASSERT_FALSE(labeling.takeFinished());
+}
+
+void test_labeling_stage_stop_is_not_a_finish()
+{
+    LabelingStage labeling(100);
+    labeling.start("hard_press", 0);
+    labeling.stop();
+    SensorSample sample = sampleAt(200);
+    labeling.process(&sample, 1);
+    TEST_ASSERT_FALSE(labeling.takeFinished());
+    TEST_ASSERT_EQUAL_STRING("waiting", labeling.getLabel());
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_sensors_register_in_definition_order);
+    RUN_TEST(test_disabled_sensors_are_skipped);
+    RUN_TEST(test_bus_hands_every_span_to_every_stage);
+    RUN_TEST(test_bus_counts_what_it_cannot_hold);
+    RUN_TEST(test_bus_refuses_stages_past_the_limit);
+    RUN_TEST(test_averaging_stage_averages_since_start);
+    RUN_TEST(test_averaging_stage_holds_past_16_bits_of_samples);
+    RUN_TEST(test_labeling_stage_closes_window_on_sample_time);
+    RUN_TEST(test_labeling_stage_stop_is_not_a_finish);
+    return UNITY_END();
+}
@@ -0,0 +1,190 @@
+// Host checks for the lock-free ring every queue of the firmware is built on
+// (the sample bus, the control command queue, the flash log pending pages):
+// the free-running counters across their 32-bit wrap, the full and empty
+// boundaries, and the span API across the end of the storage.
+//
+//   pio test -e native -f test_spsc_buffer -v
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include "SPSCBuffer.h"
+
+// Counters a few elements short of the 32-bit wrap; with 8 slots the first
+// element lands in slot 3, so the storage end comes before the counter wrap
+static const uint32_t NEAR_WRAP = 0xFFFFFFFBu;
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_push_pop_across_counter_wrap()
+{
+    SPSCBuffer<uint32_t, 8> ring(NEAR_WRAP);
+
+    uint32_t next = 0;
+    uint32_t expected = 0;
+    // 3 in flight at a time: head and tail both wrap, head first
+    for (int i = 0; i < 3; i++) {
+        TEST_ASSERT_TRUE(ring.push(next++));
+    }
+    for (int i = 0; i < 40; i++) {
+        TEST_ASSERT_TRUE(ring.push(next++));
+        TEST_ASSERT_EQUAL_UINT32(4, ring.size());
+        uint32_t value;
+        TEST_ASSERT_TRUE(ring.pop(&value));
+        TEST_ASSERT_EQUAL_UINT32(expected++, value);
+        TEST_ASSERT_EQUAL_UINT32(3, ring.size());
+    }
+}
+
+void test_full_and_empty_boundaries_across_counter_wrap()
+{
+    SPSCBuffer<uint32_t, 8> ring(NEAR_WRAP);
+    TEST_ASSERT_TRUE(ring.isEmpty());
+    TEST_ASSERT_EQUAL_UINT32(8, ring.available());
+
+    uint32_t value;
+    TEST_ASSERT_FALSE(ring.pop(&value));
+
+    for (uint32_t i = 0; i < 8; i++) {
+        TEST_ASSERT_TRUE(ring.push(i));
+    }
+    // Head has wrapped past zero, tail hasn't: still exactly full
+    TEST_ASSERT_TRUE(ring.isFull());
+    TEST_ASSERT_EQUAL_UINT32(8, ring.size());
+    TEST_ASSERT_EQUAL_UINT32(0, ring.available());
+    TEST_ASSERT_FALSE(ring.push(99));
+
+    for (uint32_t i = 0; i < 8; i++) {
+        TEST_ASSERT_TRUE(ring.pop(&value));
+        TEST_ASSERT_EQUAL_UINT32(i, value);
+    }
+    TEST_ASSERT_TRUE(ring.isEmpty());
+    TEST_ASSERT_FALSE(ring.pop(&value));
+}
+
+void test_bulk_push_and_pop_stop_at_the_boundaries()
+{
+    SPSCBuffer<uint32_t, 8> ring(NEAR_WRAP);
+    uint32_t values[12];
+    for (uint32_t i = 0; i < 12; i++) {
+        values[i] = 100 + i;
+    }
+
+    TEST_ASSERT_EQUAL(5, ring.push(values, 5));
+    // Only three slots left of the eight
+    TEST_ASSERT_EQUAL(3, ring.push(values + 5, 7));
+    TEST_ASSERT_TRUE(ring.isFull());
+
+    uint32_t out[12] = {};
+    TEST_ASSERT_EQUAL(8, ring.pop(out, 12));
+    for (uint32_t i = 0; i < 8; i++) {
+        TEST_ASSERT_EQUAL_UINT32(100 + i, out[i]);
+    }
+    TEST_ASSERT_EQUAL(0, ring.pop(out, 12));
+}
+
+void test_pop_span_stops_at_the_storage_end()
+{
+    SPSCBuffer<uint32_t, 8> ring(NEAR_WRAP);
+    for (uint32_t i = 0; i < 6; i++) {
+        TEST_ASSERT_TRUE(ring.push(i));
+    }
+
+    // Slots 3..7, then slot 0
+    const uint32_t* span;
+    size_t count = ring.popSpan(&span);
+    TEST_ASSERT_EQUAL(5, count);
+    for (uint32_t i = 0; i < count; i++) {
+        TEST_ASSERT_EQUAL_UINT32(i, span[i]);
+    }
+    // Nothing is released before commitPop()
+    TEST_ASSERT_EQUAL_UINT32(6, ring.size());
+    ring.commitPop(count);
+
+    const uint32_t* wrapped;
+    TEST_ASSERT_EQUAL(1, ring.popSpan(&wrapped));
+    TEST_ASSERT_EQUAL_UINT32(5, wrapped[0]);
+    TEST_ASSERT_TRUE(wrapped < span);
+    ring.commitPop(1);
+
+    TEST_ASSERT_EQUAL(0, ring.popSpan(&span));
+    TEST_ASSERT_TRUE(ring.isEmpty());
+}
+
+void test_push_span_stops_at_the_storage_end()
+{
+    SPSCBuffer<uint32_t, 8> ring(NEAR_WRAP);
+
+    uint32_t* span;
+    size_t count = ring.pushSpan(&span);
+    TEST_ASSERT_EQUAL(5, count);
+    for (uint32_t i = 0; i < count; i++) {
+        span[i] = i;
+    }
+    // Invisible to the consumer before commitPush()
+    TEST_ASSERT_TRUE(ring.isEmpty());
+    ring.commitPush(count);
+
+    TEST_ASSERT_EQUAL(3, ring.pushSpan(&span));
+    span[0] = 5;
+    ring.commitPush(1);
+
+    uint32_t value;
+    for (uint32_t i = 0; i < 6; i++) {
+        TEST_ASSERT_TRUE(ring.pop(&value));
+        TEST_ASSERT_EQUAL_UINT32(i, value);
+    }
+}
+
+void test_span_limited_by_queue_before_storage_end()
+{
+    SPSCBuffer<uint32_t, 8> ring(NEAR_WRAP);
+    TEST_ASSERT_TRUE(ring.push(7));
+    TEST_ASSERT_TRUE(ring.push(8));
+
+    const uint32_t* span;
+    TEST_ASSERT_EQUAL(2, ring.popSpan(&span));
+    ring.commitPop(2);
+
+    // Full except the slot under the tail: the free span is bounded by the tail, not the end
+    for (uint32_t i = 0; i < 7; i++) {
+        TEST_ASSERT_TRUE(ring.push(i));
+    }
+    uint32_t* free;
+    TEST_ASSERT_EQUAL(1, ring.pushSpan(&free));
+}
+
+void test_clear_drops_across_counter_wrap()
+{
+    SPSCBuffer<uint32_t, 8> ring(NEAR_WRAP);
+    for (uint32_t i = 0; i < 7; i++) {
+        TEST_ASSERT_TRUE(ring.push(i));
+    }
+    ring.clear();
+    TEST_ASSERT_TRUE(ring.isEmpty());
+    TEST_ASSERT_EQUAL_UINT32(8, ring.available());
+
+    TEST_ASSERT_TRUE(ring.push(42));
+    uint32_t value;
+    TEST_ASSERT_TRUE(ring.pop(&value));
+    TEST_ASSERT_EQUAL_UINT32(42, value);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_push_pop_across_counter_wrap);
+    RUN_TEST(test_full_and_empty_boundaries_across_counter_wrap);
+    RUN_TEST(test_bulk_push_and_pop_stop_at_the_boundaries);
+    RUN_TEST(test_pop_span_stops_at_the_storage_end);
+    RUN_TEST(test_push_span_stops_at_the_storage_end);
+    RUN_TEST(test_span_limited_by_queue_before_storage_end);
+    RUN_TEST(test_clear_drops_across_counter_wrap);
+    return UNITY_END();
+}
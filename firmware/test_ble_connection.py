@@ -32,7 +32,8 @@ class ESP32Tester:
         
         for device in devices:
             print(f"Found: {device.name} ({device.address})")
-            if device.name == DEVICE_NAME:
+            # Boards advertise DEVICE_NAME_<last 3 MAC bytes>
+            if device.name and device.name.startswith(DEVICE_NAME):
                 target_device = device
                 break
                 
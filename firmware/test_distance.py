@@ -6,7 +6,7 @@ import time
 from bleak import BleakScanner, BleakClient
 
 # === Settings ===
-DEVICE_NAME = "ESP32_Distance_Test"
+DEVICE_NAME = "ESP32_Unified_Sensor"     # any board, the name ends with its MAC
 CSV_FILENAME = f"distance_test_{datetime.datetime.now().strftime('%Y%m%d_%H%M%S')}.csv"
 
 # === BLE UUIDs ===
@@ -32,6 +32,9 @@ async def main():
 
     async with BleakClient(target.address) as client:
         await client.start_notify(RAW_DATA_CHAR_UUID, lambda _, data: handle_data(data))
+        # A reading every 100ms, an average every 10 readings
+        await send_control(client, "MODE:DISTANCE_TEST")
+        await send_control(client, "RATE:DISTANCE:10")
 
         while True:
             try:
@@ -55,7 +58,7 @@ def handle_data(data):
             print(f"📊 {msg['led']} @ {msg['distance_mm']}mm => IR: {msg['avg_ir']:.2f}, Red: {msg['avg_red']:.2f}")
             csv_writer.writerow([ts, msg['led'], msg['distance_mm'], '', '', msg['avg_ir'], msg['avg_red'], msg['samples']])
         else:
-            csv_writer.writerow([ts, msg['led'], msg.get('distance_mm', ''), msg['ir'], msg['red'], '', '', msg['samples']])
+            csv_writer.writerow([ts, msg['led'], msg.get('distance_mm', ''), msg['ir'], msg['red'], '', '', msg.get('samples', 1)])
     except Exception as e:
         print("❌ Data error:", e)
 
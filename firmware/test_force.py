@@ -1,12 +1,14 @@
 import asyncio
-import csv
 import datetime
 import json
+import time
+import numpy as np
 from bleak import BleakScanner, BleakClient
+from recording import RecordingWriter, CATEGORY, SUFFIX
 
 # === Settings ===
-DEVICE_NAME = "ESP32_FSR_Collector"
-CSV_FILENAME = f"fsr_data_{datetime.datetime.now().strftime('%Y%m%d_%H%M%S')}.csv"
+DEVICE_NAME = "ESP32_Unified_Sensor"     # any board, the name ends with its MAC
+RECORDING_FILENAME = f"fsr_data_{datetime.datetime.now().strftime('%Y%m%d_%H%M%S')}{SUFFIX}"
 
 # === BLE UUIDs ===
 SERVICE_UUID = "12345678-1234-5678-1234-56789abcdef0"
@@ -14,40 +16,45 @@ RAW_DATA_CHAR_UUID = "abcdefab-1234-5678-1234-56789abcdef1"
 CONTROL_CHAR_UUID = "abcdefab-1234-5678-1234-56789abcdef2"
 
 # === Global variables ===
-csv_file = None
-csv_writer = None
+recording = None
 data_count = 0
 
-def setup_csv():
-    """Initialize CSV file"""
-    global csv_file, csv_writer
-    csv_file = open(CSV_FILENAME, mode='w', newline='')
-    csv_writer = csv.writer(csv_file)
-    csv_writer.writerow(["Timestamp", "IR", "Red", "FSR", "Label", "Device_Timestamp"])
+def setup_recording():
+    """Initialize the recording, Timestamp being host time in ms"""
+    global recording
+    recording = RecordingWriter(RECORDING_FILENAME, "FORCE_TEST",
+                                [("Timestamp", np.int64), ("IR", np.int64), ("Red", np.int64),
+                                 ("FSR", np.int64), ("Label", CATEGORY), ("Device_Timestamp", np.int64)],
+                                time_columns={"Timestamp": "ms"})
+
+def close_recording():
+    global recording
+    if recording:
+        recording.close()
+        recording = None
 
 def handle_data(data):
     """Handle incoming BLE data"""
     global data_count
     try:
         msg = json.loads(data.decode())
-        ts = datetime.datetime.now().isoformat()
+        if not msg.get('collecting', True):
+            return      # between labels
         
-        # Write to CSV
-        csv_writer.writerow([
-            ts, 
-            msg['ir'], 
-            msg['red'], 
-            msg['fsr'], 
-            msg['label'],
-            msg['timestamp']
-        ])
+        # Buffered, written a chunk at a time
+        recording.append({
+            "Timestamp": int(time.time() * 1000),
+            "IR": msg['ir'],
+            "Red": msg['red'],
+            "FSR": msg['fsr'],
+            "Label": msg['label'],
+            "Device_Timestamp": msg['timestamp']
+        })
         
         data_count += 1
         if data_count % 10 == 0:  # Show progress every 10 samples
             print(f"📊 [{msg['label']}] Samples: {data_count}, IR:{msg['ir']}, Red:{msg['red']}, FSR:{msg['fsr']}")
         
-        csv_file.flush()
-        
     except Exception as e:
         print(f"❌ Data error: {e}")
 
@@ -78,8 +85,8 @@ async def main():
 
     print(f"✅ Found: {target.name}")
     
-    # Setup CSV
-    setup_csv()
+    # Setup recording
+    setup_recording()
     
     try:
         async with BleakClient(target.address) as client:
@@ -87,6 +94,9 @@ async def main():
             
             # Start notifications
             await client.start_notify(RAW_DATA_CHAR_UUID, lambda _, data: handle_data(data))
+            # FORCE_TEST reports at 10Hz
+            for command in ("MODE:FORCE_TEST", "RATE:FORCE:10"):
+                await client.write_gatt_char(CONTROL_CHAR_UUID, command.encode())
             
             print("\n=== Simple Data Collection ===")
             print("Enter labels one by one. Each label collects data for 10 seconds.")
@@ -108,9 +118,8 @@ async def main():
     except Exception as e:
         print(f"❌ Connection error: {e}")
     finally:
-        if csv_file:
-            csv_file.close()
-        print(f"📄 Data saved to: {CSV_FILENAME}")
+        close_recording()
+        print(f"📄 Data saved to: {RECORDING_FILENAME}")
 
 if __name__ == "__main__":
     try:
@@ -118,6 +127,5 @@ if __name__ == "__main__":
     except KeyboardInterrupt:
         print("\n🛑 Program terminated")
     finally:
-        if csv_file:
-            csv_file.close()
-        print(f"📄 Final save: {CSV_FILENAME}")
+        close_recording()
+        print(f"📄 Final save: {RECORDING_FILENAME}")
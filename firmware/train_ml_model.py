@@ -1,246 +1,267 @@
+import argparse
 import pandas as pd
 import numpy as np
 import matplotlib.pyplot as plt
-from sklearn.ensemble import RandomForestClassifier
+from sklearn.ensemble import GradientBoostingClassifier, RandomForestClassifier
 from sklearn.linear_model import LogisticRegression
+from sklearn.neural_network import MLPClassifier
 from sklearn.preprocessing import StandardScaler
 from sklearn.model_selection import train_test_split
 from sklearn.metrics import classification_report, accuracy_score
 import joblib
 import struct
 
+import quality_model_codegen as codegen
+from recording import read_table, glob_recordings
+from quality_features import FEATURE_NAMES, replay_features
+
+# Features the model is trained on, out of the firmware's QualityFeatures set
+MODEL_FEATURES = [
+    'HeartRate', 'SpO2', 'HR_Change',
+    'Perfusion_Index', 'PPG_Amplitude', 'Accel_Energy', 'Beat_Interval_CV'
+]
+
+# Host-side labels from record_ml_model.py win over the threshold rules
+GOOD_LABELS = {'good', 'clean', 'still', 'rest'}
+DIRTY_LABELS = {'bad', 'dirty', 'motion', 'moving', 'noise'}
+
+ASSESSMENT_PERIOD_MS = 500  # the QUALITY mode reporting period
+
+# Model families the integer kernels run, all small enough for a few us per assessment
+MODEL_KINDS = {
+    'logistic': "logistic regression",
+    'mlp': "MLP, one hidden layer of 8 ReLU",
+    'forest': "random forest, 8 trees of depth 4",
+    'boosting': "gradient boosting, 16 trees of depth 3",
+}
+
 class LightweightQualityTrainer:
-    def __init__(self, csv_file='oximeter_data.csv'):
-        self.csv_file = csv_file
+    def __init__(self, csv_files, output='lib/ml_inference/sensor_quality_model.h', kind='logistic'):
+        self.csv_files = csv_files
+        self.output = output
+        self.kind = kind
         self.df = None
         self.scaler = StandardScaler()
         self.model = None
         self.feature_names = []
-        
+
+    def load_recording(self, csv_file):
+        """Load one RAW_DATA capture as (timestamp_ms, ir, red, ax, ay, az, label) rows"""
+        raw = read_table(csv_file)
+        raw.columns = [c.strip().lower() for c in raw.columns]
+
+        if 'ir' not in raw or 'red' not in raw:
+            print(f"⚠️ {csv_file}: no IR/Red columns, skipped (needs a RAW_DATA capture)")
+            return None
+
+        # Device timestamps are the sample times, the host ones only tell when a frame arrived
+        if 'device_timestamp' in raw:
+            timestamps = raw['device_timestamp'].astype(np.int64)
+        else:
+            timestamps = raw['timestamp'].astype(np.int64)
+
+        # Without an accelerometer the wrist reads as still
+        ax = raw['ax'] if 'ax' in raw else pd.Series(0.0, index=raw.index)
+        ay = raw['ay'] if 'ay' in raw else pd.Series(0.0, index=raw.index)
+        az = raw['az'] if 'az' in raw else pd.Series(1.0, index=raw.index)
+        labels = raw['label'].astype(str).str.lower() if 'label' in raw else pd.Series('unlabeled', index=raw.index)
+
+        return zip(timestamps, raw['ir'], raw['red'], ax, ay, az, labels)
+
     def load_and_preprocess_data(self):
-        """Load and preprocess oximeter data"""
-        print("📊 Loading oximeter data...")
-        self.df = pd.read_csv(self.csv_file)
-        
-        # Convert timestamp
-        self.df['Timestamp'] = pd.to_datetime(self.df['Timestamp'])
-        
-        # Calculate time differences
-        self.df['TimeDiff'] = self.df['Timestamp'].diff().dt.total_seconds()
-        
-        print(f"✅ Loaded {len(self.df)} samples")
-        
+        """Replay raw recordings through the firmware's DSP chain and feature engine"""
+        print("📊 Replaying raw recordings...")
+        rows = []
+
+        for csv_file in self.csv_files:
+            samples = self.load_recording(csv_file)
+            if samples is None:
+                continue
+
+            count = 0
+            for timestamp, features, label in replay_features(samples, ASSESSMENT_PERIOD_MS):
+                features['Timestamp'] = timestamp
+                features['Label'] = label
+                features['Recording'] = csv_file
+                rows.append(features)
+                count += 1
+            print(f"   {csv_file}: {count} assessments")
+
+        if not rows:
+            raise SystemExit("❌ No replayable recording, record some with record_ml_model.py in raw mode")
+
+        self.df = pd.DataFrame(rows)
+        print(f"✅ Loaded {len(self.df)} assessments")
+
     def engineer_lightweight_features(self):
-        """Engineer minimal but effective features"""
-        print("🔧 Engineering lightweight features...")
-        
-        # Simple rolling statistics (window=3 for minimal memory)
-        window = 3
-        
-        # Heart Rate Features
-        self.df['HR_Prev'] = self.df['HeartRate'].shift(1)
-        self.df['HR_Change'] = np.abs(self.df['HeartRate'] - self.df['HR_Prev'])
-        self.df['HR_Mean3'] = self.df['HeartRate'].rolling(window).mean()
-        self.df['HR_Std3'] = self.df['HeartRate'].rolling(window).std()
-        
-        # SpO2 Features  
-        self.df['SpO2_Prev'] = self.df['SpO2'].shift(1)
-        self.df['SpO2_Change'] = np.abs(self.df['SpO2'] - self.df['SpO2_Prev'])
-        
-        # Accelerometer Features
-        self.df['Accel_Mag'] = np.sqrt(self.df['Ax']**2 + self.df['Ay']**2 + self.df['Az']**2)
-        self.df['Accel_Prev'] = self.df['Accel_Mag'].shift(1)
-        self.df['Accel_Change'] = np.abs(self.df['Accel_Mag'] - self.df['Accel_Prev'])
-        
-        # Drop NaN values
-        self.df = self.df.dropna()
-        
-        print(f"✅ Features engineered. {len(self.df)} samples remaining.")
-        
+        """Drop the warm-up assessments, the windows aren't full yet"""
+        print("🔧 Windowed features computed during the replay...")
+
+        # No beat rate yet: the filters and windows are still settling
+        self.df = self.df[self.df['HeartRate'] > 0].reset_index(drop=True)
+
+        print(f"✅ Features ready. {len(self.df)} assessments remaining.")
+
     def create_quality_labels(self):
-        """Create quality labels with simple thresholds"""
+        """Create quality labels from the recorded labels, thresholds otherwise"""
         print("🏷️ Creating quality labels...")
-        
+
         # Define thresholds for dirty data
         dirty_conditions = (
             (self.df['HR_Change'] > 15) |  # Sudden HR changes > 15 BPM
             (self.df['SpO2_Change'] > 3) |  # Sudden SpO2 changes > 3%
             (self.df['HeartRate'] < 40) | (self.df['HeartRate'] > 180) |  # Implausible HR
             (self.df['SpO2'] < 80) | (self.df['SpO2'] > 100) |  # Implausible SpO2
-            (self.df['Accel_Change'] > 0.2)  # High motion
+            (self.df['Accel_Energy'] > 0.01) |  # Motion, 0.1g of magnitude swing over the window
+            (self.df['Beat_Interval_CV'] > 0.2)  # Beats far from regular
         )
-        
-        self.df['Quality_Label'] = (~dirty_conditions).astype(int)
-        
+
+        labels = (~dirty_conditions).astype(int)
+        labels[self.df['Label'].isin(GOOD_LABELS)] = 1
+        labels[self.df['Label'].isin(DIRTY_LABELS)] = 0
+        self.df['Quality_Label'] = labels
+
+        manual = self.df['Label'].isin(GOOD_LABELS | DIRTY_LABELS).sum()
         good_samples = self.df['Quality_Label'].sum()
         dirty_samples = len(self.df) - good_samples
-        
+
         print(f"📊 Quality Distribution:")
         print(f"   Good samples: {good_samples} ({good_samples/len(self.df)*100:.1f}%)")
         print(f"   Dirty samples: {dirty_samples} ({dirty_samples/len(self.df)*100:.1f}%)")
-        
+        print(f"   From recorded labels: {manual}")
+
+    def make_model(self):
+        if self.kind == 'mlp':
+            return MLPClassifier(hidden_layer_sizes=(8,), activation='relu', max_iter=2000, random_state=42)
+        if self.kind == 'forest':
+            return RandomForestClassifier(n_estimators=8, max_depth=4, class_weight='balanced', random_state=42)
+        if self.kind == 'boosting':
+            return GradientBoostingClassifier(n_estimators=16, max_depth=3, random_state=42)
+        # Logistic Regression (lightweight and interpretable)
+        return LogisticRegression(random_state=42, class_weight='balanced', max_iter=1000)
+
     def train_lightweight_model(self):
-        """Train a lightweight logistic regression model"""
-        print("🤖 Training lightweight model...")
-        
-        # Select minimal feature set
-        self.feature_names = [
-            'HeartRate', 'SpO2', 'Accel_Mag',
-            'HR_Change', 'SpO2_Change', 'Accel_Change'
-        ]
-        
+        """Train a lightweight model"""
+        print(f"🤖 Training lightweight model: {MODEL_KINDS[self.kind]}...")
+
+        self.feature_names = MODEL_FEATURES
+
         X = self.df[self.feature_names].fillna(0)
         y = self.df['Quality_Label']
-        
+
         # Split data
         X_train, X_test, y_train, y_test = train_test_split(
             X, y, test_size=0.3, random_state=42, stratify=y
         )
-        
+        self.X_test = X_test
+
         # Scale features
         X_train_scaled = self.scaler.fit_transform(X_train)
         X_test_scaled = self.scaler.transform(X_test)
-        
-        # Train Logistic Regression (lightweight and interpretable)
-        self.model = LogisticRegression(
-            random_state=42, 
-            class_weight='balanced',
-            max_iter=1000
-        )
+
+        self.model = self.make_model()
         self.model.fit(X_train_scaled, y_train)
-        
+
         # Evaluate
         y_pred = self.model.predict(X_test_scaled)
+        self.y_pred = y_pred
         accuracy = accuracy_score(y_test, y_pred)
-        
+
         print(f"✅ Model Accuracy: {accuracy:.3f}")
         print("\n📊 Classification Report:")
         print(classification_report(y_test, y_pred))
-        
-        # Print model parameters for inspection
+
+        # The case this model is for: motion that the instantaneous features call good
+        moving = X_test['Accel_Energy'] > 0.01
+        if moving.any():
+            false_good = ((y_pred == 1) & (y_test == 0) & moving).sum()
+            print(f"   False good during motion: {false_good}/{moving.sum()}")
+
+        # Print scaler parameters for inspection
         print(f"\n🔍 Model Parameters:")
-        print(f"   Coefficients: {self.model.coef_[0]}")
-        print(f"   Intercept: {self.model.intercept_[0]}")
         print(f"   Scaler Mean: {self.scaler.mean_}")
         print(f"   Scaler Scale: {self.scaler.scale_}")
-        
+
         return accuracy
-    
+
+    def export_trees(self):
+        """sklearn trees as codegen lists, with the leaf values the score sums"""
+        trees = []
+        if self.kind == 'forest':
+            estimators = self.model.estimators_
+            good = list(self.model.classes_).index(1)
+            bias = 0.0
+        else:
+            estimators = [stage[0] for stage in self.model.estimators_]
+            prior = self.model.init_.class_prior_[1]
+            bias = float(np.log(prior / (1 - prior)))
+
+        for estimator in estimators:
+            tree = estimator.tree_
+            if self.kind == 'forest':
+                # Mean P(good) > 0.5 <=> sum of (P(good) - 0.5) > 0
+                values = [float(v[0][good] / v[0].sum() - 0.5) for v in tree.value]
+            else:
+                values = [float(v[0][0] * self.model.learning_rate) for v in tree.value]
+            trees.append({
+                'feature': [int(f) for f in tree.feature],
+                'threshold': [float(t) for t in tree.threshold],
+                'left': [int(c) for c in tree.children_left],
+                'right': [int(c) for c in tree.children_right],
+                'value': values,
+            })
+        return trees, bias
+
     def quantize_model_parameters(self):
-        """Quantize model parameters to int16 for ESP32"""
+        """Fold the scaler and quantize the model for the integer kernels"""
         print("⚡ Quantizing model parameters...")
-        
-        # Scale factor for quantization (use 1000 for good precision)
-        scale_factor = 1000
-        
-        # Quantize coefficients
-        coef_quantized = (self.model.coef_[0] * scale_factor).astype(np.int16)
-        intercept_quantized = int(self.model.intercept_[0] * scale_factor)
-        
-        # Quantize scaler parameters
-        mean_quantized = (self.scaler.mean_ * scale_factor).astype(np.int16)
-        scale_quantized = (self.scaler.scale_ * scale_factor).astype(np.int16)
-        
-        print(f"✅ Quantization complete with scale factor: {scale_factor}")
-        
+
+        mean = [float(m) for m in self.scaler.mean_]
+        scale = [float(s) for s in self.scaler.scale_]
+        observed = {name: float(self.df[name].abs().max()) for name in self.feature_names}
+        shifts = codegen.feature_shifts(self.feature_names, observed)
+
+        if self.kind in ('logistic', 'mlp'):
+            if self.kind == 'logistic':
+                layers = [([list(map(float, self.model.coef_[0]))], [float(self.model.intercept_[0])])]
+            else:
+                # sklearn stores the weights inputs x outputs
+                layers = [([list(map(float, column)) for column in np.asarray(w).T], list(map(float, b)))
+                          for w, b in zip(self.model.coefs_, self.model.intercepts_)]
+            layers[0] = codegen.fold_scaler(layers[0][0], layers[0][1], mean, scale)
+            quantized = codegen.quantize_dense(layers, shifts)
+            score = codegen.score_dense
+            kind = 'dense'
+        else:
+            trees, bias = self.export_trees()
+            quantized = codegen.quantize_trees(trees, bias, shifts, mean, scale)
+            score = codegen.score_trees
+            kind = 'trees'
+
+        # The integer model against the float one it comes from
+        agreement = np.mean([
+            (score(quantized, shifts, list(row)) > 0) == bool(pred)
+            for row, pred in zip(self.X_test.itertuples(index=False), self.y_pred)
+        ])
+        print(f"✅ Quantized model agrees with the float one on {agreement*100:.1f}% of the test set")
+
         return {
-            'coef': coef_quantized,
-            'intercept': intercept_quantized,
-            'mean': mean_quantized,
-            'scale': scale_quantized,
-            'scale_factor': scale_factor,
+            'kind': kind,
+            'shifts': shifts,
+            'quantized': quantized,
             'feature_names': self.feature_names
         }
-    
+
     def generate_header_file(self, quantized_params):
         """Generate C header file for ESP32"""
         print("📝 Generating C header file...")
-        
-        header_content = f"""
-#ifndef SENSOR_QUALITY_MODEL_H
-#define SENSOR_QUALITY_MODEL_H
-
-// Lightweight Sensor Quality Assessment Model
-// Generated automatically - DO NOT EDIT MANUALLY
-
-#define NUM_FEATURES {len(self.feature_names)}
-#define SCALE_FACTOR {quantized_params['scale_factor']}
-
-// Feature indices
-enum FeatureIndex {{
-"""
-        
-        for i, feature in enumerate(self.feature_names):
-            header_content += f"    FEATURE_{feature.upper().replace(' ', '_')} = {i},\n"
-        
-        header_content += "};\n\n"
-        
-        # Add quantized parameters
-        header_content += f"// Quantized model coefficients (scaled by {quantized_params['scale_factor']})\n"
-        header_content += "const int16_t model_coefficients[NUM_FEATURES] = {\n"
-        for i, coef in enumerate(quantized_params['coef']):
-            header_content += f"    {coef}{',' if i < len(quantized_params['coef'])-1 else ''} // {self.feature_names[i]}\n"
-        header_content += "};\n\n"
-        
-        header_content += f"// Quantized model intercept\n"
-        header_content += f"const int16_t model_intercept = {quantized_params['intercept']};\n\n"
-        
-        header_content += f"// Quantized scaler mean values\n"
-        header_content += "const int16_t scaler_mean[NUM_FEATURES] = {\n"
-        for i, mean in enumerate(quantized_params['mean']):
-            header_content += f"    {mean}{',' if i < len(quantized_params['mean'])-1 else ''} // {self.feature_names[i]}\n"
-        header_content += "};\n\n"
-        
-        header_content += f"// Quantized scaler scale values\n"
-        header_content += "const int16_t scaler_scale[NUM_FEATURES] = {\n"
-        for i, scale in enumerate(quantized_params['scale']):
-            header_content += f"    {scale}{',' if i < len(quantized_params['scale'])-1 else ''} // {self.feature_names[i]}\n"
-        header_content += "};\n\n"
-        
-        # Add inference function
-        header_content += """
-// Fast integer-based quality prediction
-// Returns: 1 for good quality, 0 for poor quality
-inline int predict_quality(float features[NUM_FEATURES]) {
-    int32_t score = model_intercept;
-    
-    for (int i = 0; i < NUM_FEATURES; i++) {
-        // Scale the feature: (feature - mean) / scale
-        int32_t scaled_feature = ((int32_t)(features[i] * SCALE_FACTOR) - scaler_mean[i]) * SCALE_FACTOR / scaler_scale[i];
-        score += (scaled_feature * model_coefficients[i]) / SCALE_FACTOR;
-    }
-    
-    // Apply sigmoid approximation: if score > 0, predict 1, else 0
-    return (score > 0) ? 1 : 0;
-}
 
-// Quality assessment with feature extraction
-inline int assess_sensor_quality(float hr, float spo2, float ax, float ay, float az,
-                                float hr_prev, float spo2_prev, float accel_prev) {
-    float features[NUM_FEATURES];
-    
-    // Calculate features
-    float accel_mag = sqrt(ax*ax + ay*ay + az*az);
-    
-    features[FEATURE_HEARTRATE] = hr;
-    features[FEATURE_SPO2] = spo2;
-    features[FEATURE_ACCEL_MAG] = accel_mag;
-    features[FEATURE_HR_CHANGE] = abs(hr - hr_prev);
-    features[FEATURE_SPO2_CHANGE] = abs(spo2 - spo2_prev);
-    features[FEATURE_ACCEL_CHANGE] = abs(accel_mag - accel_prev);
-    
-    return predict_quality(features);
-}
+        codegen.generate_header(self.output, self.feature_names, quantized_params['shifts'],
+                                quantized_params['kind'], f"Model: {MODEL_KINDS[self.kind]}",
+                                quantized_params['quantized'])
+
+        print(f"✅ Header file generated: {self.output}")
 
-#endif // SENSOR_QUALITY_MODEL_H
-"""
-        
-        # Write to file
-        with open('sensor_quality_model.h', 'w') as f:
-            f.write(header_content)
-        
-        print("✅ Header file generated: sensor_quality_model.h")
-        
     def run_training_pipeline(self):
         """Run complete lightweight training pipeline"""
         self.load_and_preprocess_data()
@@ -249,13 +270,18 @@ inline int assess_sensor_quality(float hr, float spo2, float ax, float ay, float
         accuracy = self.train_lightweight_model()
         quantized_params = self.quantize_model_parameters()
         self.generate_header_file(quantized_params)
-        
+
         print(f"\n🎉 Lightweight model training completed!")
         print(f"   Final Accuracy: {accuracy:.3f}")
-        print(f"   Model Size: ~{len(self.feature_names) * 2 + 10} bytes")
-        print(f"   Features: {len(self.feature_names)}")
+        print(f"   Features: {len(self.feature_names)} of {len(FEATURE_NAMES)}")
 
 # Run training
 if __name__ == "__main__":
-    trainer = LightweightQualityTrainer()
+    parser = argparse.ArgumentParser(description="Train the sensor quality model on RAW_DATA captures")
+    parser.add_argument('recordings', nargs='*', help="raw_data_* recordings (.vtrec or .csv) from record_ml_model.py (default: all in the current directory)")
+    parser.add_argument('--output', default='lib/ml_inference/sensor_quality_model.h', help="generated model header")
+    parser.add_argument('--model', choices=sorted(MODEL_KINDS), default='logistic', help="model family")
+    args = parser.parse_args()
+
+    trainer = LightweightQualityTrainer(args.recordings or [str(path) for path in glob_recordings('raw_data_*')], args.output, args.model)
     trainer.run_training_pipeline()
@@ -1,5 +1,4 @@
 import asyncio
-import csv
 import datetime
 import json
 import threading
@@ -10,9 +9,10 @@ from tkinter import ttk, messagebox
 import matplotlib.pyplot as plt
 import matplotlib.animation as animation
 from matplotlib.backends.backend_tkagg import FigureCanvasTkAgg
-from collections import deque
 import numpy as np
 from bleak import BleakScanner, BleakClient
+from ingest import StreamIngest, COLUMNS, DEFAULT_RATES_HZ
+from recording import RecordingWriter, CATEGORY, SUFFIX
 
 # === BLE Configuration ===
 BLE_CONFIG = {
@@ -25,6 +25,26 @@ BLE_CONFIG = {
     }
 }
 
+PLOT_POINTS = 100
+
+# Plot buffers, by the ingest column they show
+PLOT_COLUMNS = {
+    'hr': 'hr', 'spo2': 'spo2', 'temperature': 'temperature', 'force': 'fsr',
+    'accel_x': 'ax', 'accel_y': 'ay', 'accel_z': 'az', 'ir': 'ir', 'red': 'red',
+    'quality': 'quality', 'accel_mag': 'accel_mag'
+}
+
+# Recorded columns after the host timestamp, in get_recording_headers() order. label
+# and led are host-side context when the records don't carry them (binary frames).
+RECORDING_COLUMNS = {
+    "HR_SPO2": ['hr', 'spo2', 'ax', 'ay', 'az', 'timestamp'],
+    "TEMPERATURE": ['temperature', 'timestamp'],
+    "FORCE_TEST": ['ir', 'red', 'fsr', 'label', 'timestamp'],
+    "DISTANCE_TEST": ['ir', 'red', 'led', 'distance_mm', 'timestamp'],
+    "QUALITY": ['hr', 'spo2', 'quality', 'quality_percent', 'ax', 'ay', 'az', 'accel_mag', 'timestamp'],
+    "RAW_DATA": ['hr', 'spo2', 'ir', 'red', 'ax', 'ay', 'az', 'timestamp']
+}
+
 class SimplifiedDashboard:
     def __init__(self, root):
         self.root = root
@@ -38,30 +58,22 @@ class SimplifiedDashboard:
         self.current_mode = "IDLE"
         self.mode_lock = threading.Lock()
 
-        # Data buffers
-        self.data_buffers = {
-            'hr': deque(maxlen=100),
-            'spo2': deque(maxlen=100),
-            'temperature': deque(maxlen=100),
-            'force': deque(maxlen=100),
-            'accel_x': deque(maxlen=100),
-            'accel_y': deque(maxlen=100),
-            'accel_z': deque(maxlen=100),
-            'ir': deque(maxlen=100),
-            'red': deque(maxlen=100),
-            'quality': deque(maxlen=100),
-            'accel_mag': deque(maxlen=100),
-            'timestamps': deque(maxlen=100)
-        }
+        # Binary stream state: fields the firmware leaves out of binary records
+        self.current_label = "waiting"
+        self.current_led = "none"
+
+        # Decoded samples, one ring per stream; the plots copy the latest out
+        self.ingest = StreamIngest()
+        self.data_buffers = self.plot_buffers()
 
         # Quality statistics
         self.total_samples = 0
         self.good_samples = 0
 
-        # CSV logging
-        self.csv_file = None
-        self.csv_writer = None
-        self.csv_headers = []
+        # Recording
+        self.recording = None
+        self.recording_stream = None
+        self.recording_headers = []
         self.export_dir = Path("../test_logs")
 
         # GUI and plots
@@ -117,6 +129,11 @@ class SimplifiedDashboard:
                                   bg='#f39c12', fg='white', font=('Arial', 10, 'bold'), relief=tk.FLAT, state=tk.DISABLED)
         self.stop_btn.pack(side=tk.LEFT)
 
+        self.binary_var = tk.BooleanVar(value=True)
+        tk.Checkbutton(control_frame, text="Binary stream", variable=self.binary_var,
+                       fg='#ecf0f1', bg='#34495e', selectcolor='#2c3e50',
+                       font=('Arial', 10)).pack(side=tk.LEFT, padx=(10, 0))
+
         # Status panel
         status_frame = tk.LabelFrame(main_frame, text="Status", font=('Arial', 12, 'bold'),
                                     fg='#ecf0f1', bg='#34495e')
@@ -152,8 +169,7 @@ class SimplifiedDashboard:
                 self.ani = None
 
             # Clear buffers
-            for buffer in self.data_buffers.values():
-                buffer.clear()
+            self.ingest.clear()
             self.total_samples = 0
             self.good_samples = 0
 
@@ -285,8 +301,8 @@ class SimplifiedDashboard:
             self.current_mode = new_mode.upper()
             self.mode_label.config(text=mode_names.get(new_mode, new_mode))
 
-            # Update CSV headers
-            self.csv_headers = self.get_csv_headers(new_mode)
+            # Update recording headers
+            self.recording_headers = self.get_recording_headers(new_mode)
 
             # Update plots
             self.setup_plots()
@@ -295,8 +311,8 @@ class SimplifiedDashboard:
             if self.connected:
                 asyncio.run_coroutine_threadsafe(self.send_mode_command(new_mode), self.loop)
 
-    def get_csv_headers(self, mode):
-        """Return CSV headers for the current mode"""
+    def get_recording_headers(self, mode):
+        """Return recording column names for the current mode, those of the old CSVs"""
         headers = {
             "hr_spo2": ["Timestamp", "HeartRate", "SpO2", "AccelX", "AccelY", "AccelZ", "Device_Timestamp"],
             "temperature": ["Timestamp", "Temperature", "Device_Timestamp"],
@@ -332,11 +348,19 @@ class SimplifiedDashboard:
             print(f"Found: {target.name} @ {target.address}")
             self.client = BleakClient(target.address)
             await self.client.connect()
+            # The host stack runs the MTU exchange; binary RAW frames grow with it
+            print(f"Negotiated MTU: {self.client.mtu_size}")
 
             # Start notifications
             await self.client.start_notify(BLE_CONFIG["characteristics"]["data"], self.handle_data)
             await self.client.start_notify(BLE_CONFIG["characteristics"]["status"], self.handle_status)
 
+            # Select the wire format before any data flows
+            self.ingest.reset()
+            self.ingest.lost_frames = 0
+            data_format = "FORMAT:BINARY" if self.binary_var.get() else "FORMAT:JSON"
+            await self.client.write_gatt_char(BLE_CONFIG["characteristics"]["control"], data_format.encode())
+
             # Send initial mode command
             await self.send_mode_command(self.mode_var.get())
             self.connected = True
@@ -381,25 +405,21 @@ class SimplifiedDashboard:
         self.disconnect_btn.config(state=tk.DISABLED)
         self.start_btn.config(state=tk.DISABLED)
         self.stop_btn.config(state=tk.DISABLED)
-        for buffer in self.data_buffers.values():
-            buffer.clear()
+        self.ingest.clear()
         self.total_samples = 0
         self.good_samples = 0
 
     def start_recording(self):
-        """Start CSV logging"""
-        self.setup_csv_logging()
+        """Start recording"""
+        self.setup_recording()
         self.start_btn.config(state=tk.DISABLED)
         self.stop_btn.config(state=tk.NORMAL)
         if self.current_mode in ["FORCE_TEST", "DISTANCE_TEST"]:
             asyncio.run_coroutine_threadsafe(self.send_start_command(), self.loop)
 
     def stop_recording(self):
-        """Stop CSV logging"""
-        if self.csv_file:
-            self.csv_file.close()
-            self.csv_file = None
-            self.csv_writer = None
+        """Stop recording"""
+        self.close_recording()
         self.start_btn.config(state=tk.NORMAL)
         self.stop_btn.config(state=tk.DISABLED)
 
@@ -408,25 +428,43 @@ class SimplifiedDashboard:
         try:
             if self.client and self.client.is_connected:
                 command = "LABEL:recording" if self.current_mode == "FORCE_TEST" else "START:ir:0"
+                self.current_label = "recording"
+                self.current_led = "ir"
                 await self.client.write_gatt_char(BLE_CONFIG["characteristics"]["control"], command.encode())
         except Exception as e:
             print(f"Start command error: {e}")
 
-    def setup_csv_logging(self):
-        """Setup CSV logging"""
+    def setup_recording(self):
+        """Setup recording, the host timestamp in ms then the mode's columns"""
         mode = self.mode_var.get()
+        stream = self.current_mode
         timestamp = datetime.datetime.now().strftime('%Y%m%d_%H%M%S')
-        filename = self.export_dir / f"{mode}_data_{timestamp}.csv"
+        filename = self.export_dir / f"{mode}_data_{timestamp}{SUFFIX}"
         self.export_dir.mkdir(parents=True, exist_ok=True)
+        if stream not in RECORDING_COLUMNS:
+            messagebox.showerror("Error", f"Nothing to record in {stream}")
+            return
 
+        dtypes = dict(COLUMNS[stream])
+        columns = [(self.recording_headers[0], np.int64)] + [
+            (header, CATEGORY if name in ('label', 'led') else dtypes[name])
+            for header, name in zip(self.recording_headers[1:], RECORDING_COLUMNS[stream])]
         try:
-            self.csv_file = open(filename, mode='w', newline='')
-            self.csv_writer = csv.writer(self.csv_file)
-            self.csv_writer.writerow(self.csv_headers)
-            print(f"CSV logging started: {filename}")
+            self.recording = RecordingWriter(filename, stream, columns, sample_rate_hz=DEFAULT_RATES_HZ[stream],
+                                             time_columns={self.recording_headers[0]: "ms"})
+            self.recording_stream = stream
+            print(f"Recording started: {filename}")
         except Exception as e:
-            print(f"CSV setup error: {e}")
-            messagebox.showerror("Error", f"Failed to setup CSV: {e}")
+            print(f"Recording setup error: {e}")
+            messagebox.showerror("Error", f"Failed to setup recording: {e}")
+
+    def close_recording(self):
+        """Write what is buffered and close the recording"""
+        if self.recording:
+            self.recording.close()
+            print(f"Recording saved: {self.recording.path} ({self.recording.records} records)")
+            self.recording = None
+            self.recording_stream = None
 
     def handle_status(self, characteristic, data):
         """Handle status updates from ESP32"""
@@ -450,120 +488,87 @@ class SimplifiedDashboard:
         self.setup_plots()
 
     def handle_data(self, characteristic, data):
-        """Handle incoming BLE data"""
+        """Decode incoming BLE data into the ingest rings"""
         try:
-            obj = json.loads(data.decode())
-            print(f"Received JSON: {obj}")
-            
-            # Use after_idle to safely update GUI from BLE thread
-            self.root.after_idle(lambda: self._process_data_safe(obj))
-            
-        except Exception as e:
+            batch = self.ingest.feed(data)
+        except ValueError as e:
             print(f"Data receive error: {e}")
-    
-    def _process_data_safe(self, obj):
-        """Process data safely in the main GUI thread"""
+            return
+        if batch is None:
+            return
+        if batch.gap:
+            print(f"Lost {batch.gap} frame(s), {self.ingest.lost_frames} total")
+
+        # One GUI update per notification, whatever the records in it
+        self.root.after_idle(lambda b=batch: self._process_batch_safe(b))
+
+    def _process_batch_safe(self, batch):
+        """Label and log a batch safely in the main GUI thread"""
         with self.mode_lock:
             try:
-                timestamp = time.time()
-                device_ts = obj.get("timestamp", 0)
-
+                if batch.stream != self.current_mode or not len(batch):
+                    return
                 if self.current_mode == "IDLE":
                     self.data_label.config(text="Idle")
                     return
 
-                data_values = []
+                columns = batch.columns
+                if self.current_mode == "DISTANCE_TEST":
+                    # Averages have no reading of their own to log
+                    readings = columns['average'] == 0
+                    columns = {name: column[readings] for name, column in columns.items()}
+                n = len(columns['timestamp'])
+                if n == 0:
+                    return
+                last = {name: column[-1] for name, column in columns.items()}
+                label = batch.text.get("label", self.current_label)
+                led = batch.text.get("led", self.current_led)
 
                 if self.current_mode == "HR_SPO2":
-                    if all(k in obj for k in ["hr", "spo2", "ax", "ay", "az"]):
-                        self.data_buffers['hr'].append(float(obj["hr"]))
-                        self.data_buffers['spo2'].append(float(obj["spo2"]))
-                        self.data_buffers['accel_x'].append(float(obj["ax"]))
-                        self.data_buffers['accel_y'].append(float(obj["ay"]))
-                        self.data_buffers['accel_z'].append(float(obj["az"]))
-                        self.data_buffers['timestamps'].append(timestamp)
-                        self.data_label.config(text=f"HR: {obj['hr']:.1f} bpm, SpO2: {obj['spo2']:.1f}%")
-                        data_values = [obj["hr"], obj["spo2"], obj["ax"], obj["ay"], obj["az"], device_ts]
-                    else:
-                        print("Missing hr, spo2, or accel data")
-                        return
-
+                    self.data_label.config(text=f"HR: {last['hr']:.1f} bpm, SpO2: {last['spo2']:.1f}%")
                 elif self.current_mode == "TEMPERATURE":
-                    if "temperature" in obj:
-                        self.data_buffers['temperature'].append(float(obj["temperature"]))
-                        self.data_buffers['timestamps'].append(timestamp)
-                        self.data_label.config(text=f"Temp: {obj['temperature']:.1f}°C")
-                        data_values = [obj["temperature"], device_ts]
-                    else:
-                        print("Missing temperature data")
-                        return
-
+                    self.data_label.config(text=f"Temp: {last['temperature']:.1f}°C")
                 elif self.current_mode == "FORCE_TEST":
-                    if all(k in obj for k in ["ir", "red", "fsr", "label"]):
-                        self.data_buffers['ir'].append(float(obj["ir"]))
-                        self.data_buffers['red'].append(float(obj["red"]))
-                        self.data_buffers['force'].append(float(obj["fsr"]))
-                        self.data_buffers['timestamps'].append(timestamp)
-                        self.data_label.config(text=f"Force: {obj['fsr']:.0f}, Label: {obj['label']}")
-                        data_values = [obj["ir"], obj["red"], obj["fsr"], obj["label"], device_ts]
-                    else:
-                        print("Missing ir, red, fsr, or label")
-                        return
-
+                    self.data_label.config(text=f"Force: {last['fsr']:.0f}, Label: {label}")
                 elif self.current_mode == "DISTANCE_TEST":
-                    if all(k in obj for k in ["ir", "red", "led", "distance_mm"]):
-                        self.data_buffers['ir'].append(float(obj["ir"]))
-                        self.data_buffers['red'].append(float(obj["red"]))
-                        self.data_buffers['timestamps'].append(timestamp)
-                        self.data_label.config(text=f"IR: {obj['ir']:.0f}, Red: {obj['red']:.0f}, Distance: {obj['distance_mm']}mm")
-                        data_values = [obj["ir"], obj["red"], obj["led"], obj["distance_mm"], device_ts]
-                    else:
-                        print("Missing ir, red, led, or distance_mm")
-                        return
-
+                    self.data_label.config(text=f"IR: {last['ir']:.0f}, Red: {last['red']:.0f}, Distance: {last['distance_mm']}mm")
                 elif self.current_mode == "QUALITY":
-                    if all(k in obj for k in ["hr", "spo2", "quality", "quality_percent", "ax", "ay", "az", "accel_mag"]):
-                        self.data_buffers['hr'].append(float(obj["hr"]))
-                        self.data_buffers['spo2'].append(float(obj["spo2"]))
-                        self.data_buffers['quality'].append(float(obj["quality"]))
-                        self.data_buffers['accel_x'].append(float(obj["ax"]))
-                        self.data_buffers['accel_y'].append(float(obj["ay"]))
-                        self.data_buffers['accel_z'].append(float(obj["az"]))
-                        self.data_buffers['accel_mag'].append(float(obj["accel_mag"]))
-                        self.data_buffers['timestamps'].append(timestamp)
-                        self.total_samples += 1
-                        if obj["quality"] == 1:
-                            self.good_samples += 1
-                        self.data_label.config(text=f"HR: {obj['hr']:.1f}, SpO2: {obj['spo2']:.1f}, Quality: {obj['quality']}")
-                        data_values = [obj["hr"], obj["spo2"], obj["quality"], obj["quality_percent"], obj["ax"], obj["ay"], obj["az"], obj["accel_mag"], device_ts]
-                    else:
-                        print("Missing hr, spo2, quality, or accel data")
-                        return
-
+                    self.total_samples += n
+                    self.good_samples += int(np.count_nonzero(columns['quality'] == 1))
+                    self.data_label.config(text=f"HR: {last['hr']:.1f}, SpO2: {last['spo2']:.1f}, Quality: {last['quality']}")
                 elif self.current_mode == "RAW_DATA":
-                    if all(k in obj for k in ["hr", "spo2", "ir", "red", "ax", "ay", "az"]):
-                        self.data_buffers['hr'].append(float(obj["hr"]))
-                        self.data_buffers['spo2'].append(float(obj["spo2"]))
-                        self.data_buffers['ir'].append(float(obj["ir"]))
-                        self.data_buffers['red'].append(float(obj["red"]))
-                        self.data_buffers['accel_x'].append(float(obj["ax"]))
-                        self.data_buffers['accel_y'].append(float(obj["ay"]))
-                        self.data_buffers['accel_z'].append(float(obj["az"]))
-                        self.data_buffers['timestamps'].append(timestamp)
-                        self.data_label.config(text=f"HR: {obj['hr']:.1f}, IR: {obj['ir']:.0f}, Red: {obj['red']:.0f}")
-                        data_values = [obj["hr"], obj["spo2"], obj["ir"], obj["red"], obj["ax"], obj["ay"], obj["az"], device_ts]
-                    else:
-                        print("Missing hr, spo2, ir, red, or accel data")
-                        return
+                    self.data_label.config(text=f"HR: {last['hr']:.1f}, IR: {last['ir']:.0f}, Red: {last['red']:.0f}")
 
-                # Write to CSV
-                if self.csv_writer:
-                    self.csv_writer.writerow([datetime.datetime.now().isoformat()] + data_values)
-                    self.csv_file.flush()
+                # Append to the recording, the whole batch at once; a mode
+                # change while recording leaves the other mode's records out
+                if self.recording and self.current_mode == self.recording_stream:
+                    text = {"label": label, "led": led}
+                    values = {header: columns[name] if name in columns else text[name]
+                              for header, name in zip(self.recording_headers[1:], RECORDING_COLUMNS[self.current_mode])}
+                    self.recording.append({self.recording_headers[0]: int(time.time() * 1000), **values})
 
             except Exception as e:
                 print(f"Data parse error: {e}")
 
+    def plot_buffers(self):
+        """The latest samples of the current mode, keyed like the plots"""
+        empty = np.empty(0)
+        buffers = {key: empty for key in PLOT_COLUMNS}
+        buffers['timestamps'] = empty
+        self.plot_total = 0
+        if self.current_mode not in COLUMNS:
+            return buffers
+
+        ring = self.ingest.ring(self.current_mode)
+        data = ring.latest(PLOT_POINTS)
+        self.plot_total = ring.total
+        for key, column in PLOT_COLUMNS.items():
+            if column in data:
+                buffers[key] = data[column]
+        # Device clock: the samples of a frame arrive together
+        buffers['timestamps'] = data['timestamp'] / 1000.0
+        return buffers
+
     async def send_mode_command(self, mode):
         """Send mode command to ESP32"""
         try:
@@ -590,11 +595,12 @@ class SimplifiedDashboard:
             
         with self.mode_lock:
             try:
+                self.data_buffers = self.plot_buffers()
                 if len(self.data_buffers['timestamps']) < 2:
                     return []
 
-                timestamps = list(self.data_buffers['timestamps'])
-                time_range = [t - timestamps[0] for t in timestamps]
+                timestamps = self.data_buffers['timestamps']
+                time_range = timestamps - timestamps[0]
 
                 if self.current_mode == "QUALITY":
                     # Update Heart Rate more efficiently
@@ -619,7 +625,7 @@ class SimplifiedDashboard:
 
                     # Update Quality Assessment - only clear when necessary
                     if len(self.data_buffers['quality']) > 0:
-                        if not hasattr(self, 'last_quality_len') or len(self.data_buffers['quality']) != self.last_quality_len:
+                        if not hasattr(self, 'last_quality_total') or self.plot_total != self.last_quality_total:
                             self.ax_quality.clear()
                             quality_colors = ['red' if q == 0 else 'green' for q in self.data_buffers['quality']]
                             self.ax_quality.scatter(time_range[-len(self.data_buffers['quality']):], self.data_buffers['quality'],
@@ -628,7 +634,7 @@ class SimplifiedDashboard:
                             self.ax_quality.set_ylabel('Quality (0=Poor, 1=Good)')
                             self.ax_quality.grid(True, alpha=0.3)
                             self.ax_quality.set_ylim(-0.1, 1.1)
-                            self.last_quality_len = len(self.data_buffers['quality'])
+                            self.last_quality_total = self.plot_total
 
                     # Update Accelerometer more efficiently
                     if hasattr(self, 'accel_x_line_q') and len(self.data_buffers['accel_x']) > 0:
@@ -669,9 +675,9 @@ class SimplifiedDashboard:
                         self.ax_stats.axis('off')
                         if self.total_samples > 0:
                             quality_pct = (self.good_samples / self.total_samples) * 100
-                            current_hr = self.data_buffers['hr'][-1] if self.data_buffers['hr'] else 0
-                            current_spo2 = self.data_buffers['spo2'][-1] if self.data_buffers['spo2'] else 0
-                            current_accel = self.data_buffers['accel_mag'][-1] if self.data_buffers['accel_mag'] else 0
+                            current_hr = self.data_buffers['hr'][-1]
+                            current_spo2 = self.data_buffers['spo2'][-1]
+                            current_accel = self.data_buffers['accel_mag'][-1]
                             current_quality = "GOOD" if self.data_buffers['quality'][-1] == 1 else "POOR"
                             stats_text = f"""CURRENT VALUES:
 Heart Rate: {current_hr:.1f} BPM
@@ -771,11 +777,8 @@ Runtime: {time_range[-1]:.1f}s
                 self.ani.event_source.stop()
                 self.ani = None
                 
-            # Close CSV file
-            if self.csv_file:
-                self.csv_file.close()
-                self.csv_file = None
-                self.csv_writer = None
+            # Close the recording
+            self.close_recording()
                 
             # Disconnect BLE
             if self.client and hasattr(self.client, 'is_connected'):